@@ -48,11 +48,10 @@
 #undef DBG_TAG
 #define DBG_TAG	"CTRLPT"
 /*!
- * Mutex for protecting the global device list in a multi-threaded,
- * asynchronous environment. All functions should lock this mutex before
- * reading or writing the device list. 
+ * Devices found so far. The registry does its own locking, so it can be
+ * used from the SDK callbacks and the command loop at the same time.
  */
-ithread_mutex_t DeviceListMutex;
+DevRegistry *DeviceRegistry = NULL;
 
 UpnpClient_Handle ctrlpt_handle = -1;
 
@@ -65,42 +64,11 @@ const char OhmDeviceType[] = "OhmSwitch";
  */
 int default_timeout = 1801;
 
-/*!
-   The first node in the global device list, or NULL if empty 
- */
-struct DeviceNode *GlobalDeviceList = NULL;
-
-/********************************************************************************
- * CtrlPointDeleteNode
- *
- * Description: 
- *       Delete a device node from the global device list.  Note that this
- *       function is NOT thread safe, and should be called from another
- *       function that has already locked the global device list.
- *
- * Parameters:
- *   node -- The device node
- *
- ********************************************************************************/
-int
-CtrlPointDeleteNode( struct DeviceNode *node )
-{
-	if (NULL == node) {
-		CDBG_ERROR("CtrlPointDeleteNode: Node is empty\n");
-		return ERROR;
-	}
-
-	free(node);
-	node = NULL;
-
-	return SUCCESS;
-}
-
 /********************************************************************************
  * CtrlPointRemoveDevice
  *
  * Description: 
- *       Remove a device from the global device list.
+ *       Remove a device from the device registry.
  *
  * Parameters:
  *   UID -- The Unique Device Name for the device to remove
@@ -108,36 +76,12 @@ CtrlPointDeleteNode( struct DeviceNode *node )
  ********************************************************************************/
 int CtrlPointRemoveDevice(const char *UID)
 {
-	struct DeviceNode *curdevnode;
-	struct DeviceNode *prevdevnode;
-
-	ithread_mutex_lock(&DeviceListMutex);
-
-	curdevnode = GlobalDeviceList;
-	if (!curdevnode) {
+	if (DevRegistryRemove(DeviceRegistry, UID) != 0) {
 		CDBG_ERROR(
-			"WARNING: CtrlPointRemoveDevice: Device list empty\n");
-	} else {
-		if (0 == strcmp(curdevnode->device.UID, UID)) {
-			GlobalDeviceList = curdevnode->next;
-			CtrlPointDeleteNode(curdevnode);
-		} else {
-			prevdevnode = curdevnode;
-			curdevnode = curdevnode->next;
-			while (curdevnode) {
-				if (strcmp(curdevnode->device.UID, UID) == 0) {
-					prevdevnode->next = curdevnode->next;
-					CtrlPointDeleteNode(curdevnode);
-					break;
-				}
-				prevdevnode = curdevnode;
-				curdevnode = curdevnode->next;
-			}
-		}
+			"WARNING: CtrlPointRemoveDevice: Device %s not found\n", UID);
+		return ERROR;
 	}
 
-	ithread_mutex_unlock(&DeviceListMutex);
-
 	return SUCCESS;
 }
 
@@ -145,7 +89,7 @@ int CtrlPointRemoveDevice(const char *UID)
  * CtrlPointRemoveAll
  *
  * Description: 
- *       Remove all devices from the global device list.
+ *       Remove all devices from the device registry.
  *
  * Parameters:
  *   None
@@ -153,20 +97,7 @@ int CtrlPointRemoveDevice(const char *UID)
  ********************************************************************************/
 int CtrlPointRemoveAll(void)
 {
-	struct DeviceNode *curdevnode, *next;
-
-	ithread_mutex_lock(&DeviceListMutex);
-
-	curdevnode = GlobalDeviceList;
-	GlobalDeviceList = NULL;
-
-	while (curdevnode) {
-		next = curdevnode->next;
-		CtrlPointDeleteNode(curdevnode);
-		curdevnode = next;
-	}
-
-	ithread_mutex_unlock(&DeviceListMutex);
+	DevRegistryRemoveAll(DeviceRegistry);
 
 	return SUCCESS;
 }
@@ -175,7 +106,7 @@ int CtrlPointRemoveAll(void)
  * CtrlPointRefresh
  *
  * Description: 
- *       Clear the current global device list and issue new search
+ *       Clear the device registry and issue new search
  *	 requests to build it up again from scratch.
  *
  * Parameters:
@@ -220,17 +151,15 @@ int CtrlPointSendAction(
 	int devnum,
 	const char *actionname)
 {
-	struct DeviceNode *devnode;
+	struct OhmDevice device;
 	int rc = SUCCESS;
 
-	ithread_mutex_lock(&DeviceListMutex);
-
-	rc = CtrlPointGetDevice(devnum, &devnode);
+	rc = CtrlPointGetDevice(devnum, &device);
 	if (SUCCESS == rc) {
-	    CDBG_ERROR("%s: Location: %s\n",__func__,devnode->device.Location);
+	    CDBG_ERROR("%s: Location: %s\n",__func__,device.Location);
 
 	    rc = UpnpSendActionAsync(ctrlpt_handle,
-		    devnode->device.Location,
+		    device.Location,
 		    actionname,NULL,
 		    CtrlPointCallbackEventHandler, NULL);
 	    if (rc != UPNP_E_SUCCESS) {
@@ -240,7 +169,74 @@ int CtrlPointSendAction(
 	    }
 	}
 
-	ithread_mutex_unlock(&DeviceListMutex);
+	return rc;
+}
+
+/*! Devices collected by CtrlPointSendGroupAction(). */
+struct CtrlPointGroup {
+	const char **urls;
+	int count;
+	int size;
+};
+
+static void CtrlPointAddGroupDevice(const struct OhmDevice *device, void *arg)
+{
+	struct CtrlPointGroup *group = (struct CtrlPointGroup *)arg;
+	const char **urls;
+	char *url;
+
+	if (group->count == group->size) {
+		urls = realloc(group->urls,
+			(size_t)(group->size * 2 + 8) * sizeof(*urls));
+		if (urls == NULL) {
+			return;
+		}
+		group->urls = urls;
+		group->size = group->size * 2 + 8;
+	}
+	url = strdup(device->Location);
+	if (url != NULL) {
+		group->urls[group->count++] = url;
+	}
+}
+
+/********************************************************************************
+ * CtrlPointSendGroupAction
+ *
+ * Description: 
+ *       Send the same Action request to every device of the device registry,
+ *       at most CTRLPT_GROUP_IN_FLIGHT at once. The results come in a single
+ *       UPNP_CONTROL_GROUP_ACTION_COMPLETE callback.
+ *
+ * Parameters:
+ *   actionname -- The name of the action.
+ *
+ ********************************************************************************/
+int CtrlPointSendGroupAction(const char *actionname)
+{
+	struct CtrlPointGroup group;
+	int rc = SUCCESS;
+	int i;
+
+	memset(&group, 0, sizeof(group));
+	DevRegistryForEach(DeviceRegistry, CtrlPointAddGroupDevice, &group);
+	if (group.count == 0) {
+		CDBG_ERROR("No device to send %s to\n", actionname);
+		free(group.urls);
+		return ERROR;
+	}
+	rc = UpnpSendGroupActionAsync(ctrlpt_handle,
+		group.urls, group.count,
+		actionname, CTRLPT_GROUP_IN_FLIGHT,
+		CtrlPointCallbackEventHandler, NULL);
+	if (rc != UPNP_E_SUCCESS) {
+		CDBG_ERROR("Error in UpnpSendGroupActionAsync -- %d\n", rc);
+		rc = ERROR;
+	}
+	for (i = 0; i < group.count; i++) {
+		free((char *)group.urls[i]);
+	}
+	free(group.urls);
 
 	return rc;
 }
@@ -386,33 +382,21 @@ int CtrlPointSendReboot(int devnum)
  * CtrlPointGetDevice
  *
  * Description: 
- *       Given a list number, returns the pointer to the device
- *       node at that position in the global device list.  Note
- *       that this function is not thread safe.  It must be called 
- *       from a function that has locked the global device list.
+ *       Given a device number, copies the device with that number
+ *       from the device registry.
  *
  * Parameters:
- *   devnum -- The number of the device (order in the list,
- *             starting with 1)
- *   devnode -- The output device node pointer
+ *   devnum -- The number of the device, as printed by ListDev
+ *   device -- The output device
  *
  ********************************************************************************/
-int CtrlPointGetDevice(int devnum, struct DeviceNode **devnode)
+int CtrlPointGetDevice(int devnum, struct OhmDevice *device)
 {
-	int count = devnum;
-	struct DeviceNode *tmpdevnode = NULL;
-
-	if (count)
-		tmpdevnode = GlobalDeviceList;
-	while (--count && tmpdevnode) {
-		tmpdevnode = tmpdevnode->next;
-	}
-	if (!tmpdevnode) {
+	if (DevRegistryGet(DeviceRegistry, devnum, device) != 0) {
 		CDBG_ERROR("Error finding Device number -- %d\n",
 				 devnum);
 		return ERROR;
 	}
-	*devnode = tmpdevnode;
 
 	return SUCCESS;
 }
@@ -421,27 +405,23 @@ int CtrlPointGetDevice(int devnum, struct DeviceNode **devnode)
  * CtrlPointPrintList
  *
  * Description: 
- *       Print the universal device names for each device in the global device list
+ *       Print the universal device names for each device in the device registry
  *
  * Parameters:
  *   None
  *
  ********************************************************************************/
-int CtrlPointPrintList()
+static void CtrlPointPrintDeviceEntry(const struct OhmDevice *device, void *arg)
 {
-	struct DeviceNode *tmpdevnode;
-	int i = 0;
-
-	ithread_mutex_lock(&DeviceListMutex);
+	CDBG_ERROR(" %3d -- %s_%s\n", device->DeviceId, device->DeviceType, device->UID);
+	arg = arg;
+}
 
+int CtrlPointPrintList()
+{
 	CDBG_ERROR("CtrlPointPrintList:\n");
-	tmpdevnode = GlobalDeviceList;
-	while (tmpdevnode) {
-		CDBG_ERROR(" %3d -- %s_%s\n", ++i, tmpdevnode->device.DeviceType, tmpdevnode->device.UID);
-		tmpdevnode = tmpdevnode->next;
-	}
+	DevRegistryForEach(DeviceRegistry, CtrlPointPrintDeviceEntry, NULL);
 	CDBG_ERROR("\n");
-	ithread_mutex_unlock(&DeviceListMutex);
 
 	return SUCCESS;
 }
@@ -450,7 +430,7 @@ int CtrlPointPrintList()
  * CtrlPointAddDevice
  *
  * Description: 
- *       If the device is not already included in the global device list,
+ *       If the device is not already included in the device registry,
  *       add it.  Otherwise, update its advertisement expiration timeout.
  *
  * Parameters:
@@ -461,60 +441,23 @@ int CtrlPointPrintList()
 void CtrlPointAddDevice(
 	struct Upnp_Discovery *d_event)
 {
-	struct DeviceNode *deviceNode;
-	struct DeviceNode *tmpdevnode;
-	int found = 0;
-
-	ithread_mutex_lock(&DeviceListMutex);
+	int isNew = 0;
 
 	CDBG_INFO("UID %s\n",d_event->UID);
 	CDBG_INFO("DeviceType %s\n",d_event->DeviceType);
 
 	if (strcmp(d_event->DeviceType, OhmDeviceType) == 0) {
-
-		/* Check if this device is already in the list */
-		tmpdevnode = GlobalDeviceList;
-		while (tmpdevnode) {
-			if (strcmp(tmpdevnode->device.UID, d_event->UID) == 0) {
-				found = 1;
-				break;
-			}
-			tmpdevnode = tmpdevnode->next;
-		}
-
-		if (found) {
-			CDBG_INFO("Ohm device exits\n");
-			/* The device is already there, so just update  */
-			/* the advertisement timeout field */
-			tmpdevnode->device.AdvrTimeOut = 5;
-		} else {
+		/* adds the device, or updates its advertisement timeout */
+		if (DevRegistryAdd(DeviceRegistry, d_event->UID,
+				   d_event->DeviceType, d_event->Location,
+				   d_event->Expires, &isNew) < 0) {
+			CDBG_ERROR("Error adding Ohm device %s\n", d_event->UID);
+		} else if (isNew) {
 			CDBG_ERROR("Found Ohm device\n");
-			/* Create a new device node */
-			deviceNode =
-			    (struct DeviceNode *)
-			    malloc(sizeof(struct DeviceNode));
-			strcpy(deviceNode->device.UID, d_event->UID);
-			strcpy(deviceNode->device.DeviceType, d_event->DeviceType);
-			strcpy(deviceNode->device.Location, d_event->Location);
-			deviceNode->device.AdvrTimeOut = 5;
-			deviceNode->next = NULL;
-			/* Insert the new device node in the list */
-			if ((tmpdevnode = GlobalDeviceList)) {
-				while (tmpdevnode) {
-					if (tmpdevnode->next) {
-						tmpdevnode = tmpdevnode->next;
-					} else {
-						tmpdevnode->next = deviceNode;
-						break;
-					}
-				}
-			} else {
-				GlobalDeviceList = deviceNode;
-			}
+		} else {
+			CDBG_INFO("Ohm device exits\n");
 		}
 	}
-
-	ithread_mutex_unlock(&DeviceListMutex);
 }
 
 /********************************************************************************
@@ -565,11 +508,44 @@ int CtrlPointCallbackEventHandler(Upnp_EventType EventType, void *Event, void *C
 		CtrlPointPrintList();
 		break;
 	}
+	case UPNP_DISCOVERY_ADVERTISEMENT_EXPIRED: {
+		struct Upnp_Discovery *d_event = (struct Upnp_Discovery *)Event;
+
+		/* no announcement within max-age, the device is gone */
+		CDBG_ERROR("Advertisement expired for Device: %s\n", d_event->UID);
+		CtrlPointRemoveDevice(d_event->UID);
+		break;
+	}
 	/* SOAP Stuff */
+	case UPNP_CONTROL_GROUP_ACTION_COMPLETE: {
+		struct Upnp_Group_Action_Complete *g_event = (struct Upnp_Group_Action_Complete *)Event;
+		int i;
+
+		CDBG_ERROR("UPNP_CONTROL_GROUP_ACTION_COMPLETE: %d/%d in %d ms\n",
+				g_event->NumSucceeded, g_event->NumActions,
+				g_event->ElapsedMs);
+		for (i = 0; i < g_event->NumActions; i++) {
+			CDBG_ERROR("  %s -- %d %d %d ms\n",
+					g_event->Results[i].ActionURL,
+					g_event->Results[i].ErrCode,
+					g_event->Results[i].StatusCode,
+					g_event->Results[i].ElapsedMs);
+		}
+		break;
+	}
 	case UPNP_CONTROL_ACTION_COMPLETE: {
-		CDBG_ERROR("UPNP_CONTROL_ACTION_COMPLETE\n");
+		struct Upnp_Action_Complete *a_event = (struct Upnp_Action_Complete *)Event;
+
+		if (a_event->ErrCode != UPNP_E_SUCCESS) {
+			CDBG_ERROR("Error in Action Complete Callback -- %d\n",
+					a_event->ErrCode);
+			break;
+		}
 		/* No need for any processing here, just print out results.
 		 * Service state table updates are handled by events. */
+		CDBG_ERROR("UPNP_CONTROL_ACTION_COMPLETE: %d %s\n",
+				a_event->StatusCode,
+				a_event->Entity != NULL ? a_event->Entity : "");
 		break;
 	}
 	case UPNP_CONTROL_GET_VAR_COMPLETE: {
@@ -584,8 +560,19 @@ int CtrlPointCallbackEventHandler(Upnp_EventType EventType, void *Event, void *C
 	/* GENA Stuff */
 	case UPNP_EVENT_RECEIVED: {
 		struct Upnp_Event *e_event = (struct Upnp_Event *)Event;
+		const struct Upnp_Event_Property *props;
+		int num;
+		int i;
+
 		CDBG_ERROR("Event -- %d\n",
 					e_event->EventKey);
+		if (UpnpEventGetProperties(e_event, &props, &num) == UPNP_E_SUCCESS) {
+			for (i = 0; i < num; i++) {
+				CDBG_ERROR("  %.*s = %.*s\n",
+						(int)props[i].NameLength, props[i].Name,
+						(int)props[i].ValueLength, props[i].Value);
+			}
+		}
 
 		break;
 	}
@@ -600,6 +587,22 @@ int CtrlPointCallbackEventHandler(Upnp_EventType EventType, void *Event, void *C
 		}
 		break;
 	}
+	case UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE: {
+		struct Upnp_Group_Subscribe_Complete *gs_event = (struct Upnp_Group_Subscribe_Complete *)Event;
+		int i;
+
+		CDBG_ERROR("UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE: %d/%d in %d ms\n",
+				gs_event->NumSucceeded, gs_event->NumSubscriptions,
+				gs_event->ElapsedMs);
+		for (i = 0; i < gs_event->NumSubscriptions; i++) {
+			if (gs_event->Results[i].ErrCode != UPNP_E_SUCCESS) {
+				CDBG_ERROR("  %s -- %d\n",
+						gs_event->Results[i].PublisherUrl,
+						gs_event->Results[i].ErrCode);
+			}
+		}
+		break;
+	}
 	case UPNP_EVENT_AUTORENEWAL_FAILED:
 	case UPNP_EVENT_SUBSCRIPTION_EXPIRED: {
 		struct Upnp_Event_Subscribe *es_event = (struct Upnp_Event_Subscribe *)Event;
@@ -630,86 +633,24 @@ int CtrlPointCallbackEventHandler(Upnp_EventType EventType, void *Event, void *C
 	Cookie = Cookie;
 }
 
-void CtrlPointVerifyTimeouts(int incr)
-{
-	struct DeviceNode *prevdevnode;
-	struct DeviceNode *curdevnode;
-	int ret;
-
-	ithread_mutex_lock(&DeviceListMutex);
-
-	prevdevnode = NULL;
-	curdevnode = GlobalDeviceList;
-	while (curdevnode) {
-		curdevnode->device.AdvrTimeOut -= incr;
-		/*CDBG_ERROR("Advertisement Timeout: %d\n", curdevnode->device.AdvrTimeOut); */
-		if (curdevnode->device.AdvrTimeOut <= 0) {
-			/* This advertisement has expired, so we should remove the device
-			 * from the list */
-			if (GlobalDeviceList == curdevnode)
-				GlobalDeviceList = curdevnode->next;
-			else
-				prevdevnode->next = curdevnode->next;
-			CtrlPointDeleteNode(curdevnode);
-			if (prevdevnode)
-				curdevnode = prevdevnode->next;
-			else
-				curdevnode = GlobalDeviceList;
-		} else {
-			if (curdevnode->device.AdvrTimeOut < 2 * incr) {
-				/* This advertisement is about to expire, so
-				 * send out a search request for this device
-				 * UID to try to renew */
-				ret = UpnpSearchAsync(ctrlpt_handle, incr,
-						      curdevnode->device.DeviceType,
-						      NULL);
-				if (ret != UPNP_E_SUCCESS)
-					CDBG_ERROR
-					    ("Error sending search request for Device Type: %s -- err = %d\n",
-					     curdevnode->device.DeviceType, ret);
-			}
-			prevdevnode = curdevnode;
-			curdevnode = curdevnode->next;
-		}
-	}
-
-	ithread_mutex_unlock(&DeviceListMutex);
-}
-
-/*!
- * \brief Function that runs in its own thread and monitors advertisement
- * and subscription timeouts for devices in the global device list.
- */
-static int TvCtrlPointTimerLoopRun = 1;
-void *CtrlPointTimerLoop(void *args)
-{
-	/* how often to verify the timeouts, in seconds */
-	int incr = 30;
-
-	while (TvCtrlPointTimerLoopRun) {
-		isleep((unsigned int)incr);
-		CtrlPointVerifyTimeouts(incr);
-	}
-
-	return NULL;
-	args = args;
-}
-
 /*!
  * \brief Call this function to initialize the UPnP library and start the TV
- * Control Point.  This function creates a timer thread and provides a
+ * Control Point.  This function enables the device presence table and provides a
  * callback handler to process any UPnP events that are received.
  *
  * \return SUCCESS if everything went well, else ERROR.
  */
 int CtrlPointStart()
 {
-	ithread_t timer_thread;
 	int rc;
 	unsigned short port = 0;
 	char *ip_address = NULL;
 
-	ithread_mutex_init(&DeviceListMutex, 0);
+	DeviceRegistry = DevRegistryCreate();
+	if (DeviceRegistry == NULL) {
+		CDBG_ERROR("Error creating the device registry\n");
+		return ERROR;
+	}
 
 	CDBG_ERROR("Initializing UPnP Sdk with\n"
 			 "\tipaddress = %s port = %u\n",
@@ -743,21 +684,30 @@ int CtrlPointStart()
 
 	CDBG_ERROR("Control Point Registered\n");
 
-	CtrlPointRefresh();
+	/* only Ohm devices are of interest, drop other SSDP traffic early */
+	rc = UpnpAddDiscoveryFilter(OhmSearchType);
+	if (rc != UPNP_E_SUCCESS) {
+		CDBG_ERROR("Error adding discovery filter: %d\n", rc);
+	}
+
+	/* let the SDK expire devices at their CACHE-CONTROL max-age */
+	rc = UpnpSetDevicePresence(1);
+	if (rc != UPNP_E_SUCCESS) {
+		CDBG_ERROR("Error enabling device presence: %d\n", rc);
+	}
 
-	/* start a timer thread */
-	ithread_create(&timer_thread, NULL, CtrlPointTimerLoop, NULL);
-	ithread_detach(timer_thread);
+	CtrlPointRefresh();
 
 	return SUCCESS;
 }
 
 int CtrlPointStop(void)
 {
-	TvCtrlPointTimerLoopRun = 0;
 	CtrlPointRemoveAll();
 	UpnpUnRegisterClient( ctrlpt_handle );
 	UpnpFinish();
+	DevRegistryDestroy(DeviceRegistry);
+	DeviceRegistry = NULL;
 
 	return SUCCESS;
 }
@@ -773,6 +723,8 @@ void CtrlPointPrintShortHelp(void)
 		"  PrintDev	<devnum>\n"
 		"  PowerOn	<devnum>\n"
 		"  PowerOff	<devnum>\n"
+		"  PowerOnAll\n"
+		"  PowerOffAll\n"
 		"  GetAPList	<devnum>\n"
 		"  ConnectToAp	<devnum>\n"
 		"  CloseAP	<devnum>\n"
@@ -817,6 +769,12 @@ void CtrlPointPrintLongHelp(void)
 		"  PowerOff       <devnum>\n"
 		"       Sends the PowerOff action to the Control Service of\n"
 		"         device <devnum>.\n"
+		"  PowerOnAll\n"
+		"       Sends the PowerOn action to every device in the device\n"
+		"         list, and prints the result of each one at the end.\n"
+		"  PowerOffAll\n"
+		"       Sends the PowerOff action to every device in the device\n"
+		"         list, and prints the result of each one at the end.\n"
 		"  Exit\n"
 		"       Exits the control point application.\n");
 }
@@ -827,6 +785,8 @@ enum cmdloop_tvcmds {
 	PRTFULLHELP,
 	POWON,
 	POWOFF,
+	POWONALL,
+	POWOFFALL,
 	GETAPLIST,
 	CONNECTTOAP,
 	CLOSEAP,
@@ -884,6 +844,8 @@ static struct cmdloop_commands cmdloop_cmdlist[] = {
 	{"Reboot",   	  REBOOT,      2, "<devnum>"},
 	{"PowerOn",       POWON,       2, "<devnum>"},
 	{"PowerOff",      POWOFF,      2, "<devnum>"},
+	{"PowerOnAll",    POWONALL,    1, ""},
+	{"PowerOffAll",   POWOFFALL,   1, ""},
 	{"Exit",          EXITCMD,     1, ""}
 };
 
@@ -959,6 +921,12 @@ int CtrlPointProcessCommand(char *cmdline)
 	case POWOFF:
 		CtrlPointSendPowerOff(arg1);
 		break;
+	case POWONALL:
+		CtrlPointSendGroupAction("PowerOn");
+		break;
+	case POWOFFALL:
+		CtrlPointSendGroupAction("PowerOff");
+		break;
 	case GETAPLIST:
 		CtrlPointSendGetAPList(arg1);
 		break;
@@ -53,6 +53,7 @@ extern "C" {
 #include <stdio.h>
 #include <string.h>
 
+#include "devregistry.h"
 #include "upnp.h"
 #include "debug.h"
 #include "UpnpString.h"
@@ -66,6 +67,9 @@ extern "C" {
 
 #define TV_MAX_VAL_LEN		5
 
+/* Actions of a group action in flight at once */
+#define CTRLPT_GROUP_IN_FLIGHT	8
+
 #define SUCCESS		0
 #define ERROR		(-1)
 #define WARNING		1
@@ -73,7 +77,7 @@ extern "C" {
 /* This should be the maximum VARCOUNT from above */
 #define TV_MAXVARS		TV_CONTROL_VARCOUNT
 
-extern struct DeviceNode *GlobalDeviceList;
+extern DevRegistry *DeviceRegistry;
 
 typedef enum {
     CMDVAL_RESERVED = 0,
@@ -102,54 +106,27 @@ typedef enum {
     SWITCHTYPE_MAX
 } SwitchType;
 
-struct OhmDevice {
-    char UID[250];
-    char DeviceType[250];
-    char Location[250];
-    int  AdvrTimeOut;
-};
-
-struct DeviceNode {
-    struct OhmDevice device;
-    struct DeviceNode *next;
-};
-
-extern ithread_mutex_t DeviceListMutex;
-
 extern UpnpClient_Handle ctrlpt_handle;
 
 void	CtrlPointPrintHelp(void);
-int	CtrlPointDeleteNode(struct DeviceNode *);
 int	CtrlPointRemoveDevice(const char *);
 int	CtrlPointRemoveAll(void);
 int	CtrlPointRefresh(void);
 
 int	CtrlPointSendAction(int, int, const char *);
+int	CtrlPointSendGroupAction(const char *actionname);
 int	CtrlPointSendActionNumericArg(int devnum, int service, const char *actionName, const char *paramName, int paramValue);
 int	CtrlPointSendPowerOn(int devnum);
 int	CtrlPointSendPowerOff(int devnum);
 int 	CtrlPointSendGetAPList(int devnum);
 
-int	CtrlPointGetDevice(int, struct DeviceNode **);
+int	CtrlPointGetDevice(int, struct OhmDevice *);
 int	CtrlPointPrintList(void);
 int	CtrlPointPrintDevice(int);
 void	CtrlPointAddDevice(struct Upnp_Discovery *);
 
 int	CtrlPointCallbackEventHandler(Upnp_EventType, void *, void *);
 
-/*!
- * \brief Checks the advertisement each device in the global device list.
- *
- * If an advertisement expires, the device is removed from the list.
- *
- * If an advertisement is about to expire, a search request is sent for that
- * device.
- */
-void CtrlPointVerifyTimeouts(
-	/*! [in] The increment to subtract from the timeouts each time the
-	 * function is called. */
-	int incr);
-
 void	CtrlPointPrintCommands(void);
 void*	CtrlPointCommandLoop(void *);
 int	CtrlPointStart(void);
@@ -0,0 +1,518 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \addtogroup UpnpSamples
+ *
+ * @{
+ *
+ * \name Device Registry
+ *
+ * @{
+ *
+ * \file
+ */
+
+#include "devregistry.h"
+
+#include "ithread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*! Initial number of slots of the UID table, a power of two. */
+#define DEVREG_INIT_SLOTS 64
+/*! Initial number of device IDs. */
+#define DEVREG_INIT_IDS 32
+/*! Buckets of the interned string table, a power of two. */
+#define DEVREG_INTERN_SIZE 256
+
+/*! Slot values of the UID table other than device IDs. */
+#define SLOT_EMPTY 0
+#define SLOT_DELETED (-1)
+
+/*! An interned string. */
+typedef struct DevString {
+	struct DevString *next;
+	unsigned hash;
+	/*! Number of devices using the string. */
+	int refcount;
+	char s[1];
+} DevString;
+
+/*! A registered device. */
+typedef struct {
+	char *UID;
+	unsigned hash;
+	DevString *type;
+	DevString *location;
+	int AdvrTimeOut;
+} DevEntry;
+
+struct DevRegistry {
+	/*! Taken for reading by lookups and for writing by updates. */
+	ithread_rwlock_t lock;
+	/*! UID table: device ID, SLOT_EMPTY or SLOT_DELETED. */
+	int *slots;
+	/*! Number of slots, a power of two. */
+	size_t capacity;
+	/*! Slots not SLOT_EMPTY, including deleted ones. */
+	size_t used;
+	/*! Devices, indexed by device ID - 1. NULL for a free ID. */
+	DevEntry **byId;
+	/*! Size of byId and freeIds. */
+	int idCapacity;
+	/*! Highest device ID handed out. */
+	int idHigh;
+	/*! Stack of the free IDs below idHigh. */
+	int *freeIds;
+	int freeCount;
+	DevString *strings[DEVREG_INTERN_SIZE];
+};
+
+/*!
+ * \brief FNV-1a hash of a string.
+ */
+static unsigned DevRegistryHash(const char *s)
+{
+	unsigned hash = 2166136261u;
+
+	while (*s != '\0') {
+		hash ^= (unsigned char)*s++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Returns the interned copy of a string, creating it if needed, and
+ * takes a reference on it.
+ *
+ * \return The interned string, or NULL if out of memory.
+ */
+static DevString *DevRegistryIntern(DevRegistry *reg, const char *s)
+{
+	unsigned hash = DevRegistryHash(s);
+	DevString **bucket = &reg->strings[hash & (DEVREG_INTERN_SIZE - 1)];
+	DevString *str;
+	size_t len;
+
+	for (str = *bucket; str != NULL; str = str->next) {
+		if (str->hash == hash && strcmp(str->s, s) == 0) {
+			str->refcount++;
+			return str;
+		}
+	}
+	len = strlen(s);
+	str = (DevString *)malloc(sizeof(DevString) + len);
+	if (str == NULL) {
+		return NULL;
+	}
+	memcpy(str->s, s, len + 1);
+	str->hash = hash;
+	str->refcount = 1;
+	str->next = *bucket;
+	*bucket = str;
+
+	return str;
+}
+
+/*!
+ * \brief Drops a reference on an interned string, freeing it with the last
+ * one.
+ */
+static void DevRegistryRelease(DevRegistry *reg, DevString *str)
+{
+	DevString **link;
+
+	if (--str->refcount > 0) {
+		return;
+	}
+	link = &reg->strings[str->hash & (DEVREG_INTERN_SIZE - 1)];
+	while (*link != str) {
+		link = &(*link)->next;
+	}
+	*link = str->next;
+	free(str);
+}
+
+/*!
+ * \brief Finds the slot of a UID.
+ *
+ * \return The index of the slot holding the device, or -1 if the UID is not
+ * registered. In that case \b *insert is set to the slot to use for it.
+ */
+static long DevRegistryLookup(DevRegistry *reg, const char *UID,
+	unsigned hash, size_t *insert)
+{
+	size_t mask = reg->capacity - 1;
+	size_t i = hash & mask;
+	int found_deleted = 0;
+	DevEntry *entry;
+
+	while (reg->slots[i] != SLOT_EMPTY) {
+		if (reg->slots[i] == SLOT_DELETED) {
+			if (!found_deleted && insert != NULL) {
+				*insert = i;
+				found_deleted = 1;
+			}
+		} else {
+			entry = reg->byId[reg->slots[i] - 1];
+			if (entry->hash == hash && strcmp(entry->UID, UID) == 0) {
+				return (long)i;
+			}
+		}
+		i = (i + 1) & mask;
+	}
+	if (!found_deleted && insert != NULL) {
+		*insert = i;
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Rebuilds the UID table, doubling it if it is getting full, which
+ * also drops the deleted slots.
+ *
+ * \return 0 on success, -1 if out of memory.
+ */
+static int DevRegistryRehash(DevRegistry *reg)
+{
+	size_t count = (size_t)(reg->idHigh - reg->freeCount);
+	size_t capacity = reg->capacity;
+	size_t mask;
+	size_t i;
+	int *slots;
+	int id;
+
+	if ((count + 1) * 2 > capacity) {
+		capacity *= 2;
+	}
+	slots = (int *)calloc(capacity, sizeof(int));
+	if (slots == NULL) {
+		return -1;
+	}
+	mask = capacity - 1;
+	for (id = 1; id <= reg->idHigh; id++) {
+		if (reg->byId[id - 1] == NULL) {
+			continue;
+		}
+		i = reg->byId[id - 1]->hash & mask;
+		while (slots[i] != SLOT_EMPTY) {
+			i = (i + 1) & mask;
+		}
+		slots[i] = id;
+	}
+	free(reg->slots);
+	reg->slots = slots;
+	reg->capacity = capacity;
+	reg->used = count;
+
+	return 0;
+}
+
+/*!
+ * \brief Hands out a device ID, reusing freed ones first.
+ *
+ * \return The ID, or -1 if out of memory.
+ */
+static int DevRegistryNewId(DevRegistry *reg)
+{
+	DevEntry **byId;
+	int *freeIds;
+	int capacity;
+
+	if (reg->freeCount > 0) {
+		return reg->freeIds[--reg->freeCount];
+	}
+	if (reg->idHigh == reg->idCapacity) {
+		capacity = reg->idCapacity * 2;
+		byId = (DevEntry **)realloc(reg->byId,
+			(size_t)capacity * sizeof(DevEntry *));
+		if (byId == NULL) {
+			return -1;
+		}
+		reg->byId = byId;
+		freeIds = (int *)realloc(reg->freeIds,
+			(size_t)capacity * sizeof(int));
+		if (freeIds == NULL) {
+			return -1;
+		}
+		reg->freeIds = freeIds;
+		reg->idCapacity = capacity;
+	}
+	reg->byId[reg->idHigh] = NULL;
+
+	return ++reg->idHigh;
+}
+
+/*!
+ * \brief Frees a device and its references.
+ */
+static void DevRegistryFreeEntry(DevRegistry *reg, DevEntry *entry)
+{
+	DevRegistryRelease(reg, entry->type);
+	DevRegistryRelease(reg, entry->location);
+	free(entry->UID);
+	free(entry);
+}
+
+/*!
+ * \brief Copies a device out of the registry.
+ */
+static void DevRegistryCopy(DevEntry *entry, int DeviceId,
+	struct OhmDevice *device)
+{
+	device->DeviceId = DeviceId;
+	strncpy(device->UID, entry->UID, sizeof(device->UID) - 1);
+	device->UID[sizeof(device->UID) - 1] = '\0';
+	strncpy(device->DeviceType, entry->type->s,
+		sizeof(device->DeviceType) - 1);
+	device->DeviceType[sizeof(device->DeviceType) - 1] = '\0';
+	strncpy(device->Location, entry->location->s,
+		sizeof(device->Location) - 1);
+	device->Location[sizeof(device->Location) - 1] = '\0';
+	device->AdvrTimeOut = entry->AdvrTimeOut;
+}
+
+DevRegistry *DevRegistryCreate(void)
+{
+	DevRegistry *reg;
+
+	reg = (DevRegistry *)calloc((size_t)1, sizeof(DevRegistry));
+	if (reg == NULL) {
+		return NULL;
+	}
+	reg->capacity = DEVREG_INIT_SLOTS;
+	reg->idCapacity = DEVREG_INIT_IDS;
+	reg->slots = (int *)calloc(reg->capacity, sizeof(int));
+	reg->byId = (DevEntry **)calloc((size_t)reg->idCapacity,
+		sizeof(DevEntry *));
+	reg->freeIds = (int *)calloc((size_t)reg->idCapacity, sizeof(int));
+	if (reg->slots == NULL || reg->byId == NULL || reg->freeIds == NULL ||
+	    ithread_rwlock_init(&reg->lock, NULL) != 0) {
+		free(reg->slots);
+		free(reg->byId);
+		free(reg->freeIds);
+		free(reg);
+		return NULL;
+	}
+
+	return reg;
+}
+
+void DevRegistryDestroy(DevRegistry *reg)
+{
+	if (reg == NULL) {
+		return;
+	}
+	DevRegistryRemoveAll(reg);
+	ithread_rwlock_destroy(&reg->lock);
+	free(reg->slots);
+	free(reg->byId);
+	free(reg->freeIds);
+	free(reg);
+}
+
+int DevRegistryAdd(DevRegistry *reg, const char *UID, const char *DeviceType,
+	const char *Location, int AdvrTimeOut, int *isNew)
+{
+	unsigned hash = DevRegistryHash(UID);
+	DevString *type;
+	DevString *location;
+	DevEntry *entry;
+	size_t insert = 0;
+	long slot;
+	int id = -1;
+
+	if (isNew != NULL) {
+		*isNew = 0;
+	}
+	ithread_rwlock_wrlock(&reg->lock);
+	type = DevRegistryIntern(reg, DeviceType);
+	location = DevRegistryIntern(reg, Location);
+	if (type == NULL || location == NULL) {
+		goto error_handler;
+	}
+	slot = DevRegistryLookup(reg, UID, hash, &insert);
+	if (slot >= 0) {
+		/* known device: refresh it */
+		id = reg->slots[slot];
+		entry = reg->byId[id - 1];
+		DevRegistryRelease(reg, entry->type);
+		DevRegistryRelease(reg, entry->location);
+		entry->type = type;
+		entry->location = location;
+		entry->AdvrTimeOut = AdvrTimeOut;
+		ithread_rwlock_unlock(&reg->lock);
+		return id;
+	}
+	if ((reg->used + 1) * 10 > reg->capacity * 7) {
+		if (DevRegistryRehash(reg) != 0) {
+			goto error_handler;
+		}
+		DevRegistryLookup(reg, UID, hash, &insert);
+	}
+	entry = (DevEntry *)malloc(sizeof(DevEntry));
+	if (entry == NULL) {
+		goto error_handler;
+	}
+	entry->UID = strdup(UID);
+	id = entry->UID != NULL ? DevRegistryNewId(reg) : -1;
+	if (id < 0) {
+		free(entry->UID);
+		free(entry);
+		goto error_handler;
+	}
+	entry->hash = hash;
+	entry->type = type;
+	entry->location = location;
+	entry->AdvrTimeOut = AdvrTimeOut;
+	reg->byId[id - 1] = entry;
+	if (reg->slots[insert] == SLOT_EMPTY) {
+		reg->used++;
+	}
+	reg->slots[insert] = id;
+	ithread_rwlock_unlock(&reg->lock);
+	if (isNew != NULL) {
+		*isNew = 1;
+	}
+
+	return id;
+
+error_handler:
+	if (type != NULL) {
+		DevRegistryRelease(reg, type);
+	}
+	if (location != NULL) {
+		DevRegistryRelease(reg, location);
+	}
+	ithread_rwlock_unlock(&reg->lock);
+
+	return -1;
+}
+
+int DevRegistryRemove(DevRegistry *reg, const char *UID)
+{
+	long slot;
+	int id;
+
+	ithread_rwlock_wrlock(&reg->lock);
+	slot = DevRegistryLookup(reg, UID, DevRegistryHash(UID), NULL);
+	if (slot < 0) {
+		ithread_rwlock_unlock(&reg->lock);
+		return -1;
+	}
+	id = reg->slots[slot];
+	reg->slots[slot] = SLOT_DELETED;
+	DevRegistryFreeEntry(reg, reg->byId[id - 1]);
+	reg->byId[id - 1] = NULL;
+	reg->freeIds[reg->freeCount++] = id;
+	ithread_rwlock_unlock(&reg->lock);
+
+	return 0;
+}
+
+void DevRegistryRemoveAll(DevRegistry *reg)
+{
+	int id;
+
+	ithread_rwlock_wrlock(&reg->lock);
+	for (id = 1; id <= reg->idHigh; id++) {
+		if (reg->byId[id - 1] != NULL) {
+			DevRegistryFreeEntry(reg, reg->byId[id - 1]);
+			reg->byId[id - 1] = NULL;
+		}
+	}
+	memset(reg->slots, 0, reg->capacity * sizeof(int));
+	reg->used = 0;
+	reg->idHigh = 0;
+	reg->freeCount = 0;
+	ithread_rwlock_unlock(&reg->lock);
+}
+
+int DevRegistryGet(DevRegistry *reg, int DeviceId, struct OhmDevice *device)
+{
+	int rc = -1;
+
+	ithread_rwlock_rdlock(&reg->lock);
+	if (DeviceId > 0 && DeviceId <= reg->idHigh &&
+	    reg->byId[DeviceId - 1] != NULL) {
+		DevRegistryCopy(reg->byId[DeviceId - 1], DeviceId, device);
+		rc = 0;
+	}
+	ithread_rwlock_unlock(&reg->lock);
+
+	return rc;
+}
+
+int DevRegistryFind(DevRegistry *reg, const char *UID, struct OhmDevice *device)
+{
+	long slot;
+	int id;
+
+	ithread_rwlock_rdlock(&reg->lock);
+	slot = DevRegistryLookup(reg, UID, DevRegistryHash(UID), NULL);
+	if (slot < 0) {
+		ithread_rwlock_unlock(&reg->lock);
+		return -1;
+	}
+	id = reg->slots[slot];
+	DevRegistryCopy(reg->byId[id - 1], id, device);
+	ithread_rwlock_unlock(&reg->lock);
+
+	return 0;
+}
+
+int DevRegistryForEach(DevRegistry *reg, DevRegistryVisitor visit, void *arg)
+{
+	struct OhmDevice device;
+	int count = 0;
+	int id;
+
+	ithread_rwlock_rdlock(&reg->lock);
+	for (id = 1; id <= reg->idHigh; id++) {
+		if (reg->byId[id - 1] != NULL) {
+			DevRegistryCopy(reg->byId[id - 1], id, &device);
+			visit(&device, arg);
+			count++;
+		}
+	}
+	ithread_rwlock_unlock(&reg->lock);
+
+	return count;
+}
+
+/*! @} Device Registry */
+
+/*! @} UpnpSamples */
@@ -0,0 +1,181 @@
+#ifndef UPNP_DEVREGISTRY_H
+#define UPNP_DEVREGISTRY_H
+
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \addtogroup UpnpSamples
+ *
+ * @{
+ *
+ * \name Device Registry API
+ *
+ * Registry of the devices known to a control point.
+ *
+ * Devices are found by UID through an open addressing hash table and by
+ * device ID through a direct index. A device keeps its ID until it is
+ * removed; freed IDs are handed out again to new devices. Device types and
+ * locations are interned, so devices sharing them share one copy. Lookups
+ * take a read lock and may run concurrently; they return a copy of the
+ * device, never a pointer into the registry.
+ *
+ * @{
+ *
+ * \file
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Size of the strings of a struct OhmDevice. */
+#define DEVREG_STR_LEN 250
+
+/*! A device, as copied out of the registry. */
+struct OhmDevice {
+    /*! ID of the device, starting at 1. */
+    int  DeviceId;
+    char UID[DEVREG_STR_LEN];
+    char DeviceType[DEVREG_STR_LEN];
+    char Location[DEVREG_STR_LEN];
+    /*! Seconds the last advertisement is valid for, -1 if unknown. */
+    int  AdvrTimeOut;
+};
+
+typedef struct DevRegistry DevRegistry;
+
+/*! Called by DevRegistryForEach() for each device. */
+typedef void (*DevRegistryVisitor)(const struct OhmDevice *device, void *arg);
+
+/*!
+ * \brief Creates an empty registry.
+ *
+ * \return The registry, or NULL if out of memory.
+ */
+DevRegistry *DevRegistryCreate(void);
+
+/*!
+ * \brief Removes all the devices and frees the registry.
+ */
+void DevRegistryDestroy(
+	/*! [in] Registry to free. */
+	DevRegistry *reg);
+
+/*!
+ * \brief Adds a device, or updates the type, location and timeout of a
+ * device already registered with the same UID.
+ *
+ * \return The ID of the device, or -1 if out of memory.
+ */
+int DevRegistryAdd(
+	/*! [in] Registry. */
+	DevRegistry *reg,
+	/*! [in] UID of the device. */
+	const char *UID,
+	/*! [in] Device type. */
+	const char *DeviceType,
+	/*! [in] URL of the description document. */
+	const char *Location,
+	/*! [in] Advertisement timeout. */
+	int AdvrTimeOut,
+	/*! [out] Set to 1 if the device was not registered yet, else 0. May be
+	 * NULL. */
+	int *isNew);
+
+/*!
+ * \brief Removes a device.
+ *
+ * \return 0 on success, -1 if no device has this UID.
+ */
+int DevRegistryRemove(
+	/*! [in] Registry. */
+	DevRegistry *reg,
+	/*! [in] UID of the device. */
+	const char *UID);
+
+/*!
+ * \brief Removes all the devices. Device IDs start at 1 again.
+ */
+void DevRegistryRemoveAll(
+	/*! [in] Registry. */
+	DevRegistry *reg);
+
+/*!
+ * \brief Copies the device with a given ID.
+ *
+ * \return 0 on success, -1 if no device has this ID.
+ */
+int DevRegistryGet(
+	/*! [in] Registry. */
+	DevRegistry *reg,
+	/*! [in] ID of the device. */
+	int DeviceId,
+	/*! [out] Copy of the device. */
+	struct OhmDevice *device);
+
+/*!
+ * \brief Copies the device with a given UID.
+ *
+ * \return 0 on success, -1 if no device has this UID.
+ */
+int DevRegistryFind(
+	/*! [in] Registry. */
+	DevRegistry *reg,
+	/*! [in] UID of the device. */
+	const char *UID,
+	/*! [out] Copy of the device. */
+	struct OhmDevice *device);
+
+/*!
+ * \brief Calls \b visit for every device, by increasing ID.
+ *
+ * The registry is read locked during the walk: \b visit must not modify it.
+ *
+ * \return The number of devices visited.
+ */
+int DevRegistryForEach(
+	/*! [in] Registry. */
+	DevRegistry *reg,
+	/*! [in] Function called for each device. */
+	DevRegistryVisitor visit,
+	/*! [in] Argument passed to \b visit. */
+	void *arg);
+
+#ifdef __cplusplus
+};
+#endif
+
+/*! @} Device Registry API */
+
+/*! @} UpnpSamples */
+
+#endif /* UPNP_DEVREGISTRY_H */
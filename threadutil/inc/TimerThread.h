@@ -41,20 +41,54 @@
 #include "LinkedList.h"
 #include "ThreadPool.h"
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 #define INVALID_EVENT_ID (-10 & 1<<29)
 
+/*! Resolution of the timer, in milliseconds. */
+#define TIMER_TICK_MS 10
+/*! Number of levels of the timing wheel. */
+#define TIMER_WHEEL_LEVELS 4
+/*! log2 of the number of slots per level. */
+#define TIMER_WHEEL_BITS 8
+/*! Number of slots per level. */
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+
 /*! Timeout Types. */
 typedef enum timeoutType {
 	/*! seconds from Jan 1, 1970. */
 	ABS_SEC,
 	/*! seconds from current time. */
-	REL_SEC
+	REL_SEC,
+	/*! milliseconds from current time. */
+	REL_MSEC
 } TimeoutType;
 
+/*!
+ * Struct to contain information for a timer event.
+ *
+ * Internal to the TimerThread.
+ */
+typedef struct TIMEREVENT
+{
+	ThreadPoolJob job;
+	/*! [in] Tick the event expires at, see TimerThread::currentTick. */
+	uint64_t expires;
+	/*! [in] Long term or short term job. */
+	Duration persistent;
+	int id;
+	/*! Next event in the same wheel slot. */
+	struct TIMEREVENT *next;
+	/*! Link pointing to this event in its wheel slot. */
+	struct TIMEREVENT **pprev;
+	/*! Next event in the same bucket of the id table. */
+	struct TIMEREVENT *idNext;
+} TimerEvent;
+
 /*!
  * A timer thread similar to the one in the Upnp SDK that allows
  * the scheduling of a job to run at a specified time in the future.
@@ -62,6 +96,13 @@ typedef enum timeoutType {
  * Because the timer thread uses the thread pool there is no 
  * gurantee of timing, only approximate timing.
  *
+ * Events are kept in a hierarchical timing wheel of TIMER_WHEEL_LEVELS
+ * levels of TIMER_WHEEL_SIZE slots: level 0 holds the events due in the
+ * next TIMER_WHEEL_SIZE ticks, one slot per tick, and each further level
+ * covers TIMER_WHEEL_SIZE times the span of the previous one. Events move
+ * down a level when the lower level wraps. Scheduling and removal are
+ * O(1); all the events of a tick are handed to the thread pool together.
+ *
  * Uses ThreadPool, Mutex, Condition, Thread.
  */
 typedef struct TIMERTHREAD
@@ -69,27 +110,23 @@ typedef struct TIMERTHREAD
 	ithread_mutex_t mutex;
 	ithread_cond_t condition;
 	int lastEventId;
-	LinkedList eventQ;
+	/*! The timing wheel. */
+	TimerEvent *wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+	/*! Next tick to process, counted from baseTime. */
+	uint64_t currentTick;
+	/*! Monotonic time of tick 0, in milliseconds. */
+	uint64_t baseTime;
+	/*! Number of scheduled events. */
+	size_t count;
+	/*! Events hashed by id, for removal. */
+	TimerEvent **idTable;
+	/*! Number of buckets of idTable, a power of two. */
+	size_t idBuckets;
 	int shutdown;
 	FreeList freeEvents;
 	ThreadPool *tp;
 } TimerThread;
 
-/*!
- * Struct to contain information for a timer event.
- *
- * Internal to the TimerThread.
- */
-typedef struct TIMEREVENT
-{
-	ThreadPoolJob job;
-	/*! [in] Absolute time for event in seconds since Jan 1, 1970. */
-	time_t eventTime;
-	/*! [in] Long term or short term job. */
-	Duration persistent;
-	int id;
-} TimerEvent;
-
 /*!
  * \brief Initializes and starts timer thread.
  *
@@ -113,10 +150,11 @@ int TimerThreadSchedule(
 	/*! [in] Valid timer thread pointer. */
 	TimerThread* timer,
 	/*! [in] time of event. Either in absolute seconds, or relative
-	 * seconds in the future. */
+	 * seconds or milliseconds in the future. */
 	time_t time, 
-	/*! [in] either ABS_SEC, or REL_SEC. If REL_SEC, then the event
-	 * will be scheduled at the current time + REL_SEC. */
+	/*! [in] either ABS_SEC, REL_SEC or REL_MSEC. If REL_SEC, then the
+	 * event will be scheduled at the current time + REL_SEC. The event
+	 * runs within TIMER_TICK_MS of its time. */
 	TimeoutType type,
 	/*! [in] Valid Thread pool job with following fields. */
 	ThreadPoolJob *job,
@@ -129,6 +167,7 @@ int TimerThreadSchedule(
  * \brief Removes an event from the timer Q.
  *
  * Events can only be removed before they have been placed in the thread pool.
+ * Removal is O(1): the id is the handle of the event.
  *
  * \return 0 on success, INVALID_EVENT_ID on failure.
  */
@@ -617,6 +617,56 @@ static UPNP_INLINE int ithread_cleanup_thread(void) {
 #endif /* UPNP_USE_RWLOCK */
 
 
+/****************************************************************************
+ * Function: ithread_condattr_init
+ *
+ *  Description:
+ *      Initializes condition variable attribute.
+ *      Must be called before use.
+ *  Parameters:
+ *      ithread_condattr_t * attr (must be valid non NULL pointer to
+ *                                 pthread_condattr_t)
+ *  Returns:
+ *      0 on success, Nonzero on failure.
+ *      See man page for pthread_condattr_init
+ ***************************************************************************/
+#define ithread_condattr_init pthread_condattr_init
+
+
+/****************************************************************************
+ * Function: ithread_condattr_destroy
+ *
+ *  Description:
+ *      Releases any resources held by the condition variable attribute.
+ *  Parameters:
+ *      ithread_condattr_t * attr (must be valid non NULL pointer to
+ *                                 pthread_condattr_t)
+ *  Returns:
+ *      0 on success, Nonzero on failure.
+ *      See man page for pthread_condattr_destroy
+ ***************************************************************************/
+#define ithread_condattr_destroy pthread_condattr_destroy
+
+
+/****************************************************************************
+ * Function: ithread_condattr_setclock
+ *
+ *  Description:
+ *      Sets the clock of the absolute times given to ithread_cond_timedwait.
+ *      Only defined where the system supports clock selection.
+ *  Parameters:
+ *      ithread_condattr_t * attr (must be valid non NULL pointer to
+ *                                 pthread_condattr_t)
+ *      clockid_t clock_id (e.g. CLOCK_MONOTONIC)
+ *  Returns:
+ *      0 on success, Nonzero on failure.
+ *      See man page for pthread_condattr_setclock
+ ***************************************************************************/
+#if defined(_POSIX_CLOCK_SELECTION) && _POSIX_CLOCK_SELECTION >= 0
+	#define ithread_condattr_setclock pthread_condattr_setclock
+#endif
+
+
 /****************************************************************************
  * Function: ithread_cond_init
  *
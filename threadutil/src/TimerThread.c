@@ -37,6 +37,47 @@
 #include "TimerThread.h"
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+/*! Initial number of buckets of the id table, a power of two. */
+#define TIMER_ID_BUCKETS 64
+
+/*! Mask of a slot index in a wheel level. */
+#define TIMER_WHEEL_MASK ((uint64_t)TIMER_WHEEL_SIZE - 1)
+
+/*! Nonzero if the worker waits on the monotonic clock. Elsewhere its waits
+ * are computed from the wall clock, and a clock step only makes it wake up
+ * early or late once. */
+#if defined(ithread_condattr_setclock) && defined(_POSIX_MONOTONIC_CLOCK)
+	#define TIMER_COND_MONOTONIC 1
+#else
+	#define TIMER_COND_MONOTONIC 0
+#endif
+
+/*!
+ * \brief Returns the monotonic time in milliseconds.
+ */
+static uint64_t TimerNow(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+/*!
+ * \brief Returns the current tick of a timer.
+ */
+static uint64_t TimerCurrentTick(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer)
+{
+	return (TimerNow() - timer->baseTime) / TIMER_TICK_MS;
+}
 
 /*!
  * \brief Deallocates a dynamically allocated TimerEvent.
@@ -52,104 +93,325 @@ static void FreeTimerEvent(
 	FreeListFree(&timer->freeEvents, event);
 }
 
+/*!
+ * \brief Adds an event to the id table, growing the table when it holds
+ * more events than buckets.
+ */
+static void IdTableInsert(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event to add. */
+	TimerEvent *event)
+{
+	TimerEvent **table;
+	TimerEvent *temp;
+	size_t buckets;
+	size_t i;
+	size_t j;
+
+	if (timer->count >= timer->idBuckets) {
+		buckets = timer->idBuckets * 2;
+		table = (TimerEvent **)calloc(buckets, sizeof(TimerEvent *));
+		/* on failure just keep longer chains. */
+		if (table != NULL) {
+			for (i = 0; i < timer->idBuckets; i++) {
+				while ((temp = timer->idTable[i]) != NULL) {
+					timer->idTable[i] = temp->idNext;
+					j = (size_t)(unsigned)temp->id & (buckets - 1);
+					temp->idNext = table[j];
+					table[j] = temp;
+				}
+			}
+			free(timer->idTable);
+			timer->idTable = table;
+			timer->idBuckets = buckets;
+		}
+	}
+	i = (size_t)(unsigned)event->id & (timer->idBuckets - 1);
+	event->idNext = timer->idTable[i];
+	timer->idTable[i] = event;
+}
+
+/*!
+ * \brief Removes an event from the id table.
+ *
+ * \return The event, or NULL if no event has this id.
+ */
+static TimerEvent *IdTableRemove(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Id of the event. */
+	int id)
+{
+	TimerEvent **link;
+	TimerEvent *temp;
+
+	link = &timer->idTable[(size_t)(unsigned)id & (timer->idBuckets - 1)];
+	while ((temp = *link) != NULL) {
+		if (temp->id == id) {
+			*link = temp->idNext;
+			return temp;
+		}
+		link = &temp->idNext;
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Puts an event in the wheel slot matching its expiration tick.
+ *
+ * The level is chosen from the distance to the current tick; events beyond
+ * the last level are parked in it and placed again when it wraps.
+ */
+static void WheelPlace(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Event to place. */
+	TimerEvent *event)
+{
+	uint64_t expires = event->expires;
+	uint64_t delta;
+	TimerEvent **slot;
+	int level;
+
+	if (expires < timer->currentTick) {
+		expires = timer->currentTick;
+	}
+	delta = expires - timer->currentTick;
+	for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+		if (delta < (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1))) {
+			break;
+		}
+	}
+	if (delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) {
+		expires = timer->currentTick +
+			((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+	}
+	slot = &timer->wheel[level][(expires >> (TIMER_WHEEL_BITS * level)) &
+		TIMER_WHEEL_MASK];
+	event->next = *slot;
+	if (*slot != NULL) {
+		(*slot)->pprev = &event->next;
+	}
+	event->pprev = slot;
+	*slot = event;
+}
+
+/*!
+ * \brief Takes an event out of its wheel slot.
+ */
+static void WheelUnlink(
+	/*! [in] Event in the wheel. */
+	TimerEvent *event)
+{
+	*event->pprev = event->next;
+	if (event->next != NULL) {
+		event->next->pprev = event->pprev;
+	}
+}
+
+/*!
+ * \brief Moves the events of the upper levels whose slot comes up at
+ * \b tick down the wheel.
+ */
+static void WheelCascade(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Tick being processed. */
+	uint64_t tick)
+{
+	TimerEvent *list;
+	TimerEvent *next;
+	TimerEvent **slot;
+	int level;
+
+	for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+		if ((tick & (((uint64_t)1 << (TIMER_WHEEL_BITS * level)) - 1)) != 0) {
+			/* the level below did not wrap. */
+			break;
+		}
+		slot = &timer->wheel[level][(tick >> (TIMER_WHEEL_BITS * level)) &
+			TIMER_WHEEL_MASK];
+		list = *slot;
+		*slot = NULL;
+		while (list != NULL) {
+			next = list->next;
+			WheelPlace(timer, list);
+			list = next;
+		}
+	}
+}
+
+/*!
+ * \brief Processes the ticks up to \b now.
+ *
+ * \return The events due, linked through \b next, or NULL.
+ */
+static TimerEvent *WheelAdvance(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer,
+	/*! [in] Current tick. */
+	uint64_t now)
+{
+	TimerEvent *due = NULL;
+	TimerEvent **tail = &due;
+	TimerEvent **slot;
+	TimerEvent *temp;
+
+	while (timer->currentTick <= now) {
+		if (timer->count == 0) {
+			/* nothing to cascade: skip the idle ticks. */
+			timer->currentTick = now + 1;
+			break;
+		}
+		WheelCascade(timer, timer->currentTick);
+		slot = &timer->wheel[0][timer->currentTick & TIMER_WHEEL_MASK];
+		while ((temp = *slot) != NULL) {
+			WheelUnlink(temp);
+			IdTableRemove(timer, temp->id);
+			timer->count--;
+			temp->next = NULL;
+			*tail = temp;
+			tail = &temp->next;
+		}
+		timer->currentTick++;
+	}
+
+	return due;
+}
+
+/*!
+ * \brief Returns the next tick the worker has to process: the next non
+ * empty slot of level 0, or the next cascade, whichever comes first.
+ *
+ * \return The tick, or UINT64_MAX if there are no events.
+ */
+static uint64_t WheelNextTick(
+	/*! [in] Valid timer thread pointer. */
+	TimerThread *timer)
+{
+	uint64_t tick = timer->currentTick;
+	int i;
+
+	if (timer->count == 0) {
+		return UINT64_MAX;
+	}
+	for (i = 0; i < TIMER_WHEEL_SIZE; i++, tick++) {
+		if ((tick & TIMER_WHEEL_MASK) == 0 ||
+		    timer->wheel[0][tick & TIMER_WHEEL_MASK] != NULL) {
+			break;
+		}
+	}
+
+	return tick;
+}
+
 /*!
  * \brief Implements timer thread.
  *
  * Waits for next event to occur and schedules associated job into threadpool.
+ * All the events due at the same tick are taken from the wheel at once and
+ * handed to the thread pool with the timer mutex released.
  */
 static void *TimerThreadWorker(
 	/*! [in] arg is cast to (TimerThread *). */
 	void *arg)
 {
-    TimerThread *timer = ( TimerThread * ) arg;
-    ListNode *head = NULL;
-    TimerEvent *nextEvent = NULL;
-    time_t currentTime = 0;
-    time_t nextEventTime = 0;
-    struct timespec timeToWait;
-    int tempId;
-
-    assert( timer != NULL );
-
-    ithread_mutex_lock( &timer->mutex );
-    while (1) {
-        /* mutex should always be locked at top of loop */
-	/* Check for shutdown. */
-        if (timer->shutdown) {
-            timer->shutdown = 0;
-            ithread_cond_signal( &timer->condition );
-            ithread_mutex_unlock( &timer->mutex );
-            return NULL;
-        }
-        nextEvent = NULL;
-        /* Get the next event if possible. */
-        if (timer->eventQ.size > 0) {
-            head = ListHead( &timer->eventQ );
-            if (head == NULL) {
-                ithread_mutex_unlock( &timer->mutex );
-                return NULL;
-            }
-            nextEvent = ( TimerEvent * ) head->item;
-            nextEventTime = nextEvent->eventTime;
-        }
-        currentTime = time(NULL);
-        /* If time has elapsed, schedule job. */
-        if (nextEvent && currentTime >= nextEventTime) {
-            if( nextEvent->persistent ) {
-                if (ThreadPoolAddPersistent( timer->tp, &nextEvent->job, &tempId ) != 0) {
-			if (nextEvent->job.arg != NULL && nextEvent->job.free_func != NULL) {
-				nextEvent->job.free_func(nextEvent->job.arg);
-			}
+	TimerThread *timer = (TimerThread *) arg;
+	TimerEvent *due;
+	TimerEvent *temp;
+	uint64_t nextTick;
+	uint64_t waitTime;
+	uint64_t now;
+#if !TIMER_COND_MONOTONIC
+	struct timeval tv;
+#endif
+	struct timespec timeToWait;
+	int tempId;
+	int rc;
+
+	assert(timer != NULL);
+
+	ithread_mutex_lock(&timer->mutex);
+	while (1) {
+		/* mutex should always be locked at top of loop */
+		/* Check for shutdown. */
+		if (timer->shutdown) {
+			timer->shutdown = 0;
+			ithread_cond_signal(&timer->condition);
+			ithread_mutex_unlock(&timer->mutex);
+			return NULL;
 		}
-            } else {
-                if (ThreadPoolAdd( timer->tp, &nextEvent->job, &tempId ) != 0) {
-			if (nextEvent->job.arg != NULL && nextEvent->job.free_func != NULL) {
-				nextEvent->job.free_func(nextEvent->job.arg);
+		due = WheelAdvance(timer, TimerCurrentTick(timer));
+		if (due != NULL) {
+			ithread_mutex_unlock(&timer->mutex);
+			for (temp = due; temp != NULL; temp = temp->next) {
+				if (temp->persistent) {
+					rc = ThreadPoolAddPersistent(timer->tp,
+						&temp->job, &tempId);
+				} else {
+					rc = ThreadPoolAdd(timer->tp,
+						&temp->job, &tempId);
+				}
+				if (rc != 0 && temp->job.arg != NULL &&
+				    temp->job.free_func != NULL) {
+					temp->job.free_func(temp->job.arg);
+				}
 			}
+			ithread_mutex_lock(&timer->mutex);
+			while ((temp = due) != NULL) {
+				due = temp->next;
+				FreeTimerEvent(timer, temp);
+			}
+			continue;
+		}
+		nextTick = WheelNextTick(timer);
+		if (nextTick == UINT64_MAX) {
+			ithread_cond_wait(&timer->condition, &timer->mutex);
+			continue;
 		}
-            }
-            ListDelNode( &timer->eventQ, head, 0 );
-            FreeTimerEvent( timer, nextEvent );
-            continue;
-        }
-        if (nextEvent) {
-            timeToWait.tv_nsec = 0;
-            timeToWait.tv_sec = (long)nextEvent->eventTime;
-            ithread_cond_timedwait( &timer->condition, &timer->mutex,
-                                    &timeToWait );
-        } else {
-            ithread_cond_wait( &timer->condition, &timer->mutex );
-        }
-    }
+		now = TimerNow();
+		waitTime = timer->baseTime + nextTick * TIMER_TICK_MS;
+		waitTime = waitTime > now ? waitTime - now : 0;
+#if TIMER_COND_MONOTONIC
+		clock_gettime(CLOCK_MONOTONIC, &timeToWait);
+#else
+		gettimeofday(&tv, NULL);
+		timeToWait.tv_sec = tv.tv_sec;
+		timeToWait.tv_nsec = tv.tv_usec * 1000L;
+#endif
+		timeToWait.tv_sec += (time_t)(waitTime / 1000u);
+		timeToWait.tv_nsec += (long)(waitTime % 1000u) * 1000000L;
+		if (timeToWait.tv_nsec >= 1000000000L) {
+			timeToWait.tv_sec++;
+			timeToWait.tv_nsec -= 1000000000L;
+		}
+		ithread_cond_timedwait(&timer->condition, &timer->mutex,
+			&timeToWait);
+	}
 }
 
-
 /*!
- * \brief Calculates the appropriate timeout in absolute seconds
- * since Jan 1, 1970.
+ * \brief Converts a timeout to milliseconds from now.
  *
- * \return 
+ * \return The delay in milliseconds, 0 for a time in the past.
  */
-static int CalculateEventTime(
+static uint64_t CalculateEventTime(
 	/*! [in] Timeout. */
-	time_t *timeout,
+	time_t timeout,
 	/*! [in] Timeout type. */
 	TimeoutType type)
 {
-    time_t now;
-
-    assert( timeout != NULL );
-
-    switch (type) {
-    case ABS_SEC:
-        return 0;
-    default: /* REL_SEC) */
-        time(&now);
-        ( *timeout ) += now;
-        return 0;
-    }
-
-    return -1;
+	switch (type) {
+	case ABS_SEC:
+		timeout -= time(NULL);
+		/* fall through */
+	case REL_SEC:
+		return timeout > 0 ? (uint64_t)timeout * 1000u : 0u;
+	default: /* REL_MSEC */
+		return timeout > 0 ? (uint64_t)timeout : 0u;
+	}
 }
 
 /*!
@@ -164,82 +426,101 @@ static TimerEvent *CreateTimerEvent(
 	ThreadPoolJob *job,
 	/*! [in] . */
 	Duration persistent,
-	/*! [in] The absoule time of the event in seconds from Jan, 1970. */
-	time_t eventTime,
+	/*! [in] The tick the event expires at. */
+	uint64_t expires,
 	/*! [in] Id of job. */
 	int id)
 {
-    TimerEvent *temp = NULL;
-
-    assert( timer != NULL );
-    assert( job != NULL );
-
-    temp = ( TimerEvent * ) FreeListAlloc( &timer->freeEvents );
-    if( temp == NULL )
-        return temp;
-    temp->job = ( *job );
-    temp->persistent = persistent;
-    temp->eventTime = eventTime;
-    temp->id = id;
+	TimerEvent *temp = NULL;
 
-    return temp;
+	assert(timer != NULL);
+	assert(job != NULL);
+
+	temp = (TimerEvent *) FreeListAlloc(&timer->freeEvents);
+	if (temp == NULL)
+		return temp;
+	temp->job = (*job);
+	temp->persistent = persistent;
+	temp->expires = expires;
+	temp->id = id;
+	temp->next = NULL;
+	temp->pprev = NULL;
+	temp->idNext = NULL;
+
+	return temp;
 }
 
-
 int TimerThreadInit(TimerThread *timer, ThreadPool *tp)
 {
+	int rc = 0;
 
-    int rc = 0;
-
-    ThreadPoolJob timerThreadWorker;
-
-    assert( timer != NULL );
-    assert( tp != NULL );
+	ThreadPoolJob timerThreadWorker;
 
-    if( ( timer == NULL ) || ( tp == NULL ) ) {
-        return EINVAL;
-    }
-
-    rc += ithread_mutex_init( &timer->mutex, NULL );
-
-    assert( rc == 0 );
-
-    rc += ithread_mutex_lock( &timer->mutex );
-    assert( rc == 0 );
-
-    rc += ithread_cond_init( &timer->condition, NULL );
-    assert( rc == 0 );
-
-    rc += FreeListInit( &timer->freeEvents, sizeof( TimerEvent ), 100 );
-    assert( rc == 0 );
-
-    timer->shutdown = 0;
-    timer->tp = tp;
-    timer->lastEventId = 0;
-    rc += ListInit( &timer->eventQ, NULL, NULL );
-
-    assert( rc == 0 );
-
-    if( rc != 0 ) {
-        rc = EAGAIN;
-    } else {
-
-        TPJobInit( &timerThreadWorker, TimerThreadWorker, timer );
-        TPJobSetPriority( &timerThreadWorker, HIGH_PRIORITY );
-
-        rc = ThreadPoolAddPersistent( tp, &timerThreadWorker, NULL );
-    }
-
-    ithread_mutex_unlock( &timer->mutex );
-
-    if( rc != 0 ) {
-        ithread_cond_destroy( &timer->condition );
-        ithread_mutex_destroy( &timer->mutex );
-        FreeListDestroy( &timer->freeEvents );
-        ListDestroy( &timer->eventQ, 0 );
-    }
-
-    return rc;
+	assert(timer != NULL);
+	assert(tp != NULL);
+
+	if ((timer == NULL) || (tp == NULL)) {
+		return EINVAL;
+	}
+
+	rc += ithread_mutex_init(&timer->mutex, NULL);
+
+	assert(rc == 0);
+
+	rc += ithread_mutex_lock(&timer->mutex);
+	assert(rc == 0);
+
+#if TIMER_COND_MONOTONIC
+	{
+		ithread_condattr_t attr;
+
+		rc += ithread_condattr_init(&attr);
+		rc += ithread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		rc += ithread_cond_init(&timer->condition, &attr);
+		ithread_condattr_destroy(&attr);
+	}
+#else
+	rc += ithread_cond_init(&timer->condition, NULL);
+#endif
+	assert(rc == 0);
+
+	rc += FreeListInit(&timer->freeEvents, sizeof(TimerEvent), 100);
+	assert(rc == 0);
+
+	timer->shutdown = 0;
+	timer->tp = tp;
+	timer->lastEventId = 0;
+	memset(timer->wheel, 0, sizeof(timer->wheel));
+	timer->currentTick = 0;
+	timer->baseTime = TimerNow();
+	timer->count = 0;
+	timer->idBuckets = TIMER_ID_BUCKETS;
+	timer->idTable = (TimerEvent **)calloc(timer->idBuckets,
+		sizeof(TimerEvent *));
+	if (timer->idTable == NULL) {
+		rc = EAGAIN;
+	}
+
+	if (rc != 0) {
+		rc = EAGAIN;
+	} else {
+		TPJobInit(&timerThreadWorker, TimerThreadWorker, timer);
+		TPJobSetPriority(&timerThreadWorker, HIGH_PRIORITY);
+
+		rc = ThreadPoolAddPersistent(tp, &timerThreadWorker, NULL);
+	}
+
+	ithread_mutex_unlock(&timer->mutex);
+
+	if (rc != 0) {
+		ithread_cond_destroy(&timer->condition);
+		ithread_mutex_destroy(&timer->mutex);
+		FreeListDestroy(&timer->freeEvents);
+		free(timer->idTable);
+		timer->idTable = NULL;
+	}
+
+	return rc;
 }
 
 int TimerThreadSchedule(
@@ -250,65 +531,43 @@ int TimerThreadSchedule(
 	Duration duration,
 	int *id)
 {
-    int rc = EOUTOFMEM;
-    int found = 0;
-    int tempId = 0;
-
-    ListNode *tempNode = NULL;
-    TimerEvent *temp = NULL;
-    TimerEvent *newEvent = NULL;
-
-    assert( timer != NULL );
-    assert( job != NULL );
-
-    if( ( timer == NULL ) || ( job == NULL ) ) {
-        return EINVAL;
-    }
-
-    CalculateEventTime( &timeout, type );
-    ithread_mutex_lock( &timer->mutex );
-
-    if( id == NULL )
-        id = &tempId;
-
-    ( *id ) = INVALID_EVENT_ID;
-
-    newEvent = CreateTimerEvent( timer, job, duration, timeout,
-                                 timer->lastEventId );
-
-    if( newEvent == NULL ) {
-        ithread_mutex_unlock( &timer->mutex );
-        return rc;
-    }
-
-    tempNode = ListHead( &timer->eventQ );
-    /* add job to Q. Q is ordered by eventTime with the head of the Q being
-     * the next event. */
-    while( tempNode != NULL ) {
-        temp = ( TimerEvent * ) tempNode->item;
-        if( temp->eventTime >= timeout ) {
-            if (ListAddBefore( &timer->eventQ, newEvent, tempNode))
-                rc = 0;
-            found = 1;
-            break;
-        }
-        tempNode = ListNext( &timer->eventQ, tempNode );
-    }
-    /* add to the end of Q. */
-    if (!found) {
-        if( ListAddTail( &timer->eventQ, newEvent ) != NULL )
-            rc = 0;
-    }
-    /* signal change in Q. */
-    if( rc == 0 ) {
-        ithread_cond_signal( &timer->condition );
-    } else {
-        FreeTimerEvent( timer, newEvent );
-    }
-    ( *id ) = timer->lastEventId++;
-    ithread_mutex_unlock( &timer->mutex );
-
-    return rc;
+	int tempId = 0;
+	uint64_t expires;
+	TimerEvent *newEvent = NULL;
+
+	assert(timer != NULL);
+	assert(job != NULL);
+
+	if ((timer == NULL) || (job == NULL)) {
+		return EINVAL;
+	}
+
+	/* round up, so that the event never runs early. */
+	expires = (TimerNow() - timer->baseTime +
+		CalculateEventTime(timeout, type) + TIMER_TICK_MS - 1) /
+		TIMER_TICK_MS;
+	ithread_mutex_lock(&timer->mutex);
+
+	if (id == NULL)
+		id = &tempId;
+
+	(*id) = INVALID_EVENT_ID;
+
+	newEvent = CreateTimerEvent(timer, job, duration, expires,
+		timer->lastEventId);
+	if (newEvent == NULL) {
+		ithread_mutex_unlock(&timer->mutex);
+		return EOUTOFMEM;
+	}
+	WheelPlace(timer, newEvent);
+	IdTableInsert(timer, newEvent);
+	timer->count++;
+	/* signal change in Q. */
+	ithread_cond_signal(&timer->condition);
+	(*id) = timer->lastEventId++;
+	ithread_mutex_unlock(&timer->mutex);
+
+	return 0;
 }
 
 int TimerThreadRemove(
@@ -316,86 +575,79 @@ int TimerThreadRemove(
 	int id,
 	ThreadPoolJob *out)
 {
-    int rc = INVALID_EVENT_ID;
-    ListNode *tempNode = NULL;
-    TimerEvent *temp = NULL;
+	int rc = INVALID_EVENT_ID;
+	TimerEvent *temp = NULL;
 
-    assert( timer != NULL );
-
-    if( timer == NULL ) {
-        return EINVAL;
-    }
-
-    ithread_mutex_lock( &timer->mutex );
-
-    tempNode = ListHead( &timer->eventQ );
-
-    while( tempNode != NULL ) {
-        temp = ( TimerEvent * ) tempNode->item;
-        if( temp->id == id )
-        {
-
-            ListDelNode( &timer->eventQ, tempNode, 0 );
-            if( out != NULL )
-                ( *out ) = temp->job;
-            FreeTimerEvent( timer, temp );
-            rc = 0;
-            break;
-        }
-        tempNode = ListNext( &timer->eventQ, tempNode );
-    }
+	assert(timer != NULL);
 
-    ithread_mutex_unlock( &timer->mutex );
-    return rc;
+	if (timer == NULL) {
+		return EINVAL;
+	}
+
+	ithread_mutex_lock(&timer->mutex);
+	temp = IdTableRemove(timer, id);
+	if (temp != NULL) {
+		WheelUnlink(temp);
+		timer->count--;
+		if (out != NULL)
+			(*out) = temp->job;
+		FreeTimerEvent(timer, temp);
+		rc = 0;
+	}
+	ithread_mutex_unlock(&timer->mutex);
+
+	return rc;
 }
 
 int TimerThreadShutdown(TimerThread *timer)
 {
-    ListNode *tempNode2 = NULL;
-    ListNode *tempNode = NULL;
-
-    assert( timer != NULL );
-
-    if( timer == NULL ) {
-        return EINVAL;
-    }
+	TimerEvent *temp;
+	int level;
+	int i;
 
-    ithread_mutex_lock( &timer->mutex );
-
-    timer->shutdown = 1;
-    tempNode = ListHead( &timer->eventQ );
-
-    /* Delete nodes in Q. Call registered free function on argument. */
-    while( tempNode != NULL ) {
-        TimerEvent *temp = ( TimerEvent * ) tempNode->item;
-
-        tempNode2 = ListNext( &timer->eventQ, tempNode );
-        ListDelNode( &timer->eventQ, tempNode, 0 );
-        if( temp->job.free_func ) {
-            temp->job.free_func( temp->job.arg );
-        }
-        FreeTimerEvent( timer, temp );
-        tempNode = tempNode2;
-    }
-
-    ListDestroy( &timer->eventQ, 0 );
-    FreeListDestroy( &timer->freeEvents );
+	assert(timer != NULL);
 
-    ithread_cond_broadcast( &timer->condition );
+	if (timer == NULL) {
+		return EINVAL;
+	}
 
-    while (timer->shutdown) {
-	/* wait for timer thread to shutdown. */
-        ithread_cond_wait( &timer->condition, &timer->mutex );
-    }
-    ithread_mutex_unlock(&timer->mutex);
+	ithread_mutex_lock(&timer->mutex);
 
-    /* destroy condition. */
-    while(ithread_cond_destroy(&timer->condition) != 0) {
-    }
-    /* destroy mutex. */
-    while (ithread_mutex_destroy(&timer->mutex) != 0) {
-    }
+	timer->shutdown = 1;
 
-    return 0;
+	/* Delete events in the wheel. Call registered free function on
+	 * argument. */
+	for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (i = 0; i < TIMER_WHEEL_SIZE; i++) {
+			while ((temp = timer->wheel[level][i]) != NULL) {
+				timer->wheel[level][i] = temp->next;
+				if (temp->job.free_func) {
+					temp->job.free_func(temp->job.arg);
+				}
+				FreeTimerEvent(timer, temp);
+			}
+		}
+	}
+	timer->count = 0;
+
+	ithread_cond_broadcast(&timer->condition);
+
+	while (timer->shutdown) {
+		/* wait for timer thread to shutdown. */
+		ithread_cond_wait(&timer->condition, &timer->mutex);
+	}
+	/* the worker may have freed events after the wheel was emptied. */
+	FreeListDestroy(&timer->freeEvents);
+	free(timer->idTable);
+	timer->idTable = NULL;
+	ithread_mutex_unlock(&timer->mutex);
+
+	/* destroy condition. */
+	while (ithread_cond_destroy(&timer->condition) != 0) {
+	}
+	/* destroy mutex. */
+	while (ithread_mutex_destroy(&timer->mutex) != 0) {
+	}
+
+	return 0;
 }
-
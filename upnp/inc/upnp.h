@@ -313,6 +313,15 @@
  */
 #define UPNP_E_CANCELED			-210
 
+/*!
+ * \brief The request was not sent: the last requests to the device failed
+ * and its circuit breaker is open.
+ *
+ * This error can be returned by the functions that send actions or
+ * subscriptions to a device, see \b UpnpGetDeviceHealth.
+ */
+#define UPNP_E_DEVICE_UNREACHABLE	-211
+
 #define UPNP_E_EVENT_PROTOCOL		-300
 
 /*!
@@ -451,7 +460,7 @@ enum Upnp_EventType_e {
 	UPNP_CONTROL_ACTION_REQUEST,
 
 	/*! A \b UpnpSendActionAsync call completed. The \b Event
-	 * parameter contains a pointer to a \b UpnpActionComplete structure
+	 * parameter contains a pointer to a \b Upnp_Action_Complete structure
 	 * with the results of the action.  */
 	UPNP_CONTROL_ACTION_COMPLETE,
 
@@ -538,7 +547,26 @@ enum Upnp_EventType_e {
 	 * if auto-renewal of subscriptions is disabled.
 	 * The \b Event parameter is a \b UpnpEventSubscribe
 	 * structure. The subscription is no longer valid. */
-	UPNP_EVENT_SUBSCRIPTION_EXPIRED
+	UPNP_EVENT_SUBSCRIPTION_EXPIRED,
+
+	/*! Received by a control point when a device tracked by the presence
+	 * table was not announced again before its CACHE-CONTROL max-age
+	 * elapsed, see \b UpnpSetDevicePresence. The \b Event parameter
+	 * contains a pointer to a \b UpnpDiscovery structure with the last
+	 * announcement of the device. */
+	UPNP_DISCOVERY_ADVERTISEMENT_EXPIRED,
+
+	/*! A \b UpnpSendGroupActionAsync call completed: every action of the
+	 * group completed or failed. The \b Event parameter contains a pointer
+	 * to a \b Upnp_Group_Action_Complete structure with the result of
+	 * each action. */
+	UPNP_CONTROL_GROUP_ACTION_COMPLETE,
+
+	/*! A \b UpnpSubscribeGroupAsync call completed: every subscription of
+	 * the group completed or failed. The \b Event parameter contains a
+	 * pointer to a \b Upnp_Group_Subscribe_Complete structure with the
+	 * result of each subscription. */
+	UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE
 };
 
 typedef enum Upnp_EventType_e Upnp_EventType;
@@ -599,6 +627,74 @@ enum Upnp_DescType_e {
 typedef enum Upnp_DescType_e Upnp_DescType;
 
 #if UPNP_VERSION < 10800
+/** Returned along with a {\bf UPNP_CONTROL_ACTION_COMPLETE} callback.  */
+
+struct Upnp_Action_Complete
+{
+  /** The result of the operation: {\tt UPNP_E_SUCCESS} if the device
+   *  answered, whatever the HTTP status, else the error that ended the
+   *  request. */
+  int ErrCode;
+
+  /** The HTTP status code of the response, 0 if there is none. */
+  int StatusCode;
+
+  /** The entity of the response, nul terminated, or {\tt NULL} if there
+   *  is none. It is freed when the callback returns, unless the callback
+   *  takes it with {\bf UpnpDetachActionEntity}. */
+  char *Entity;
+
+  /** The length of {\bf Entity}, without the terminating nul. */
+  size_t EntityLength;
+};
+
+/** The result of one action of a group, returned as part of a
+ *  {\bf UPNP_CONTROL_GROUP_ACTION_COMPLETE} callback.  */
+
+struct Upnp_Group_Action_Result
+{
+  /** The action URL the action was sent to. */
+  const char *ActionURL;
+
+  /** The result of the action, as in {\bf Upnp_Action_Complete}. */
+  int ErrCode;
+
+  /** The HTTP status code of the response, 0 if there is none. */
+  int StatusCode;
+
+  /** Milliseconds from sending the action to its completion. */
+  int ElapsedMs;
+
+  /** The entity of the response, nul terminated, or {\tt NULL} if there
+   *  is none. It is freed when the callback returns, unless the callback
+   *  takes it and sets the field to {\tt NULL}; it then frees it with
+   *  {\bf UpnpReleaseActionEntity}. */
+  char *Entity;
+
+  /** The length of {\bf Entity}, without the terminating nul. */
+  size_t EntityLength;
+};
+
+/** Returned along with a {\bf UPNP_CONTROL_GROUP_ACTION_COMPLETE}
+ *  callback.  */
+
+struct Upnp_Group_Action_Complete
+{
+  /** The number of actions in the group. */
+  int NumActions;
+
+  /** The number of actions the device answered, that is with an
+   *  {\bf ErrCode} of {\tt UPNP_E_SUCCESS}. */
+  int NumSucceeded;
+
+  /** Milliseconds from the call to {\bf UpnpSendGroupActionAsync} to the
+   *  completion of its last action. */
+  int ElapsedMs;
+
+  /** The result of each action, in the order of the action URLs. */
+  struct Upnp_Group_Action_Result *Results;
+};
+
 /** Returned as part of a {\bf UPNP_CONTROL_ACTION_COMPLETE} callback.  */
 
 struct Upnp_State_Var_Complete
@@ -613,6 +709,26 @@ struct Upnp_State_Var_Complete
   char StateVarName[NAME_SIZE];
 };
 
+/** A state variable changed by an event, indexed by
+ *  {\bf UpnpEventGetProperties}. The name and the value point into the
+ *  {\bf Body} of the event: they are not nul terminated, and the value is
+ *  the raw content of the variable element, XML entities not decoded.  */
+
+struct Upnp_Event_Property
+{
+  /** The name of the state variable. */
+  const char *Name;
+
+  /** The length of {\bf Name}. */
+  size_t NameLength;
+
+  /** The new value of the state variable. */
+  const char *Value;
+
+  /** The length of {\bf Value}, 0 for an empty value. */
+  size_t ValueLength;
+};
+
 /** Returned along with a {\bf UPNP_EVENT_RECEIVED} callback.  */
 
 struct Upnp_Event
@@ -622,6 +738,21 @@ struct Upnp_Event
 
   /** The event sequence number. */
   int EventKey;
+
+  /** The body of the event, the property set sent by the device. It
+   *  points into the received message: it is not nul terminated and is
+   *  only valid until the callback returns. */
+  const char *Body;
+
+  /** The length of {\bf Body}. */
+  size_t BodyLength;
+
+  /** The changed state variables, {\tt NULL} until the first call to
+   *  {\bf UpnpEventGetProperties}. Freed when the callback returns. */
+  struct Upnp_Event_Property *Properties;
+
+  /** The number of {\bf Properties}, -1 until they are indexed. */
+  int NumProperties;
 };
 
 /*
@@ -636,6 +767,10 @@ struct Upnp_Discovery
 	/** The result code of the {\bf UpnpSearchAsync} call. */
 	int  ErrCode;                  
 				     
+	/** The max-age of the CACHE-CONTROL header in seconds, i.e. the time
+	 *  the advertisement stays valid, or -1 if the header is missing. */
+	int  Expires;
+
 	/** The unique device identifier. */
 	char UID[LINE_SIZE];
 
@@ -649,6 +784,93 @@ struct Upnp_Discovery
 	struct sockaddr_storage DestAddr;
 };
 
+/** Filled in by {\bf UpnpGetDiscoveryStats}. All counters are cumulative
+ *  since {\bf UpnpInit}. */
+struct Upnp_Discovery_Stats
+{
+	/** The number of reads that returned at least one SSDP datagram. */
+	unsigned long Batches;
+
+	/** The number of SSDP datagrams read. {\bf Datagrams} / {\bf Batches}
+	 *  is the average number of datagrams per batch. */
+	unsigned long Datagrams;
+
+	/** The largest number of datagrams read in a single batch. */
+	unsigned long MaxBatch;
+
+	/** The number of datagrams dropped by the kernel because an SSDP
+	 *  receive queue was full. Always 0 if SO_RXQ_OVFL is not supported. */
+	unsigned long KernelDrops;
+
+	/** The number of datagrams passed to the SSDP handlers. */
+	unsigned long FilterAccepted;
+
+	/** The number of datagrams dropped by the discovery filter, see
+	 *  {\bf UpnpAddDiscoveryFilter}. */
+	unsigned long FilterDropped;
+
+	/** The number of duplicate announcements and search replies dropped
+	 *  before the callback, see {\bf UpnpSetDiscoveryDedupWindow}. */
+	unsigned long DedupHits;
+
+	/** The number of announcements and search replies checked against the
+	 *  duplicate cache and passed to the callback. */
+	unsigned long DedupMisses;
+};
+
+/** States of the circuit breaker of a device, see {\bf
+ *  UpnpGetDeviceHealth}. */
+enum Upnp_Breaker_State {
+	/** Requests go through. */
+	UPNP_BREAKER_CLOSED,
+	/** Requests fail at once with {\tt UPNP_E_DEVICE_UNREACHABLE}. */
+	UPNP_BREAKER_OPEN,
+	/** One request goes through to probe the device. */
+	UPNP_BREAKER_HALF_OPEN
+};
+
+/** Filled in by {\bf UpnpGetDeviceHealth}. */
+struct Upnp_Device_Health
+{
+	/** The state of the circuit breaker of the device, an {\bf
+	 *  Upnp_Breaker_State}. */
+	int State;
+
+	/** The number of requests to the device that failed in a row. */
+	int ConsecutiveFailures;
+
+	/** The smoothed time, in milliseconds, connections to the device take
+	 *  to open, -1 if the control point has not connected to it yet. */
+	int SmoothedRttMs;
+
+	/** The variation of {\bf SmoothedRttMs}, in milliseconds. */
+	int RttVariationMs;
+
+	/** How long the next connection to the device may take to open, in
+	 *  milliseconds. */
+	int ConnectTimeoutMs;
+
+	/** The time, in milliseconds, until an open breaker lets a request
+	 *  through, 0 if it is not open. */
+	int RetryInMs;
+};
+
+/** Filled in by {\bf UpnpGetActionStats}. All counters are cumulative
+ *  since {\bf UpnpInit}. */
+struct Upnp_Action_Stats
+{
+	/** The number of actions handed to the asynchronous action engine. */
+	unsigned long Submitted;
+
+	/** The number of actions that joined an identical action in flight
+	 *  instead of being sent, see {\bf UpnpSetActionCoalescing}. */
+	unsigned long Coalesced;
+
+	/** The number of actions still waiting for a connection that were
+	 *  replaced by a newer action of the same command class. */
+	unsigned long Replaced;
+};
+
 /** Returned along with a {\bf UPNP_EVENT_SUBSCRIBE_COMPLETE} or {\bf
  * UPNP_EVENT_UNSUBSCRIBE_COMPLETE} callback.  */
 
@@ -672,6 +894,27 @@ struct Upnp_Event_Subscribe {
   int TimeOut;              
                               
 };
+
+/** Returned along with a {\bf UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE}
+ *  callback.  */
+
+struct Upnp_Group_Subscribe_Complete
+{
+  /** The number of subscriptions in the group. */
+  int NumSubscriptions;
+
+  /** The number of subscriptions made, that is with an {\bf ErrCode} of
+   *  {\tt UPNP_E_SUCCESS}. */
+  int NumSucceeded;
+
+  /** Milliseconds from the call to {\bf UpnpSubscribeGroupAsync} to the
+   *  completion of its last subscription. */
+  int ElapsedMs;
+
+  /** The result of each subscription, in the order of the event URLs, as
+   *  for a {\bf UPNP_EVENT_SUBSCRIBE_COMPLETE} callback. */
+  struct Upnp_Event_Subscribe *Results;
+};
   
 /** Returned along with a {\bf UPNP_EVENT_SUBSCRIPTION_REQUEST}
  *  callback.  */
@@ -1282,6 +1525,45 @@ EXPORT_SPEC int UpnpSetMaxContentLength(
 	 * in bytes. */
 	size_t contentLength);
 
+/*!
+ * \brief Sets the deadline of the actions sent by the control points.
+ *
+ * The deadline covers the connection to the device, the request and the
+ * response, including the M-POST retry, and is measured on the monotonic
+ * clock. It applies to \b UpnpSendAction, \b UpnpSendActionEx and their
+ * asynchronous versions. The default is 30000 milliseconds.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Milliseconds is negative.
+ */
+EXPORT_SPEC int UpnpSetActionTimeoutMs(
+	/*! [in] Deadline in milliseconds, 0 to wait without limit. */
+	int Milliseconds);
+
+/*!
+ * \brief Gets the health of the device serving a URL.
+ *
+ * The control point tracks each device it sends actions and subscriptions
+ * to, by address and port: how long its connections take to open, which
+ * sets the connect timeout, and how many requests failed in a row. After
+ * \c HTTP_BREAKER_FAILURES failures the circuit breaker of the device opens
+ * and its requests fail at once with \c UPNP_E_DEVICE_UNREACHABLE, until a
+ * probe request succeeds.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Url or \b Health is \c NULL.
+ *     \li \c UPNP_E_INVALID_URL: \b Url is not a valid URL.
+ */
+EXPORT_SPEC int UpnpGetDeviceHealth(
+	/*! [in] A URL of the device, such as its control URL. */
+	const char *Url,
+	/*! [out] Structure receiving the health of the device. */
+	struct Upnp_Device_Health *Health);
+
 /* @} Initialization and Registration */
 
 /******************************************************************************
@@ -1335,6 +1617,80 @@ EXPORT_SPEC int UpnpSearchAsync(
 	/*! The user data to pass when the callback function is invoked. */
 	const void *Cookie_const); 
 
+/*!
+ * \brief Returns the SSDP receive counters of the SDK.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Stats is \c NULL.
+ */
+EXPORT_SPEC int UpnpGetDiscoveryStats(
+	/*! [out] Structure receiving a snapshot of the counters. */
+	struct Upnp_Discovery_Stats *Stats);
+
+/*!
+ * \brief Adds a prefix to the discovery filter.
+ *
+ * Once at least one prefix is registered, SSDP datagrams are checked as
+ * soon as they are read: a datagram is only handled if one of its NT or ST
+ * headers starts with a registered prefix. Other datagrams are dropped
+ * before any memory allocation or thread pool job.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Prefix is \c NULL, empty or too long.
+ *     \li \c UPNP_E_OUTOF_BOUNDS: Too many prefixes are registered.
+ */
+EXPORT_SPEC int UpnpAddDiscoveryFilter(
+	/*! [in] NT/ST prefix to accept, e.g. "urn:schemas-upnp-org:device:". */
+	const char *Prefix);
+
+/*!
+ * \brief Removes all the prefixes of the discovery filter, so that all SSDP
+ * datagrams are handled again.
+ */
+EXPORT_SPEC void UpnpRemoveAllDiscoveryFilters(void);
+
+/*!
+ * \brief Sets the window of the duplicate announcement cache.
+ *
+ * An advertisement or search reply with the same UID, NTS and LOCATION as
+ * one received less than \b Milliseconds ago is dropped before the callback.
+ * Search replies are checked per search: a reply is only dropped for a
+ * search that already got the same reply, so each outstanding search still
+ * sees every device. The default is \c SSDP_DEDUP_WINDOW.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Milliseconds is negative.
+ */
+EXPORT_SPEC int UpnpSetDiscoveryDedupWindow(
+	/*! [in] Window in milliseconds, 0 disables the cache. */
+	int Milliseconds);
+
+/*!
+ * \brief Enables or disables the device presence table.
+ *
+ * When enabled, every announced device is tracked by UID until the
+ * CACHE-CONTROL max-age of its last announcement, or for
+ * \c SSDP_DEFAULT_MAX_AGE seconds if it gave none. Each new announcement
+ * or search reply pushes its deadline back; a byebye removes it. A device
+ * whose deadline passes is reported once with
+ * \c UPNP_DISCOVERY_ADVERTISEMENT_EXPIRED, so the application does not need
+ * to poll for stale devices. The table is disabled by default and disabling
+ * it forgets all tracked devices.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ */
+EXPORT_SPEC int UpnpSetDevicePresence(
+	/*! [in] Non-zero to enable the table, 0 to disable it. */
+	int Enable);
+
 /*!
  * \brief Sends out the discovery announcements for all devices and services
  * for a device.
@@ -1423,6 +1779,8 @@ EXPORT_SPEC int UpnpSendAdvertisementLowPower(
  *     \li \c UPNP_E_INVALID_ACTION: This action is not valid.
  *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to 
  *             complete this operation.
+ *     \li \c UPNP_E_DEVICE_UNREACHABLE: The device failed its last
+ *             requests and is not tried again yet; no callback is made.
  */
 EXPORT_SPEC int UpnpSendActionAsync(
 	/*! [in] The handle of the control point sending the action. */
@@ -1440,6 +1798,100 @@ EXPORT_SPEC int UpnpSendActionAsync(
 	 * invoked. */
 	const void *Cookie);
 
+/*!
+ * \brief Sends the same action to a group of devices, generating a single
+ * callback once every action of the group completed.
+ *
+ * At most \b MaxInFlight actions of the group are in flight at once; the
+ * next one is sent as soon as one completes. The actions go through the
+ * same engine as \b UpnpSendActionAsync, and an action that cannot be sent,
+ * for instance because its device is unreachable, completes at once with
+ * the error. \b Fun is called with \c UPNP_CONTROL_GROUP_ACTION_COMPLETE
+ * and a \b Upnp_Group_Action_Complete structure.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The actions are on their way.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control 
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b ActionURLs, one of them, \b Body
+ *             or \b Fun is \c NULL, \b NumActions is not positive or
+ *             \b MaxInFlight is negative.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to 
+ *             complete this operation.
+ *     \li \c UPNP_E_FINISH: The action engine is not available.
+ */
+EXPORT_SPEC int UpnpSendGroupActionAsync(
+	/*! [in] The handle of the control point sending the actions. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The action URLs of the devices. */
+	const char **ActionURLs,
+	/*! [in] The number of action URLs. */
+	int NumActions,
+	/*! [in] The body of the action, sent to every device. */
+	const char *Body,
+	/*! [in] The maximum number of actions in flight, or 0 for
+	 * \c SOAP_GROUP_MAX_IN_FLIGHT. */
+	int MaxInFlight,
+	/*! [in] Pointer to a callback function to be invoked when the last
+	 * action completes. */
+	Upnp_FunPtr Fun,
+	/*! [in] Pointer to user data that to be passed to the callback when
+	 * invoked. */
+	const void *Cookie);
+
+/*!
+ * \brief Enables or disables the coalescing of asynchronous actions.
+ *
+ * When enabled, an action sent by \b UpnpSendActionAsync or
+ * \b UpnpSendGroupActionAsync with the same control URL and body as an
+ * action still in flight is not sent: it completes with the result of that
+ * action, each callback getting its own copy of the response entity. A
+ * newer action to a control URL also replaces the actions of the same
+ * command class, see \c SOAP_COALESCE_CLASS_KEY, that are still waiting
+ * for a connection to the device; they complete with its result. Coalescing
+ * is disabled by default.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ */
+EXPORT_SPEC int UpnpSetActionCoalescing(
+	/*! [in] Non-zero to enable coalescing, 0 to disable it. */
+	int Enable);
+
+/*!
+ * \brief Returns the counters of the asynchronous action engine.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Stats is \c NULL.
+ */
+EXPORT_SPEC int UpnpGetActionStats(
+	/*! [out] Structure receiving a snapshot of the counters. */
+	struct Upnp_Action_Stats *Stats);
+
+/*!
+ * \brief Takes the response entity of a \c UPNP_CONTROL_ACTION_COMPLETE
+ * event, so that it outlives the callback.
+ *
+ * The entity is not copied: the event gives its buffer up and the
+ * application frees it with \b UpnpReleaseActionEntity once done with it.
+ * This function can only be called from the callback.
+ *
+ * \return The entity, or \c NULL if the event has none.
+ */
+EXPORT_SPEC char *UpnpDetachActionEntity(
+	/*! [in,out] Event passed to the callback. */
+	struct Upnp_Action_Complete *Event);
+
+/*!
+ * \brief Frees an entity returned by \b UpnpDetachActionEntity.
+ */
+EXPORT_SPEC void UpnpReleaseActionEntity(
+	/*! [in] Entity, or \c NULL. */
+	char *Entity);
+
 /*! @} Control */
 
 /******************************************************************************
@@ -1773,6 +2225,75 @@ EXPORT_SPEC int UpnpSubscribeAsync(
 	/*! A user data value passed to the callback function when invoked. */
 	const void *Cookie);
 
+/*!
+ * \brief Subscribes to a group of services, generating a single callback
+ * once every subscription completed.
+ *
+ * At most \b MaxInFlight SUBSCRIBE requests of the group are in flight at
+ * once; the next one is sent as soon as one completes. The groups share a
+ * thread pool of their own, of \c GENA_GROUP_MAX_THREADS threads, that
+ * also bounds the requests in flight. The subscriptions
+ * are added to the control point in batches rather than one by one, and an
+ * event that arrives for a subscription of the group before it is added
+ * waits for it. \b Fun is called with
+ * \c UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE and a
+ * \b Upnp_Group_Subscribe_Complete structure; the subscriptions that
+ * succeeded are then like those made by \b UpnpSubscribe.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The subscriptions are on their way.
+ *     \li \c UPNP_E_INVALID_HANDLE: The handle is not a valid control 
+ *             point handle.
+ *     \li \c UPNP_E_INVALID_PARAM: \b PublisherUrls, one of them or
+ *             \b Fun is \c NULL, \b NumUrls is not positive, \b TimeOut
+ *             is not valid or \b MaxInFlight is negative.
+ *     \li \c UPNP_E_INVALID_URL: One of the \b PublisherUrls is too long.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to 
+ *             complete this operation.
+ */
+EXPORT_SPEC int UpnpSubscribeGroupAsync(
+	/*! [in] The handle of the control point that is subscribing. */
+	UpnpClient_Handle Hnd,
+	/*! [in] The URLs of the services to subscribe to. */
+	const char **PublisherUrls,
+	/*! [in] The number of URLs. */
+	int NumUrls,
+	/*! [in] The requested time of every subscription. */
+	int TimeOut,
+	/*! [in] The maximum number of SUBSCRIBE requests in flight, or 0 for
+	 * \c GENA_GROUP_MAX_IN_FLIGHT. */
+	int MaxInFlight,
+	/*! [in] Pointer to a callback function to be invoked when the last
+	 * subscription completes. */
+	Upnp_FunPtr Fun,
+	/*! [in] Pointer to user data that to be passed to the callback when
+	 * invoked. */
+	const void *Cookie);
+
+/*!
+ * \brief Indexes the state variables changed by an event, from the body
+ * passed to a \c UPNP_EVENT_RECEIVED callback.
+ *
+ * The first call scans the body and keeps the index in \b Event; later
+ * calls return it at once. Nothing is copied: the names and values of the
+ * index point into the body, and are valid until the callback returns.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Event, \b Properties or
+ *             \b NumProperties is \c NULL.
+ *     \li \c UPNP_E_OUTOF_MEMORY: Insufficient resources exist to 
+ *             complete this operation.
+ *     \li \c UPNP_E_EVENT_PROTOCOL: The body is not a property set.
+ */
+EXPORT_SPEC int UpnpEventGetProperties(
+	/*! [in,out] The event of the callback. */
+	struct Upnp_Event *Event,
+	/*! [out] The changed state variables, in the order of the body. */
+	const struct Upnp_Event_Property **Properties,
+	/*! [out] The number of changed state variables. */
+	int *NumProperties);
+
 /*!
  * \brief Removes the subscription of a control point from a service previously
  * subscribed to using \b UpnpSubscribe or \b UpnpSubscribeAsync.
@@ -1917,6 +2438,24 @@ EXPORT_SPEC int UpnpDownloadUrlItem(
 	 * \c LINE_SIZE bytes in size. */
 	char *contentType);
 
+/*!
+ * \brief Forgets what the SDK cached about the host and port of a URL.
+ *
+ * The SDK keeps the URLs it parsed, with the address their host resolved
+ * to, and the requests it built for them, for up to a few minutes. When a
+ * device moves, the application calls this function with its former
+ * LOCATION, so that the next requests resolve its URLs again. The SDK does
+ * it on its own when a device announces a new LOCATION or says byebye.
+ *
+ * \return An integer representing one of the following:
+ *     \li \c UPNP_E_SUCCESS: The operation completed successfully.
+ *     \li \c UPNP_E_FINISH: The SDK is not initialized.
+ *     \li \c UPNP_E_INVALID_PARAM: \b Location is \c NULL.
+ */
+EXPORT_SPEC int UpnpInvalidateLocation(
+	/*! [in] A URL of the device, such as its former LOCATION. */
+	const char *Location);
+
 /*!
  * \brief Gets a file specified in a URL.
  *
@@ -42,6 +42,10 @@
 
 #include "upnpapi.h"
 
+#include "httpconnpool.h"
+#include "httphealth.h"
+#include "httptemplate.h"
+#include "httpurlcache.h"
 #include "httpreadwrite.h"
 #include "membuffer.h"
 #include "ssdplib.h"
@@ -119,6 +123,11 @@ ThreadPool gRecvThreadPool;
 /*! Mini server thread pool. */
 ThreadPool gMiniServerThreadPool;
 
+#if defined(INCLUDE_CLIENT_APIS) && EXCLUDE_GENA == 0
+/*! Thread pool sending the subscriptions of the groups. */
+ThreadPool gSubscribeThreadPool;
+#endif
+
 /*! Flag to indicate the state of web server */
 WebServerState bWebServerState = WEB_SERVER_DISABLED;
 
@@ -155,6 +164,14 @@ extern membuffer gDocumentRootDir;
  * error 413 (HTTP Error Code) will be returned to the remote end point. */
 size_t g_maxContentLength = DEFAULT_SOAP_CONTENT_LENGTH;
 
+/*! Deadline of a SOAP action, from the connection to the end of the response,
+ * in milliseconds. */
+int g_actionTimeoutMs = UPNP_TIMEOUT * 1000;
+
+/*! TRUE if identical asynchronous actions in flight are sent once, see
+ * UpnpSetActionCoalescing. */
+int g_actionCoalescing = FALSE;
+
 /*! Global variable to denote the state of Upnp SDK == 0 if uninitialized,
  * == 1 if initialized. */
 int UpnpSdkInit = 0;
@@ -283,6 +300,17 @@ static int UpnpInitThreadPools(void)
 		goto exit_function;
 	}
 
+#if defined(INCLUDE_CLIENT_APIS) && EXCLUDE_GENA == 0
+	/* a job waits for its device: one thread per job, none when idle. */
+	TPAttrSetMaxThreads(&attr, GENA_GROUP_MAX_THREADS);
+	TPAttrSetMinThreads(&attr, 0);
+	TPAttrSetJobsPerThread(&attr, 1);
+	if (ThreadPoolInit(&gSubscribeThreadPool, &attr) != UPNP_E_SUCCESS) {
+		ret = UPNP_E_INIT_FAILED;
+		goto exit_function;
+	}
+#endif
+
 exit_function:
 	if (ret != UPNP_E_SUCCESS) {
 		UpnpSdkInit = 0;
@@ -348,6 +376,19 @@ static int UpnpInitPreamble(void)
 	}
 	HandleUnlock();
 
+#if EXCLUDE_SSDP == 0
+	/* Initialize the SSDP receive buffers and counters. */
+	retVal = ssdp_server_init();
+	if (retVal != UPNP_E_SUCCESS) {
+		return retVal;
+	}
+#endif
+
+#if EXCLUDE_GENA == 0
+	/* Hand the NOTIFY requests read by the miniserver over to GENA. */
+	SetGenaCallback(genaCallback);
+#endif
+
 	/* Initialize SDK global thread pools. */
 	retVal = UpnpInitThreadPools();
 	if (retVal != UPNP_E_SUCCESS) {
@@ -362,6 +403,11 @@ static int UpnpInitPreamble(void)
 		return retVal;
 	}
 
+#ifdef INCLUDE_CLIENT_APIS
+	/* Start the pool of connections to the devices. */
+	http_ConnPoolInit();
+#endif
+
 	return UPNP_E_SUCCESS;
 }
 
@@ -604,13 +650,26 @@ int UpnpFinish(void)
 	default:
 		break;
 	}
+#if EXCLUDE_SOAP == 0
+	SoapGroupShutdown();
+	SoapAsyncShutdown();
+#endif
+	http_ConnPoolDestroy();
+	http_TemplateFlush();
+	http_HealthFlush();
 #endif
+	http_UrlCacheFlush();
 	TimerThreadShutdown(&gTimerThread);
 #if EXCLUDE_MINISERVER == 0
 	StopMiniServer();
 #endif
 #if EXCLUDE_WEB_SERVER == 0
 	web_server_destroy();
+#endif
+#if defined(INCLUDE_CLIENT_APIS) && EXCLUDE_GENA == 0
+	ThreadPoolShutdown(&gSubscribeThreadPool);
+	PrintThreadPoolStats(&gSubscribeThreadPool, __FILE__, __LINE__,
+		"Subscribe Thread Pool");
 #endif
 	ThreadPoolShutdown(&gMiniServerThreadPool);
 	PrintThreadPoolStats(&gMiniServerThreadPool, __FILE__, __LINE__,
@@ -621,6 +680,12 @@ int UpnpFinish(void)
 	ThreadPoolShutdown(&gSendThreadPool);
 	PrintThreadPoolStats(&gRecvThreadPool, __FILE__, __LINE__,
 		"Recv Thread Pool");
+#if defined(INCLUDE_CLIENT_APIS) && EXCLUDE_SOAP == 0
+	SoapGroupFlush();
+#endif
+#if EXCLUDE_SSDP == 0
+	ssdp_server_destroy();
+#endif
 #ifdef INCLUDE_CLIENT_APIS
 	ithread_mutex_destroy(&GlobalClientSubscribeMutex);
 #endif
@@ -761,7 +826,23 @@ int UpnpRegisterClient(Upnp_FunPtr Fun, const void *Cookie,
 	HInfo->Callback = Fun;
 	HInfo->Cookie = (void *)Cookie;
 	HInfo->ClientSubList = NULL;
+	HInfo->ClientSubIdx = calloc((size_t)1, sizeof(ClientSubIndex));
+	if (HInfo->ClientSubIdx == NULL) {
+		free(HInfo);
+		HandleUnlock();
+		return UPNP_E_OUTOF_MEMORY;
+	}
 	ListInit(&HInfo->SsdpSearchList, NULL, NULL);
+#if EXCLUDE_SSDP == 0
+	HInfo->SsdpSearchIdx = calloc((size_t)1, sizeof(SsdpSearchIndex));
+	if (HInfo->SsdpSearchIdx == NULL) {
+		ListDestroy(&HInfo->SsdpSearchList, 0);
+		free(HInfo->ClientSubIdx);
+		free(HInfo);
+		HandleUnlock();
+		return UPNP_E_OUTOF_MEMORY;
+	}
+#endif
 	HandleTable[*Hnd] = HInfo;
 	UpnpSdkClientRegistered = 1;
 	HandleUnlock();
@@ -816,6 +897,13 @@ int UpnpUnRegisterClient(UpnpClient_Handle Hnd)
 		node = ListHead(&HInfo->SsdpSearchList);
 	}
 	ListDestroy(&HInfo->SsdpSearchList, 0);
+#if EXCLUDE_SSDP == 0
+	ssdp_presence_enable(FALSE);
+	ssdp_search_index_destroy(HInfo->SsdpSearchIdx);
+	free(HInfo->SsdpSearchIdx);
+#endif
+	/* emptied by genaUnregisterClient(). */
+	free(HInfo->ClientSubIdx);
 	FreeHandle(Hnd);
 	UpnpSdkClientRegistered = 0;
 	HandleUnlock();
@@ -882,6 +970,62 @@ int UpnpSearchAsync(
     return UPNP_E_SUCCESS;
 
 }
+
+int UpnpGetDiscoveryStats(struct Upnp_Discovery_Stats *Stats)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Stats == NULL) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	ssdp_get_stats(Stats);
+
+	return UPNP_E_SUCCESS;
+}
+
+int UpnpAddDiscoveryFilter(const char *Prefix)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Prefix == NULL || Prefix[0] == '\0') {
+		return UPNP_E_INVALID_PARAM;
+	}
+
+	return ssdp_add_filter(Prefix);
+}
+
+void UpnpRemoveAllDiscoveryFilters(void)
+{
+	if (UpnpSdkInit != 1) {
+		return;
+	}
+	ssdp_remove_all_filters();
+}
+
+int UpnpSetDiscoveryDedupWindow(int Milliseconds)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Milliseconds < 0) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	ssdp_set_dedup_window(Milliseconds);
+
+	return UPNP_E_SUCCESS;
+}
+
+int UpnpSetDevicePresence(int Enable)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	ssdp_presence_enable(Enable);
+
+	return UPNP_E_SUCCESS;
+}
 #endif /* INCLUDE_CLIENT_APIS */
 #endif
 
@@ -969,6 +1113,79 @@ int UpnpSubscribeAsync(
 #endif /* INCLUDE_CLIENT_APIS */
 
 
+#ifdef INCLUDE_CLIENT_APIS
+int UpnpSubscribeGroupAsync(
+	UpnpClient_Handle Hnd,
+	const char **PublisherUrls,
+	int NumUrls,
+	int TimeOut,
+	int MaxInFlight,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	struct Handle_Info *SInfo = NULL;
+	int i;
+
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	CDBG_INFO("Inside UpnpSubscribeGroupAsync\n");
+
+	HandleReadLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	HandleUnlock();
+
+	if (PublisherUrls == NULL || NumUrls <= 0 || Fun == NULL ||
+	    (TimeOut != UPNP_INFINITE && TimeOut < 1) || MaxInFlight < 0) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	for (i = 0; i < NumUrls; i++) {
+		if (PublisherUrls[i] == NULL) {
+			return UPNP_E_INVALID_PARAM;
+		}
+		if (strlen(PublisherUrls[i]) >= (size_t)NAME_SIZE) {
+			return UPNP_E_INVALID_URL;
+		}
+	}
+	if (MaxInFlight == 0) {
+		MaxInFlight = GENA_GROUP_MAX_IN_FLIGHT;
+	}
+
+	return genaSubscribeGroup(Hnd, PublisherUrls, NumUrls, TimeOut,
+		MaxInFlight, Fun, Cookie);
+}
+#endif /* INCLUDE_CLIENT_APIS */
+
+
+#ifdef INCLUDE_CLIENT_APIS
+int UpnpEventGetProperties(
+	struct Upnp_Event *Event,
+	const struct Upnp_Event_Property **Properties,
+	int *NumProperties)
+{
+	int ret_code;
+
+	if (Event == NULL || Properties == NULL || NumProperties == NULL) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	ret_code = genaEventProperties(Event);
+	if (ret_code != UPNP_E_SUCCESS) {
+		return ret_code;
+	}
+	*Properties = Event->Properties;
+	*NumProperties = Event->NumProperties;
+
+	return UPNP_E_SUCCESS;
+}
+#endif /* INCLUDE_CLIENT_APIS */
+
+
 #ifdef INCLUDE_CLIENT_APIS
 int UpnpSubscribe(
 	UpnpClient_Handle Hnd,
@@ -1306,6 +1523,7 @@ int UpnpSendActionAsync(
     ThreadPoolJob job;
     struct Handle_Info *SInfo = NULL;
     struct UpnpNonblockParam *Param;
+    int retVal;
     char *ActionURL = (char *)ActionURL_const;
     char *ServiceType = (char *)ServiceType_const;
     /* udn not used? */
@@ -1337,6 +1555,15 @@ int UpnpSendActionAsync(
 	return UPNP_E_INVALID_PARAM;
     }
 
+    /* Hand the action over to the event-driven engine; fall back to a
+     * blocking job of the send thread pool if the engine cannot run. */
+    retVal = SoapSendActionAsync( ActionURL, ServiceType, Fun, Cookie_const );
+    if( retVal != UPNP_E_FINISH ) {
+	CDBG_INFO(
+		"Exiting UpnpSendActionAsync \n");
+	return retVal;
+    }
+
     Param =
 	( struct UpnpNonblockParam * )
 	malloc( sizeof( struct UpnpNonblockParam ) );
@@ -1367,6 +1594,92 @@ int UpnpSendActionAsync(
     return UPNP_E_SUCCESS;
 }
 
+int UpnpSendGroupActionAsync(
+	UpnpClient_Handle Hnd,
+	const char **ActionURLs,
+	int NumActions,
+	const char *Body,
+	int MaxInFlight,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	struct Handle_Info *SInfo = NULL;
+	int i;
+
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	CDBG_INFO("Inside UpnpSendGroupActionAsync\n");
+
+	HandleReadLock();
+	switch (GetHandleInfo(Hnd, &SInfo)) {
+	case HND_CLIENT:
+		break;
+	default:
+		HandleUnlock();
+		return UPNP_E_INVALID_HANDLE;
+	}
+	HandleUnlock();
+
+	if (ActionURLs == NULL || NumActions <= 0 || Body == NULL ||
+	    Fun == NULL || MaxInFlight < 0) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	for (i = 0; i < NumActions; i++) {
+		if (ActionURLs[i] == NULL) {
+			return UPNP_E_INVALID_PARAM;
+		}
+	}
+	if (MaxInFlight == 0) {
+		MaxInFlight = SOAP_GROUP_MAX_IN_FLIGHT;
+	}
+
+	return SoapSendGroupActionAsync(ActionURLs, NumActions, Body,
+		MaxInFlight, Fun, Cookie);
+}
+
+int UpnpSetActionCoalescing(int Enable)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	g_actionCoalescing = Enable ? TRUE : FALSE;
+
+	return UPNP_E_SUCCESS;
+}
+
+int UpnpGetActionStats(struct Upnp_Action_Stats *Stats)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Stats == NULL) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	SoapAsyncGetStats(Stats);
+
+	return UPNP_E_SUCCESS;
+}
+
+char *UpnpDetachActionEntity(struct Upnp_Action_Complete *Event)
+{
+	char *entity;
+
+	if (Event == NULL) {
+		return NULL;
+	}
+	entity = Event->Entity;
+	Event->Entity = NULL;
+	Event->EntityLength = (size_t)0;
+
+	return entity;
+}
+
+void UpnpReleaseActionEntity(char *Entity)
+{
+	free(Entity);
+}
+
 #endif /* INCLUDE_CLIENT_APIS */
 #endif /* EXCLUDE_SOAP */
 
@@ -1492,6 +1805,20 @@ int UpnpDownloadUrlItem(const char *url, char **outBuf, char *contentType)
 	return ret_code;
 }
 
+
+int UpnpInvalidateLocation(const char *Location)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Location == NULL) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	http_InvalidateLocation(Location);
+
+	return UPNP_E_SUCCESS;
+}
+
 int UpnpGetIfInfo(const char *IfName)
 {
 	char szBuffer[MAX_INTERFACES * sizeof(struct ifreq)];
@@ -1717,10 +2044,14 @@ void UpnpThreadDistribution(struct UpnpNonblockParam *Param)
 #endif /* EXCLUDE_GENA == 0 */
 #if EXCLUDE_SOAP == 0
 	case ACTION: {
+		struct Upnp_Action_Complete Evt;
+
 		SoapSendAction(
 			Param->Url,
-			Param->ServiceType);
-		Param->Fun(UPNP_CONTROL_ACTION_COMPLETE, NULL, Param->Cookie);
+			Param->ServiceType,
+			&Evt);
+		Param->Fun(UPNP_CONTROL_ACTION_COMPLETE, &Evt, Param->Cookie);
+		UpnpReleaseActionEntity(Evt.Entity);
 		free(Param);
 		break;
 	}
@@ -2284,4 +2615,37 @@ int UpnpSetMaxContentLength(size_t contentLength)
 	return errCode;
 }
 
+int UpnpSetActionTimeoutMs(int Milliseconds)
+{
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Milliseconds < 0) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	g_actionTimeoutMs = Milliseconds;
+
+	return UPNP_E_SUCCESS;
+}
+
+#ifdef INCLUDE_CLIENT_APIS
+int UpnpGetDeviceHealth(const char *Url, struct Upnp_Device_Health *Health)
+{
+	uri_type url;
+
+	if (UpnpSdkInit != 1) {
+		return UPNP_E_FINISH;
+	}
+	if (Url == NULL || Health == NULL) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	if (http_FixStrUrl(Url, strlen(Url), &url) != UPNP_E_SUCCESS) {
+		return UPNP_E_INVALID_URL;
+	}
+	http_HealthGet(&url.hostport.IPaddress, Health);
+
+	return UPNP_E_SUCCESS;
+}
+#endif /* INCLUDE_CLIENT_APIS */
+
 /* @} UPnPAPI */
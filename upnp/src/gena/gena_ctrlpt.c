@@ -44,14 +44,18 @@
 
 
 #include "gena.h"
+#include "httpconnpool.h"
 #include "httpparser.h"
 #include "httpreadwrite.h"
+#include "httptemplate.h"
 #include "parsetools.h"
 #include "statcodes.h"
 #include "sysdep.h"
 #include "uuid.h"
 #include "upnpapi.h"
 
+#include <ctype.h>
+
 #ifdef WIN32
 	#define snprintf _snprintf
 #endif
@@ -62,16 +66,114 @@
 extern ithread_mutex_t GlobalClientSubscribeMutex;
 
 
+/*! A renewal, waiting in the timer thread or in the renewal queue. */
+typedef struct gena_renewal
+{
+	/*! Argument of the timer job; first, so that free_upnp_timeout() frees
+	 * the whole renewal. */
+	upnp_timeout timeout;
+	/*! Renewals of the subscription that failed in a row. */
+	int attempt;
+	/*! Monotonic time, in milliseconds, the subscription expires. */
+	int64_t expires;
+	/*! Next renewal of the queue. */
+	struct gena_renewal *next;
+} gena_renewal;
+
+/*! Renewals due, protected by renewMutex. */
+static gena_renewal *renewHead = NULL;
+static gena_renewal *renewTail = NULL;
+/*! Threads sending renewals, at most GENA_MAX_CONCURRENT_RENEWALS. */
+static int renewActive = 0;
+static ithread_mutex_t renewMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int gena_renew_subscription(UpnpClient_Handle client_handle,
+	const UpnpString *in_sid, int *TimeOut, const gena_renewal *renewal,
+	int *retrying);
+
+
 /*!
- * \brief This is a thread function to send the renewal just before the
- * subscription times out.
+ * \brief Tells whether two URLs have the same host and port.
  */
-static void GenaAutoRenewSubscription(
-	/*! [in] Thread data(upnp_timeout *) needed to send the renewal. */
-	IN void *input)
+static int gena_same_host(
+	/*! [in] URL. */
+	const char *url1,
+	/*! [in] URL. */
+	const char *url2)
+{
+	const char *host1 = strstr(url1, "://");
+	const char *host2 = strstr(url2, "://");
+	size_t len1;
+	size_t len2;
+
+	if (host1 == NULL || host2 == NULL) {
+		return FALSE;
+	}
+	host1 += 3;
+	host2 += 3;
+	len1 = strcspn(host1, "/");
+	len2 = strcspn(host2, "/");
+
+	return len1 == len2 && strncasecmp(host1, host2, len1) == 0;
+}
+
+
+/*!
+ * \brief Takes the next renewal out of the queue: the first one to the
+ * host of the previous renewal if there is one, so that it goes over the
+ * connection the previous renewal left in the pool, else the oldest one.
+ * Called with renewMutex held.
+ *
+ * \return The renewal, or NULL if the queue is empty.
+ */
+static gena_renewal *gena_renewal_pop(
+	/*! [in] Event URL of the previous renewal, or NULL. */
+	const char *url)
 {
-	upnp_timeout *event = (upnp_timeout *) input;
-        struct Upnp_Event_Subscribe *sub_struct = (struct Upnp_Event_Subscribe *)event->Event;
+	gena_renewal *prev = NULL;
+	gena_renewal *renewal = renewHead;
+	struct Upnp_Event_Subscribe *sub_struct;
+
+	if (url != NULL) {
+		for (; renewal != NULL; prev = renewal, renewal = renewal->next) {
+			sub_struct = (struct Upnp_Event_Subscribe *)
+				renewal->timeout.Event;
+			if (gena_same_host(url, sub_struct->PublisherUrl)) {
+				break;
+			}
+		}
+		if (renewal == NULL) {
+			prev = NULL;
+			renewal = renewHead;
+		}
+	}
+	if (renewal == NULL) {
+		return NULL;
+	}
+	if (prev == NULL) {
+		renewHead = renewal->next;
+	} else {
+		prev->next = renewal->next;
+	}
+	if (renewTail == renewal) {
+		renewTail = prev;
+	}
+	renewal->next = NULL;
+
+	return renewal;
+}
+
+
+/*!
+ * \brief Sends a renewal, or reports the expiry of the subscription when
+ * automatic renewal is off, and frees it.
+ */
+static void gena_renewal_run(
+	/*! [in] Renewal. */
+	gena_renewal *renewal)
+{
+	upnp_timeout *event = &renewal->timeout;
+	struct Upnp_Event_Subscribe *sub_struct = (struct Upnp_Event_Subscribe *)event->Event;
 	void *cookie;
 	Upnp_FunPtr callback_fun;
 	struct Handle_Info *handle_info;
@@ -79,6 +181,7 @@ static void GenaAutoRenewSubscription(
 	int eventType = 0;
 	int timeout = 0;
 	int errCode = 0;
+	int retrying = FALSE;
 	UpnpString *tmpSID = UpnpString_new();
 
 	if (AUTO_RENEW_TIME == 0) {
@@ -90,13 +193,16 @@ static void GenaAutoRenewSubscription(
 		CDBG_INFO("GENA AUTO RENEW");
 		timeout = sub_struct->TimeOut;
 		UpnpString_set_String(tmpSID, sub_struct->Sid);
-		errCode = genaRenewSubscription(
+		errCode = gena_renew_subscription(
 			event->handle,
 			tmpSID,
-			&timeout);
+			&timeout,
+			renewal,
+			&retrying);
 		sub_struct->ErrCode = errCode;
 		sub_struct->TimeOut = timeout;
-		if (errCode != UPNP_E_SUCCESS &&
+		if (!retrying &&
+		    errCode != UPNP_E_SUCCESS &&
 		    errCode != GENA_E_BAD_SID &&
 		    errCode != GENA_E_BAD_HANDLE) {
 			send_callback = 1;
@@ -129,20 +235,82 @@ end_function:
 
 
 /*!
- * \brief Schedules a job to renew the subscription just before time out.
+ * \brief This is a thread function to send the renewal just before the
+ * subscription times out.
  *
- * \return GENA_E_SUCCESS if successful, otherwise returns the appropriate
+ * The renewal joins the queue of the renewals due. Up to
+ * GENA_MAX_CONCURRENT_RENEWALS of these jobs then send the renewals of the
+ * queue until it is empty; the others return at once.
+ */
+static void GenaAutoRenewSubscription(
+	/*! [in] Thread data(gena_renewal *) needed to send the renewal. */
+	IN void *input)
+{
+	gena_renewal *renewal = (gena_renewal *)input;
+	struct Upnp_Event_Subscribe *sub_struct;
+	char url[NAME_SIZE];
+	int work;
+
+	renewal->next = NULL;
+	ithread_mutex_lock(&renewMutex);
+	if (renewTail == NULL) {
+		renewHead = renewal;
+	} else {
+		renewTail->next = renewal;
+	}
+	renewTail = renewal;
+	work = renewActive < GENA_MAX_CONCURRENT_RENEWALS;
+	if (work) {
+		renewActive++;
+	}
+	ithread_mutex_unlock(&renewMutex);
+	if (!work) {
+		/* a running job sends it. */
+		return;
+	}
+
+	url[0] = '\0';
+	for (;;) {
+		ithread_mutex_lock(&renewMutex);
+		renewal = gena_renewal_pop(url[0] != '\0' ? url : NULL);
+		if (renewal == NULL) {
+			renewActive--;
+			ithread_mutex_unlock(&renewMutex);
+			break;
+		}
+		ithread_mutex_unlock(&renewMutex);
+		sub_struct = (struct Upnp_Event_Subscribe *)
+			renewal->timeout.Event;
+		memcpy(url, sub_struct->PublisherUrl, sizeof(url));
+		url[sizeof(url) - 1] = '\0';
+		gena_renewal_run(renewal);
+	}
+}
+
+
+/*!
+ * \brief Schedules a renewal of a subscription. Called with the handle
+ * lock held.
+ *
+ * \return GENA_SUCCESS if successful, otherwise returns the appropriate
  * 	error code.
  */
-static int ScheduleGenaAutoRenew(
+static int gena_renewal_schedule(
 	/*! [in] Handle that also contains the subscription list. */
 	IN int client_handle,
+	/*! [in] Subscription being renewed. */
+	IN ClientSubscription *sub,
+	/*! [in] Milliseconds before the renewal is sent. */
+	IN int64_t delay_ms,
 	/*! [in] The time out value of the subscription. */
 	IN int TimeOut,
-	/*! [in] Subscription being renewed. */
-	IN ClientSubscription *sub)
+	/*! [in] Renewals of the subscription that failed in a row. */
+	IN int attempt,
+	/*! [in] Monotonic time, in milliseconds, the subscription expires. */
+	IN int64_t expires)
 {
 	struct Upnp_Event_Subscribe *RenewEventStruct = NULL;
+	gena_renewal *renewal = NULL;
 	upnp_timeout *RenewEvent = NULL;
 	int return_code = GENA_SUCCESS;
 	ThreadPoolJob job;
@@ -151,11 +319,6 @@ static int ScheduleGenaAutoRenew(
 
 	memset(&job, 0, sizeof(job));
 
-	if (TimeOut == UPNP_INFINITE) {
-		return_code = GENA_SUCCESS;
-		goto end_function;
-	}
-
 	RenewEventStruct = (struct Upnp_Event_Subscribe *)malloc(sizeof (struct Upnp_Event_Subscribe));
 	if (RenewEventStruct == NULL) {
 		return_code = UPNP_E_OUTOF_MEMORY;
@@ -163,13 +326,14 @@ static int ScheduleGenaAutoRenew(
 	}
 	memset(RenewEventStruct, 0, sizeof(struct Upnp_Event_Subscribe));
 
-	RenewEvent = (upnp_timeout *) malloc(sizeof(upnp_timeout));
-	if (RenewEvent == NULL) {
+	renewal = (gena_renewal *)malloc(sizeof(gena_renewal));
+	if (renewal == NULL) {
 		free(RenewEventStruct);
 		return_code = UPNP_E_OUTOF_MEMORY;
 		goto end_function;
 	}
-	memset(RenewEvent, 0, sizeof(upnp_timeout));
+	memset(renewal, 0, sizeof(gena_renewal));
+	RenewEvent = &renewal->timeout;
 
 	/* schedule expire event */
 	RenewEventStruct->ErrCode = UPNP_E_SUCCESS;
@@ -182,20 +346,22 @@ static int ScheduleGenaAutoRenew(
 	/* RenewEvent->EventType=UPNP_EVENT_SUBSCRIPTION_EXPIRE; */
 	RenewEvent->handle = client_handle;
 	RenewEvent->Event = RenewEventStruct;
+	renewal->attempt = attempt;
+	renewal->expires = expires;
 
-	TPJobInit(&job, (start_routine) GenaAutoRenewSubscription, RenewEvent);
+	TPJobInit(&job, (start_routine) GenaAutoRenewSubscription, renewal);
 	TPJobSetFreeFunction(&job, (free_routine)free_upnp_timeout);
 	TPJobSetPriority(&job, MED_PRIORITY);
 
 	/* Schedule the job */
 	return_code = TimerThreadSchedule(
 		&gTimerThread,
-		TimeOut - AUTO_RENEW_TIME,
-		REL_SEC,
+		(time_t)(delay_ms > 0 ? delay_ms : 0),
+		REL_MSEC,
 		&job, SHORT_TERM,
 		&(RenewEvent->eventId));
 	if (return_code != UPNP_E_SUCCESS) {
-		free(RenewEvent);
+		free(renewal);
 		free(RenewEventStruct);
 		goto end_function;
 	}
@@ -209,6 +375,132 @@ end_function:
 }
 
 
+/*!
+ * \brief Schedules a job to renew the subscription just before time out.
+ *
+ * The renewal is sent at a random time of the last GENA_RENEW_JITTER
+ * percent of the subscription time before AUTO_RENEW_TIME, never before
+ * half of the subscription time, so that subscriptions made together are
+ * renewed at different times.
+ *
+ * \return GENA_E_SUCCESS if successful, otherwise returns the appropriate
+ * 	error code.
+ */
+static int ScheduleGenaAutoRenew(
+	/*! [in] Handle that also contains the subscription list. */
+	IN int client_handle,
+	/*! [in] The time out value of the subscription. */
+	IN int TimeOut,
+	/*! [in] Subscription being renewed. */
+	IN ClientSubscription *sub)
+{
+	int64_t renew_ms;
+	int64_t spread_ms;
+
+	if (TimeOut == UPNP_INFINITE) {
+		return GENA_SUCCESS;
+	}
+
+	renew_ms = (int64_t)(TimeOut - AUTO_RENEW_TIME) * 1000;
+	spread_ms = (int64_t)TimeOut * GENA_RENEW_JITTER * 10;
+	if (spread_ms > renew_ms - (int64_t)TimeOut * 500) {
+		spread_ms = renew_ms - (int64_t)TimeOut * 500;
+	}
+	if (spread_ms > 0) {
+		renew_ms -= (int64_t)rand() * (spread_ms + 1) /
+			((int64_t)RAND_MAX + 1);
+	}
+
+	return gena_renewal_schedule(client_handle, sub, renew_ms, TimeOut, 0,
+		sock_monotonic_ms() + (int64_t)TimeOut * 1000);
+}
+
+
+/*!
+ * \brief Renders the template of an UNSUBSCRIBE request: the SID goes
+ * between head and tail.
+ */
+static int gena_build_unsubscribe(
+	/*! [in] Event URL of the service. */
+	const uri_type *url,
+	/*! [in,out] Head of the template. */
+	membuffer *head,
+	/*! [in,out] Tail of the template. */
+	membuffer *tail)
+{
+	if (http_MakeMessage(head, 1, 1, "q",
+		HTTPMETHOD_UNSUBSCRIBE, url) != 0 ||
+	    http_MakeMessage(tail, 1, 1, "Uc") != 0) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return 0;
+}
+
+
+/*!
+ * \brief Renders the template of a renewal: the SID and TIMEOUT go between
+ * head and tail.
+ */
+static int gena_build_renew(
+	/*! [in] Event URL of the service. */
+	const uri_type *url,
+	/*! [in,out] Head of the template. */
+	membuffer *head,
+	/*! [in,out] Tail of the template. */
+	membuffer *tail)
+{
+	if (http_MakeMessage(head, 1, 1, "q",
+		HTTPMETHOD_SUBSCRIBE, url) != 0 ||
+	    http_MakeMessage(tail, 1, 1, "c") != 0) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return 0;
+}
+
+
+/*!
+ * \brief Renders the template of a first subscription: the head ends with
+ * the CALLBACK and NT headers, the TIMEOUT goes between head and tail.
+ */
+static int gena_build_subscribe(
+	/*! [in] Event URL of the service. */
+	const uri_type *url,
+	/*! [in,out] Head of the template. */
+	membuffer *head,
+	/*! [in,out] Tail of the template. */
+	membuffer *tail)
+{
+	int return_code;
+
+	if (url->hostport.IPaddress.ss_family == AF_INET6) {
+		const struct sockaddr_in6* DestAddr6 = (const struct sockaddr_in6*)&url->hostport.IPaddress;
+		return_code = http_MakeMessage(
+			head, 1, 1,
+			"q" "sssdsc" "sc",
+			HTTPMETHOD_SUBSCRIBE, url,
+			"CALLBACK: <http://[",
+			(IN6_IS_ADDR_LINKLOCAL(&DestAddr6->sin6_addr) || strlen(gIF_IPV6_ULA_GUA) == 0) ?
+				gIF_IPV6 : gIF_IPV6_ULA_GUA,
+			"]:", LOCAL_PORT_V6, "/>",
+			"NT: upnp:event");
+	} else {
+		return_code = http_MakeMessage(
+			head, 1, 1,
+			"q" "sssdsc" "sc",
+			HTTPMETHOD_SUBSCRIBE, url,
+			"CALLBACK: <http://", gIF_IPV4, ":", LOCAL_PORT_V4, "/>",
+			"NT: upnp:event");
+	}
+	if (return_code != 0 || http_MakeMessage(tail, 1, 1, "c") != 0) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return 0;
+}
+
+
 /*!
  * \brief Sends the UNSUBCRIBE gena request and recieves the response from the
  * 	device and returns it as a parameter.
@@ -224,26 +516,23 @@ static int gena_unsubscribe(
 	OUT http_parser_t *response )
 {
 	int return_code;
-	uri_type dest_url;
+	struct sockaddr_storage dest;
 	membuffer request;
-
-	/* parse url */
-	return_code = http_FixStrUrl(
-		UpnpString_get_String(url),
-		UpnpString_get_Length(url),
-		&dest_url);
-	if (return_code != 0) {
-		return return_code;
-	}
+	memptr vars[3];
+	int timeout_ms = sock_timeout_ms(HTTP_DEFAULT_TIMEOUT);
 
 	/* make request msg */
+	vars[0].buf = "SID: ";
+	vars[0].length = strlen(vars[0].buf);
+	vars[1].buf = (char *)UpnpString_get_String(sid);
+	vars[1].length = UpnpString_get_Length(sid);
+	vars[2].buf = "\r\n";
+	vars[2].length = strlen(vars[2].buf);
 	membuffer_init(&request);
-	request.size_inc = 30;
-	return_code = http_MakeMessage(
-		&request, 1, 1,
-		"q" "ssc" "Uc",
-		HTTPMETHOD_UNSUBSCRIBE, &dest_url,
-		"SID: ", UpnpString_get_String(sid));
+	return_code = http_TemplateRender(HTTP_TEMPLATE_GENA_UNSUBSCRIBE,
+		UpnpString_get_String(url), UpnpString_get_Length(url),
+		gena_build_unsubscribe, vars, (size_t)3, NULL, (size_t)0,
+		&request, &dest);
 
 	/* Not able to make the message so destroy the existing buffer */
 	if (return_code != 0) {
@@ -253,9 +542,9 @@ static int gena_unsubscribe(
 	}
 
 	/* send request and get reply */
-	return_code = http_RequestAndResponse(
-		&dest_url, request.buf, request.length,
-		HTTPMETHOD_UNSUBSCRIBE, HTTP_DEFAULT_TIMEOUT, response);
+	return_code = http_PooledRequestAndResponse(
+		&dest, request.buf, request.length,
+		HTTPMETHOD_UNSUBSCRIBE, &timeout_ms, response);
 	membuffer_destroy(&request);
 	if (return_code != 0) {
 		httpmsg_destroy(&response->msg);
@@ -293,9 +582,12 @@ static int gena_subscribe(
 	memptr timeout_hdr;
 	char timeout_str[25];
 	membuffer request;
-	uri_type dest_url;
+	memptr vars[6];
+	size_t num_vars = (size_t)0;
+	struct sockaddr_storage dest;
 	http_parser_t response;
 	int rc = 0;
+	int timeout_ms = sock_timeout_ms(HTTP_DEFAULT_TIMEOUT);
 
 	UpnpString_clear(sid);
 
@@ -315,59 +607,52 @@ static int gena_subscribe(
 	if (rc < 0 || (unsigned int) rc >= sizeof(timeout_str))
 		return UPNP_E_OUTOF_MEMORY;
 
-	/* parse url */
-	return_code = http_FixStrUrl(
-		UpnpString_get_String(url),
-		UpnpString_get_Length(url),
-		&dest_url);
-	if (return_code != 0) {
-		return return_code;
-	}
-
 	/* make request msg */
 	membuffer_init(&request);
-	request.size_inc = 30;
+	if (renewal_sid) {
+		vars[num_vars].buf = "SID: ";
+		vars[num_vars].length = strlen(vars[num_vars].buf);
+		num_vars++;
+		vars[num_vars].buf = (char *)UpnpString_get_String(renewal_sid);
+		vars[num_vars].length = UpnpString_get_Length(renewal_sid);
+		num_vars++;
+		vars[num_vars].buf = "\r\n";
+		vars[num_vars].length = strlen(vars[num_vars].buf);
+		num_vars++;
+	}
+	vars[num_vars].buf = "TIMEOUT: Second-";
+	vars[num_vars].length = strlen(vars[num_vars].buf);
+	num_vars++;
+	vars[num_vars].buf = timeout_str;
+	vars[num_vars].length = strlen(timeout_str);
+	num_vars++;
+	vars[num_vars].buf = "\r\n";
+	vars[num_vars].length = strlen(vars[num_vars].buf);
+	num_vars++;
 	if (renewal_sid) {
 		/* renew subscription */
-		return_code = http_MakeMessage(
-			&request, 1, 1,
-			"q" "ssc" "sscc",
-			HTTPMETHOD_SUBSCRIBE, &dest_url,
-			"SID: ", UpnpString_get_String(renewal_sid),
-			"TIMEOUT: Second-", timeout_str );
+		return_code = http_TemplateRender(HTTP_TEMPLATE_GENA_RENEW,
+			UpnpString_get_String(url), UpnpString_get_Length(url),
+			gena_build_renew, vars, num_vars, NULL, (size_t)0,
+			&request, &dest);
 	} else {
 		/* subscribe */
-		if (dest_url.hostport.IPaddress.ss_family == AF_INET6) {
-			struct sockaddr_in6* DestAddr6 = (struct sockaddr_in6*)&dest_url.hostport.IPaddress;
-			return_code = http_MakeMessage(
-				&request, 1, 1,
-				"q" "sssdsc" "sc" "sscc",
-				HTTPMETHOD_SUBSCRIBE, &dest_url,
-				"CALLBACK: <http://[",
-				(IN6_IS_ADDR_LINKLOCAL(&DestAddr6->sin6_addr) || strlen(gIF_IPV6_ULA_GUA) == 0) ?
-					gIF_IPV6 : gIF_IPV6_ULA_GUA,
-				"]:", LOCAL_PORT_V6, "/>",
-				"NT: upnp:event",
-				"TIMEOUT: Second-", timeout_str);
-		} else {
-			return_code = http_MakeMessage(
-				&request, 1, 1,
-				"q" "sssdsc" "sc" "sscc",
-				HTTPMETHOD_SUBSCRIBE, &dest_url,
-				"CALLBACK: <http://", gIF_IPV4, ":", LOCAL_PORT_V4, "/>",
-				"NT: upnp:event",
-				"TIMEOUT: Second-", timeout_str);
-		}
+		return_code = http_TemplateRender(HTTP_TEMPLATE_GENA_SUBSCRIBE,
+			UpnpString_get_String(url), UpnpString_get_Length(url),
+			gena_build_subscribe, vars, num_vars, NULL, (size_t)0,
+			&request, &dest);
 	}
 	if (return_code != 0) {
+		membuffer_destroy(&request);
+
 		return return_code;
 	}
 
 	/* send request and get reply */
-	return_code = http_RequestAndResponse(&dest_url, request.buf,
+	return_code = http_PooledRequestAndResponse(&dest, request.buf,
 		request.length,
 		HTTPMETHOD_SUBSCRIBE,
-		HTTP_DEFAULT_TIMEOUT,
+		&timeout_ms,
 		&response);
 	membuffer_destroy(&request);
 
@@ -438,7 +723,7 @@ int genaUnregisterClient(UpnpClient_Handle client_handle)
 		}
 		UpnpClientSubscription_assign(sub_copy, handle_info->ClientSubList);
 		RemoveClientSubClientSID(
-			&handle_info->ClientSubList,
+			&handle_info->ClientSubList, handle_info->ClientSubIdx,
 			UpnpClientSubscription_get_SID(sub_copy));
 
 		HandleUnlock();
@@ -480,7 +765,7 @@ int genaUnSubscribe(
 		return_code = GENA_E_BAD_HANDLE;
 		goto exit_function;
 	}
-	sub = GetClientSubClientSID(handle_info->ClientSubList, in_sid);
+	sub = GetClientSubClientSID(handle_info->ClientSubIdx, in_sid);
 	if (sub == NULL) {
 		HandleUnlock();
 		return_code = GENA_E_BAD_SID;
@@ -504,7 +789,8 @@ int genaUnSubscribe(
 		return_code = GENA_E_BAD_HANDLE;
 		goto exit_function;
 	}
-	RemoveClientSubClientSID(&handle_info->ClientSubList, in_sid);
+	RemoveClientSubClientSID(&handle_info->ClientSubList,
+		handle_info->ClientSubIdx, in_sid);
 	HandleUnlock();
 
 exit_function:
@@ -515,25 +801,66 @@ exit_function:
 
 
 #ifdef INCLUDE_CLIENT_APIS
-int genaSubscribe(
-	UpnpClient_Handle client_handle,
+/*!
+ * \brief Creates the entry of a subscription accepted by its device, with a
+ * new client SID.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_OUTOF_MEMORY.
+ */
+static int gena_client_sub_new(
+	/*! [in] URL of the service. */
 	const UpnpString *PublisherURL,
-	int *TimeOut,
-	UpnpString *out_sid)
+	/*! [in] SID returned by the device. */
+	const UpnpString *ActualSID,
+	/*! [out] SID of the subscription for the application. */
+	UpnpString *out_sid,
+	/*! [out] The entry, not in the table yet. */
+	ClientSubscription **sub)
 {
-	int return_code = GENA_SUCCESS;
-	ClientSubscription *newSubscription = UpnpClientSubscription_new();
+	ClientSubscription *newSubscription = NULL;
 	uuid_upnp uid;
 	Upnp_SID temp_sid;
 	Upnp_SID temp_sid2;
-	UpnpString *ActualSID = UpnpString_new();
-	UpnpString *EventURL = UpnpString_new();
-	struct Handle_Info *handle_info;
 	int rc = 0;
 
 	memset(temp_sid, 0, sizeof(temp_sid));
 	memset(temp_sid2, 0, sizeof(temp_sid2));
 
+	/* generate client SID */
+	uuid_create(&uid );
+	uuid_unpack(&uid, temp_sid);
+	rc = snprintf(temp_sid2, sizeof(temp_sid2), "uuid:%s", temp_sid);
+	if (rc < 0 || (unsigned int) rc >= sizeof(temp_sid2)) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	UpnpString_set_String(out_sid, temp_sid2);
+
+	/* fill subscription */
+	newSubscription = UpnpClientSubscription_new();
+	if (newSubscription == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	UpnpClientSubscription_set_RenewEventId(newSubscription, -1);
+	UpnpClientSubscription_set_SID(newSubscription, out_sid);
+	UpnpClientSubscription_set_ActualSID(newSubscription, ActualSID);
+	UpnpClientSubscription_set_EventURL(newSubscription, PublisherURL);
+	*sub = newSubscription;
+
+	return UPNP_E_SUCCESS;
+}
+
+
+int genaSubscribe(
+	UpnpClient_Handle client_handle,
+	const UpnpString *PublisherURL,
+	int *TimeOut,
+	UpnpString *out_sid)
+{
+	int return_code = GENA_SUCCESS;
+	ClientSubscription *newSubscription = NULL;
+	UpnpString *ActualSID = UpnpString_new();
+	struct Handle_Info *handle_info;
+
 	CDBG_INFO("GENA SUBSCRIBE BEGIN");
 
 	UpnpString_clear(out_sid);
@@ -563,37 +890,25 @@ int genaSubscribe(
 		goto error_handler;
 	}
 
-	/* generate client SID */
-	uuid_create(&uid );
-	uuid_unpack(&uid, temp_sid);
-	rc = snprintf(temp_sid2, sizeof(temp_sid2), "uuid:%s", temp_sid);
-	if (rc < 0 || (unsigned int) rc >= sizeof(temp_sid2)) {
-		return_code = UPNP_E_OUTOF_MEMORY;
-		goto error_handler;
-	}
-	UpnpString_set_String(out_sid, temp_sid2);
-
-	/* create event url */
-	UpnpString_assign(EventURL, PublisherURL);
-
-	/* fill subscription */
-	if (newSubscription == NULL) {
-		return_code = UPNP_E_OUTOF_MEMORY;
+	return_code = gena_client_sub_new(PublisherURL, ActualSID, out_sid,
+		&newSubscription);
+	if (return_code != UPNP_E_SUCCESS) {
 		goto error_handler;
 	}
-	UpnpClientSubscription_set_RenewEventId(newSubscription, -1);
-	UpnpClientSubscription_set_SID(newSubscription, out_sid);
-	UpnpClientSubscription_set_ActualSID(newSubscription, ActualSID);
-	UpnpClientSubscription_set_EventURL(newSubscription, EventURL);
-	UpnpClientSubscription_set_Next(newSubscription, handle_info->ClientSubList);
-	handle_info->ClientSubList = newSubscription;
+	AddClientSub(&handle_info->ClientSubList, handle_info->ClientSubIdx,
+		newSubscription);
 
 	/* schedule expiration event */
 	return_code = ScheduleGenaAutoRenew(client_handle, *TimeOut, newSubscription);
+	if (return_code != UPNP_E_SUCCESS) {
+		/* freed with the table entry. */
+		RemoveClientSubClientSID(&handle_info->ClientSubList,
+			handle_info->ClientSubIdx, out_sid);
+		newSubscription = NULL;
+	}
 
 error_handler:
 	UpnpString_delete(ActualSID);
-	UpnpString_delete(EventURL);
 	if (return_code != UPNP_E_SUCCESS)
 		UpnpClientSubscription_delete(newSubscription);
 	HandleUnlock();
@@ -601,13 +916,418 @@ error_handler:
 
 	return return_code;
 }
+
+
+/*! A group of subscriptions sent by genaSubscribeGroup(). */
+typedef struct gena_group
+{
+	/*! Protects next, active, succeeded, ready and numReady. */
+	ithread_mutex_t mutex;
+	UpnpClient_Handle handle;
+	int num;
+	/*! Next subscription to send. */
+	int next;
+	/*! Jobs sending the subscriptions of the group. */
+	int active;
+	int succeeded;
+	/*! Monotonic time, in milliseconds, the group was sent. */
+	int64_t start;
+	Upnp_FunPtr Fun;
+	const void *Cookie;
+	/*! Entries of the subscriptions accepted by their device. */
+	ClientSubscription **subs;
+	/*! Subscriptions accepted by their device and not in the table yet. */
+	int *ready;
+	int numReady;
+	struct Upnp_Event_Subscribe *results;
+	/*! Next group of groupList. */
+	struct gena_group *groupNext;
+} gena_group;
+
+/*! Groups being sent, and their subscriptions sent and not in the table
+ * yet, protected by groupMutex. */
+static gena_group *groupList = NULL;
+static int groupPending = 0;
+static ithread_mutex_t groupMutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t groupCond = PTHREAD_COND_INITIALIZER;
+
+
+/*!
+ * \brief Puts the subscriptions of a group accepted since the last call in
+ * the table, in one batch, and schedules their renewal.
+ *
+ * \note groupMutex must be locked.
+ */
+static void gena_group_flush(
+	/*! [in] Group. */
+	gena_group *group)
+{
+	struct Handle_Info *handle_info;
+	struct Upnp_Event_Subscribe *result;
+	ClientSubscription *sub;
+	int valid;
+	int num;
+	int i;
+
+	ithread_mutex_lock(&group->mutex);
+	num = group->numReady;
+	if (num == 0) {
+		ithread_mutex_unlock(&group->mutex);
+		return;
+	}
+	HandleLock();
+	valid = GetHandleInfo(group->handle, &handle_info) == HND_CLIENT;
+	for (i = 0; i < num; i++) {
+		result = &group->results[group->ready[i]];
+		sub = group->subs[group->ready[i]];
+		group->subs[group->ready[i]] = NULL;
+		if (!valid) {
+			result->ErrCode = GENA_E_BAD_HANDLE;
+			UpnpClientSubscription_delete(sub);
+			continue;
+		}
+		AddClientSub(&handle_info->ClientSubList,
+			handle_info->ClientSubIdx, sub);
+		result->ErrCode = ScheduleGenaAutoRenew(group->handle,
+			result->TimeOut, sub);
+		if (result->ErrCode != UPNP_E_SUCCESS) {
+			/* freed with the table entry. */
+			RemoveClientSubClientSID(&handle_info->ClientSubList,
+				handle_info->ClientSubIdx,
+				UpnpClientSubscription_get_SID(sub));
+			continue;
+		}
+		group->succeeded++;
+	}
+	HandleUnlock();
+	group->numReady = 0;
+	ithread_mutex_unlock(&group->mutex);
+
+	groupPending -= num;
+	ithread_cond_broadcast(&groupCond);
+}
+
+
+/*!
+ * \brief Removes a group from groupList.
+ *
+ * \note groupMutex must be locked.
+ */
+static void gena_group_unlink(
+	/*! [in] Group. */
+	gena_group *group)
+{
+	gena_group **prev = &groupList;
+
+	while (*prev != group) {
+		prev = &(*prev)->groupNext;
+	}
+	*prev = group->groupNext;
+}
+
+
+/*!
+ * \brief Waits until the subscription of an event that has none is put in
+ * the table, in case it belongs to a group being sent. The subscriptions
+ * of the groups accepted meanwhile are put in the table at once.
+ *
+ * \return TRUE if the subscription was put in the table.
+ */
+static int gena_group_wait(
+	/*! [in] SID of the event. */
+	token *sid)
+{
+	struct Handle_Info *handle_info;
+	UpnpClient_Handle client_handle;
+	gena_group *group;
+	struct timespec deadline;
+	struct timeval tv;
+	int found = FALSE;
+
+	/* the subscription was sent before its event arrived: its response
+	 * comes within HTTP_DEFAULT_TIMEOUT. */
+	gettimeofday(&tv, NULL);
+	deadline.tv_sec = tv.tv_sec + HTTP_DEFAULT_TIMEOUT;
+	deadline.tv_nsec = tv.tv_usec * 1000L;
+	ithread_mutex_lock(&groupMutex);
+	while (groupPending > 0) {
+		for (group = groupList; group != NULL;
+		     group = group->groupNext) {
+			gena_group_flush(group);
+		}
+		HandleReadLock();
+		found = GetClientHandleInfo(&client_handle, &handle_info) ==
+			HND_CLIENT &&
+			GetClientSubActualSID(handle_info->ClientSubIdx,
+				sid) != NULL;
+		HandleUnlock();
+		if (found || groupPending == 0 ||
+		    ithread_cond_timedwait(&groupCond, &groupMutex,
+			&deadline) == ETIMEDOUT) {
+			break;
+		}
+	}
+	ithread_mutex_unlock(&groupMutex);
+
+	return found;
+}
+
+
+/*!
+ * \brief Sends a subscription of a group. An accepted subscription waits
+ * for the next gena_group_flush(), done at once by the events waiting in
+ * gena_group_wait().
+ */
+static void gena_group_subscribe(
+	/*! [in] Group. */
+	gena_group *group,
+	/*! [in] Index of the subscription. */
+	int index)
+{
+	struct Upnp_Event_Subscribe *result = &group->results[index];
+	UpnpString *url = UpnpString_new();
+	UpnpString *ActualSID = UpnpString_new();
+	UpnpString *sid = UpnpString_new();
+	ClientSubscription *sub = NULL;
+
+	ithread_mutex_lock(&groupMutex);
+	groupPending++;
+	ithread_mutex_unlock(&groupMutex);
+
+	UpnpString_set_String(url, result->PublisherUrl);
+	result->ErrCode = gena_subscribe(url, &result->TimeOut, NULL,
+		ActualSID);
+	if (result->ErrCode == UPNP_E_SUCCESS) {
+		result->ErrCode = gena_client_sub_new(url, ActualSID, sid,
+			&sub);
+	}
+	if (result->ErrCode == UPNP_E_SUCCESS) {
+		strncpy(result->Sid, UpnpString_get_String(sid),
+			sizeof(result->Sid) - 1);
+		ithread_mutex_lock(&group->mutex);
+		group->subs[index] = sub;
+		group->ready[group->numReady++] = index;
+		ithread_mutex_unlock(&group->mutex);
+	} else {
+		CDBG_ERROR("SUBSCRIBE to %s failed: %d\n",
+			result->PublisherUrl, result->ErrCode);
+	}
+
+	ithread_mutex_lock(&groupMutex);
+	if (result->ErrCode != UPNP_E_SUCCESS) {
+		groupPending--;
+	}
+	ithread_cond_broadcast(&groupCond);
+	ithread_mutex_unlock(&groupMutex);
+
+	UpnpString_delete(sid);
+	UpnpString_delete(ActualSID);
+	UpnpString_delete(url);
+}
+
+
+/*!
+ * \brief Frees a group.
+ */
+static void gena_group_free(
+	/*! [in] Group. */
+	gena_group *group)
+{
+	ithread_mutex_destroy(&group->mutex);
+	free(group->results);
+	free(group->ready);
+	free(group->subs);
+	free(group);
+}
+
+
+/*!
+ * \brief Ends a job of a group. The last one puts the remaining
+ * subscriptions in the table, calls the callback of the group and frees
+ * it.
+ */
+static void gena_group_release(
+	/*! [in] Group. */
+	gena_group *group,
+	/*! [in] Number of jobs ended. */
+	int jobs)
+{
+	struct Upnp_Group_Subscribe_Complete event;
+	int last;
+
+	ithread_mutex_lock(&group->mutex);
+	group->active -= jobs;
+	last = group->active == 0;
+	ithread_mutex_unlock(&group->mutex);
+	if (!last) {
+		return;
+	}
+
+	ithread_mutex_lock(&groupMutex);
+	gena_group_unlink(group);
+	gena_group_flush(group);
+	ithread_mutex_unlock(&groupMutex);
+	event.NumSubscriptions = group->num;
+	event.NumSucceeded = group->succeeded;
+	event.ElapsedMs = (int)(sock_monotonic_ms() - group->start);
+	event.Results = group->results;
+	CDBG_INFO("Group of %d subscriptions completed in %d ms, %d "
+		"succeeded\n", event.NumSubscriptions, event.ElapsedMs,
+		event.NumSucceeded);
+	group->Fun(UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE, &event,
+		(void *)group->Cookie);
+	gena_group_free(group);
+}
+
+
+/*!
+ * \brief Sends subscriptions of a group until none is left. Job of the
+ * subscribe thread pool.
+ */
+static void gena_group_send(
+	/*! [in] Group. */
+	gena_group *group)
+{
+	int index;
+
+	for (;;) {
+		ithread_mutex_lock(&group->mutex);
+		index = group->next < group->num ? group->next++ : -1;
+		ithread_mutex_unlock(&group->mutex);
+		if (index < 0) {
+			break;
+		}
+		gena_group_subscribe(group, index);
+	}
+	gena_group_release(group, 1);
+}
+
+
+int genaSubscribeGroup(
+	UpnpClient_Handle client_handle,
+	const char **PublisherURLs,
+	int num_urls,
+	int TimeOut,
+	int max_in_flight,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	gena_group *group;
+	ThreadPoolJob job;
+	int jobs;
+	int i;
+
+	group = (gena_group *)calloc((size_t)1, sizeof(gena_group));
+	if (group == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	group->subs = (ClientSubscription **)calloc((size_t)num_urls,
+		sizeof(ClientSubscription *));
+	group->ready = (int *)calloc((size_t)num_urls, sizeof(int));
+	group->results = (struct Upnp_Event_Subscribe *)calloc(
+		(size_t)num_urls, sizeof(struct Upnp_Event_Subscribe));
+	if (group->subs == NULL || group->ready == NULL ||
+	    group->results == NULL) {
+		free(group->results);
+		free(group->ready);
+		free(group->subs);
+		free(group);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	ithread_mutex_init(&group->mutex, NULL);
+	for (i = 0; i < num_urls; i++) {
+		strncpy(group->results[i].PublisherUrl, PublisherURLs[i],
+			sizeof(group->results[i].PublisherUrl) - 1);
+		group->results[i].TimeOut = TimeOut;
+	}
+	group->handle = client_handle;
+	group->num = num_urls;
+	group->Fun = Fun;
+	group->Cookie = Cookie;
+	group->start = sock_monotonic_ms();
+	jobs = num_urls < max_in_flight ? num_urls : max_in_flight;
+	/* no job ends the group before they are all added. */
+	group->active = jobs;
+	ithread_mutex_lock(&groupMutex);
+	group->groupNext = groupList;
+	groupList = group;
+	ithread_mutex_unlock(&groupMutex);
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)gena_group_send, group);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	for (i = 0; i < jobs; i++) {
+		if (ThreadPoolAdd(&gSubscribeThreadPool, &job, NULL) != 0) {
+			break;
+		}
+	}
+	if (i == 0) {
+		ithread_mutex_lock(&groupMutex);
+		gena_group_unlink(group);
+		ithread_mutex_unlock(&groupMutex);
+		gena_group_free(group);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	if (i < jobs) {
+		/* job queue full: the jobs added send the whole group. */
+		gena_group_release(group, jobs - i);
+	}
+
+	return UPNP_E_SUCCESS;
+}
 #endif /* INCLUDE_CLIENT_APIS */
 
 
-int genaRenewSubscription(
+/*!
+ * \brief Tells whether a renewal that failed with an error may succeed if
+ * it is sent again: the device could not be reached or did not answer
+ * properly, rather than refusing it.
+ */
+static int gena_renew_transient(
+	/*! [in] Error of the renewal. */
+	int return_code)
+{
+	switch (return_code) {
+	case UPNP_E_SOCKET_CONNECT:
+	case UPNP_E_SOCKET_WRITE:
+	case UPNP_E_SOCKET_READ:
+	case UPNP_E_SOCKET_ERROR:
+	case UPNP_E_OUTOF_SOCKET:
+	case UPNP_E_NETWORK_ERROR:
+	case UPNP_E_TIMEDOUT:
+	case UPNP_E_BAD_HTTPMSG:
+	case UPNP_E_BAD_RESPONSE:
+	case UPNP_E_DEVICE_UNREACHABLE:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+
+/*!
+ * \brief Renews a subscription, for genaRenewSubscription() or for an
+ * automatic renewal.
+ *
+ * An automatic renewal that fails with a transient error is tried again,
+ * GENA_RENEW_RETRY_MIN seconds later and twice as late after every failure
+ * up to GENA_RENEW_RETRY_MAX, as long as the subscription has not expired;
+ * the subscription is only removed once no retry is left.
+ *
+ * \return UPNP_E_SUCCESS if successful, otherwise returns the appropriate
+ * 	error code.
+ */
+static int gena_renew_subscription(
+	/*! [in] Client handle. */
 	UpnpClient_Handle client_handle,
+	/*! [in] Subscription ID. */
 	const UpnpString *in_sid,
-	int *TimeOut)
+	/*! [in,out] Requested and granted subscription time. */
+	int *TimeOut,
+	/*! [in] Automatic renewal being sent, or NULL. */
+	const gena_renewal *renewal,
+	/*! [out] TRUE if the renewal failed and a retry was scheduled. */
+	int *retrying)
 {
 	int return_code = GENA_SUCCESS;
 	ClientSubscription *sub = NULL;
@@ -615,6 +1335,10 @@ int genaRenewSubscription(
 	struct Handle_Info *handle_info;
 	UpnpString *ActualSID = UpnpString_new();
 	ThreadPoolJob tempJob;
+	int requested = *TimeOut;
+	int64_t backoff_ms;
+
+	*retrying = FALSE;
 
 	HandleLock();
 
@@ -626,13 +1350,22 @@ int genaRenewSubscription(
 		goto exit_function;
 	}
 
-	sub = GetClientSubClientSID(handle_info->ClientSubList, in_sid);
+	sub = GetClientSubClientSID(handle_info->ClientSubIdx, in_sid);
 	if (sub == NULL) {
 		HandleUnlock();
 
 		return_code = GENA_E_BAD_SID;
 		goto exit_function;
 	}
+	if (renewal != NULL &&
+	    UpnpClientSubscription_get_RenewEventId(sub) !=
+	    renewal->timeout.eventId) {
+		/* renewed by the application while this renewal was queued. */
+		HandleUnlock();
+
+		return_code = GENA_E_BAD_SID;
+		goto exit_function;
+	}
 
 	/* remove old events */
 	if (TimerThreadRemove(
@@ -666,15 +1399,39 @@ int genaRenewSubscription(
 	/* we just called GetHandleInfo, so we don't check for return value */
 	/*GetHandleInfo(client_handle, &handle_info); */
 	if (return_code != UPNP_E_SUCCESS) {
+		sub = GetClientSubClientSID(handle_info->ClientSubIdx, in_sid);
+		if (renewal != NULL && sub != NULL &&
+		    gena_renew_transient(return_code)) {
+			backoff_ms = renewal->attempt < 16 ?
+				((int64_t)GENA_RENEW_RETRY_MIN << renewal->attempt) *
+				1000 : (int64_t)GENA_RENEW_RETRY_MAX * 1000;
+			if (backoff_ms > (int64_t)GENA_RENEW_RETRY_MAX * 1000) {
+				backoff_ms = (int64_t)GENA_RENEW_RETRY_MAX * 1000;
+			}
+			if (sock_monotonic_ms() + backoff_ms < renewal->expires &&
+			    gena_renewal_schedule(client_handle, sub, backoff_ms,
+				    requested, renewal->attempt + 1,
+				    renewal->expires) == GENA_SUCCESS) {
+				CDBG_INFO("Renewal failed with %d, trying again "
+					"in %d ms\n", return_code,
+					(int)backoff_ms);
+				*TimeOut = requested;
+				*retrying = TRUE;
+				free_client_subscription(sub_copy);
+				HandleUnlock();
+				goto exit_function;
+			}
+		}
 		/* network failure (remove client sub) */
-		RemoveClientSubClientSID(&handle_info->ClientSubList, in_sid);
+		RemoveClientSubClientSID(&handle_info->ClientSubList,
+			handle_info->ClientSubIdx, in_sid);
 		free_client_subscription(sub_copy);
 		HandleUnlock();
 		goto exit_function;
 	}
 
 	/* get subscription */
-	sub = GetClientSubClientSID(handle_info->ClientSubList, in_sid);
+	sub = GetClientSubClientSID(handle_info->ClientSubIdx, in_sid);
 	if (sub == NULL) {
 		free_client_subscription(sub_copy);
 		HandleUnlock();
@@ -683,13 +1440,13 @@ int genaRenewSubscription(
 	}
 
 	/* store actual sid */
-	UpnpClientSubscription_set_ActualSID(sub, ActualSID);
+	SetClientSubActualSID(handle_info->ClientSubIdx, sub, ActualSID);
 
 	/* start renew subscription timer */
 	return_code = ScheduleGenaAutoRenew(client_handle, *TimeOut, sub);
 	if (return_code != GENA_SUCCESS) {
 		RemoveClientSubClientSID(
-			&handle_info->ClientSubList,
+			&handle_info->ClientSubList, handle_info->ClientSubIdx,
 			UpnpClientSubscription_get_SID(sub));
 	}
 	free_client_subscription(sub_copy);
@@ -702,6 +1459,213 @@ exit_function:
 }
 
 
+int genaRenewSubscription(
+	UpnpClient_Handle client_handle,
+	const UpnpString *in_sid,
+	int *TimeOut)
+{
+	int retrying;
+
+	return gena_renew_subscription(client_handle, in_sid, TimeOut, NULL,
+		&retrying);
+}
+
+
+/*! A tag of an XML body. */
+typedef struct gena_xml_tag
+{
+	/*! Name of the tag, prefix included. */
+	const char *name;
+	size_t nameLength;
+	/*! TRUE for an end tag. */
+	int closing;
+	/*! TRUE for an empty element tag. */
+	int empty;
+	/*! The '<' of the tag. */
+	const char *start;
+} gena_xml_tag;
+
+
+/*!
+ * \brief Finds a string in an XML body.
+ *
+ * \return The character after the string, or NULL if it is not found.
+ */
+static const char *gena_xml_find(
+	/*! [in] Where to start. */
+	const char *pos,
+	/*! [in] End of the body. */
+	const char *end,
+	/*! [in] String to find. */
+	const char *s)
+{
+	size_t len = strlen(s);
+
+	for (; (size_t)(end - pos) >= len; pos++) {
+		if (memcmp(pos, s, len) == 0) {
+			return pos + len;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*!
+ * \brief Finds the next tag of an XML body, past the comments, CDATA
+ * sections, processing instructions and declarations.
+ *
+ * \return 1 if a tag was found, 0 at the end of the body, -1 if the body is
+ * 	not well formed.
+ */
+static int gena_xml_next(
+	/*! [in,out] Where to start, then the character after the tag. */
+	const char **pos,
+	/*! [in] End of the body. */
+	const char *end,
+	/*! [out] The tag. */
+	gena_xml_tag *tag)
+{
+	const char *p = *pos;
+	char quote = '\0';
+
+	for (;;) {
+		p = (const char *)memchr(p, '<', (size_t)(end - p));
+		if (p == NULL) {
+			return 0;
+		}
+		if (end - p < 2 || (p[1] != '!' && p[1] != '?')) {
+			break;
+		}
+		if (end - p >= 4 && memcmp(p, "<!--", (size_t)4) == 0) {
+			p = gena_xml_find(p + 4, end, "-->");
+		} else if (end - p >= 9 &&
+			   memcmp(p, "<![CDATA[", (size_t)9) == 0) {
+			p = gena_xml_find(p + 9, end, "]]>");
+		} else {
+			p = gena_xml_find(p + 2, end, ">");
+		}
+		if (p == NULL) {
+			return -1;
+		}
+	}
+	tag->start = p++;
+	tag->closing = p < end && *p == '/';
+	if (tag->closing) {
+		p++;
+	}
+	tag->name = p;
+	while (p < end && !isspace((unsigned char)*p) && *p != '/' &&
+	       *p != '>') {
+		p++;
+	}
+	tag->nameLength = (size_t)(p - tag->name);
+	for (; p < end; p++) {
+		if (quote != '\0') {
+			if (*p == quote) {
+				quote = '\0';
+			}
+		} else if (*p == '"' || *p == '\'') {
+			quote = *p;
+		} else if (*p == '>') {
+			break;
+		}
+	}
+	if (p >= end || tag->nameLength == 0) {
+		return -1;
+	}
+	tag->empty = !tag->closing && p[-1] == '/';
+	*pos = p + 1;
+
+	return 1;
+}
+
+
+int genaEventProperties(struct Upnp_Event *event)
+{
+	const char *pos = event->Body;
+	const char *end = event->Body + event->BodyLength;
+	const char *value;
+	struct Upnp_Event_Property *props = NULL;
+	struct Upnp_Event_Property *tmp;
+	gena_xml_tag tag;
+	gena_xml_tag var;
+	int num = 0;
+	int size = 0;
+	int depth = 0;
+	int nested;
+	int rc;
+
+	if (event->NumProperties >= 0) {
+		return UPNP_E_SUCCESS;
+	}
+	if (event->Body == NULL) {
+		event->NumProperties = 0;
+		return UPNP_E_SUCCESS;
+	}
+	/* <propertyset> is at depth 1, <property> at depth 2 and the
+	 * variables it holds at depth 3. */
+	while ((rc = gena_xml_next(&pos, end, &tag)) > 0) {
+		if (tag.closing) {
+			if (depth == 0) {
+				rc = -1;
+				break;
+			}
+			depth--;
+			continue;
+		}
+		if (depth < 2) {
+			if (!tag.empty) {
+				depth++;
+			}
+			continue;
+		}
+		var = tag;
+		value = pos;
+		if (!var.empty) {
+			/* the value ends at the end tag of the variable. */
+			nested = 0;
+			while ((rc = gena_xml_next(&pos, end, &tag)) > 0) {
+				if (!tag.closing) {
+					nested += !tag.empty;
+				} else if (nested-- == 0) {
+					break;
+				}
+			}
+			if (rc <= 0) {
+				rc = -1;
+				break;
+			}
+		}
+		if (num == size) {
+			size = size == 0 ? 8 : size * 2;
+			tmp = (struct Upnp_Event_Property *)realloc(props,
+				(size_t)size * sizeof(*props));
+			if (tmp == NULL) {
+				free(props);
+				return UPNP_E_OUTOF_MEMORY;
+			}
+			props = tmp;
+		}
+		props[num].Name = var.name;
+		props[num].NameLength = var.nameLength;
+		props[num].Value = value;
+		props[num].ValueLength = var.empty ?
+			(size_t)0 : (size_t)(tag.start - value);
+		num++;
+	}
+	if (rc < 0 || depth != 0) {
+		CDBG_ERROR("Event body is not a property set\n");
+		free(props);
+		return UPNP_E_EVENT_PROTOCOL;
+	}
+	event->Properties = props;
+	event->NumProperties = num;
+
+	return UPNP_E_SUCCESS;
+}
+
+
 void gena_process_notification_event(
 	SOCKINFO *info,
 	http_message_t *event)
@@ -750,7 +1714,9 @@ void gena_process_notification_event(
 		goto exit_function;
 	}
 
-	HandleLock();
+	/* the lookup only reads the table: events are processed in
+	 * parallel. */
+	HandleReadLock();
 
 	/* get client info */
 	if (GetClientHandleInfo(&client_handle, &handle_info) != HND_CLIENT) {
@@ -760,7 +1726,7 @@ void gena_process_notification_event(
 	}
 
 	/* get subscription based on SID */
-	subscription = GetClientSubActualSID(handle_info->ClientSubList, &sid);
+	subscription = GetClientSubActualSID(handle_info->ClientSubIdx, &sid);
 	if (subscription == NULL) {
 		if (eventKey == 0) {
 			/* wait until we've finished processing a subscription  */
@@ -774,7 +1740,7 @@ void gena_process_notification_event(
 			SubscribeLock();
 
 			/* get HandleLock again */
-			HandleLock();
+			HandleReadLock();
 
 			if (GetClientHandleInfo(&client_handle, &handle_info) != HND_CLIENT) {
 				error_respond(info, HTTP_PRECONDITION_FAILED, event);
@@ -783,15 +1749,25 @@ void gena_process_notification_event(
 				goto exit_function;
 			}
 
-			subscription = GetClientSubActualSID(handle_info->ClientSubList, &sid);
+			subscription = GetClientSubActualSID(handle_info->ClientSubIdx, &sid);
 			if (subscription == NULL) {
-				error_respond( info, HTTP_PRECONDITION_FAILED, event );
+				/* or of a group of subscriptions */
 				SubscribeUnlock();
 				HandleUnlock();
-				goto exit_function;
+				if (!gena_group_wait(&sid)) {
+					error_respond(info, HTTP_PRECONDITION_FAILED, event);
+					goto exit_function;
+				}
+				HandleReadLock();
+				if (GetClientHandleInfo(&client_handle, &handle_info) != HND_CLIENT ||
+				    (subscription = GetClientSubActualSID(handle_info->ClientSubIdx, &sid)) == NULL) {
+					error_respond(info, HTTP_PRECONDITION_FAILED, event);
+					HandleUnlock();
+					goto exit_function;
+				}
+			} else {
+				SubscribeUnlock();
 			}
-
-			SubscribeUnlock();
 		} else {
 			error_respond( info, HTTP_PRECONDITION_FAILED, event );
 			HandleUnlock();
@@ -799,15 +1775,16 @@ void gena_process_notification_event(
 		}
 	}
 
-	/* success */
-	error_respond(info, HTTP_OK, event);
-
 	/* fill event struct */
 	tmpSID = UpnpClientSubscription_get_SID(subscription);
 	memset(event_struct.Sid, 0, sizeof(event_struct.Sid));
 	strncpy(event_struct.Sid, UpnpString_get_String(tmpSID),
 		sizeof(event_struct.Sid) - 1);
 	event_struct.EventKey = eventKey;
+	event_struct.Body = event->entity.buf;
+	event_struct.BodyLength = event->entity.length;
+	event_struct.Properties = NULL;
+	event_struct.NumProperties = -1;
 
 	/* copy callback */
 	callback = handle_info->Callback;
@@ -815,11 +1792,15 @@ void gena_process_notification_event(
 
 	HandleUnlock();
 
+	/* success: answered without the lock held. */
+	error_respond(info, HTTP_OK, event);
+
 	/* make callback with event struct */
 	/* In future, should find a way of mainting */
 	/* that the handle is not unregistered in the middle of a */
 	/* callback */
 	callback(UPNP_EVENT_RECEIVED, &event_struct, cookie);
+	free(event_struct.Properties);
 exit_function:
 	return;
 }
@@ -43,11 +43,14 @@
 
 #include "client_table.h"
 
+#include "upnputil.h"
+
 
 #ifdef INCLUDE_CLIENT_APIS
 #if EXCLUDE_GENA == 0
 
 #include <stdlib.h> /* for calloc(), free() */
+#include <string.h>
 
 
 struct SClientSubscription {
@@ -56,6 +59,16 @@ struct SClientSubscription {
 	UpnpString *m_actualSID;
 	UpnpString *m_eventURL;
 	struct SClientSubscription *m_next;
+	/*! Previous subscription of the table, for O(1) removal. */
+	struct SClientSubscription *m_prev;
+	/*! Hash of m_SID when the subscription was indexed. */
+	unsigned m_sidHash;
+	/*! Hash of m_actualSID when the subscription was indexed. */
+	unsigned m_actualHash;
+	/*! Next subscription of the same ClientSubIndex bySID bucket. */
+	ClientSubscription *m_sidNext;
+	/*! Next subscription of the same ClientSubIndex byActualSID bucket. */
+	ClientSubscription *m_actualNext;
 };
 
 
@@ -119,8 +132,11 @@ void UpnpClientSubscription_assign(ClientSubscription *q, const ClientSubscripti
 		UpnpClientSubscription_set_SID(q, UpnpClientSubscription_get_SID(p));
 		UpnpClientSubscription_set_ActualSID(q, UpnpClientSubscription_get_ActualSID(p));
 		UpnpClientSubscription_set_EventURL(q, UpnpClientSubscription_get_EventURL(p));
-		/* Do not copy m_next */
+		/* Do not copy m_next nor the links of the index */
 		((struct SClientSubscription *)q)->m_next = NULL;
+		((struct SClientSubscription *)q)->m_prev = NULL;
+		((struct SClientSubscription *)q)->m_sidNext = NULL;
+		((struct SClientSubscription *)q)->m_actualNext = NULL;
 	}
 }
 
@@ -263,68 +279,168 @@ void freeClientSubList(ClientSubscription *list)
 }
 
 
-void RemoveClientSubClientSID(ClientSubscription **head, const UpnpString *sid)
+/*!
+ * \brief Hashes a SID.
+ */
+static unsigned client_sub_hash(
+	/*! [in] SID. */
+	const char *sid,
+	/*! [in] Length of \b sid. */
+	size_t len)
 {
-	ClientSubscription *finger = *head;
-	ClientSubscription *previous = NULL;
-	int found = 0;
-	while (finger) {
-		found = !strcmp(
-			UpnpString_get_String(sid),
-			UpnpClientSubscription_get_SID_cstr(finger));
-		if (found) {
-			if (previous) {
-				UpnpClientSubscription_set_Next(previous,
-					UpnpClientSubscription_get_Next(finger));
-			} else {
-				*head = UpnpClientSubscription_get_Next(finger);
-			}
-			UpnpClientSubscription_set_Next(finger, NULL);
-			freeClientSubList(finger);
-			finger = NULL;
-		} else {
-			previous = finger;
-			finger = UpnpClientSubscription_get_Next(finger);
+	unsigned hash = 2166136261u;
+	size_t i;
+
+	for (i = (size_t)0; i < len; i++) {
+		hash ^= (unsigned char)sid[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Removes a subscription from the chain of a bucket of the index.
+ */
+static void client_sub_unchain(
+	/*! [in,out] Bucket. */
+	ClientSubscription **link,
+	/*! [in] Subscription. */
+	ClientSubscription *sub,
+	/*! [in] TRUE for a byActualSID bucket, FALSE for a bySID one. */
+	int actual)
+{
+	struct SClientSubscription *q;
+
+	while (*link != NULL) {
+		q = (struct SClientSubscription *)*link;
+		if (*link == sub) {
+			*link = actual ? q->m_actualNext : q->m_sidNext;
+			return;
 		}
+		link = actual ? &q->m_actualNext : &q->m_sidNext;
 	}
 }
 
+/*!
+ * \brief Adds a subscription to the byActualSID part of the index.
+ */
+static void client_sub_chain_actual(
+	/*! [in,out] Index. */
+	ClientSubIndex *index,
+	/*! [in] Subscription. */
+	ClientSubscription *sub)
+{
+	struct SClientSubscription *q = (struct SClientSubscription *)sub;
+	const char *actual = UpnpClientSubscription_get_ActualSID_cstr(sub);
+	ClientSubscription **bucket;
+
+	q->m_actualHash = client_sub_hash(actual, strlen(actual));
+	bucket = &index->byActualSID[q->m_actualHash % CLIENT_SUB_HASH_SIZE];
+	q->m_actualNext = *bucket;
+	*bucket = sub;
+}
+
 
-ClientSubscription *GetClientSubClientSID(ClientSubscription *head, const UpnpString *sid)
+void AddClientSub(ClientSubscription **head, ClientSubIndex *index,
+	ClientSubscription *sub)
 {
-	ClientSubscription *next = head;
-	int found = 0;
-	while (next) {
-		found = !strcmp(
-			UpnpClientSubscription_get_SID_cstr(next),
-			UpnpString_get_String(sid));
-		if(found) {
-			break;
-		} else {
-			next = UpnpClientSubscription_get_Next(next);
-		}
+	struct SClientSubscription *q = (struct SClientSubscription *)sub;
+	const char *sid = UpnpClientSubscription_get_SID_cstr(sub);
+	ClientSubscription **bucket;
+
+	q->m_prev = NULL;
+	q->m_next = (struct SClientSubscription *)*head;
+	if (q->m_next != NULL) {
+		q->m_next->m_prev = q;
+	}
+	*head = sub;
+	q->m_sidHash = client_sub_hash(sid, strlen(sid));
+	bucket = &index->bySID[q->m_sidHash % CLIENT_SUB_HASH_SIZE];
+	q->m_sidNext = *bucket;
+	*bucket = sub;
+	client_sub_chain_actual(index, sub);
+}
+
+
+void RemoveClientSubClientSID(ClientSubscription **head,
+	ClientSubIndex *index, const UpnpString *sid)
+{
+	ClientSubscription *sub = GetClientSubClientSID(index, sid);
+	struct SClientSubscription *q = (struct SClientSubscription *)sub;
+
+	if (sub == NULL) {
+		return;
+	}
+	client_sub_unchain(&index->bySID[q->m_sidHash % CLIENT_SUB_HASH_SIZE],
+		sub, FALSE);
+	client_sub_unchain(
+		&index->byActualSID[q->m_actualHash % CLIENT_SUB_HASH_SIZE],
+		sub, TRUE);
+	if (q->m_prev != NULL) {
+		q->m_prev->m_next = q->m_next;
+	} else {
+		*head = (ClientSubscription *)q->m_next;
+	}
+	if (q->m_next != NULL) {
+		q->m_next->m_prev = q->m_prev;
+	}
+	q->m_prev = NULL;
+	q->m_next = NULL;
+	freeClientSubList(sub);
+}
+
+
+ClientSubscription *GetClientSubClientSID(ClientSubIndex *index,
+	const UpnpString *sid)
+{
+	const char *key = UpnpString_get_String(sid);
+	ClientSubscription *next;
+
+	next = index->bySID[client_sub_hash(key, strlen(key)) %
+		CLIENT_SUB_HASH_SIZE];
+	while (next != NULL &&
+	       strcmp(UpnpClientSubscription_get_SID_cstr(next), key) != 0) {
+		next = ((struct SClientSubscription *)next)->m_sidNext;
 	}
 
 	return next;
 }
 
 
-ClientSubscription *GetClientSubActualSID(ClientSubscription *head, token *sid)
+ClientSubscription *GetClientSubActualSID(ClientSubIndex *index, token *sid)
 {
-	ClientSubscription *next = head;
-	while (next) {
-		if (!memcmp(
-			UpnpClientSubscription_get_ActualSID_cstr(next),
-			sid->buff, sid->size)) {
+	ClientSubscription *next;
+	const UpnpString *actual;
+
+	next = index->byActualSID[client_sub_hash(sid->buff, sid->size) %
+		CLIENT_SUB_HASH_SIZE];
+	while (next != NULL) {
+		actual = UpnpClientSubscription_get_ActualSID(next);
+		if (UpnpString_get_Length(actual) == sid->size &&
+		    memcmp(UpnpString_get_String(actual), sid->buff,
+			sid->size) == 0) {
 			break;
-		} else {
-			next = UpnpClientSubscription_get_Next(next);
 		}
+		next = ((struct SClientSubscription *)next)->m_actualNext;
 	}
 
 	return next;
 }
 
+
+void SetClientSubActualSID(ClientSubIndex *index, ClientSubscription *sub,
+	const UpnpString *actual_sid)
+{
+	struct SClientSubscription *q = (struct SClientSubscription *)sub;
+
+	client_sub_unchain(
+		&index->byActualSID[q->m_actualHash % CLIENT_SUB_HASH_SIZE],
+		sub, TRUE);
+	UpnpClientSubscription_set_ActualSID(sub, actual_sid);
+	client_sub_chain_actual(index, sub);
+}
+
 #endif /* EXCLUDE_GENA */
 #endif /* INCLUDE_CLIENT_APIS */
 
@@ -30,6 +30,8 @@
  *
  **************************************************************************/
 
+#define _GNU_SOURCE	/* For accept4() in sys/socket.h */
+
 #include "config.h"
 
 #if EXCLUDE_MINISERVER == 0
@@ -49,6 +51,7 @@
 
 #include "miniserver.h"
 
+#include "httpparser.h"
 #include "httpreadwrite.h"
 #include "ithread.h"
 #include "ssdplib.h"
@@ -64,6 +67,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#if MINISERVER_USE_EPOLL
+	#include <sys/epoll.h>
+#endif /* MINISERVER_USE_EPOLL */
 
 /*! . */
 #define APPLICATION_LISTENING_PORT 49152
@@ -71,11 +77,53 @@
 #undef DBG_TAG
 #define DBG_TAG "MSERV"
 
+#if MINISERVER_USE_EPOLL
+/*! Kinds of the sockets registered with the epoll instance. */
+typedef enum {
+	/*! The stop socket of the array. */
+	MSERV_SOCK_STOP,
+	/*! An HTTP listener of the array. */
+	MSERV_SOCK_LISTEN,
+	/*! An SSDP socket of the array. */
+	MSERV_SOCK_SSDP,
+	/*! An accepted connection. */
+	MSERV_SOCK_CONN
+} MiniServerSockKind;
+
+/*! Data registered with the epoll instance for a socket, telling what to
+ * do once it is ready. */
+typedef struct {
+	MiniServerSockKind kind;
+	SOCKET sock;
+	/*! Connection, for MSERV_SOCK_CONN only. */
+	struct mserv_request_t *request;
+} MiniServerSockTag;
+#endif /* MINISERVER_USE_EPOLL */
+
+/*! A connection accepted on an HTTP listener. */
 struct mserv_request_t {
 	/*! Connection handle. */
 	SOCKET connfd;
+#if MINISERVER_USE_EPOLL
+	/*! Registration of the connection with the epoll instance. */
+	MiniServerSockTag tag;
+#endif /* MINISERVER_USE_EPOLL */
 	/*! . */
 	struct sockaddr_storage foreign_sockaddr;
+	/*! Request, read by the epoll loop or by the job handling it. */
+	http_parser_t parser;
+	/*! TRUE once the epoll loop has read the whole request. */
+	int parsed;
+	/*! Status to answer instead of dispatching the request, 0 if none. */
+	int http_error_code;
+	/*! TRUE if the entity of the request ends with the connection. */
+	int ok_on_close;
+	/*! Monotonic time, in milliseconds, the connection is closed at if
+	 * its request is not read yet. */
+	int64_t deadline;
+	/*! Links of the connections the epoll loop reads, oldest first. */
+	struct mserv_request_t *prev;
+	struct mserv_request_t *next;
 };
 
 /*! . */
@@ -95,6 +143,21 @@ uint16_t miniStopSockPort;
  * module vars
  */
 static MiniServerState gMServState = MSERV_IDLE;
+/*! Handles GET, HEAD and POST requests, NULL if there is no web server. */
+static MiniServerCallback gGetCallback = NULL;
+/*! Handles NOTIFY, SUBSCRIBE and UNSUBSCRIBE requests. */
+static MiniServerCallback gGenaCallback = NULL;
+
+void SetHTTPGetCallback(MiniServerCallback callback)
+{
+	gGetCallback = callback;
+}
+
+void SetGenaCallback(MiniServerCallback callback)
+{
+	gGenaCallback = callback;
+}
+
 static UPNP_INLINE void fdset_if_valid(SOCKET sock, fd_set *set)
 {
 	if (sock != INVALID_SOCKET) {
@@ -102,18 +165,197 @@ static UPNP_INLINE void fdset_if_valid(SOCKET sock, fd_set *set)
 	}
 }
 
-static void web_server_accept(SOCKET lsock, fd_set *set)
+static UPNP_INLINE int fdisset_if_valid(SOCKET sock, fd_set *set)
+{
+	return sock != INVALID_SOCKET && FD_ISSET(sock, set);
+}
+
+/*!
+ * \brief Hands a request over to the callback of its method.
+ *
+ * \return 0 if the callback answered the request, else the HTTP status to
+ * answer it with.
+ */
+static int dispatch_request(
+	/*! [in] Socket Information object. */
+	SOCKINFO *info,
+	/*! [in] HTTP parser object holding the request. */
+	http_parser_t *hparser)
+{
+	MiniServerCallback callback;
+
+	switch (hparser->msg.method) {
+	case HTTPMETHOD_NOTIFY:
+	case HTTPMETHOD_SUBSCRIBE:
+	case HTTPMETHOD_UNSUBSCRIBE:
+		callback = gGenaCallback;
+		break;
+	case HTTPMETHOD_GET:
+	case HTTPMETHOD_POST:
+	case HTTPMETHOD_HEAD:
+	case HTTPMETHOD_SIMPLEGET:
+		callback = gGetCallback;
+		break;
+	default:
+		/* no SOAP server: control requests are for devices. */
+		callback = NULL;
+		break;
+	}
+	if (callback == NULL) {
+		return HTTP_NOT_IMPLEMENTED;
+	}
+	callback(hparser, &hparser->msg, info);
+
+	return 0;
+}
+
+/*!
+ * \brief Allocates the request of an accepted connection.
+ *
+ * \return The request, or NULL if out of memory.
+ */
+static struct mserv_request_t *new_request(
+	/*! [in] Accepted connection. */
+	SOCKET connfd,
+	/*! [in] Address of the client. */
+	const struct sockaddr_storage *clientAddr)
+{
+	struct mserv_request_t *request;
+
+	request = (struct mserv_request_t *)calloc((size_t)1,
+		sizeof(struct mserv_request_t));
+	if (request == NULL) {
+		return NULL;
+	}
+	request->connfd = connfd;
+	memcpy(&request->foreign_sockaddr, clientAddr,
+		sizeof(request->foreign_sockaddr));
+	parser_request_init(&request->parser);
+
+	return request;
+}
+
+/*!
+ * \brief Closes the connection of a request and frees it.
+ */
+static void free_handle_request_arg(
+	/*! [in] Request. */
+	void *args)
+{
+	struct mserv_request_t *request = (struct mserv_request_t *)args;
+
+	sock_close(request->connfd);
+	httpmsg_destroy(&request->parser.msg);
+	free(request);
+}
+
+/*!
+ * \brief Reads the request of a connection, unless the epoll loop did, and
+ * answers it. Job of the miniserver thread pool.
+ */
+static void handle_request(
+	/*! [in] Request. */
+	void *args)
+{
+	struct mserv_request_t *request = (struct mserv_request_t *)args;
+	http_message_t *hmsg = &request->parser.msg;
+	SOCKINFO info;
+	int http_error_code = request->http_error_code;
+	int timeout = HTTP_DEFAULT_TIMEOUT;
+	int major = 1;
+	int minor = 1;
+	int ret_code;
+
+	ret_code = sock_init_with_ip(&info, request->connfd,
+		(struct sockaddr *)&request->foreign_sockaddr);
+	if (ret_code != UPNP_E_SUCCESS) {
+		free_handle_request_arg(request);
+		return;
+	}
+	if (!request->parsed) {
+		ret_code = http_RecvMessage(&info, &request->parser,
+			HTTPMETHOD_UNKNOWN, &timeout, &http_error_code);
+		if (ret_code != UPNP_E_SUCCESS && http_error_code == 0) {
+			/* nobody to answer. */
+			http_error_code = -1;
+		}
+	}
+	if (http_error_code == 0) {
+		http_error_code = dispatch_request(&info, &request->parser);
+	}
+	if (http_error_code > 0) {
+		if (request->parser.position > POS_REQUEST_LINE) {
+			http_CalcResponseVersion(hmsg->major_version,
+				hmsg->minor_version, &major, &minor);
+		}
+		http_SendStatusResponse(&info, http_error_code, major, minor);
+	}
+	sock_destroy(&info, SD_BOTH);
+	httpmsg_destroy(hmsg);
+	free(request);
+}
+
+/*!
+ * \brief Adds the job handling a request to the miniserver thread pool.
+ */
+static void schedule_request_job(
+	/*! [in] Request. */
+	struct mserv_request_t *request)
 {
+	ThreadPoolJob job;
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)handle_request, (void *)request);
+	TPJobSetFreeFunction(&job, free_handle_request_arg);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gMiniServerThreadPool, &job, NULL) != 0) {
+		CDBG_ERROR("mserv %d: cannot schedule request\n",
+			request->connfd);
+		free_handle_request_arg(request);
+	}
 }
 
-static void ssdp_read(SOCKET rsock, fd_set *set)
+/*!
+ * \brief Accepts a connection on an HTTP listener of the select() loop. The
+ * job handling it reads its request.
+ */
+static void web_server_accept(
+	/*! [in] Listening socket. */
+	SOCKET lsock)
 {
-	if (rsock != INVALID_SOCKET && FD_ISSET(rsock, set)) {
-		readFromSSDPSocket(rsock);
+	char errorBuffer[ERROR_BUFFER_LEN];
+	struct sockaddr_storage clientAddr;
+	socklen_t clientLen = sizeof(clientAddr);
+	struct mserv_request_t *request;
+	SOCKET connfd;
+
+	connfd = accept(lsock, (struct sockaddr *)&clientAddr, &clientLen);
+	if (connfd == INVALID_SOCKET) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR(
+			"miniserver: Error in accept(): %s\n", errorBuffer);
+		return;
 	}
+	request = new_request(connfd, &clientAddr);
+	if (request == NULL) {
+		sock_close(connfd);
+		return;
+	}
+	schedule_request_job(request);
 }
 
-static int receive_from_stopSock(SOCKET ssock, fd_set *set)
+static void ssdp_read(SOCKET rsock)
+{
+	readFromSSDPSocket(rsock);
+}
+
+/*!
+ * \brief Reads one datagram from the stop socket.
+ *
+ * \return 1 if a shutdown request was received, 0 if some other datagram was
+ * read and -1 if nothing could be read.
+ */
+static int receive_from_stopSock(SOCKET ssock)
 {
 	ssize_t byteReceived;
 	socklen_t clientLen;
@@ -121,25 +363,26 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 	char requestBuf[256];
 	char buf_ntop[INET6_ADDRSTRLEN];
 
-	if (FD_ISSET(ssock, set)) {
-		clientLen = sizeof(clientAddr);
-		memset((char *)&clientAddr, 0, sizeof(clientAddr));
-		byteReceived = recvfrom(ssock, requestBuf,
-			(size_t)25, 0, (struct sockaddr *)&clientAddr, &clientLen);
-		if (byteReceived > 0) {
-			requestBuf[byteReceived] = '\0';
-			inet_ntop(AF_INET,
-				&((struct sockaddr_in*)&clientAddr)->sin_addr,
-				buf_ntop, sizeof(buf_ntop));
-			CDBG_INFO(
-				"Received response: %s From host %s \n",
-				requestBuf, buf_ntop );
-			CDBG_INFO(
-				"Received multicast packet: \n %s\n",
-				requestBuf);
-			if (NULL != strstr(requestBuf, "ShutDown")) {
-				return 1;
-			}
+	clientLen = sizeof(clientAddr);
+	memset((char *)&clientAddr, 0, sizeof(clientAddr));
+	byteReceived = recvfrom(ssock, requestBuf,
+		(size_t)25, 0, (struct sockaddr *)&clientAddr, &clientLen);
+	if (byteReceived < 0) {
+		return -1;
+	}
+	if (byteReceived > 0) {
+		requestBuf[byteReceived] = '\0';
+		inet_ntop(AF_INET,
+			&((struct sockaddr_in*)&clientAddr)->sin_addr,
+			buf_ntop, sizeof(buf_ntop));
+		CDBG_INFO(
+			"Received response: %s From host %s \n",
+			requestBuf, buf_ntop );
+		CDBG_INFO(
+			"Received multicast packet: \n %s\n",
+			requestBuf);
+		if (NULL != strstr(requestBuf, "ShutDown")) {
+			return 1;
 		}
 	}
 
@@ -147,13 +390,13 @@ static int receive_from_stopSock(SOCKET ssock, fd_set *set)
 }
 
 /*!
- * \brief Run the miniserver.
+ * \brief Miniserver loop based on select().
  *
- * The MiniServer accepts a new request and schedules a thread to handle the
- * new request. Checks for socket state and invokes appropriate read and
- * shutdown actions for the Miniserver and SSDP sockets.
+ * Rebuilds the read and exception sets on every iteration and probes each
+ * socket of the array. Returns when a shutdown request has been received on
+ * the stop socket.
  */
-static void RunMiniServer(
+static void RunMiniServerSelect(
 	/*! [in] Socket Array. */
 	MiniServerSockArray *miniSock)
 {
@@ -177,7 +420,6 @@ static void RunMiniServer(
 #endif /* INCLUDE_CLIENT_APIS */
 	++maxMiniSock;
 
-	gMServState = MSERV_RUNNING;
 	while (!stopSock) {
 		FD_ZERO(&rdSet);
 		FD_ZERO(&expSet);
@@ -204,19 +446,448 @@ static void RunMiniServer(
 				"Error in select(): %s\n", errorBuffer);
 			continue;
 		} else {
-			web_server_accept(miniSock->miniServerSock4, &rdSet);
-			web_server_accept(miniSock->miniServerSock6, &rdSet);
+			if (fdisset_if_valid(miniSock->miniServerSock4, &rdSet))
+				web_server_accept(miniSock->miniServerSock4);
+			if (fdisset_if_valid(miniSock->miniServerSock6, &rdSet))
+				web_server_accept(miniSock->miniServerSock6);
 #ifdef INCLUDE_CLIENT_APIS
-			ssdp_read(miniSock->ssdpReqSock4, &rdSet);
-			ssdp_read(miniSock->ssdpReqSock6, &rdSet);
+			if (fdisset_if_valid(miniSock->ssdpReqSock4, &rdSet))
+				ssdp_read(miniSock->ssdpReqSock4);
+			if (fdisset_if_valid(miniSock->ssdpReqSock6, &rdSet))
+				ssdp_read(miniSock->ssdpReqSock6);
 #endif /* INCLUDE_CLIENT_APIS */
-			ssdp_read(miniSock->ssdpSock4, &rdSet);
-			ssdp_read(miniSock->ssdpSock6, &rdSet);
-			ssdp_read(miniSock->ssdpSock6UlaGua, &rdSet);
-			stopSock = receive_from_stopSock(
-				miniSock->miniServerStopSock, &rdSet);
+			if (fdisset_if_valid(miniSock->ssdpSock4, &rdSet))
+				ssdp_read(miniSock->ssdpSock4);
+			if (fdisset_if_valid(miniSock->ssdpSock6, &rdSet))
+				ssdp_read(miniSock->ssdpSock6);
+			if (fdisset_if_valid(miniSock->ssdpSock6UlaGua, &rdSet))
+				ssdp_read(miniSock->ssdpSock6UlaGua);
+			if (FD_ISSET(miniSock->miniServerStopSock, &rdSet))
+				stopSock = receive_from_stopSock(
+					miniSock->miniServerStopSock) == 1;
 		}
 	}
+}
+
+#if MINISERVER_USE_EPOLL
+/*! Connections whose request the epoll loop reads, oldest first, hence
+ * in the order of their deadlines. Only used by the miniserver thread. */
+static struct mserv_request_t *gConnHead = NULL;
+static struct mserv_request_t *gConnTail = NULL;
+static int gConnCount = 0;
+
+/*!
+ * \brief Registers a socket of the array for edge-triggered read events.
+ *
+ * The socket is switched to non-blocking mode, since edge-triggered
+ * readiness requires draining it until EAGAIN.
+ *
+ * \return 0 on success or if the socket is not valid, -1 on error.
+ */
+static int epoll_add_if_valid(
+	/*! [in] epoll instance. */
+	int epfd,
+	/*! [out] Tag of the socket, which must live as long as the
+	 * registration. */
+	MiniServerSockTag *tag,
+	/*! [in] Socket to register, from the socket array. */
+	SOCKET sock,
+	/*! [in] What the socket is. */
+	MiniServerSockKind kind)
+{
+	struct epoll_event ev;
+
+	if (sock == INVALID_SOCKET) {
+		return 0;
+	}
+	if (sock_make_no_blocking(sock) == -1) {
+		return -1;
+	}
+	tag->kind = kind;
+	tag->sock = sock;
+	tag->request = NULL;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLET;
+	ev.data.ptr = tag;
+
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, sock, &ev);
+}
+
+/*!
+ * \brief Unlinks a connection from the connections being read.
+ */
+static void conn_unlink(
+	/*! [in] Connection. */
+	struct mserv_request_t *request)
+{
+	if (request->prev != NULL) {
+		request->prev->next = request->next;
+	} else {
+		gConnHead = request->next;
+	}
+	if (request->next != NULL) {
+		request->next->prev = request->prev;
+	} else {
+		gConnTail = request->prev;
+	}
+	request->prev = request->next = NULL;
+	gConnCount--;
+}
+
+/*!
+ * \brief Closes a connection being read, dropping its request.
+ */
+static void conn_close(
+	/*! [in] Connection. */
+	struct mserv_request_t *request)
+{
+	conn_unlink(request);
+	/* closing the socket takes it out of the epoll instance. */
+	free_handle_request_arg(request);
+}
+
+/*!
+ * \brief Hands a connection whose request is read over to the miniserver
+ * thread pool.
+ */
+static void conn_dispatch(
+	/*! [in] epoll instance. */
+	int epfd,
+	/*! [in] Connection. */
+	struct mserv_request_t *request,
+	/*! [in] Status to answer instead of dispatching the request, 0 to
+	 * dispatch it. */
+	int http_error_code)
+{
+	conn_unlink(request);
+	epoll_ctl(epfd, EPOLL_CTL_DEL, request->connfd, NULL);
+	/* the handlers write with blocking sends. */
+	if (sock_make_blocking(request->connfd) == -1) {
+		free_handle_request_arg(request);
+		return;
+	}
+	request->parsed = TRUE;
+	request->http_error_code = http_error_code;
+	if (http_error_code == 0) {
+		CDBG_INFO("<<< (RECVD) <<<\n%s\n-----------------\n",
+			request->parser.msg.msg.buf);
+	}
+	schedule_request_job(request);
+}
+
+/*!
+ * \brief Reads what a connection sent until EAGAIN, feeding it to the
+ * parser of its request, and dispatches the request once it is complete.
+ */
+static void conn_read(
+	/*! [in] epoll instance. */
+	int epfd,
+	/*! [in] Connection. */
+	struct mserv_request_t *request)
+{
+	http_parser_t *parser = &request->parser;
+	parse_status_t status;
+	ssize_t num_read;
+	char buf[2 * 1024];
+
+	while (TRUE) {
+		num_read = recv(request->connfd, buf, sizeof(buf), 0);
+		if (num_read == 0) {
+			if (request->ok_on_close) {
+				conn_dispatch(epfd, request, 0);
+			} else {
+				/* partial request: nobody to answer. */
+				conn_close(request);
+			}
+			return;
+		}
+		if (num_read < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				conn_close(request);
+			}
+			return;
+		}
+		status = parser_append(parser, buf, (size_t)num_read);
+		switch (status) {
+		case PARSE_SUCCESS:
+		case PARSE_CONTINUE_1:
+			/* after a 100 Continue, the web server reads the
+			 * entity itself. */
+			if (g_maxContentLength > (size_t)0 &&
+			    parser->content_length >
+			    (unsigned int)g_maxContentLength) {
+				conn_dispatch(epfd, request,
+					HTTP_REQ_ENTITY_TOO_LARGE);
+			} else {
+				conn_dispatch(epfd, request, 0);
+			}
+			return;
+		case PARSE_FAILURE:
+		case PARSE_NO_MATCH:
+			conn_dispatch(epfd, request,
+				parser->http_error_code > 0 ?
+				parser->http_error_code : HTTP_BAD_REQUEST);
+			return;
+		case PARSE_INCOMPLETE_ENTITY:
+			request->ok_on_close = TRUE;
+			break;
+		default:
+			break;
+		}
+		if (parser->position < POS_ENTITY &&
+		    parser->msg.msg.length > (size_t)MINISERVER_MAX_HEADERS_SIZE) {
+			conn_dispatch(epfd, request, HTTP_BAD_REQUEST);
+			return;
+		}
+		if (parser->position == POS_ENTITY &&
+		    g_maxContentLength > (size_t)0 &&
+		    parser->content_length > (unsigned int)g_maxContentLength) {
+			/* do not wait for an entity that is refused anyway. */
+			conn_dispatch(epfd, request, HTTP_REQ_ENTITY_TOO_LARGE);
+			return;
+		}
+	}
+}
+
+/*!
+ * \brief Accepts all the pending connections of an HTTP listener and
+ * registers them with the epoll instance, which then reports the data they
+ * send.
+ */
+static void web_server_accept_batch(
+	/*! [in] epoll instance. */
+	int epfd,
+	/*! [in] Listening socket. */
+	SOCKET lsock)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	struct sockaddr_storage clientAddr;
+	socklen_t clientLen;
+	struct mserv_request_t *request;
+	struct epoll_event ev;
+	SOCKET connfd;
+
+	while (TRUE) {
+		clientLen = sizeof(clientAddr);
+#ifdef HAVE_ACCEPT4
+		connfd = accept4(lsock, (struct sockaddr *)&clientAddr,
+			&clientLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+		connfd = accept(lsock, (struct sockaddr *)&clientAddr,
+			&clientLen);
+		if (connfd != INVALID_SOCKET &&
+		    sock_make_no_blocking(connfd) == -1) {
+			sock_close(connfd);
+			continue;
+		}
+#endif
+		if (connfd == INVALID_SOCKET) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				strerror_r(errno, errorBuffer,
+					ERROR_BUFFER_LEN);
+				CDBG_ERROR(
+					"miniserver: Error in accept(): %s\n",
+					errorBuffer);
+			}
+			return;
+		}
+		if (gConnCount >= MINISERVER_MAX_CONNECTIONS) {
+			CDBG_ERROR("miniserver: %d connections being read, "
+				"closing a new one\n", gConnCount);
+			sock_close(connfd);
+			continue;
+		}
+		request = new_request(connfd, &clientAddr);
+		if (request == NULL) {
+			sock_close(connfd);
+			continue;
+		}
+		request->tag.kind = MSERV_SOCK_CONN;
+		request->tag.sock = connfd;
+		request->tag.request = request;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.ptr = &request->tag;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, connfd, &ev) == -1) {
+			free_handle_request_arg(request);
+			continue;
+		}
+		request->deadline = sock_monotonic_ms() +
+			(int64_t)MINISERVER_REQUEST_TIMEOUT * 1000;
+		request->prev = gConnTail;
+		if (gConnTail != NULL) {
+			gConnTail->next = request;
+		} else {
+			gConnHead = request;
+		}
+		gConnTail = request;
+		gConnCount++;
+	}
+}
+
+/*!
+ * \brief Closes the connections that did not send their request in time.
+ *
+ * \return How long, in milliseconds, to wait for the next deadline, -1 if
+ * no connection is being read.
+ */
+static int conn_expire(void)
+{
+	int64_t now = sock_monotonic_ms();
+
+	while (gConnHead != NULL && gConnHead->deadline <= now) {
+		CDBG_INFO("mserv %d: request timed out\n", gConnHead->connfd);
+		conn_close(gConnHead);
+	}
+
+	return gConnHead != NULL ? (int)(gConnHead->deadline - now) : -1;
+}
+
+/*!
+ * \brief Dispatches one ready socket, draining it completely.
+ *
+ * \return 1 if a shutdown request was read from the stop socket, else 0.
+ */
+static int dispatch_ready_sock(
+	/*! [in] epoll instance. */
+	int epfd,
+	/*! [in] Tag registered for the socket reported ready by
+	 * epoll_wait(). */
+	MiniServerSockTag *tag)
+{
+	int ret;
+	int stopSock = 0;
+
+	switch (tag->kind) {
+	case MSERV_SOCK_STOP:
+		while ((ret = receive_from_stopSock(tag->sock)) >= 0 ||
+		       errno == EINTR) {
+			if (ret == 1) {
+				stopSock = 1;
+			}
+		}
+		break;
+	case MSERV_SOCK_LISTEN:
+		web_server_accept_batch(epfd, tag->sock);
+		break;
+	case MSERV_SOCK_SSDP:
+		while (readFromSSDPSocket(tag->sock) >= 0 || errno == EINTR) {
+		}
+		break;
+	case MSERV_SOCK_CONN:
+		conn_read(epfd, tag->request);
+		break;
+	}
+
+	return stopSock;
+}
+
+/*!
+ * \brief Miniserver loop based on an edge-triggered epoll instance.
+ *
+ * Every socket of the array is registered once; only the sockets reported
+ * ready are dispatched. Accepted HTTP connections are registered as well and
+ * their requests parsed as their data arrives, so that no thread is tied up
+ * by a slow client; a job of the miniserver thread pool only runs once a
+ * request is complete.
+ *
+ * \return 0 when the loop ended on a shutdown request, -1 if the epoll
+ * instance could not be set up, in which case the caller should fall back
+ * to RunMiniServerSelect().
+ */
+static int RunMiniServerEpoll(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	struct epoll_event events[MINISERVER_MAX_EVENTS];
+	/* one per socket of the array. */
+	MiniServerSockTag tags[8];
+	int epfd;
+	int nfds;
+	int i;
+	int stopSock = 0;
+
+	epfd = epoll_create(MINISERVER_MAX_EVENTS);
+	if (epfd == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR(
+			"Error in epoll_create(): %s\n", errorBuffer);
+		return -1;
+	}
+	if (epoll_add_if_valid(epfd, &tags[0], miniSock->miniServerStopSock,
+		MSERV_SOCK_STOP) == -1 ||
+	    epoll_add_if_valid(epfd, &tags[1], miniSock->miniServerSock4,
+		MSERV_SOCK_LISTEN) == -1 ||
+	    epoll_add_if_valid(epfd, &tags[2], miniSock->miniServerSock6,
+		MSERV_SOCK_LISTEN) == -1 ||
+#ifdef INCLUDE_CLIENT_APIS
+	    epoll_add_if_valid(epfd, &tags[3], miniSock->ssdpReqSock4,
+		MSERV_SOCK_SSDP) == -1 ||
+	    epoll_add_if_valid(epfd, &tags[4], miniSock->ssdpReqSock6,
+		MSERV_SOCK_SSDP) == -1 ||
+#endif /* INCLUDE_CLIENT_APIS */
+	    epoll_add_if_valid(epfd, &tags[5], miniSock->ssdpSock4,
+		MSERV_SOCK_SSDP) == -1 ||
+	    epoll_add_if_valid(epfd, &tags[6], miniSock->ssdpSock6,
+		MSERV_SOCK_SSDP) == -1 ||
+	    epoll_add_if_valid(epfd, &tags[7], miniSock->ssdpSock6UlaGua,
+		MSERV_SOCK_SSDP) == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR(
+			"Error in epoll_ctl(): %s\n", errorBuffer);
+		close(epfd);
+		return -1;
+	}
+	while (!stopSock) {
+		nfds = epoll_wait(epfd, events, MINISERVER_MAX_EVENTS,
+			conn_expire());
+		if (nfds == -1) {
+			if (errno != EINTR) {
+				strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+				CDBG_ERROR(
+					"Error in epoll_wait(): %s\n", errorBuffer);
+			}
+			continue;
+		}
+		for (i = 0; i < nfds; i++) {
+			if (dispatch_ready_sock(epfd,
+				(MiniServerSockTag *)events[i].data.ptr)) {
+				stopSock = 1;
+			}
+		}
+	}
+	while (gConnHead != NULL) {
+		conn_close(gConnHead);
+	}
+	close(epfd);
+
+	return 0;
+}
+#endif /* MINISERVER_USE_EPOLL */
+
+/*!
+ * \brief Run the miniserver.
+ *
+ * The MiniServer accepts a new request and schedules a thread to handle the
+ * new request. Checks for socket state and invokes appropriate read and
+ * shutdown actions for the Miniserver and SSDP sockets.
+ */
+static void RunMiniServer(
+	/*! [in] Socket Array. */
+	MiniServerSockArray *miniSock)
+{
+	gMServState = MSERV_RUNNING;
+#if MINISERVER_USE_EPOLL
+	if (RunMiniServerEpoll(miniSock) != 0)
+#endif /* MINISERVER_USE_EPOLL */
+		RunMiniServerSelect(miniSock);
 	/* Close all sockets. */
 	sock_close(miniSock->miniServerSock4);
 	sock_close(miniSock->miniServerSock6);
@@ -314,6 +985,132 @@ static int get_miniserver_stopsock(
 	return UPNP_E_SUCCESS;
 }
 
+/*!
+ * \brief Creates an HTTP listener of the miniserver on all the addresses
+ * of a family.
+ *
+ * If \b *port is 0, the first free port from APPLICATION_LISTENING_PORT up
+ * is used.
+ *
+ * \return
+ * \li \c UPNP_E_OUTOF_SOCKET: Failed to create a socket.
+ * \li \c UPNP_E_SOCKET_BIND: Bind() failed.
+ * \li \c UPNP_E_LISTEN: Listen() failed.
+ * \li \c UPNP_E_INTERNAL_ERROR: Port returned by the socket layer is < 0.
+ * \li \c UPNP_E_SUCCESS: Success.
+ */
+static int get_listen_socket(
+	/*! [in] AF_INET or AF_INET6. */
+	int family,
+	/*! [out] Listening socket. */
+	SOCKET *out,
+	/*! [in,out] Port to listen on, 0 for any; port listened on. */
+	uint16_t *port)
+{
+	char errorBuffer[ERROR_BUFFER_LEN];
+	struct sockaddr_storage addr;
+	struct sockaddr_in *addr4 = (struct sockaddr_in *)&addr;
+	struct sockaddr_in6 *addr6 = (struct sockaddr_in6 *)&addr;
+	socklen_t addrLen;
+	SOCKET sock;
+	uint16_t tryPort;
+	int reuseaddr = 1;
+	int onlyV6 = 1;
+	int ret;
+
+	sock = socket(family, SOCK_STREAM, 0);
+	if (sock == INVALID_SOCKET) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR(
+			"Error in socket(): %s\n", errorBuffer);
+		return UPNP_E_OUTOF_SOCKET;
+	}
+	setsockopt(sock, SOL_SOCKET, SO_REUSEADDR,
+		(char *)&reuseaddr, sizeof(reuseaddr));
+	if (family == AF_INET6) {
+		setsockopt(sock, IPPROTO_IPV6, IPV6_V6ONLY,
+			(char *)&onlyV6, sizeof(onlyV6));
+	}
+	tryPort = *port != 0u ? *port : (uint16_t)APPLICATION_LISTENING_PORT;
+	while (TRUE) {
+		memset(&addr, 0, sizeof(addr));
+		if (family == AF_INET6) {
+			addr6->sin6_family = (sa_family_t)AF_INET6;
+			addr6->sin6_addr = in6addr_any;
+			addr6->sin6_port = htons(tryPort);
+			addrLen = sizeof(*addr6);
+		} else {
+			addr4->sin_family = (sa_family_t)AF_INET;
+			addr4->sin_addr.s_addr = htonl(INADDR_ANY);
+			addr4->sin_port = htons(tryPort);
+			addrLen = sizeof(*addr4);
+		}
+		ret = bind(sock, (struct sockaddr *)&addr, addrLen);
+		if (ret != SOCKET_ERROR || *port != 0u || tryPort == 65535u) {
+			break;
+		}
+		tryPort++;
+	}
+	if (ret == SOCKET_ERROR) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR(
+			"Error in bind(), port %d: %s\n", (int)tryPort,
+			errorBuffer);
+		sock_close(sock);
+		return UPNP_E_SOCKET_BIND;
+	}
+	if (listen(sock, SOMAXCONN) == SOCKET_ERROR) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR(
+			"Error in listen(): %s\n", errorBuffer);
+		sock_close(sock);
+		return UPNP_E_LISTEN;
+	}
+	if (get_port(sock, port) == -1) {
+		sock_close(sock);
+		return UPNP_E_INTERNAL_ERROR;
+	}
+	*out = sock;
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Creates the HTTP listeners of the miniserver: IPv4, and IPv6 if
+ * the SDK has an IPv6 address.
+ *
+ * \return UPNP_E_SUCCESS, or the error of get_listen_socket() for the IPv4
+ * listener. A missing IPv6 listener is not an error.
+ */
+static int get_miniserver_sockets(
+	/*! [in,out] Miniserver Socket Array. */
+	MiniServerSockArray *out,
+	/*! [in,out] Port of the IPv4 listener, 0 for any. */
+	uint16_t *listen_port4,
+	/*! [in,out] Port of the IPv6 listener, 0 for any. */
+	uint16_t *listen_port6)
+{
+	int ret_code;
+
+	ret_code = get_listen_socket(AF_INET, &out->miniServerSock4,
+		listen_port4);
+	if (ret_code != UPNP_E_SUCCESS) {
+		return ret_code;
+	}
+	out->miniServerPort4 = *listen_port4;
+#ifdef UPNP_ENABLE_IPV6
+	if (gIF_IPV6[0] != 0 &&
+	    get_listen_socket(AF_INET6, &out->miniServerSock6,
+		listen_port6) == UPNP_E_SUCCESS) {
+		out->miniServerPort6 = *listen_port6;
+	}
+#else
+	(void)listen_port6;
+#endif
+
+	return UPNP_E_SUCCESS;
+}
+
 static UPNP_INLINE void InitMiniServerSockArray(MiniServerSockArray *miniSocket)
 {
 	miniSocket->miniServerSock4 = INVALID_SOCKET;
@@ -360,6 +1157,13 @@ int StartMiniServer(
 		return UPNP_E_OUTOF_MEMORY;
 	}
 	InitMiniServerSockArray(miniSocket);
+	/* HTTP listeners for eventing, description and control. */
+	ret_code = get_miniserver_sockets(miniSocket, listen_port4,
+		listen_port6);
+	if (ret_code != UPNP_E_SUCCESS) {
+		free(miniSocket);
+		return ret_code;
+	}
 	/* Stop socket (To end miniserver processing). */
 	ret_code = get_miniserver_stopsock(miniSocket);
 	if (ret_code != UPNP_E_SUCCESS) {
@@ -0,0 +1,797 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Pool of the persistent HTTP/1.1 connections of the control point.
+ *
+ * Each device the control point talks to has an entry, keyed on its address
+ * and port, with the number of connections in use and a list of the idle
+ * ones, most recently used first. Idle connections are checked with a
+ * non-blocking peek before being reused, and closed by an event on the timer
+ * thread once they have been idle for HTTP_POOL_IDLE_TIMEOUT.
+ *
+ * Requests go through the circuit breaker of the device, and new
+ * connections wait for it as long as its health estimate says.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+
+#include "httpconnpool.h"
+
+#include "httphealth.h"
+#include "httpreadwrite.h"
+#include "ithread.h"
+#include "sock.h"
+#include "TimerThread.h"
+#include "upnp.h"
+#include "upnpapi.h"
+#include "UpnpInet.h"
+#include "UpnpIntTypes.h"
+#include "UpnpStdInt.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <time.h>
+
+#undef DBG_TAG
+#define DBG_TAG "HTTP"
+
+/*! Nonzero if poolCond waits on the monotonic clock. */
+#if defined(ithread_condattr_setclock) && defined(_POSIX_MONOTONIC_CLOCK)
+	#define HTTP_POOL_COND_MONOTONIC 1
+#else
+	#define HTTP_POOL_COND_MONOTONIC 0
+#endif
+
+/*! An idle connection. */
+typedef struct http_pool_conn
+{
+	SOCKET sock;
+	/*! Monotonic time, in milliseconds, the connection became idle. */
+	int64_t idleSince;
+	struct http_pool_conn *next;
+} http_pool_conn;
+
+/*! The connections to one device. */
+typedef struct http_pool_host
+{
+	/*! Address and port of the device. */
+	struct sockaddr_storage addr;
+	/*! Number of connections in use. */
+	int active;
+	/*! Number of requests waiting for a connection. */
+	int waiting;
+	/*! Idle connections, most recently used first. */
+	http_pool_conn *idle;
+	struct http_pool_host *next;
+} http_pool_host;
+
+/*! Devices, protected by poolMutex. */
+static http_pool_host *poolTable[HTTP_POOL_HASH_SIZE];
+/*! TRUE while the pool is not running: requests fail and released
+ * connections are closed. */
+static int poolShutdown = TRUE;
+/*! TRUE while a sweep event is scheduled. */
+static int poolSweepPending = FALSE;
+static ithread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+/*! Signalled when a connection is released. It is never destroyed, as
+ * requests still running at UpnpFinish may signal it. */
+static ithread_cond_t poolCond;
+static int poolCondInit = FALSE;
+
+/*!
+ * \brief Returns the bucket of an address.
+ */
+static http_pool_host **http_pool_bucket(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr)
+{
+	const unsigned char *bytes;
+	size_t length;
+	unsigned hash = 2166136261u;
+	size_t i;
+
+	if (addr->ss_family == (sa_family_t)AF_INET6) {
+		const struct sockaddr_in6 *sa6 =
+			(const struct sockaddr_in6 *)addr;
+		bytes = (const unsigned char *)&sa6->sin6_addr;
+		length = sizeof(sa6->sin6_addr);
+		hash ^= sa6->sin6_port;
+	} else {
+		const struct sockaddr_in *sa4 =
+			(const struct sockaddr_in *)addr;
+		bytes = (const unsigned char *)&sa4->sin_addr;
+		length = sizeof(sa4->sin_addr);
+		hash ^= sa4->sin_port;
+	}
+	hash *= 16777619u;
+	for (i = (size_t)0; i < length; i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+
+	return &poolTable[hash & (HTTP_POOL_HASH_SIZE - 1)];
+}
+
+/*!
+ * \brief Compares the address and port of two devices.
+ *
+ * \return TRUE if they are the same.
+ */
+static int http_pool_same_addr(
+	/*! [in] First address. */
+	const struct sockaddr_storage *a,
+	/*! [in] Second address. */
+	const struct sockaddr_storage *b)
+{
+	if (a->ss_family != b->ss_family) {
+		return FALSE;
+	}
+	if (a->ss_family == (sa_family_t)AF_INET6) {
+		const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+		const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+		return a6->sin6_port == b6->sin6_port &&
+			a6->sin6_scope_id == b6->sin6_scope_id &&
+			memcmp(&a6->sin6_addr, &b6->sin6_addr,
+				sizeof(a6->sin6_addr)) == 0;
+	} else {
+		const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+		const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+
+		return a4->sin_port == b4->sin_port &&
+			a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+	}
+}
+
+/*!
+ * \brief Returns the entry of a device, creating it if needed. Called with
+ * poolMutex held.
+ *
+ * \return The entry, or NULL if out of memory.
+ */
+static http_pool_host *http_pool_host_get(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr)
+{
+	http_pool_host **bucket = http_pool_bucket(addr);
+	http_pool_host *host;
+
+	for (host = *bucket; host != NULL; host = host->next) {
+		if (http_pool_same_addr(&host->addr, addr)) {
+			return host;
+		}
+	}
+	host = (http_pool_host *)calloc((size_t)1, sizeof(http_pool_host));
+	if (host == NULL) {
+		return NULL;
+	}
+	memcpy(&host->addr, addr, sizeof(host->addr));
+	host->next = *bucket;
+	*bucket = host;
+
+	return host;
+}
+
+/*!
+ * \brief Frees the entry of a device if nothing refers to it any more.
+ * Called with poolMutex held.
+ */
+static void http_pool_host_drop(
+	/*! [in] Entry of the device. */
+	http_pool_host *host)
+{
+	http_pool_host **link;
+
+	if (host->active != 0 || host->waiting != 0 || host->idle != NULL) {
+		return;
+	}
+	for (link = http_pool_bucket(&host->addr); *link != NULL;
+	     link = &(*link)->next) {
+		if (*link == host) {
+			*link = host->next;
+			free(host);
+			return;
+		}
+	}
+}
+
+/*!
+ * \brief Shuts down and closes a connection.
+ */
+static void http_pool_close(
+	/*! [in] Socket of the connection. */
+	SOCKET sock)
+{
+	SOCKINFO info;
+
+	sock_init(&info, sock);
+	sock_destroy(&info, SD_BOTH);
+}
+
+/*!
+ * \brief Checks that the device did not close an idle connection.
+ *
+ * \return TRUE if the connection can be reused.
+ */
+static int http_pool_alive(
+	/*! [in] Socket of the connection. */
+	SOCKET sock)
+{
+	char c;
+	ssize_t n;
+
+	n = recv(sock, &c, (size_t)1, MSG_PEEK | MSG_DONTWAIT);
+	if (n >= 0) {
+		/* closed by the device, or data nobody asked for. */
+		return FALSE;
+	}
+
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+/*!
+ * \brief Subtracts the time elapsed since \b start_time from a timeout.
+ */
+static void http_pool_elapse(
+	/*! [in,out] Timeout in milliseconds, 0 for none. */
+	int *timeout_ms,
+	/*! [in] Monotonic time the timeout was last updated. */
+	int64_t start_time)
+{
+	int64_t remaining;
+
+	if (*timeout_ms != 0) {
+		remaining = *timeout_ms - (sock_monotonic_ms() - start_time);
+		*timeout_ms = remaining > 0 ? (int)remaining : -1;
+	}
+}
+
+static void http_pool_sweep(void *arg);
+
+/*!
+ * \brief Schedules the sweep of the idle connections, unless one is already
+ * scheduled. Called with poolMutex held.
+ */
+static void http_pool_schedule_sweep(
+	/*! [in] Milliseconds until the sweep. */
+	int64_t delay)
+{
+	ThreadPoolJob job;
+
+	if (poolSweepPending || poolShutdown) {
+		return;
+	}
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)http_pool_sweep, NULL);
+	TPJobSetPriority(&job, LOW_PRIORITY);
+	if (TimerThreadSchedule(&gTimerThread, (time_t)delay, REL_MSEC, &job,
+		SHORT_TERM, NULL) == 0) {
+		poolSweepPending = TRUE;
+	}
+}
+
+/*!
+ * \brief Closes the connections idle for HTTP_POOL_IDLE_TIMEOUT and frees
+ * the devices left without connections.
+ */
+static void http_pool_sweep(
+	/*! [in] Unused. */
+	void *arg)
+{
+	http_pool_host **host;
+	http_pool_host *freed;
+	http_pool_conn **conn;
+	http_pool_conn *expired;
+	int64_t now = sock_monotonic_ms();
+	int64_t next = -1;
+	int i;
+
+	(void)arg;
+	ithread_mutex_lock(&poolMutex);
+	poolSweepPending = FALSE;
+	for (i = 0; i < HTTP_POOL_HASH_SIZE; i++) {
+		host = &poolTable[i];
+		while (*host != NULL) {
+			conn = &(*host)->idle;
+			while (*conn != NULL) {
+				if (now - (*conn)->idleSince <
+				    HTTP_POOL_IDLE_TIMEOUT) {
+					if (next < 0 || (*conn)->idleSince <
+					    next) {
+						next = (*conn)->idleSince;
+					}
+					conn = &(*conn)->next;
+					continue;
+				}
+				expired = *conn;
+				*conn = expired->next;
+				http_pool_close(expired->sock);
+				free(expired);
+			}
+			if ((*host)->active == 0 && (*host)->waiting == 0 &&
+			    (*host)->idle == NULL) {
+				freed = *host;
+				*host = freed->next;
+				free(freed);
+			} else {
+				host = &(*host)->next;
+			}
+		}
+	}
+	if (next >= 0) {
+		http_pool_schedule_sweep(next + HTTP_POOL_IDLE_TIMEOUT - now);
+	}
+	ithread_mutex_unlock(&poolMutex);
+}
+
+/*!
+ * \brief Waits for a connection to be released. Called with poolMutex held.
+ */
+static void http_pool_wait(
+	/*! [in] Milliseconds to wait at most, 0 for no limit. */
+	int timeout_ms)
+{
+	struct timespec deadline;
+#if !HTTP_POOL_COND_MONOTONIC
+	struct timeval tv;
+#endif
+
+	if (timeout_ms == 0) {
+		ithread_cond_wait(&poolCond, &poolMutex);
+		return;
+	}
+#if HTTP_POOL_COND_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+#else
+	gettimeofday(&tv, NULL);
+	deadline.tv_sec = tv.tv_sec;
+	deadline.tv_nsec = tv.tv_usec * 1000L;
+#endif
+	deadline.tv_sec += (time_t)(timeout_ms / 1000);
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	ithread_cond_timedwait(&poolCond, &poolMutex, &deadline);
+}
+
+/*!
+ * \brief Takes the most recently used idle connection of a device that is
+ * still open, closing the stale ones on the way. Called with poolMutex held.
+ *
+ * \return The socket, counted as in use, or INVALID_SOCKET if there is no
+ * such connection.
+ */
+static SOCKET http_pool_take_idle(
+	/*! [in] Entry of the device. */
+	http_pool_host *host,
+	/*! [in] Close all the idle connections instead of reusing one. */
+	int fresh)
+{
+	http_pool_conn *conn;
+	int64_t idleSince;
+	SOCKET connfd;
+
+	while ((conn = host->idle) != NULL) {
+		host->idle = conn->next;
+		connfd = conn->sock;
+		idleSince = conn->idleSince;
+		free(conn);
+		if (!fresh && sock_monotonic_ms() - idleSince <
+		    HTTP_POOL_IDLE_TIMEOUT && http_pool_alive(connfd)) {
+			host->active++;
+			return connfd;
+		}
+		http_pool_close(connfd);
+	}
+
+	return INVALID_SOCKET;
+}
+
+/*!
+ * \brief Takes a connection to a device: an idle one still open if there
+ * is one, else a new one once the device has less than
+ * HTTP_POOL_MAX_PER_HOST connections.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_TIMEDOUT, UPNP_E_FINISH, or an error code
+ * of http_ConnectMs().
+ */
+static int http_pool_acquire(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *destination,
+	/*! [in] Drop the idle connections instead of reusing one. */
+	int fresh,
+	/*! [in,out] Timeout in milliseconds, 0 for none. */
+	int *timeout_ms,
+	/*! [out] Entry of the device. */
+	http_pool_host **hostp,
+	/*! [out] Socket of the connection. */
+	SOCKET *sock,
+	/*! [out] TRUE if the connection was idle in the pool. */
+	int *reused)
+{
+	http_pool_host *host;
+	int64_t start_time = sock_monotonic_ms();
+	SOCKET connfd;
+	int connect_ms;
+
+	ithread_mutex_lock(&poolMutex);
+	if (poolShutdown) {
+		ithread_mutex_unlock(&poolMutex);
+		return UPNP_E_FINISH;
+	}
+	host = http_pool_host_get(destination);
+	if (host == NULL) {
+		ithread_mutex_unlock(&poolMutex);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	while (TRUE) {
+		connfd = http_pool_take_idle(host, fresh);
+		if (connfd != INVALID_SOCKET) {
+			ithread_mutex_unlock(&poolMutex);
+			http_pool_elapse(timeout_ms, start_time);
+			*hostp = host;
+			*sock = connfd;
+			*reused = TRUE;
+			return UPNP_E_SUCCESS;
+		}
+		if (host->active < HTTP_POOL_MAX_PER_HOST) {
+			break;
+		}
+		http_pool_elapse(timeout_ms, start_time);
+		start_time = sock_monotonic_ms();
+		if (*timeout_ms < 0) {
+			ithread_mutex_unlock(&poolMutex);
+			return UPNP_E_TIMEDOUT;
+		}
+		host->waiting++;
+		http_pool_wait(*timeout_ms);
+		host->waiting--;
+		if (poolShutdown) {
+			http_pool_host_drop(host);
+			ithread_mutex_unlock(&poolMutex);
+			return UPNP_E_FINISH;
+		}
+	}
+	host->active++;
+	ithread_mutex_unlock(&poolMutex);
+
+	http_pool_elapse(timeout_ms, start_time);
+	start_time = sock_monotonic_ms();
+	if (*timeout_ms < 0) {
+		connfd = (SOCKET)UPNP_E_TIMEDOUT;
+	} else {
+		connect_ms = http_HealthConnectTimeout(destination);
+		if (*timeout_ms > 0 && *timeout_ms < connect_ms) {
+			connect_ms = *timeout_ms;
+		}
+		connfd = http_ConnectMs(destination, connect_ms);
+		if ((int)connfd >= 0) {
+			http_HealthRtt(destination,
+				(int)(sock_monotonic_ms() - start_time));
+		}
+	}
+	if ((int)connfd < 0) {
+		ithread_mutex_lock(&poolMutex);
+		host->active--;
+		if (poolShutdown) {
+			http_pool_host_drop(host);
+		}
+		ithread_cond_broadcast(&poolCond);
+		ithread_mutex_unlock(&poolMutex);
+		return (int)connfd;
+	}
+	http_pool_elapse(timeout_ms, start_time);
+	*hostp = host;
+	*sock = connfd;
+	*reused = FALSE;
+
+	return UPNP_E_SUCCESS;
+}
+
+/*!
+ * \brief Gives a connection back to the pool, or closes it.
+ */
+static void http_pool_release(
+	/*! [in] Entry of the device. */
+	http_pool_host *host,
+	/*! [in] Socket of the connection. */
+	SOCKET sock,
+	/*! [in] TRUE if the connection can be reused. */
+	int keep)
+{
+	http_pool_conn *conn = NULL;
+
+	if (keep) {
+		conn = (http_pool_conn *)malloc(sizeof(http_pool_conn));
+	}
+	ithread_mutex_lock(&poolMutex);
+	host->active--;
+	if (conn != NULL && !poolShutdown) {
+		conn->sock = sock;
+		conn->idleSince = sock_monotonic_ms();
+		conn->next = host->idle;
+		host->idle = conn;
+		http_pool_schedule_sweep((int64_t)HTTP_POOL_IDLE_TIMEOUT);
+		conn = NULL;
+		sock = INVALID_SOCKET;
+	} else if (poolShutdown) {
+		http_pool_host_drop(host);
+	}
+	ithread_cond_broadcast(&poolCond);
+	ithread_mutex_unlock(&poolMutex);
+	free(conn);
+	if (sock != INVALID_SOCKET) {
+		http_pool_close(sock);
+	}
+}
+
+/*!
+ * \brief Tells if the connection a response was read from can carry another
+ * request.
+ *
+ * \return TRUE if it can.
+ */
+static int http_pool_reusable(
+	/*! [in] Response read completely. */
+	http_parser_t *response)
+{
+	http_header_t *header;
+	size_t i;
+
+	if (response->msg.major_version != 1 ||
+	    response->msg.minor_version < 1) {
+		return FALSE;
+	}
+	if (response->ent_position == ENTREAD_UNTIL_CLOSE) {
+		return FALSE;
+	}
+	/* bytes past the entity belong to nothing we sent. */
+	if (response->ent_position == ENTREAD_USING_CLEN &&
+	    response->msg.msg.length + response->msg.amount_discarded !=
+	    response->entity_start_position + response->content_length) {
+		return FALSE;
+	}
+	header = httpmsg_find_hdr_str(&response->msg, "CONNECTION");
+	if (header != NULL) {
+		for (i = (size_t)0; i + (size_t)5 <= header->value.length; i++) {
+			if (strncasecmp(header->value.buf + i, "close",
+				(size_t)5) == 0) {
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+int http_ConnPoolTryAcquire(
+	const struct sockaddr_storage *addr,
+	int fresh,
+	http_pool_host **hostp,
+	SOCKET *sock)
+{
+	http_pool_host *host;
+	int ret_code;
+
+	*sock = INVALID_SOCKET;
+	ithread_mutex_lock(&poolMutex);
+	if (poolShutdown) {
+		ithread_mutex_unlock(&poolMutex);
+		return UPNP_E_FINISH;
+	}
+	host = http_pool_host_get(addr);
+	if (host == NULL) {
+		ithread_mutex_unlock(&poolMutex);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	*sock = http_pool_take_idle(host, fresh);
+	if (*sock != INVALID_SOCKET) {
+		ret_code = HTTP_POOL_IDLE;
+	} else if (host->active < HTTP_POOL_MAX_PER_HOST) {
+		host->active++;
+		ret_code = HTTP_POOL_NEW;
+	} else {
+		ret_code = HTTP_POOL_FULL;
+	}
+	ithread_mutex_unlock(&poolMutex);
+	*hostp = host;
+
+	return ret_code;
+}
+
+void http_ConnPoolRelease(
+	http_pool_host *host,
+	SOCKET sock,
+	int keep)
+{
+	http_pool_release(host, sock, keep && sock != INVALID_SOCKET);
+}
+
+int http_ConnPoolReusable(http_parser_t *response)
+{
+	return http_pool_reusable(response);
+}
+
+void http_ConnPoolInit(void)
+{
+#if HTTP_POOL_COND_MONOTONIC
+	ithread_condattr_t attr;
+#endif
+
+	ithread_mutex_lock(&poolMutex);
+	if (!poolCondInit) {
+#if HTTP_POOL_COND_MONOTONIC
+		ithread_condattr_init(&attr);
+		ithread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		ithread_cond_init(&poolCond, &attr);
+		ithread_condattr_destroy(&attr);
+#else
+		ithread_cond_init(&poolCond, NULL);
+#endif
+		poolCondInit = TRUE;
+	}
+	poolShutdown = FALSE;
+	poolSweepPending = FALSE;
+	ithread_mutex_unlock(&poolMutex);
+}
+
+void http_ConnPoolDestroy(void)
+{
+	http_pool_host *host;
+	http_pool_host *next;
+	http_pool_conn *conn;
+	int i;
+
+	ithread_mutex_lock(&poolMutex);
+	poolShutdown = TRUE;
+	for (i = 0; i < HTTP_POOL_HASH_SIZE; i++) {
+		for (host = poolTable[i]; host != NULL; host = next) {
+			next = host->next;
+			while ((conn = host->idle) != NULL) {
+				host->idle = conn->next;
+				http_pool_close(conn->sock);
+				free(conn);
+			}
+			/* entries in use are freed when released. */
+			http_pool_host_drop(host);
+		}
+	}
+	if (poolCondInit) {
+		ithread_cond_broadcast(&poolCond);
+	}
+	ithread_mutex_unlock(&poolMutex);
+}
+
+/*!
+ * \brief Sends a request on a pooled connection and reads the response.
+ *
+ * \return See http_PooledRequestAndResponse().
+ */
+static int http_pool_request(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *destination,
+	/*! [in] Request to be sent. */
+	const char *request,
+	/*! [in] Length of the request. */
+	size_t request_length,
+	/*! [in] HTTP Request method. */
+	http_method_t req_method,
+	/*! [in,out] Time out in milliseconds; returns the time left. */
+	int *timeout_ms,
+	/*! [out] Parser object to receive the response. */
+	http_parser_t *response)
+{
+	http_pool_host *host;
+	SOCKINFO info;
+	SOCKET sock;
+	int http_error_code;
+	int reused;
+	int fresh = FALSE;
+	int sent;
+	int ret_code;
+
+	while (TRUE) {
+		ret_code = http_pool_acquire(destination, fresh, timeout_ms,
+			&host, &sock, &reused);
+		if (ret_code != UPNP_E_SUCCESS) {
+			parser_response_init(response, req_method);
+			return ret_code;
+		}
+		sock_init(&info, sock);
+		ret_code = sock_write_ms(&info, request, request_length,
+			timeout_ms);
+		CDBG_INFO(">>> (SENT) >>>\n%.*s\nbuf_length=%" PRIzd
+			", num_written=%d, reused=%d\n------------\n",
+			(int)request_length, request, request_length, ret_code,
+			reused);
+		sent = ret_code >= 0 && (size_t)ret_code == request_length;
+		if (sent) {
+			ret_code = http_RecvMessageMs(&info, response,
+				req_method, timeout_ms, &http_error_code);
+			if (ret_code == UPNP_E_SUCCESS) {
+				http_pool_release(host, sock,
+					http_pool_reusable(response));
+				return UPNP_E_SUCCESS;
+			}
+		} else {
+			parser_response_init(response, req_method);
+			if (ret_code != UPNP_E_TIMEDOUT) {
+				ret_code = UPNP_E_SOCKET_WRITE;
+			}
+		}
+		http_pool_release(host, sock, FALSE);
+		/* a reused connection the request could not be written to was
+		 * closed by the device while idle: try a new one. Once the
+		 * whole request is out the device may have acted on it, and
+		 * sending it again could run an action twice. */
+		if (!reused || fresh || sent || ret_code == UPNP_E_TIMEDOUT) {
+			return ret_code;
+		}
+		CDBG_INFO("Pooled connection closed by the device, "
+			"retrying on a new one\n");
+		httpmsg_destroy(&response->msg);
+		fresh = TRUE;
+	}
+}
+
+int http_PooledRequestAndResponse(
+	const struct sockaddr_storage *destination,
+	const char *request,
+	size_t request_length,
+	http_method_t req_method,
+	int *timeout_ms,
+	http_parser_t *response)
+{
+	int ret_code;
+
+	ret_code = http_HealthAdmit(destination);
+	if (ret_code != UPNP_E_SUCCESS) {
+		parser_response_init(response, req_method);
+		return ret_code;
+	}
+	ret_code = http_pool_request(destination, request, request_length,
+		req_method, timeout_ms, response);
+	http_HealthReport(destination, ret_code);
+
+	return ret_code;
+}
+
+#endif /* INCLUDE_CLIENT_APIS */
@@ -0,0 +1,346 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Health of the devices the control point sends requests to.
+ *
+ * Devices are kept in a direct mapped table hashed on their address and
+ * port: a new device replaces the one in its slot. The connection time is
+ * smoothed the way TCP smooths its round trip time (RFC 6298), and the
+ * connect timeout is the estimate plus four times its variation, within
+ * HTTP_CONNECT_TIMEOUT_MIN and HTTP_CONNECT_TIMEOUT_MAX.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+
+#include "httphealth.h"
+
+#include "ithread.h"
+#include "sock.h"
+#include "upnpapi.h"
+#include "upnputil.h"
+#include "UpnpStdInt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#undef DBG_TAG
+#define DBG_TAG "HTTP"
+
+/*! How long, in milliseconds, a half open breaker waits for the result of
+ * its probe before letting another request through. */
+#define HTTP_HEALTH_PROBE_TIME (UPNP_TIMEOUT * 1000)
+
+/*! Health of a device. */
+typedef struct http_health_entry
+{
+	/*! Address and port of the device, other fields zeroed; the family is
+	 * 0 if the slot is empty. */
+	struct sockaddr_storage addr;
+	/*! Smoothed connection time in milliseconds, -1 if unknown. */
+	int srtt;
+	/*! Variation of the connection time in milliseconds. */
+	int rttvar;
+	/*! Requests that failed in a row. */
+	int failures;
+	/*! UPNP_BREAKER_CLOSED, UPNP_BREAKER_OPEN or UPNP_BREAKER_HALF_OPEN. */
+	int state;
+	/*! How long the breaker stays open, doubled by each failed probe. */
+	int openMs;
+	/*! Monotonic time, in milliseconds, an open breaker turns half
+	 * open. */
+	int64_t retryAt;
+	/*! Monotonic time, in milliseconds, the probe of a half open breaker
+	 * is given up on; 0 if no probe is in flight. */
+	int64_t probeUntil;
+} http_health_entry;
+
+/*! Devices, protected by healthMutex. */
+static http_health_entry healthTable[HTTP_HEALTH_TABLE_SIZE];
+static ithread_mutex_t healthMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Copies the address and port of a device, zeroing the other
+ * fields, so that keys compare with memcmp().
+ */
+static void http_health_key(
+	/*! [out] Key. */
+	struct sockaddr_storage *key,
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr)
+{
+	memset(key, 0, sizeof(*key));
+	if (addr->ss_family == (sa_family_t)AF_INET6) {
+		const struct sockaddr_in6 *src =
+			(const struct sockaddr_in6 *)addr;
+		struct sockaddr_in6 *dst = (struct sockaddr_in6 *)key;
+
+		dst->sin6_family = src->sin6_family;
+		dst->sin6_port = src->sin6_port;
+		dst->sin6_addr = src->sin6_addr;
+		dst->sin6_scope_id = src->sin6_scope_id;
+	} else {
+		const struct sockaddr_in *src =
+			(const struct sockaddr_in *)addr;
+		struct sockaddr_in *dst = (struct sockaddr_in *)key;
+
+		dst->sin_family = src->sin_family;
+		dst->sin_port = src->sin_port;
+		dst->sin_addr = src->sin_addr;
+	}
+}
+
+/*!
+ * \brief Finds the entry of a device. Called with healthMutex held.
+ *
+ * \return The entry, or NULL if the device has none and \b create is
+ * FALSE.
+ */
+static http_health_entry *http_health_find(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr,
+	/*! [in] TRUE to create the entry, replacing the one in its slot. */
+	int create)
+{
+	struct sockaddr_storage key;
+	const unsigned char *bytes = (const unsigned char *)&key;
+	unsigned hash = 2166136261u;
+	http_health_entry *entry;
+	size_t i;
+
+	http_health_key(&key, addr);
+	for (i = (size_t)0; i < sizeof(key); i++) {
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	entry = &healthTable[hash & (HTTP_HEALTH_TABLE_SIZE - 1)];
+	if (entry->addr.ss_family != 0 &&
+	    memcmp(&entry->addr, &key, sizeof(key)) == 0) {
+		return entry;
+	}
+	if (!create) {
+		return NULL;
+	}
+	memset(entry, 0, sizeof(*entry));
+	memcpy(&entry->addr, &key, sizeof(key));
+	entry->srtt = -1;
+	entry->state = UPNP_BREAKER_CLOSED;
+	entry->openMs = HTTP_BREAKER_OPEN_TIME;
+
+	return entry;
+}
+
+/*!
+ * \brief Opens the breaker of a device. Called with healthMutex held.
+ */
+static void http_health_open(
+	/*! [in] Entry of the device. */
+	http_health_entry *entry,
+	/*! [in] Monotonic time in milliseconds. */
+	int64_t now)
+{
+	entry->state = UPNP_BREAKER_OPEN;
+	entry->retryAt = now + entry->openMs;
+	entry->probeUntil = 0;
+	CDBG_INFO("Device unreachable after %d failures, failing its requests "
+		"for %d ms\n", entry->failures, entry->openMs);
+}
+
+/*!
+ * \brief Computes the connect timeout of a device. Called with healthMutex
+ * held.
+ */
+static int http_health_timeout(
+	/*! [in] Entry of the device, or NULL. */
+	const http_health_entry *entry)
+{
+	int timeout;
+
+	if (entry == NULL || entry->srtt < 0) {
+		return HTTP_CONNECT_TIMEOUT_MAX;
+	}
+	timeout = entry->srtt + 4 * entry->rttvar;
+	if (timeout < HTTP_CONNECT_TIMEOUT_MIN) {
+		timeout = HTTP_CONNECT_TIMEOUT_MIN;
+	} else if (timeout > HTTP_CONNECT_TIMEOUT_MAX) {
+		timeout = HTTP_CONNECT_TIMEOUT_MAX;
+	}
+
+	return timeout;
+}
+
+int http_HealthAdmit(const struct sockaddr_storage *addr)
+{
+	http_health_entry *entry;
+	int64_t now;
+	int ret_code = UPNP_E_SUCCESS;
+
+	ithread_mutex_lock(&healthMutex);
+	entry = http_health_find(addr, FALSE);
+	if (entry != NULL && entry->state != UPNP_BREAKER_CLOSED) {
+		now = sock_monotonic_ms();
+		if (entry->state == UPNP_BREAKER_OPEN && now >= entry->retryAt) {
+			entry->state = UPNP_BREAKER_HALF_OPEN;
+		}
+		if (entry->state == UPNP_BREAKER_HALF_OPEN &&
+		    (entry->probeUntil == 0 || now >= entry->probeUntil)) {
+			/* this request is the probe. */
+			entry->probeUntil = now + HTTP_HEALTH_PROBE_TIME;
+		} else {
+			ret_code = UPNP_E_DEVICE_UNREACHABLE;
+		}
+	}
+	ithread_mutex_unlock(&healthMutex);
+
+	return ret_code;
+}
+
+void http_HealthReport(const struct sockaddr_storage *addr, int ret_code)
+{
+	http_health_entry *entry;
+	int failed;
+
+	switch (ret_code) {
+	case UPNP_E_SOCKET_CONNECT:
+	case UPNP_E_SOCKET_WRITE:
+	case UPNP_E_SOCKET_READ:
+	case UPNP_E_SOCKET_ERROR:
+	case UPNP_E_NETWORK_ERROR:
+	case UPNP_E_TIMEDOUT:
+	case UPNP_E_BAD_HTTPMSG:
+		failed = TRUE;
+		break;
+	default:
+		failed = FALSE;
+		break;
+	}
+	ithread_mutex_lock(&healthMutex);
+	entry = http_health_find(addr, failed);
+	if (entry == NULL) {
+		/* healthy and unknown: nothing to remember. */
+	} else if (ret_code == UPNP_E_SUCCESS) {
+		entry->failures = 0;
+		entry->state = UPNP_BREAKER_CLOSED;
+		entry->openMs = HTTP_BREAKER_OPEN_TIME;
+		entry->probeUntil = 0;
+	} else if (failed) {
+		entry->failures++;
+		if (entry->state == UPNP_BREAKER_HALF_OPEN) {
+			/* the probe failed. */
+			entry->openMs = entry->openMs > HTTP_BREAKER_OPEN_MAX / 2 ?
+				HTTP_BREAKER_OPEN_MAX : entry->openMs * 2;
+			http_health_open(entry, sock_monotonic_ms());
+		} else if (entry->state == UPNP_BREAKER_CLOSED &&
+			   entry->failures >= HTTP_BREAKER_FAILURES) {
+			http_health_open(entry, sock_monotonic_ms());
+		}
+	} else if (entry->state == UPNP_BREAKER_HALF_OPEN) {
+		/* the probe told nothing about the device: let another one
+		 * through. */
+		entry->probeUntil = 0;
+	}
+	ithread_mutex_unlock(&healthMutex);
+}
+
+void http_HealthRtt(const struct sockaddr_storage *addr, int rtt_ms)
+{
+	http_health_entry *entry;
+	int delta;
+
+	if (rtt_ms < 0) {
+		return;
+	}
+	ithread_mutex_lock(&healthMutex);
+	entry = http_health_find(addr, TRUE);
+	if (entry->srtt < 0) {
+		entry->srtt = rtt_ms;
+		entry->rttvar = rtt_ms / 2;
+	} else {
+		delta = entry->srtt - rtt_ms;
+		if (delta < 0) {
+			delta = -delta;
+		}
+		entry->rttvar = (3 * entry->rttvar + delta) / 4;
+		entry->srtt = (7 * entry->srtt + rtt_ms) / 8;
+	}
+	ithread_mutex_unlock(&healthMutex);
+}
+
+int http_HealthConnectTimeout(const struct sockaddr_storage *addr)
+{
+	int timeout;
+
+	ithread_mutex_lock(&healthMutex);
+	timeout = http_health_timeout(http_health_find(addr, FALSE));
+	ithread_mutex_unlock(&healthMutex);
+
+	return timeout;
+}
+
+void http_HealthGet(
+	const struct sockaddr_storage *addr,
+	struct Upnp_Device_Health *health)
+{
+	http_health_entry *entry;
+	int64_t wait;
+
+	memset(health, 0, sizeof(*health));
+	ithread_mutex_lock(&healthMutex);
+	entry = http_health_find(addr, FALSE);
+	health->ConnectTimeoutMs = http_health_timeout(entry);
+	if (entry == NULL) {
+		health->State = UPNP_BREAKER_CLOSED;
+		health->SmoothedRttMs = -1;
+	} else {
+		health->State = entry->state;
+		health->ConsecutiveFailures = entry->failures;
+		health->SmoothedRttMs = entry->srtt;
+		health->RttVariationMs = entry->rttvar;
+		if (entry->state == UPNP_BREAKER_OPEN) {
+			wait = entry->retryAt - sock_monotonic_ms();
+			health->RetryInMs = wait > 0 ? (int)wait : 0;
+		}
+	}
+	ithread_mutex_unlock(&healthMutex);
+}
+
+void http_HealthFlush(void)
+{
+	ithread_mutex_lock(&healthMutex);
+	memset(healthTable, 0, sizeof(healthTable));
+	ithread_mutex_unlock(&healthMutex);
+}
+
+#endif /* INCLUDE_CLIENT_APIS */
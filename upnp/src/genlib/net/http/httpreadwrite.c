@@ -40,6 +40,7 @@
 #include "config.h"
 
 #include "httpreadwrite.h"
+#include "httpurlcache.h"
 
 #include "unixutil.h"
 #include "upnp.h"
@@ -97,15 +98,22 @@ static int Check_Connect_And_Wait_Connection(
 	/*! [in] socket. */
 	SOCKET sock,
 	/*! [in] result of connect. */
-	int connect_res)
+	int connect_res,
+	/*! [in] Milliseconds to wait, capped to DEFAULT_TCP_CONNECT_TIMEOUT.
+	 * 0 waits DEFAULT_TCP_CONNECT_TIMEOUT. */
+	int timeout_ms)
 {
-	struct timeval tmvTimeout = {DEFAULT_TCP_CONNECT_TIMEOUT, 0};
+	struct timeval tmvTimeout;
 	int result;
 #ifdef WIN32
 	struct fd_set fdSet;
 #else
 	fd_set fdSet;
 #endif
+	if (timeout_ms <= 0 || timeout_ms > DEFAULT_TCP_CONNECT_TIMEOUT * 1000)
+		timeout_ms = DEFAULT_TCP_CONNECT_TIMEOUT * 1000;
+	tmvTimeout.tv_sec = timeout_ms / 1000;
+	tmvTimeout.tv_usec = (timeout_ms % 1000) * 1000;
 	FD_ZERO(&fdSet);
 	FD_SET(sock, &fdSet);
 
@@ -149,13 +157,16 @@ static int Check_Connect_And_Wait_Connection(
 static int private_connect(
 	SOCKET sockfd,
 	const struct sockaddr *serv_addr,
-	socklen_t addrlen)
+	socklen_t addrlen,
+	/* milliseconds left to connect, 0 for the default timeout. */
+	int timeout_ms)
 {
 #ifndef UPNP_ENABLE_BLOCKING_TCP_CONNECTIONS
 	int ret = sock_make_no_blocking(sockfd);
 	if (ret != - 1) {
 		ret = connect(sockfd, serv_addr, addrlen);
-		ret = Check_Connect_And_Wait_Connection(sockfd, ret);
+		ret = Check_Connect_And_Wait_Connection(sockfd, ret,
+			timeout_ms);
 		if (ret != - 1) {
 			ret = sock_make_blocking(sockfd);
 		}
@@ -163,6 +174,7 @@ static int private_connect(
 
 	return ret;
 #else
+	(void)timeout_ms;
 	return connect(sockfd, serv_addr, addrlen);
 #endif /* UPNP_ENABLE_BLOCKING_TCP_CONNECTIONS */
 }
@@ -205,12 +217,20 @@ int http_FixStrUrl(
 	OUT uri_type *fixed_url)
 {
 	uri_type url;
+	int ret_code;
 
+	if (http_UrlCacheGet(urlstr, urlstrlen, fixed_url)) {
+		return UPNP_E_SUCCESS;
+	}
 	if (parse_uri(urlstr, urlstrlen, &url) != HTTP_SUCCESS) {
 		return UPNP_E_INVALID_URL;
 	}
+	ret_code = http_FixUrl(&url, fixed_url);
+	if (ret_code == UPNP_E_SUCCESS) {
+		http_UrlCachePut(urlstr, urlstrlen, fixed_url);
+	}
 
-	return http_FixUrl(&url, fixed_url);
+	return ret_code;
 }
 
 /************************************************************************
@@ -231,23 +251,30 @@ int http_FixStrUrl(
 SOCKET http_Connect(
 	IN uri_type *destination_url,
 	OUT uri_type *url)
+{
+	http_FixUrl(destination_url, url);
+
+	return http_ConnectMs(&url->hostport.IPaddress, 0);
+}
+
+SOCKET http_ConnectMs(
+	IN const struct sockaddr_storage *addr,
+	IN int timeout_ms)
 {
 	SOCKET connfd;
 	socklen_t sockaddr_len;
 	int ret_connect;
 	char errorBuffer[ERROR_BUFFER_LEN];
 
-	http_FixUrl(destination_url, url);
-
-	connfd = socket((int)url->hostport.IPaddress.ss_family,
-		SOCK_STREAM, 0);
+	connfd = socket((int)addr->ss_family, SOCK_STREAM, 0);
 	if (connfd == INVALID_SOCKET) {
 		return (SOCKET)(UPNP_E_OUTOF_SOCKET);
 	}
-	sockaddr_len = (socklen_t)(url->hostport.IPaddress.ss_family == AF_INET6 ?
+	sockaddr_len = (socklen_t)(addr->ss_family == AF_INET6 ?
 		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
 	ret_connect = private_connect(connfd,
-		(struct sockaddr *)&url->hostport.IPaddress, sockaddr_len);
+		(const struct sockaddr *)addr, sockaddr_len,
+		timeout_ms);
 	if (ret_connect == -1) {
 #ifdef WIN32
 		CDBG_INFO(
@@ -266,6 +293,25 @@ SOCKET http_Connect(
 }
 
 
+int http_RecvMessage(
+	IN SOCKINFO *info,
+	OUT http_parser_t *parser,
+	IN http_method_t request_method,
+	IN OUT int *timeout_secs,
+	OUT int *http_error_code)
+{
+	int timeout_ms = sock_timeout_ms(*timeout_secs);
+	int64_t start_time = sock_monotonic_ms() / 1000;
+	int ret;
+
+	ret = http_RecvMessageMs(info, parser, request_method, &timeout_ms,
+		http_error_code);
+	if (*timeout_secs > 0)
+		*timeout_secs -= (int)(sock_monotonic_ms() / 1000 - start_time);
+
+	return ret;
+}
+
 /*!
  * \brief Get the data on the socket and take actions based on the read data to
  * modify the parser objects buffer.
@@ -277,18 +323,18 @@ SOCKET http_Connect(
  *	IN SOCKINFO *info;			Socket information object
  *	OUT http_parser_t* parser;		HTTP parser object
  *	IN http_method_t request_method;	HTTP request method
- *	IN OUT int* timeout_secs;		time out
+ *	IN OUT int* timeout_ms;			time out in milliseconds
  *	OUT int* http_error_code;		HTTP error code returned
  *
  * \return
  * 	 UPNP_E_SUCCESS
  *	 UPNP_E_BAD_HTTPMSG
  */
-int http_RecvMessage(
+int http_RecvMessageMs(
 	IN SOCKINFO *info,
 	OUT http_parser_t *parser,
 	IN http_method_t request_method,
-	IN OUT int *timeout_secs,
+	IN OUT int *timeout_ms,
 	OUT int *http_error_code)
 {
 	int ret = UPNP_E_SUCCESS;
@@ -305,7 +351,7 @@ int http_RecvMessage(
 	}
 
 	while (TRUE) {
-		num_read = sock_read(info, buf, sizeof buf, timeout_secs);
+		num_read = sock_read_ms(info, buf, sizeof buf, timeout_ms);
 		if (num_read > 0) {
 			/* got data */
 			status = parser_append(parser, buf, (size_t)num_read);
@@ -369,7 +415,7 @@ int http_RecvMessage(
 ExitFunction:
 	if (ret != UPNP_E_SUCCESS) {
 		CDBG_INFO(
-			"(http_RecvMessage): Line %d Error %d, http_error_code = %d.\n",
+			"(http_RecvMessageMs): Line %d Error %d, http_error_code = %d.\n",
 			line, ret,
 			*http_error_code);
 	}
@@ -586,13 +632,58 @@ int http_RequestAndResponse(
 	IN http_method_t req_method,
 	IN int timeout_secs,
 	OUT http_parser_t *response)
+{
+	int timeout_ms = sock_timeout_ms(timeout_secs);
+
+	return http_RequestAndResponseMs(destination, request, request_length,
+		req_method, &timeout_ms, response);
+}
+
+/************************************************************************
+ * Function: http_RequestAndResponseMs
+ *
+ * Parameters:
+ *	IN uri_type* destination;	Destination URI object which contains
+ *					remote IP address among other elements
+ *	IN const char* request;		Request to be sent
+ *	IN size_t request_length;	Length of the request
+ *	IN http_method_t req_method;	HTTP Request method
+ *	IN OUT int* timeout_ms;		time out in milliseconds, covering
+ *					the connection, the request and the
+ *					response; returns the time left
+ *	OUT http_parser_t* response;	Parser object to receive the repsonse
+ *
+ * Description:
+ *	Same as http_RequestAndResponse, with a deadline in milliseconds
+ *	measured on the monotonic clock.
+ *
+ * Returns:
+ *	UPNP_E_SOCKET_ERROR
+ * 	UPNP_E_SOCKET_CONNECT
+ *	UPNP_E_SOCKET_WRITE
+ *	UPNP_E_TIMEDOUT
+ *	Error Codes returned by http_RecvMessageMs
+ ************************************************************************/
+int http_RequestAndResponseMs(
+	IN uri_type *destination,
+	IN const char *request,
+	IN size_t request_length,
+	IN http_method_t req_method,
+	IN OUT int *timeout_ms,
+	OUT http_parser_t *response)
 {
 	SOCKET tcp_connection;
 	int ret_code;
 	size_t sockaddr_len;
 	int http_error_code;
+	int64_t start_time = sock_monotonic_ms();
+	int64_t remaining;
 	SOCKINFO info;
 
+	if (*timeout_ms < 0) {
+		parser_response_init(response, req_method);
+		return UPNP_E_TIMEDOUT;
+	}
 	tcp_connection = socket(
 		(int)destination->hostport.IPaddress.ss_family, SOCK_STREAM, 0);
 	if (tcp_connection == INVALID_SOCKET) {
@@ -609,22 +700,30 @@ int http_RequestAndResponse(
 		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
 	ret_code = private_connect(info.socket,
 		(struct sockaddr *)&(destination->hostport.IPaddress),
-		(socklen_t)sockaddr_len);
+		(socklen_t)sockaddr_len, *timeout_ms);
 	if (ret_code == -1) {
 		parser_response_init(response, req_method);
 		ret_code = UPNP_E_SOCKET_CONNECT;
 		goto end_function;
 	}
+	if (*timeout_ms != 0) {
+		remaining = *timeout_ms - (sock_monotonic_ms() - start_time);
+		*timeout_ms = remaining > 0 ? (int)remaining : -1;
+	}
 	/* send request */
-	ret_code = http_SendMessage(&info, &timeout_secs, "b",
-		request, request_length);
-	if (ret_code != 0) {
+	ret_code = sock_write_ms(&info, request, request_length, timeout_ms);
+	CDBG_INFO(">>> (SENT) >>>\n%.*s\nbuf_length=%" PRIzd
+		", num_written=%d\n------------\n",
+		(int)request_length, request, request_length, ret_code);
+	if (ret_code < 0 || (size_t)ret_code != request_length) {
 		parser_response_init(response, req_method);
+		if (ret_code != UPNP_E_TIMEDOUT)
+			ret_code = UPNP_E_SOCKET_WRITE;
 		goto end_function;
 	}
 	/* recv response */
-	ret_code = http_RecvMessage(&info, response, req_method,
-		&timeout_secs, &http_error_code);
+	ret_code = http_RecvMessageMs(&info, response, req_method,
+		timeout_ms, &http_error_code);
 
 end_function:
 	/* should shutdown completely */
@@ -1038,7 +1137,7 @@ int http_OpenHttpPost(
 		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
 	ret_code = private_connect(handle->sock_info.socket,
 		(struct sockaddr *)&(url.hostport.IPaddress),
-		(socklen_t)sockaddr_len);
+		(socklen_t)sockaddr_len, 0);
 	if (ret_code == -1) {
 		sock_destroy(&handle->sock_info, SD_BOTH);
 		ret_code = UPNP_E_SOCKET_CONNECT;
@@ -1532,7 +1631,7 @@ int http_OpenHttpGetProxy(const char *url_str, const char *proxy_str,
 	    sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
 	ret_code = private_connect(handle->sock_info.socket,
 		(struct sockaddr *)&(peer->hostport.IPaddress),
-		(socklen_t) sockaddr_len);
+		(socklen_t) sockaddr_len, 0);
 	if (ret_code == -1) {
 		sock_destroy(&handle->sock_info, SD_BOTH);
 		ret_code = UPNP_E_SOCKET_CONNECT;
@@ -2074,7 +2173,7 @@ int http_OpenHttpGetEx(
 			sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
 		errCode  = private_connect(handle->sock_info.socket,
 			(struct sockaddr *)&(url.hostport.IPaddress),
-			(socklen_t)sockaddr_len);
+			(socklen_t)sockaddr_len, 0);
 		if (errCode == -1) {
 			sock_destroy(&handle->sock_info, SD_BOTH);
 			errCode = UPNP_E_SOCKET_CONNECT;
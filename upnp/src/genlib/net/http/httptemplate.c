@@ -0,0 +1,302 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Templates of the requests the control point sends over and over.
+ *
+ * Templates are kept in a direct mapped table hashed on the kind and the
+ * URL: a new template replaces the one in its slot. They age out after
+ * HTTP_TEMPLATE_TTL, so that a URL naming a host is resolved again from
+ * time to time.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+
+#include "httptemplate.h"
+
+#include "httpreadwrite.h"
+#include "ithread.h"
+#include "sock.h"
+#include "upnp.h"
+#include "upnpapi.h"
+#include "UpnpStdInt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#undef DBG_TAG
+#define DBG_TAG "HTTP"
+
+/*! A rendered template. */
+typedef struct http_template
+{
+	http_template_kind kind;
+	/*! URL of the requests. */
+	char *url;
+	size_t urlLen;
+	/*! Host and port in \b url. */
+	size_t hostOffset;
+	size_t hostLen;
+	/*! Address and port the URL resolved to. */
+	struct sockaddr_storage dest;
+	/*! Head followed by tail, in one block. */
+	char *text;
+	size_t headLen;
+	size_t tailLen;
+	/*! Monotonic time, in milliseconds, the template expires; 0 if the
+	 * slot is empty. */
+	int64_t expires;
+} http_template;
+
+/*! Templates, protected by templateMutex. */
+static http_template templateCache[HTTP_TEMPLATE_CACHE_SIZE];
+static ithread_mutex_t templateMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Returns the slot of a kind of request to a URL.
+ */
+static http_template *http_template_slot(
+	/*! [in] Kind of request. */
+	http_template_kind kind,
+	/*! [in] URL of the request. */
+	const char *url_str,
+	/*! [in] Length of \b url_str. */
+	size_t url_len)
+{
+	unsigned hash = 2166136261u;
+	size_t i;
+
+	hash ^= (unsigned)kind;
+	hash *= 16777619u;
+	for (i = (size_t)0; i < url_len; i++) {
+		hash ^= (unsigned char)url_str[i];
+		hash *= 16777619u;
+	}
+
+	return &templateCache[hash & (HTTP_TEMPLATE_CACHE_SIZE - 1)];
+}
+
+/*!
+ * \brief Frees the template of a slot and empties it.
+ */
+static void http_template_clear(
+	/*! [in,out] Slot. */
+	http_template *tmpl)
+{
+	free(tmpl->url);
+	free(tmpl->text);
+	memset(tmpl, 0, sizeof(*tmpl));
+}
+
+/*!
+ * \brief Parses and resolves a URL, and renders the template of a kind of
+ * request to it.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_URL, UPNP_E_OUTOF_MEMORY, or an
+ * error code of \b build.
+ */
+static int http_template_make(
+	/*! [out] Template. */
+	http_template *tmpl,
+	/*! [in] Kind of request. */
+	http_template_kind kind,
+	/*! [in] URL of the request. */
+	const char *url_str,
+	/*! [in] Length of \b url_str. */
+	size_t url_len,
+	/*! [in] Renders the template. */
+	http_template_build build)
+{
+	uri_type url;
+	membuffer head;
+	membuffer tail;
+	int ret_code;
+
+	memset(tmpl, 0, sizeof(*tmpl));
+	if (http_FixStrUrl(url_str, url_len, &url) != 0) {
+		return UPNP_E_INVALID_URL;
+	}
+	membuffer_init(&head);
+	membuffer_init(&tail);
+	head.size_inc = tail.size_inc = (size_t)50;
+	ret_code = build(&url, &head, &tail);
+	if (ret_code == 0) {
+		tmpl->url = (char *)malloc(url_len + (size_t)1);
+		tmpl->text = (char *)malloc(head.length + tail.length +
+			(size_t)1);
+		if (tmpl->url == NULL || tmpl->text == NULL) {
+			http_template_clear(tmpl);
+			ret_code = UPNP_E_OUTOF_MEMORY;
+		}
+	}
+	if (ret_code == 0) {
+		memcpy(tmpl->url, url_str, url_len);
+		tmpl->url[url_len] = 0;
+		tmpl->urlLen = url_len;
+		tmpl->hostOffset = (size_t)(url.hostport.text.buff - url_str);
+		tmpl->hostLen = url.hostport.text.size;
+		memcpy(tmpl->text, head.buf, head.length);
+		memcpy(tmpl->text + head.length, tail.buf, tail.length);
+		tmpl->text[head.length + tail.length] = 0;
+		tmpl->headLen = head.length;
+		tmpl->tailLen = tail.length;
+		tmpl->kind = kind;
+		memcpy(&tmpl->dest, &url.hostport.IPaddress,
+			sizeof(tmpl->dest));
+		tmpl->expires = sock_monotonic_ms() +
+			(int64_t)HTTP_TEMPLATE_TTL * 1000;
+	}
+	membuffer_destroy(&head);
+	membuffer_destroy(&tail);
+
+	return ret_code;
+}
+
+/*!
+ * \brief Tells if a slot holds the live template of a kind of request to a
+ * URL. Called with templateMutex held.
+ */
+static int http_template_match(
+	/*! [in] Slot. */
+	const http_template *tmpl,
+	/*! [in] Kind of request. */
+	http_template_kind kind,
+	/*! [in] URL of the request. */
+	const char *url_str,
+	/*! [in] Length of \b url_str. */
+	size_t url_len)
+{
+	return tmpl->expires != 0 &&
+		sock_monotonic_ms() < tmpl->expires &&
+		tmpl->kind == kind &&
+		tmpl->urlLen == url_len &&
+		memcmp(tmpl->url, url_str, url_len) == 0;
+}
+
+int http_TemplateRender(
+	http_template_kind kind,
+	const char *url_str,
+	size_t url_len,
+	http_template_build build,
+	const memptr *vars,
+	size_t num_vars,
+	const char *body,
+	size_t body_len,
+	membuffer *request,
+	struct sockaddr_storage *dest)
+{
+	http_template *tmpl = http_template_slot(kind, url_str, url_len);
+	http_template fresh;
+	size_t total;
+	size_t i;
+	int ret_code;
+
+	ithread_mutex_lock(&templateMutex);
+	if (!http_template_match(tmpl, kind, url_str, url_len)) {
+		/* resolving the host may block: not under the lock. */
+		ithread_mutex_unlock(&templateMutex);
+		ret_code = http_template_make(&fresh, kind, url_str, url_len,
+			build);
+		if (ret_code != UPNP_E_SUCCESS) {
+			return ret_code;
+		}
+		CDBG_INFO("New request template %d for %s\n", (int)kind,
+			fresh.url);
+		ithread_mutex_lock(&templateMutex);
+		http_template_clear(tmpl);
+		*tmpl = fresh;
+	}
+
+	/* one allocation, at the final size. */
+	total = tmpl->headLen + tmpl->tailLen + body_len;
+	for (i = (size_t)0; i < num_vars; i++) {
+		total += vars[i].length;
+	}
+	ret_code = UPNP_E_OUTOF_MEMORY;
+	if (membuffer_set_size(request, total) != 0 ||
+	    membuffer_append(request, tmpl->text, tmpl->headLen) != 0) {
+		goto exit_function;
+	}
+	for (i = (size_t)0; i < num_vars; i++) {
+		if (membuffer_append(request, vars[i].buf,
+			vars[i].length) != 0) {
+			goto exit_function;
+		}
+	}
+	if (membuffer_append(request, tmpl->text + tmpl->headLen,
+		tmpl->tailLen) != 0 ||
+	    (body_len > (size_t)0 &&
+	     membuffer_append(request, body, body_len) != 0)) {
+		goto exit_function;
+	}
+	memcpy(dest, &tmpl->dest, sizeof(*dest));
+	ret_code = UPNP_E_SUCCESS;
+
+exit_function:
+	ithread_mutex_unlock(&templateMutex);
+
+	return ret_code;
+}
+
+void http_TemplateInvalidate(const char *host, size_t host_len)
+{
+	http_template *tmpl;
+	int i;
+
+	ithread_mutex_lock(&templateMutex);
+	for (i = 0; i < HTTP_TEMPLATE_CACHE_SIZE; i++) {
+		tmpl = &templateCache[i];
+		if (tmpl->expires != 0 && tmpl->hostLen == host_len &&
+		    strncasecmp(tmpl->url + tmpl->hostOffset, host,
+			host_len) == 0) {
+			http_template_clear(tmpl);
+		}
+	}
+	ithread_mutex_unlock(&templateMutex);
+}
+
+void http_TemplateFlush(void)
+{
+	int i;
+
+	ithread_mutex_lock(&templateMutex);
+	for (i = 0; i < HTTP_TEMPLATE_CACHE_SIZE; i++) {
+		http_template_clear(&templateCache[i]);
+	}
+	ithread_mutex_unlock(&templateMutex);
+}
+
+#endif /* INCLUDE_CLIENT_APIS */
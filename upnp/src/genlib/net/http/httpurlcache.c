@@ -0,0 +1,354 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Cache of the URLs parsed and resolved by http_FixStrUrl().
+ *
+ * Entries are hashed on the URL string and kept on a list from the most to
+ * the least recently used. Their tokens point into their own copy of the
+ * URL and are moved onto the caller's string on a hit.
+ */
+
+#include "config.h"
+
+#include "httpurlcache.h"
+
+#include "httptemplate.h"
+#include "ithread.h"
+#include "sock.h"
+#include "upnpapi.h"
+#include "UpnpStdInt.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#undef DBG_TAG
+#define DBG_TAG "HTTP"
+
+/*! A cached URL. */
+typedef struct http_url_entry
+{
+	/*! URL, its tokens point into it. */
+	char *url;
+	size_t urlLen;
+	unsigned hash;
+	/*! Fixed URL. */
+	uri_type fixed;
+	/*! Monotonic time, in milliseconds, the entry expires. */
+	int64_t expires;
+	/*! Next entry of the bucket. */
+	struct http_url_entry *next;
+	/*! Neighbours on the LRU list. */
+	struct http_url_entry *lruPrev;
+	struct http_url_entry *lruNext;
+} http_url_entry;
+
+/*! Cache, protected by urlCacheMutex. */
+static http_url_entry *urlCacheTable[HTTP_URL_CACHE_SIZE];
+/*! Most recently used entry. */
+static http_url_entry *urlCacheHead = NULL;
+/*! Least recently used entry, evicted first. */
+static http_url_entry *urlCacheTail = NULL;
+static int urlCacheCount = 0;
+static ithread_mutex_t urlCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Hashes a URL.
+ */
+static unsigned http_url_hash(
+	/*! [in] URL. */
+	const char *urlstr,
+	/*! [in] Length of \b urlstr. */
+	size_t urlstrlen)
+{
+	unsigned hash = 2166136261u;
+	size_t i;
+
+	for (i = (size_t)0; i < urlstrlen; i++) {
+		hash ^= (unsigned char)urlstr[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+/*!
+ * \brief Moves a token pointing into a string onto the same offset of a
+ * copy of the string. Tokens outside of it, such as the "/" path set by
+ * http_FixUrl(), are left as they are.
+ */
+static void http_url_rebase(
+	/*! [in,out] Token. */
+	token *tok,
+	/*! [in] String the token points into. */
+	const char *from,
+	/*! [in] Length of \b from. */
+	size_t len,
+	/*! [in] Copy of \b from. */
+	const char *to)
+{
+	if (tok->buff != NULL && tok->buff >= from && tok->buff <= from + len) {
+		tok->buff = to + (tok->buff - from);
+	}
+}
+
+/*!
+ * \brief Copies a fixed URL, moving its tokens onto a copy of its string.
+ */
+static void http_url_copy(
+	/*! [out] Copy. */
+	uri_type *dst,
+	/*! [in] Fixed URL. */
+	const uri_type *src,
+	/*! [in] String \b src points into. */
+	const char *from,
+	/*! [in] Length of \b from. */
+	size_t len,
+	/*! [in] Copy of \b from. */
+	const char *to)
+{
+	*dst = *src;
+	http_url_rebase(&dst->scheme, from, len, to);
+	http_url_rebase(&dst->pathquery, from, len, to);
+	http_url_rebase(&dst->fragment, from, len, to);
+	http_url_rebase(&dst->hostport.text, from, len, to);
+}
+
+/*!
+ * \brief Unlinks an entry from the LRU list.
+ */
+static void http_url_lru_remove(
+	/*! [in] Entry. */
+	http_url_entry *entry)
+{
+	if (entry->lruPrev != NULL) {
+		entry->lruPrev->lruNext = entry->lruNext;
+	} else {
+		urlCacheHead = entry->lruNext;
+	}
+	if (entry->lruNext != NULL) {
+		entry->lruNext->lruPrev = entry->lruPrev;
+	} else {
+		urlCacheTail = entry->lruPrev;
+	}
+	entry->lruPrev = entry->lruNext = NULL;
+}
+
+/*!
+ * \brief Puts an entry at the head of the LRU list.
+ */
+static void http_url_lru_push(
+	/*! [in] Entry. */
+	http_url_entry *entry)
+{
+	entry->lruPrev = NULL;
+	entry->lruNext = urlCacheHead;
+	if (urlCacheHead != NULL) {
+		urlCacheHead->lruPrev = entry;
+	} else {
+		urlCacheTail = entry;
+	}
+	urlCacheHead = entry;
+}
+
+/*!
+ * \brief Removes an entry from the cache and frees it.
+ */
+static void http_url_drop(
+	/*! [in] Entry. */
+	http_url_entry *entry)
+{
+	http_url_entry **link =
+		&urlCacheTable[entry->hash & (HTTP_URL_CACHE_SIZE - 1)];
+
+	while (*link != entry) {
+		link = &(*link)->next;
+	}
+	*link = entry->next;
+	http_url_lru_remove(entry);
+	urlCacheCount--;
+	free(entry->url);
+	free(entry);
+}
+
+/*!
+ * \brief Finds the entry of a URL, dropping it if it expired.
+ */
+static http_url_entry *http_url_find(
+	/*! [in] URL. */
+	const char *urlstr,
+	/*! [in] Length of \b urlstr. */
+	size_t urlstrlen,
+	/*! [in] Hash of the URL. */
+	unsigned hash)
+{
+	http_url_entry *entry = urlCacheTable[hash & (HTTP_URL_CACHE_SIZE - 1)];
+
+	while (entry != NULL &&
+	       (entry->hash != hash || entry->urlLen != urlstrlen ||
+		memcmp(entry->url, urlstr, urlstrlen) != 0)) {
+		entry = entry->next;
+	}
+	if (entry != NULL && sock_monotonic_ms() >= entry->expires) {
+		/* resolve the host again. */
+		http_url_drop(entry);
+		entry = NULL;
+	}
+
+	return entry;
+}
+
+int http_UrlCacheGet(
+	const char *urlstr,
+	size_t urlstrlen,
+	uri_type *fixed_url)
+{
+	http_url_entry *entry;
+	unsigned hash = http_url_hash(urlstr, urlstrlen);
+
+	ithread_mutex_lock(&urlCacheMutex);
+	entry = http_url_find(urlstr, urlstrlen, hash);
+	if (entry == NULL) {
+		ithread_mutex_unlock(&urlCacheMutex);
+		return 0;
+	}
+	http_url_lru_remove(entry);
+	http_url_lru_push(entry);
+	http_url_copy(fixed_url, &entry->fixed, entry->url, entry->urlLen,
+		urlstr);
+	ithread_mutex_unlock(&urlCacheMutex);
+
+	return 1;
+}
+
+void http_UrlCachePut(
+	const char *urlstr,
+	size_t urlstrlen,
+	const uri_type *fixed_url)
+{
+	http_url_entry *entry;
+	http_url_entry *old;
+	unsigned hash = http_url_hash(urlstr, urlstrlen);
+
+	entry = (http_url_entry *)malloc(sizeof(http_url_entry));
+	if (entry == NULL) {
+		return;
+	}
+	entry->url = (char *)malloc(urlstrlen + (size_t)1);
+	if (entry->url == NULL) {
+		free(entry);
+		return;
+	}
+	memcpy(entry->url, urlstr, urlstrlen);
+	entry->url[urlstrlen] = 0;
+	entry->urlLen = urlstrlen;
+	entry->hash = hash;
+	http_url_copy(&entry->fixed, fixed_url, urlstr, urlstrlen,
+		entry->url);
+	entry->expires = sock_monotonic_ms() +
+		(int64_t)HTTP_URL_CACHE_TTL * 1000;
+
+	ithread_mutex_lock(&urlCacheMutex);
+	/* another thread may have cached it meanwhile. */
+	old = http_url_find(urlstr, urlstrlen, hash);
+	if (old != NULL) {
+		http_url_drop(old);
+	}
+	if (urlCacheCount >= HTTP_URL_CACHE_SIZE) {
+		http_url_drop(urlCacheTail);
+	}
+	entry->next = urlCacheTable[hash & (HTTP_URL_CACHE_SIZE - 1)];
+	urlCacheTable[hash & (HTTP_URL_CACHE_SIZE - 1)] = entry;
+	http_url_lru_push(entry);
+	urlCacheCount++;
+	ithread_mutex_unlock(&urlCacheMutex);
+}
+
+/*!
+ * \brief Finds the host and port of a URL without resolving it.
+ *
+ * \return 0 on success, -1 if the URL has no host.
+ */
+static int http_url_authority(
+	/*! [in] URL. */
+	const char *location,
+	/*! [out] Host and port, pointing into \b location. */
+	token *authority)
+{
+	const char *start = strstr(location, "://");
+
+	if (start == NULL) {
+		return -1;
+	}
+	start += 3;
+	authority->buff = start;
+	authority->size = strcspn(start, "/?#");
+
+	return authority->size > (size_t)0 ? 0 : -1;
+}
+
+void http_InvalidateLocation(const char *location)
+{
+	http_url_entry *entry;
+	http_url_entry *next;
+	token authority;
+
+	if (location == NULL || http_url_authority(location, &authority) != 0) {
+		return;
+	}
+	CDBG_INFO("Dropping the cached URLs of %.*s\n",
+		(int)authority.size, authority.buff);
+	ithread_mutex_lock(&urlCacheMutex);
+	for (entry = urlCacheHead; entry != NULL; entry = next) {
+		next = entry->lruNext;
+		if (entry->fixed.hostport.text.size == authority.size &&
+		    strncasecmp(entry->fixed.hostport.text.buff,
+			authority.buff, authority.size) == 0) {
+			http_url_drop(entry);
+		}
+	}
+	ithread_mutex_unlock(&urlCacheMutex);
+#ifdef INCLUDE_CLIENT_APIS
+	http_TemplateInvalidate(authority.buff, authority.size);
+#endif
+}
+
+void http_UrlCacheFlush(void)
+{
+	ithread_mutex_lock(&urlCacheMutex);
+	while (urlCacheHead != NULL) {
+		http_url_drop(urlCacheHead);
+	}
+	ithread_mutex_unlock(&urlCacheMutex);
+}
@@ -54,6 +54,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>	/* for F_GETFL, F_SETFL, O_NONBLOCK */
+#include <limits.h>
 #include <time.h>
 #include <string.h>
 
@@ -110,9 +111,28 @@ int sock_destroy(SOCKINFO *info, int ShutdownMethod)
 	return ret;
 }
 
+int64_t sock_monotonic_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000 + (int64_t)ts.tv_nsec / 1000000;
+}
+
+int sock_timeout_ms(int timeoutSecs)
+{
+	if (timeoutSecs <= 0)
+		return timeoutSecs;
+	if (timeoutSecs > INT_MAX / 1000)
+		return INT_MAX;
+
+	return timeoutSecs * 1000;
+}
+
 /*!
- * \brief Receives or sends data. Also returns the time taken to receive or
- * send data.
+ * \brief Receives or sends data. Also returns the time left once the data is
+ * received or sent.
  *
  * \return
  *	\li \c numBytes - On Success, no of bytes received or sent or
@@ -126,8 +146,9 @@ static int sock_read_write(
 	char *buffer,
 	/*! [in] Size of the buffer. */
 	size_t bufsize,
-	/*! [in] timeout value. */
-	int *timeoutSecs,
+	/*! [in,out] Timeout in milliseconds: 0 waits forever, a negative value
+	 * times out at once. Decremented by the time taken, down to -1. */
+	int *timeoutMs,
 	/*! [in] Boolean value specifying read or write option. */
 	int bRead)
 {
@@ -136,13 +157,14 @@ static int sock_read_write(
 	fd_set writeSet;
 	struct timeval timeout;
 	long numBytes;
-	time_t start_time = time(NULL);
+	int64_t start_time = sock_monotonic_ms();
+	int64_t remaining;
 	SOCKET sockfd = info->socket;
 	long bytes_sent = 0;
 	size_t byte_left = (size_t)0;
 	ssize_t num_written;
 
-	if (*timeoutSecs < 0)
+	if (*timeoutMs < 0)
 		return UPNP_E_TIMEDOUT;
 	FD_ZERO(&readSet);
 	FD_ZERO(&writeSet);
@@ -150,17 +172,19 @@ static int sock_read_write(
 		FD_SET(sockfd, &readSet);
 	else
 		FD_SET(sockfd, &writeSet);
-	timeout.tv_sec = *timeoutSecs;
-	timeout.tv_usec = 0;
+	timeout.tv_sec = *timeoutMs / 1000;
+	timeout.tv_usec = (*timeoutMs % 1000) * 1000;
 	while (TRUE) {
-		if (*timeoutSecs == 0)
+		if (*timeoutMs == 0)
 			retCode = select(sockfd + 1, &readSet, &writeSet,
 				NULL, NULL);
 		else
 			retCode = select(sockfd + 1, &readSet, &writeSet,
 				NULL, &timeout);
-		if (retCode == 0)
+		if (retCode == 0) {
+			*timeoutMs = -1;
 			return UPNP_E_TIMEDOUT;
+		}
 		if (retCode == -1) {
 			if (errno == EINTR)
 				continue;
@@ -206,22 +230,69 @@ static int sock_read_write(
 #endif
 	if (numBytes < 0)
 		return UPNP_E_SOCKET_ERROR;
-	/* subtract time used for reading/writing. */
-	if (*timeoutSecs != 0)
-		*timeoutSecs -= (int)(time(NULL) - start_time);
+	/* subtract time used for reading/writing. An exhausted timeout must
+	 * not become 0, which would wait forever on the next call. */
+	if (*timeoutMs != 0) {
+		remaining = *timeoutMs - (sock_monotonic_ms() - start_time);
+		*timeoutMs = remaining > 0 ? (int)remaining : -1;
+	}
 
 	return (int)numBytes;
 }
 
+/*!
+ * \brief Receives or sends data with a timeout in seconds.
+ *
+ * The time taken is counted in whole seconds of the monotonic clock, and
+ * an exhausted timeout keeps its historical meaning: 0 waits forever.
+ *
+ * \return See sock_read_write().
+ */
+static int sock_read_write_secs(
+	/*! [in] Socket Information Object. */
+	SOCKINFO *info,
+	/*! [out] Buffer to get data to or send data from. */
+	char *buffer,
+	/*! [in] Size of the buffer. */
+	size_t bufsize,
+	/*! [in,out] Timeout in seconds. */
+	int *timeoutSecs,
+	/*! [in] Boolean value specifying read or write option. */
+	int bRead)
+{
+	int timeoutMs = sock_timeout_ms(*timeoutSecs);
+	int64_t start_time = sock_monotonic_ms() / 1000;
+	int ret;
+
+	ret = sock_read_write(info, buffer, bufsize, &timeoutMs, bRead);
+	if (ret >= 0 && *timeoutSecs != 0)
+		*timeoutSecs -= (int)(sock_monotonic_ms() / 1000 - start_time);
+
+	return ret;
+}
+
 int sock_read(SOCKINFO *info, char *buffer, size_t bufsize, int *timeoutSecs)
 {
-	return sock_read_write(info, buffer, bufsize, timeoutSecs, TRUE);
+	return sock_read_write_secs(info, buffer, bufsize, timeoutSecs, TRUE);
 }
 
 int sock_write(SOCKINFO *info, const char *buffer, size_t bufsize, int *timeoutSecs)
 {
 	/* Consciently removing constness. */
-	return sock_read_write(info, (char *)buffer, bufsize, timeoutSecs, FALSE);
+	return sock_read_write_secs(info, (char *)buffer, bufsize, timeoutSecs,
+		FALSE);
+}
+
+int sock_read_ms(SOCKINFO *info, char *buffer, size_t bufsize, int *timeoutMs)
+{
+	return sock_read_write(info, buffer, bufsize, timeoutMs, TRUE);
+}
+
+int sock_write_ms(SOCKINFO *info, const char *buffer, size_t bufsize,
+	int *timeoutMs)
+{
+	/* Consciently removing constness. */
+	return sock_read_write(info, (char *)buffer, bufsize, timeoutMs, FALSE);
 }
 
 int sock_make_blocking(SOCKET sock)
@@ -33,6 +33,24 @@ extern TimerThread gTimerThread;
 typedef struct s_ClientSubscription ClientSubscription;
 
 
+/*! Buckets of the client subscription index. */
+#define CLIENT_SUB_HASH_SIZE 1024
+
+
+/*!
+ * \brief Subscriptions of a control point indexed by the SID handed to the
+ * application and by the SID of the device. It is modified with the handle
+ * write lock held and can be looked up under the read lock.
+ */
+typedef struct ClientSubIndex
+{
+	/*! Subscriptions hashed on their client SID. */
+	ClientSubscription *bySID[CLIENT_SUB_HASH_SIZE];
+	/*! Subscriptions hashed on their actual SID. */
+	ClientSubscription *byActualSID[CLIENT_SUB_HASH_SIZE];
+} ClientSubIndex;
+
+
 /*!
  * \brief Constructor.
  */
@@ -196,14 +214,29 @@ void freeClientSubList(
 	ClientSubscription *list);
 
 
+/*!
+ * \brief Adds a client subscription at the head of the table and to its
+ * index. The subscription is not copied.
+ */
+void AddClientSub(
+	/*! [in,out] Head of the subscription list. */
+	ClientSubscription **head,
+	/*! [in,out] Index of the subscription list. */
+	ClientSubIndex *index,
+	/*! [in] Subscription to add. */
+	ClientSubscription *sub);
+
+
 /*!
  * \brief Remove the client subscription matching the subscritpion id
  * represented by the const Upnp_SID sid parameter from the table and
  * update the table.
  */
 void RemoveClientSubClientSID(
-	/*! [in] Head of the subscription list. */
+	/*! [in,out] Head of the subscription list. */
 	ClientSubscription **head,
+	/*! [in,out] Index of the subscription list. */
+	ClientSubIndex *index,
 	/*! [in] Subscription ID to be mactched. */
 	const UpnpString *sid);
 
@@ -215,8 +248,8 @@ void RemoveClientSubClientSID(
  * \return The matching subscription.
  */
 ClientSubscription *GetClientSubClientSID(
-	/*! [in] Head of the subscription list. */
-	ClientSubscription *head,
+	/*! [in] Index of the subscription list. */
+	ClientSubIndex *index,
 	/*! [in] Subscription ID to be mactched. */
 	const UpnpString *sid);
 
@@ -228,12 +261,25 @@ ClientSubscription *GetClientSubClientSID(
  * \return The matching subscription.
  */
 ClientSubscription *GetClientSubActualSID(
-	/*! [in] Head of the subscription list. */
-	ClientSubscription *head,
+	/*! [in] Index of the subscription list. */
+	ClientSubIndex *index,
 	/*! [in] Subscription ID to be mactched. */
 	token *sid);
 
 
+/*!
+ * \brief Changes the actual SID of a subscription of the table, moving it
+ * in the index.
+ */
+void SetClientSubActualSID(
+	/*! [in,out] Index of the subscription list. */
+	ClientSubIndex *index,
+	/*! [in,out] Subscription of the table. */
+	ClientSubscription *sub,
+	/*! [in] New actual SID. */
+	const UpnpString *actual_sid);
+
+
 #endif /* INCLUDE_CLIENT_APIS */
 
 
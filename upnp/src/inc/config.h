@@ -182,6 +182,132 @@
 #define SSDP_PAUSE  100u
 /* @} */
 
+/*!
+ * \name SSDP_RECV_BATCH
+ *
+ * The {\tt SSDP_RECV_BATCH} is the maximum number of SSDP datagrams read
+ * from a socket with a single recvmmsg() call. The whole batch is read into
+ * preallocated buffers and handed to one receive thread pool job. Setting
+ * it to 1, or building on a system without recvmmsg(), reads one datagram
+ * per job. The default value is 32.
+ *
+ * @{
+ */
+#define SSDP_RECV_BATCH 32
+/* @} */
+
+/*!
+ * \name SSDP_DEDUP_WINDOW
+ *
+ * Devices send each advertisement and search reply {\tt NUM_SSDP_COPY}
+ * times, possibly over both IPv4 and IPv6. The control point keeps a small
+ * cache of the recent (UID, NTS, LOCATION) triplets and drops the copies
+ * received within {\tt SSDP_DEDUP_WINDOW} milliseconds of the first one,
+ * before any callback. The window can be changed, or the cache disabled,
+ * with {\tt UpnpSetDiscoveryDedupWindow}. The default value is 2000
+ * milliseconds.
+ *
+ * @{
+ */
+#define SSDP_DEDUP_WINDOW 2000
+/* @} */
+
+/*!
+ * \name SSDP_DEDUP_SIZE
+ *
+ * The {\tt SSDP_DEDUP_SIZE} is the number of entries of the duplicate
+ * announcement cache. It must be a power of two. The default value is 256.
+ *
+ * @{
+ */
+#define SSDP_DEDUP_SIZE 256
+/* @} */
+
+/*!
+ * \name SSDP_DEFAULT_MAX_AGE
+ *
+ * The device presence table expires a device at the CACHE-CONTROL max-age
+ * of its last announcement. A device announced without a usable max-age is
+ * tracked for {\tt SSDP_DEFAULT_MAX_AGE} seconds instead, the lifetime the
+ * UPnP Device Architecture recommends. The default value is 1800 seconds.
+ *
+ * @{
+ */
+#define SSDP_DEFAULT_MAX_AGE 1800
+/* @} */
+
+/*!
+ * \name MINISERVER_USE_EPOLL
+ *
+ * The {\tt MINISERVER_USE_EPOLL} option selects the event loop used by the
+ * miniserver. When set to 1 the sockets are registered once with an
+ * edge-triggered epoll instance and only the ready ones are dispatched.
+ * When set to 0, or if the epoll instance cannot be created at run time,
+ * the miniserver falls back to rebuilding an fd_set for select() on every
+ * iteration. It defaults to 1 when {\tt sys/epoll.h} is available; define
+ * {\tt MINISERVER_USE_SELECT} to force the select() loop.
+ *
+ * @{
+ */
+#if defined(HAVE_SYS_EPOLL_H) && !defined(MINISERVER_USE_SELECT)
+	#define MINISERVER_USE_EPOLL 1
+#else
+	#define MINISERVER_USE_EPOLL 0
+#endif
+/* @} */
+
+/*!
+ * \name MINISERVER_MAX_EVENTS
+ *
+ * The {\tt MINISERVER_MAX_EVENTS} is the maximum number of ready sockets
+ * collected by a single epoll_wait() call of the miniserver loop. Only used
+ * when {\tt MINISERVER_USE_EPOLL} is 1. The default value is 16.
+ *
+ * @{
+ */
+#define MINISERVER_MAX_EVENTS 16
+/* @} */
+
+/*!
+ * \name MINISERVER_MAX_CONNECTIONS
+ *
+ * The {\tt MINISERVER_MAX_CONNECTIONS} is the maximum number of HTTP
+ * connections whose request the epoll loop of the miniserver reads at the
+ * same time. Connections accepted beyond it are closed at once. Connections
+ * whose request has been read and handed over to the miniserver thread pool
+ * do not count. The default value is 100.
+ *
+ * @{
+ */
+#define MINISERVER_MAX_CONNECTIONS 100
+/* @} */
+
+/*!
+ * \name MINISERVER_REQUEST_TIMEOUT
+ *
+ * The {\tt MINISERVER_REQUEST_TIMEOUT} specifies the number of seconds an
+ * HTTP client has to send its whole request, from the connection being
+ * accepted, before the miniserver closes the connection.
+ *
+ * @{
+ */
+#define MINISERVER_REQUEST_TIMEOUT HTTP_DEFAULT_TIMEOUT
+/* @} */
+
+/*!
+ * \name MINISERVER_MAX_HEADERS_SIZE
+ *
+ * The {\tt MINISERVER_MAX_HEADERS_SIZE} is the maximum size, in bytes, of
+ * the request line and headers of an HTTP request read by the epoll loop of
+ * the miniserver. Larger requests are answered with 400 Bad Request. The
+ * size of the entity is bounded by UpnpSetMaxContentLength(). The default
+ * value is 16384.
+ *
+ * @{
+ */
+#define MINISERVER_MAX_HEADERS_SIZE 16384
+/* @} */
+
 /*!
  * \name WEB_SERVER_BUF_SIZE
  * 
@@ -207,6 +333,277 @@
 #define WEB_SERVER_CONTENT_LANGUAGE ""
 /* @} */
 
+/*!
+ * \name HTTP_POOL_MAX_PER_HOST
+ *
+ * The control point keeps its HTTP/1.1 connections to the devices open and
+ * reuses them for the next SOAP action or GENA request to the same address
+ * and port. {\tt HTTP_POOL_MAX_PER_HOST} bounds the number of connections
+ * open to one device, idle or in use; further requests wait for one to be
+ * released. The default value is 4.
+ *
+ * @{
+ */
+#define HTTP_POOL_MAX_PER_HOST 4
+/* @} */
+
+/*!
+ * \name HTTP_POOL_IDLE_TIMEOUT
+ *
+ * Time, in milliseconds, a pooled connection is kept open without being
+ * used before the timer thread closes it. Devices usually drop idle
+ * connections on their own after a few seconds; this should stay below
+ * their keep-alive timeout. The default value is 5000 milliseconds.
+ *
+ * @{
+ */
+#define HTTP_POOL_IDLE_TIMEOUT 5000
+/* @} */
+
+/*!
+ * \name HTTP_POOL_HASH_SIZE
+ *
+ * Number of buckets, a power of two, of the table of devices the pool has
+ * connections to. The default value is 32.
+ *
+ * @{
+ */
+#define HTTP_POOL_HASH_SIZE 32
+/* @} */
+
+/*!
+ * \name SOAP_ASYNC_USE_EPOLL
+ *
+ * When set to 1, {\tt UpnpSendActionAsync} hands its actions to an event
+ * loop that drives the connect, request and response of all the actions in
+ * flight with non-blocking sockets and one epoll instance, on a single
+ * thread of the send thread pool. When set to 0, or if the loop cannot be
+ * started, each action blocks a thread of the send thread pool until it
+ * completes. It defaults to 1 when {\tt sys/epoll.h} is available.
+ *
+ * @{
+ */
+#if defined(HAVE_SYS_EPOLL_H)
+	#define SOAP_ASYNC_USE_EPOLL 1
+#else
+	#define SOAP_ASYNC_USE_EPOLL 0
+#endif
+/* @} */
+
+/*!
+ * \name SOAP_ASYNC_MAX_EVENTS
+ *
+ * Maximum number of ready sockets collected by a single epoll_wait() call
+ * of the action engine. The default value is 64.
+ *
+ * @{
+ */
+#define SOAP_ASYNC_MAX_EVENTS 64
+/* @} */
+
+/*!
+ * \name SOAP_ASYNC_RETRY_INTERVAL
+ *
+ * Time, in milliseconds, between two attempts of the action engine to get
+ * a connection to a device that already has {\tt HTTP_POOL_MAX_PER_HOST}
+ * connections in use. The default value is 20 milliseconds.
+ *
+ * @{
+ */
+#define SOAP_ASYNC_RETRY_INTERVAL 20
+/* @} */
+
+/*!
+ * \name SOAP_GROUP_MAX_IN_FLIGHT
+ *
+ * Number of actions of a group sent by {\tt UpnpSendGroupActionAsync} that
+ * are in flight at once when the application does not choose. The default
+ * value is 16.
+ *
+ * @{
+ */
+#define SOAP_GROUP_MAX_IN_FLIGHT 16
+/* @} */
+
+/*!
+ * \name SOAP_COALESCE_TABLE_SIZE
+ *
+ * Number of buckets, a power of two, of the table of the asynchronous
+ * actions in flight that new identical actions can join, see
+ * {\tt UpnpSetActionCoalescing}. The actions are hashed on their control
+ * URL. The default value is 64.
+ *
+ * @{
+ */
+#define SOAP_COALESCE_TABLE_SIZE 64
+/* @} */
+
+/*!
+ * \name SOAP_COALESCE_CLASS_KEY
+ *
+ * Member of the body of an action naming its command class, such as
+ * {\tt "commandName":"setSwitchVal"}. With coalescing enabled, a new
+ * action to a control URL replaces the actions of the same class to that
+ * URL that are still waiting for a connection. Actions without this member
+ * are never replaced.
+ *
+ * @{
+ */
+#define SOAP_COALESCE_CLASS_KEY "\"commandName\""
+/* @} */
+
+/*!
+ * \name SOAP_MPOST_CACHE_SIZE
+ *
+ * Number of slots, a power of two, of the cache of the control URLs that
+ * answered 405 to a POST action and accepted it as M-POST. Actions to
+ * these URLs are sent as M-POST at once, saving a round trip. A new entry
+ * replaces the one in its slot. The default value is 64.
+ *
+ * @{
+ */
+#define SOAP_MPOST_CACHE_SIZE 64
+/* @} */
+
+/*!
+ * \name SOAP_MPOST_CACHE_TTL
+ *
+ * Time, in seconds, a control URL stays in the M-POST cache. Once it ages
+ * out, the next action tries POST again, so that a device whose firmware
+ * now accepts POST is noticed. The default value is 600 seconds.
+ *
+ * @{
+ */
+#define SOAP_MPOST_CACHE_TTL 600
+/* @} */
+
+/*!
+ * \name HTTP_TEMPLATE_CACHE_SIZE
+ *
+ * Number of slots, a power of two, of the cache of request templates: the
+ * request line, HOST and fixed headers of the SOAP, SUBSCRIBE and
+ * UNSUBSCRIBE requests to a URL, rendered once along with the address the
+ * URL resolved to. A new template replaces the one in its slot. The
+ * default value is 64.
+ *
+ * @{
+ */
+#define HTTP_TEMPLATE_CACHE_SIZE 64
+/* @} */
+
+/*!
+ * \name HTTP_TEMPLATE_TTL
+ *
+ * Time, in seconds, a request template is used before it is rendered, and
+ * its URL resolved, again. The default value is 300 seconds.
+ *
+ * @{
+ */
+#define HTTP_TEMPLATE_TTL 300
+/* @} */
+
+/*!
+ * \name HTTP_URL_CACHE_SIZE
+ *
+ * Maximum number of URLs, a power of two, kept parsed and resolved by
+ * http_FixStrUrl(). Once it is reached, the least recently used URL is
+ * dropped. The default value is 256.
+ *
+ * @{
+ */
+#define HTTP_URL_CACHE_SIZE 256
+/* @} */
+
+/*!
+ * \name HTTP_URL_CACHE_TTL
+ *
+ * Time, in seconds, a parsed URL is used before it is parsed, and its host
+ * resolved, again. The entries of a device are also dropped when it
+ * announces a new LOCATION, or with {\tt UpnpInvalidateLocation}. The
+ * default value is 60 seconds.
+ *
+ * @{
+ */
+#define HTTP_URL_CACHE_TTL 60
+/* @} */
+
+/*!
+ * \name HTTP_HEALTH_TABLE_SIZE
+ *
+ * Number of slots, a power of two, of the table of the health of the
+ * devices: connection time estimate, requests failed in a row and circuit
+ * breaker, see {\tt UpnpGetDeviceHealth}. A new device replaces the one in
+ * its slot. The default value is 128.
+ *
+ * @{
+ */
+#define HTTP_HEALTH_TABLE_SIZE 128
+/* @} */
+
+/*!
+ * \name HTTP_BREAKER_FAILURES
+ *
+ * Number of requests to a device that must fail in a row, by connection
+ * failure, I/O error or timeout, for its circuit breaker to open. Requests
+ * to the device then fail at once with {\tt UPNP_E_DEVICE_UNREACHABLE}
+ * instead of holding a thread for the connect timeout. The default value
+ * is 3.
+ *
+ * @{
+ */
+#define HTTP_BREAKER_FAILURES 3
+/* @} */
+
+/*!
+ * \name HTTP_BREAKER_OPEN_TIME
+ *
+ * Time, in milliseconds, a circuit breaker stays open before letting one
+ * request through to probe the device. Each failed probe doubles it, up to
+ * {\tt HTTP_BREAKER_OPEN_MAX}; a successful request closes the breaker and
+ * resets it. The default value is 2000 milliseconds.
+ *
+ * @{
+ */
+#define HTTP_BREAKER_OPEN_TIME 2000
+/* @} */
+
+/*!
+ * \name HTTP_BREAKER_OPEN_MAX
+ *
+ * Longest time, in milliseconds, a circuit breaker stays open. The default
+ * value is 60000 milliseconds.
+ *
+ * @{
+ */
+#define HTTP_BREAKER_OPEN_MAX 60000
+/* @} */
+
+/*!
+ * \name HTTP_CONNECT_TIMEOUT_MIN
+ *
+ * The connect timeout of a device is its smoothed connection time plus
+ * four times its variation, but no less than {\tt
+ * HTTP_CONNECT_TIMEOUT_MIN} milliseconds, so that a single lost SYN, sent
+ * again after one second, does not fail the request. The default value is
+ * 1500 milliseconds.
+ *
+ * @{
+ */
+#define HTTP_CONNECT_TIMEOUT_MIN 1500
+/* @} */
+
+/*!
+ * \name HTTP_CONNECT_TIMEOUT_MAX
+ *
+ * Longest connect timeout, in milliseconds, also used for the devices the
+ * control point has not connected to yet. The default value is 5000
+ * milliseconds.
+ *
+ * @{
+ */
+#define HTTP_CONNECT_TIMEOUT_MAX 5000
+/* @} */
+
 /*!
  * \name AUTO_RENEW_TIME
  *
@@ -237,6 +634,89 @@
 #define CP_MINIMUM_SUBSCRIPTION_TIME (AUTO_RENEW_TIME + 5)
 /* @} */
 
+/*!
+ * \name GENA_RENEW_JITTER
+ *
+ * The {\tt GENA_RENEW_JITTER} is the part, in percent of the subscription
+ * time, over which automatic renewals are spread. A renewal is sent at a
+ * random time of the window that ends {\tt AUTO_RENEW_TIME} seconds before
+ * the subscription expires, so that subscriptions made together are not all
+ * renewed in the same second. The window never starts before half of the
+ * subscription time. Setting it to 0 renews exactly {\tt AUTO_RENEW_TIME}
+ * seconds before expiry. The default value is 25.
+ *
+ * @{
+ */
+#define GENA_RENEW_JITTER 25
+/* @} */
+
+/*!
+ * \name GENA_MAX_CONCURRENT_RENEWALS
+ *
+ * The {\tt GENA_MAX_CONCURRENT_RENEWALS} is the maximum number of automatic
+ * renewals sent at the same time, each one holding a thread of the send
+ * thread pool while it waits for the device. Renewals due meanwhile wait in
+ * a queue, and those to the same device are sent one after the other over
+ * its pooled connection. The default value is 4.
+ *
+ * @{
+ */
+#define GENA_MAX_CONCURRENT_RENEWALS 4
+/* @} */
+
+/*!
+ * \name GENA_RENEW_RETRY_MIN
+ *
+ * The {\tt GENA_RENEW_RETRY_MIN} is the time, in seconds, before an
+ * automatic renewal that failed to reach its device is tried again. The
+ * time doubles with every failure, up to {\tt GENA_RENEW_RETRY_MAX}.
+ * Renewals are retried until the subscription expires, and only then does
+ * the application get {\tt UPNP_EVENT_AUTORENEWAL_FAILED}. The default value
+ * is 2 seconds.
+ *
+ * @{
+ */
+#define GENA_RENEW_RETRY_MIN 2
+/* @} */
+
+/*!
+ * \name GENA_RENEW_RETRY_MAX
+ *
+ * The {\tt GENA_RENEW_RETRY_MAX} is the longest time, in seconds, between
+ * two tries of an automatic renewal. The default value is 60 seconds.
+ *
+ * @{
+ */
+#define GENA_RENEW_RETRY_MAX 60
+/* @} */
+
+/*!
+ * \name GENA_GROUP_MAX_IN_FLIGHT
+ *
+ * Number of subscriptions of a group sent by {\tt UpnpSubscribeGroupAsync}
+ * that are in flight at once when the application does not choose. The
+ * default value is 4.
+ *
+ * @{
+ */
+#define GENA_GROUP_MAX_IN_FLIGHT 4
+/* @} */
+
+
+/*!
+ * \name GENA_GROUP_MAX_THREADS
+ *
+ * The {\tt GENA_GROUP_MAX_THREADS} is the number of threads of the pool
+ * sending the subscriptions of the groups. Each subscription in flight
+ * holds one of them while it waits for its device, up to
+ * {\tt HTTP_DEFAULT_TIMEOUT}, so that at most this many subscriptions of
+ * all the groups are in flight at once. The default value is 4.
+ *
+ * @{
+ */
+#define GENA_GROUP_MAX_THREADS 4
+/* @} */
+
 
 /*!
  * \name MAX_SEARCH_TIME
@@ -188,6 +188,56 @@ EXTERN_C int genaSubscribe(
 #endif /* INCLUDE_CLIENT_APIS */
 
 
+/*!
+ * \brief Subscribes to a group of PublisherURLs, generating a single
+ * callback once every subscription completed.
+ *
+ * Up to \b max_in_flight jobs of the subscribe thread pool send the
+ * SUBSCRIBE requests, each one sending the next as soon as its previous one
+ * completes; the pool has GENA_GROUP_MAX_THREADS threads, shared by all the
+ * groups. The accepted subscriptions are added to the subscription list
+ * in batches, one locked update each: once the group completes, or as soon
+ * as an event arrives for a subscription not in the list yet.
+ *
+ * \return UPNP_E_SUCCESS if the subscriptions are on their way, otherwise
+ * 	UPNP_E_OUTOF_MEMORY.
+ */
+#ifdef INCLUDE_CLIENT_APIS
+EXTERN_C int genaSubscribeGroup(
+	/*! [in] The client handle. */
+	UpnpClient_Handle client_handle,
+	/*! [in] The URLs of the services. */
+	const char **PublisherURLs,
+	/*! [in] The number of URLs. */
+	int num_urls,
+	/*! [in] Requested duration of every subscription, -1 for "infinite". */
+	int TimeOut,
+	/*! [in] The maximum number of SUBSCRIBE requests in flight. */
+	int max_in_flight,
+	/*! [in] Callback called with UPNP_EVENT_GROUP_SUBSCRIBE_COMPLETE. */
+	Upnp_FunPtr Fun,
+	/*! [in] Cookie of the callback. */
+	const void *Cookie);
+#endif /* INCLUDE_CLIENT_APIS */
+
+
+/*!
+ * \brief Indexes the state variables of the body of an event, once: the
+ * index is kept in the event.
+ *
+ * The body is scanned as a property set, each property holding one
+ * variable; the name and value of each variable are slices of the body.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_OUTOF_MEMORY, or UPNP_E_EVENT_PROTOCOL if
+ * 	the body is not a property set.
+ */
+#ifdef INCLUDE_CLIENT_APIS
+EXTERN_C int genaEventProperties(
+	/*! [in,out] Event of a UPNP_EVENT_RECEIVED callback. */
+	struct Upnp_Event *event);
+#endif /* INCLUDE_CLIENT_APIS */
+
+
 /*!
  * \brief Unsubscribes a SID.
  *
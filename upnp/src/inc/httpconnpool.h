@@ -0,0 +1,173 @@
+#ifndef GENLIB_NET_HTTP_HTTPCONNPOOL_H
+#define GENLIB_NET_HTTP_HTTPCONNPOOL_H
+
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Pool of the persistent HTTP/1.1 connections of the control point.
+ *
+ * Connections are keyed on the address and port of the device. A request
+ * takes an idle connection to the device if there is one, else opens a new
+ * one, up to HTTP_POOL_MAX_PER_HOST. Once the response is read, the
+ * connection goes back to the pool unless the device asked to close it or
+ * sent a response delimited by the end of the connection.
+ */
+
+#include "config.h"
+#include "httpparser.h"
+#include "uri.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! The connections to one device. */
+typedef struct http_pool_host http_pool_host;
+
+/*! Results of http_ConnPoolTryAcquire(). */
+enum http_pool_acquire_e {
+	/*! An idle connection was taken. */
+	HTTP_POOL_IDLE,
+	/*! A slot was reserved: the caller opens the connection. */
+	HTTP_POOL_NEW,
+	/*! The device already has HTTP_POOL_MAX_PER_HOST connections. */
+	HTTP_POOL_FULL
+};
+
+/*!
+ * \brief Initializes the connection pool. Called by UpnpInit.
+ */
+void http_ConnPoolInit(void);
+
+/*!
+ * \brief Closes all the idle connections and stops the pool. Called by
+ * UpnpFinish before the timer thread is stopped: the requests still running
+ * fail or close their connection once done.
+ */
+void http_ConnPoolDestroy(void);
+
+/*!
+ * \brief Same as http_RequestAndResponseMs(), on a pooled connection.
+ *
+ * An idle connection that the device closed in the meantime is detected
+ * before it is used. If the request cannot be written to a reused
+ * connection, it is sent again once on a new connection; once it has been
+ * written, an error is returned as is, since the device may have acted on
+ * the request. The request fails at once if the circuit breaker of the
+ * device is open, and its outcome is reported to it.
+ *
+ * \return
+ *	\li \c UPNP_E_SUCCESS
+ *	\li \c UPNP_E_DEVICE_UNREACHABLE
+ *	\li \c UPNP_E_OUTOF_MEMORY
+ *	\li \c UPNP_E_OUTOF_SOCKET
+ *	\li \c UPNP_E_SOCKET_CONNECT
+ *	\li \c UPNP_E_SOCKET_WRITE
+ *	\li \c UPNP_E_TIMEDOUT
+ *	\li Error codes returned by http_RecvMessageMs()
+ */
+int http_PooledRequestAndResponse(
+	/*! [in] Address and port of the device, as resolved by
+	 * http_FixUrl(). */
+	const struct sockaddr_storage *destination,
+	/*! [in] Request to be sent. */
+	const char *request,
+	/*! [in] Length of the request. */
+	size_t request_length,
+	/*! [in] HTTP Request method. */
+	http_method_t req_method,
+	/*! [in,out] Time out in milliseconds, covering the wait for a
+	 * connection, the request and the response; returns the time left. */
+	int *timeout_ms,
+	/*! [out] Parser object to receive the response. */
+	http_parser_t *response);
+
+/*!
+ * \brief Takes a connection to a device without waiting, for callers that
+ * drive their sockets themselves.
+ *
+ * Unless \c HTTP_POOL_FULL or an error is returned, the connection counts
+ * as in use until it is given back with http_ConnPoolRelease(), even when
+ * the caller fails to open it. Pooled connections are in blocking mode.
+ *
+ * \return
+ *	\li \c HTTP_POOL_IDLE: \b sock is an open connection.
+ *	\li \c HTTP_POOL_NEW: \b sock is INVALID_SOCKET, the caller connects.
+ *	\li \c HTTP_POOL_FULL: try again once a connection is released.
+ *	\li \c UPNP_E_OUTOF_MEMORY
+ *	\li \c UPNP_E_FINISH: the pool is stopped.
+ */
+int http_ConnPoolTryAcquire(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr,
+	/*! [in] Close the idle connections instead of reusing one. */
+	int fresh,
+	/*! [out] Entry of the device, to pass to http_ConnPoolRelease(). */
+	http_pool_host **host,
+	/*! [out] Socket of the connection, or INVALID_SOCKET. */
+	SOCKET *sock);
+
+/*!
+ * \brief Gives back a connection taken by http_ConnPoolTryAcquire().
+ */
+void http_ConnPoolRelease(
+	/*! [in] Entry of the device. */
+	http_pool_host *host,
+	/*! [in] Socket in blocking mode, or INVALID_SOCKET if the caller
+	 * could not open the connection. */
+	SOCKET sock,
+	/*! [in] TRUE to keep the connection open for the next request, else
+	 * it is closed. */
+	int keep);
+
+/*!
+ * \brief Tells if the connection a response was read from can carry another
+ * request: HTTP/1.1, no "Connection: close", and a delimited entity with
+ * nothing past it.
+ *
+ * \return TRUE if it can.
+ */
+int http_ConnPoolReusable(
+	/*! [in] Response read completely. */
+	http_parser_t *response);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLIENT_APIS */
+
+#endif /* GENLIB_NET_HTTP_HTTPCONNPOOL_H */
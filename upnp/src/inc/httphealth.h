@@ -0,0 +1,123 @@
+#ifndef GENLIB_NET_HTTP_HTTPHEALTH_H
+#define GENLIB_NET_HTTP_HTTPHEALTH_H
+
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Health of the devices the control point sends requests to.
+ *
+ * Each device, keyed on its address and port, has a smoothed estimate of
+ * the time its connections take to open, a count of the requests that
+ * failed in a row, and a circuit breaker. After HTTP_BREAKER_FAILURES
+ * failures the breaker opens and requests fail at once with
+ * UPNP_E_DEVICE_UNREACHABLE. Once HTTP_BREAKER_OPEN_TIME has elapsed it is
+ * half open: a single request goes through, and closes the breaker if it
+ * succeeds or opens it again, for twice as long, if it fails.
+ */
+
+#include "config.h"
+#include "upnp.h"
+#include "UpnpInet.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Lets a request to a device go through, or not. Every request let
+ * through must end with http_HealthReport().
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_DEVICE_UNREACHABLE if the breaker of the
+ * device is open.
+ */
+int http_HealthAdmit(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr);
+
+/*!
+ * \brief Reports how a request let through by http_HealthAdmit() ended.
+ * Connection failures, I/O errors and timeouts count as failures of the
+ * device; errors of the control point itself, such as
+ * UPNP_E_OUTOF_MEMORY, do not count.
+ */
+void http_HealthReport(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr,
+	/*! [in] Result of the request. */
+	int ret_code);
+
+/*!
+ * \brief Adds the time a connection to a device took to open to its
+ * estimate.
+ */
+void http_HealthRtt(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr,
+	/*! [in] Milliseconds from connect() to the connection being open. */
+	int rtt_ms);
+
+/*!
+ * \brief Computes how long to wait for a connection to a device to open,
+ * from its estimate.
+ *
+ * \return Milliseconds, HTTP_CONNECT_TIMEOUT_MAX if the device has no
+ * estimate yet.
+ */
+int http_HealthConnectTimeout(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr);
+
+/*!
+ * \brief Fills the health of a device for UpnpGetDeviceHealth().
+ */
+void http_HealthGet(
+	/*! [in] Address and port of the device. */
+	const struct sockaddr_storage *addr,
+	/*! [out] Health of the device. */
+	struct Upnp_Device_Health *health);
+
+/*!
+ * \brief Forgets the health of all the devices. Called by UpnpFinish.
+ */
+void http_HealthFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLIENT_APIS */
+
+#endif /* GENLIB_NET_HTTP_HTTPHEALTH_H */
@@ -99,6 +99,20 @@ SOCKET http_Connect(
 	/*! [out] Fixed and corrected URL. */
 	uri_type *url);
 
+/*!
+ * \brief Connects to a remote address.
+ *
+ * \return Socket descriptor on success, or on error:
+ * 	\li \c UPNP_E_OUTOF_SOCKET
+ * 	\li \c UPNP_E_SOCKET_CONNECT
+ */
+SOCKET http_ConnectMs(
+	/*! [in] Address and port, as resolved by http_FixUrl(). */
+	const struct sockaddr_storage *addr,
+	/*! [in] Milliseconds to wait for the connection, 0 for the default
+	 * connect timeout. */
+	int timeout_ms);
+
 
 /************************************************************************
  * Function: http_RecvMessage
@@ -126,6 +140,30 @@ int http_RecvMessage( IN SOCKINFO *info, OUT http_parser_t* parser,
 		OUT int* http_error_code );
 
 
+/************************************************************************
+ * Function: http_RecvMessageMs
+ *
+ * Parameters:
+ *	IN SOCKINFO *info;			Socket information object
+ *	OUT http_parser_t* parser;		HTTP parser object
+ *	IN http_method_t request_method;	HTTP request method
+ *	IN OUT int* timeout_ms;			time out in milliseconds
+ *	OUT int* http_error_code;		HTTP error code returned
+ *
+ * Description:
+ *	Same as http_RecvMessage, with a timeout in milliseconds measured
+ *	on the monotonic clock. The timeout is set to -1 once used up.
+ *
+ * Returns:
+ *	 UPNP_E_BAD_HTTPMSG
+ * 	 UPNP_E_SUCCESS
+ ************************************************************************/
+int http_RecvMessageMs( IN SOCKINFO *info, OUT http_parser_t* parser,
+		IN http_method_t request_method,
+		IN OUT int* timeout_ms,
+		OUT int* http_error_code );
+
+
 /*!
  * \brief Sends a message to the destination based on the format parameter.
  *
@@ -189,6 +227,40 @@ int http_RequestAndResponse(
 	OUT http_parser_t* response );
 
 
+/************************************************************************
+ * Function: http_RequestAndResponseMs
+ *
+ * Parameters:
+ *	IN uri_type* destination;	Destination URI object which contains
+ *					remote IP address among other elements
+ *	IN const char* request;		Request to be sent
+ *	IN size_t request_length;	Length of the request
+ *	IN http_method_t req_method;	HTTP Request method
+ *	IN OUT int* timeout_ms;		time out in milliseconds, covering
+ *					the connection, the request and the
+ *					response; returns the time left
+ *	OUT http_parser_t* response;	Parser object to receive the repsonse
+ *
+ * Description:
+ *	Same as http_RequestAndResponse, with a deadline in milliseconds
+ *	measured on the monotonic clock.
+ *
+ * Returns:
+ *	UPNP_E_SOCKET_ERROR
+ * 	UPNP_E_SOCKET_CONNECT
+ *	UPNP_E_SOCKET_WRITE
+ *	UPNP_E_TIMEDOUT
+ *	Error Codes returned by http_RecvMessageMs
+ ************************************************************************/
+int http_RequestAndResponseMs(
+	IN uri_type* destination,
+	IN const char* request,
+	IN size_t request_length,
+	IN http_method_t req_method,
+	IN OUT int* timeout_ms,
+	OUT http_parser_t* response );
+
+
 /************************************************************************
  * return codes:
  *	0 -- success
@@ -0,0 +1,137 @@
+#ifndef GENLIB_NET_HTTP_HTTPTEMPLATE_H
+#define GENLIB_NET_HTTP_HTTPTEMPLATE_H
+
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Templates of the requests the control point sends over and over.
+ *
+ * The request line, HOST header and fixed headers of a kind of request to a
+ * URL are rendered once, with http_MakeMessage(), into a head and a tail.
+ * Each request then only formats its variable headers, such as
+ * CONTENT-LENGTH, SID or TIMEOUT, and is assembled from the template into a
+ * buffer allocated once at its final size. The template also keeps the
+ * address the URL resolved to, so the URL is neither parsed nor resolved
+ * again.
+ */
+
+#include "config.h"
+#include "membuffer.h"
+#include "uri.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! Kinds of templated requests. */
+typedef enum {
+	HTTP_TEMPLATE_SOAP_POST,
+	HTTP_TEMPLATE_SOAP_MPOST,
+	HTTP_TEMPLATE_GENA_SUBSCRIBE,
+	HTTP_TEMPLATE_GENA_RENEW,
+	HTTP_TEMPLATE_GENA_UNSUBSCRIBE
+} http_template_kind;
+
+/*!
+ * \brief Renders the fixed parts of a kind of request to a URL: the head
+ * goes before the variable headers, the tail after them and before the
+ * body.
+ *
+ * \return 0 on success, else an UPNP_E_* error code.
+ */
+typedef int (*http_template_build)(
+	/*! [in] Fixed URL of the request. */
+	const uri_type *url,
+	/*! [in,out] Initialized buffer receiving the head. */
+	membuffer *head,
+	/*! [in,out] Initialized buffer receiving the tail. */
+	membuffer *tail);
+
+/*!
+ * \brief Assembles a request from the template of its kind and URL,
+ * building the template with \b build if it is not cached.
+ *
+ * \return
+ *	\li \c UPNP_E_SUCCESS
+ *	\li \c UPNP_E_INVALID_URL
+ *	\li \c UPNP_E_OUTOF_MEMORY
+ *	\li Error codes returned by \b build
+ */
+int http_TemplateRender(
+	/*! [in] Kind of request. */
+	http_template_kind kind,
+	/*! [in] URL of the request. */
+	const char *url_str,
+	/*! [in] Length of \b url_str. */
+	size_t url_len,
+	/*! [in] Renders the template on a cache miss. */
+	http_template_build build,
+	/*! [in] Pieces of the variable headers, CRLF included. */
+	const memptr *vars,
+	/*! [in] Number of pieces in \b vars. */
+	size_t num_vars,
+	/*! [in] Body, or NULL. */
+	const char *body,
+	/*! [in] Length of \b body. */
+	size_t body_len,
+	/*! [in,out] Initialized, empty buffer receiving the request. */
+	membuffer *request,
+	/*! [out] Address and port of the device. */
+	struct sockaddr_storage *dest);
+
+/*!
+ * \brief Drops the templates of the requests to a host and port, as written
+ * in their URL.
+ */
+void http_TemplateInvalidate(
+	/*! [in] Host and port. */
+	const char *host,
+	/*! [in] Length of \b host. */
+	size_t host_len);
+
+/*!
+ * \brief Drops all the templates. Called by UpnpFinish, as the CALLBACK
+ * header of the subscriptions depends on the local address.
+ */
+void http_TemplateFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCLUDE_CLIENT_APIS */
+
+#endif /* GENLIB_NET_HTTP_HTTPTEMPLATE_H */
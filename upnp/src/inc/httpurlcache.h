@@ -0,0 +1,96 @@
+#ifndef GENLIB_NET_HTTP_HTTPURLCACHE_H
+#define GENLIB_NET_HTTP_HTTPURLCACHE_H
+
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Cache of the URLs parsed and resolved by http_FixStrUrl().
+ *
+ * A URL string maps to its fixed uri_type, address included, so that the
+ * same description, control and event URLs are neither parsed nor resolved
+ * again. Entries age out after HTTP_URL_CACHE_TTL seconds, the least
+ * recently used one is evicted once HTTP_URL_CACHE_SIZE are cached, and the
+ * entries of a device are dropped when its LOCATION changes.
+ */
+
+#include "config.h"
+#include "uri.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Looks a URL up.
+ *
+ * \return 1 if the URL is cached, with \b fixed_url filled and its tokens
+ * pointing into \b urlstr; 0 if it is not.
+ */
+int http_UrlCacheGet(
+	/*! [in] URL. */
+	const char *urlstr,
+	/*! [in] Length of \b urlstr. */
+	size_t urlstrlen,
+	/*! [out] Fixed URL. */
+	uri_type *fixed_url);
+
+/*!
+ * \brief Caches a URL fixed by http_FixStrUrl().
+ */
+void http_UrlCachePut(
+	/*! [in] URL. */
+	const char *urlstr,
+	/*! [in] Length of \b urlstr. */
+	size_t urlstrlen,
+	/*! [in] Fixed URL; its tokens point into \b urlstr. */
+	const uri_type *fixed_url);
+
+/*!
+ * \brief Drops the cached URLs and request templates of the host and port
+ * of a URL, typically the former LOCATION of a device.
+ */
+void http_InvalidateLocation(
+	/*! [in] URL naming the host and port. */
+	const char *location);
+
+/*!
+ * \brief Drops all the cached URLs. Called by UpnpFinish.
+ */
+void http_UrlCacheFlush(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENLIB_NET_HTTP_HTTPURLCACHE_H */
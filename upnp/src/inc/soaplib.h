@@ -59,8 +59,8 @@ void soap_device_callback(
  * Parameters:
  *	IN char* action_url: device contrl URL
  *	IN char *service_type: device service type
- *	IN IXML_Document *action_node: SOAP action node
- *	OUT IXML_Document **response_node: SOAP response node
+ *	OUT struct Upnp_Action_Complete *event: result of the action,
+ *		owning the response entity
  *
  * Description: This function is called by UPnP API to send the SOAP
  *	action request and waits till it gets the response from the device
@@ -72,7 +72,167 @@ void soap_device_callback(
  ****************************************************************************/
 int SoapSendAction(
 	IN char* action_url,
-	IN char *service_type);
+	IN char *service_type,
+	OUT struct Upnp_Action_Complete *event);
+
+/*!
+ * \brief Fills the event of a completed action. On success, the message
+ * buffer of the response is detached and handed over to the event with the
+ * entity moved to its start, so the entity is not copied.
+ */
+void SoapFillActionComplete(
+	/*! [out] Event to fill. */
+	struct Upnp_Action_Complete *Event,
+	/*! [in] Result of the action. */
+	int ErrCode,
+	/*! [in,out] Response of the device, or NULL if none was read. */
+	http_parser_t *response);
+
+/*! Identifies a control URL in the cache of the devices that accept
+ * M-POST only. */
+typedef struct SoapMethodKey
+{
+	/*! Control URL, not copied: it must outlive the key. */
+	const char *url;
+	/*! Length of the control URL. */
+	size_t length;
+	/*! Hash of the control URL. */
+	unsigned hash;
+} SoapMethodKey;
+
+/*!
+ * \brief Tells whether two keys name the same control URL. The hash is
+ * only a shortcut, the URLs themselves are compared.
+ *
+ * \return TRUE if they do.
+ */
+int SoapMethodKeyEqual(
+	/*! [in] First key. */
+	const SoapMethodKey *a,
+	/*! [in] Second key. */
+	const SoapMethodKey *b);
+
+/*!
+ * \brief Builds the request of an action from the template of its control
+ * URL: POST, or M-POST if the device is known to reject POST. The cache is
+ * looked up first, so only one template is rendered.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_URL or UPNP_E_OUTOF_MEMORY.
+ */
+int SoapMakeActionRequest(
+	/*! [in] Control URL of the device. */
+	const char *action_url,
+	/*! [in] Body of the action. */
+	const char *body,
+	/*! [out] Address and port of the device. */
+	struct sockaddr_storage *dest,
+	/*! [in,out] Initialized, empty buffer receiving the request. */
+	membuffer *request,
+	/*! [out] Key of the URL in the M-POST cache, pointing to
+	 * \b action_url. */
+	SoapMethodKey *key,
+	/*! [out] SOAPMETHOD_POST or HTTPMETHOD_MPOST. */
+	http_method_t *method);
+
+/*!
+ * \brief Records the method a control URL accepts. HTTPMETHOD_MPOST makes
+ * the next SOAP_MPOST_CACHE_TTL seconds of actions go as M-POST at once;
+ * SOAPMETHOD_POST forgets the URL.
+ */
+void SoapMethodLearn(
+	/*! [in] Key of the URL. */
+	const SoapMethodKey *key,
+	/*! [in] Method the device accepted. */
+	http_method_t method);
+
+/*!
+ * \brief Turns a POST request built by SoapMakeActionRequest() into an
+ * M-POST one, for devices answering 405 to the POST.
+ *
+ * \return 0 on success, UPNP_E_OUTOF_MEMORY on error.
+ */
+int SoapAddManHeader(
+	/*! [in,out] Request. */
+	membuffer *headers);
+
+/*!
+ * \brief Turns an M-POST request built by SoapMakeActionRequest() back
+ * into a POST one, for devices answering 405 to the M-POST.
+ */
+void SoapRemoveManHeader(
+	/*! [in,out] Request. */
+	membuffer *headers);
+
+/*!
+ * \brief Sends an action through the asynchronous action engine, starting
+ * it if needed. \b Fun is called with UPNP_CONTROL_ACTION_COMPLETE and a
+ * struct Upnp_Action_Complete on a thread of the send thread pool once the
+ * response is read or the request failed or timed out.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_URL, UPNP_E_OUTOF_MEMORY, or
+ * UPNP_E_FINISH if the engine cannot run (then nothing was sent).
+ */
+int SoapSendActionAsync(
+	/*! [in] Control URL of the device. */
+	const char *action_url,
+	/*! [in] Body of the action. */
+	const char *body,
+	/*! [in] Callback of the application. */
+	Upnp_FunPtr Fun,
+	/*! [in] Cookie passed to \b Fun. */
+	const void *Cookie);
+
+/*!
+ * \brief Stops the asynchronous action engine. The actions in flight are
+ * dropped without calling their callback. Called by UpnpFinish.
+ */
+void SoapAsyncShutdown(void);
+
+/*!
+ * \brief Copies the counters of the asynchronous action engine.
+ */
+void SoapAsyncGetStats(
+	/*! [out] Counters. */
+	struct Upnp_Action_Stats *stats);
+
+/*!
+ * \brief Sends the same action to a group of devices through the
+ * asynchronous action engine, at most \b max_in_flight at once. \b Fun is
+ * called once, with UPNP_CONTROL_GROUP_ACTION_COMPLETE and a struct
+ * Upnp_Group_Action_Complete, on a thread of the send thread pool.
+ *
+ * An action the engine refuses completes at once with its error.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_OUTOF_MEMORY, or UPNP_E_FINISH if the
+ * engine is not built in (then nothing was sent).
+ */
+int SoapSendGroupActionAsync(
+	/*! [in] Control URLs of the devices. */
+	const char **action_urls,
+	/*! [in] Number of control URLs, positive. */
+	int num_actions,
+	/*! [in] Body of the action. */
+	const char *body,
+	/*! [in] Maximum number of actions in flight, positive. */
+	int max_in_flight,
+	/*! [in] Callback of the application. */
+	Upnp_FunPtr Fun,
+	/*! [in] Cookie passed to \b Fun. */
+	const void *Cookie);
+
+/*!
+ * \brief Stops sending the actions of the groups in flight; those not sent
+ * yet complete with UPNP_E_FINISH. Called by UpnpFinish before
+ * SoapAsyncShutdown().
+ */
+void SoapGroupShutdown(void);
+
+/*!
+ * \brief Frees the groups whose actions were dropped by SoapAsyncShutdown(),
+ * without calling their callback. Called by UpnpFinish once the send thread
+ * pool is down.
+ */
+void SoapGroupFlush(void);
 
 extern const char* ContentTypeHeader;
 
@@ -43,6 +43,7 @@
 
 #include "UpnpInet.h"		/* for SOCKET, netinet/in */
 #include "UpnpGlobal.h"		/* for UPNP_INLINE */
+#include "UpnpStdInt.h"		/* for int64_t */
 
 /* The following are not defined under winsock.h */
 #ifndef SD_RECEIVE
@@ -166,6 +167,65 @@ int sock_write(
 	/*! [in,out] timeout value. */
 	int *timeoutSecs);
 
+/*!
+ * \brief Reads data on socket in sockinfo, with a timeout in milliseconds.
+ *
+ * The time taken is measured on the monotonic clock and subtracted from
+ * \b timeoutMs. Once the timeout is used up it is set to -1, so that the
+ * next call times out at once instead of waiting forever.
+ *
+ * \return Integer:
+ * \li \c numBytes - On Success, no of bytes received.
+ * \li \c UPNP_E_TIMEDOUT - Timeout.
+ * \li \c UPNP_E_SOCKET_ERROR - Error on socket calls.
+ */
+int sock_read_ms(
+	/*! [in] Socket Information Object. */
+	SOCKINFO *info,
+	/*! [out] Buffer to get data to. */
+	char* buffer,
+	/*! [in] Size of the buffer. */
+	size_t bufsize,
+	/*! [in,out] Timeout in milliseconds, 0 to wait forever. */
+	int *timeoutMs);
+
+/*!
+ * \brief Writes data on the socket in sockinfo, with a timeout in
+ * milliseconds. See sock_read_ms().
+ *
+ * \return Integer:
+ * \li \c numBytes - On Success, no of bytes sent.
+ * \li \c UPNP_E_TIMEDOUT - Timeout.
+ * \li \c UPNP_E_SOCKET_ERROR - Error on socket calls.
+ */
+int sock_write_ms(
+	/*! [in] Socket Information Object. */
+	SOCKINFO *info,
+	/*! [in] Buffer to send data from. */
+	const char *buffer,
+	/*! [in] Size of the buffer. */
+	size_t bufsize,
+	/*! [in,out] Timeout in milliseconds, 0 to wait forever. */
+	int *timeoutMs);
+
+/*!
+ * \brief Returns the time of the monotonic clock in milliseconds.
+ *
+ * Unlike time(), it does not jump when the wall clock is set, so it is the
+ * clock to measure timeouts with.
+ */
+int64_t sock_monotonic_ms(void);
+
+/*!
+ * \brief Converts a timeout in seconds to milliseconds.
+ *
+ * \return The timeout in milliseconds, 0 (no timeout) and negative
+ * (expired) values being kept as they are.
+ */
+int sock_timeout_ms(
+	/*! [in] Timeout in seconds. */
+	int timeoutSecs);
+
 /*!
  * \brief Make socket blocking.
  * 
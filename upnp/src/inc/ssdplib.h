@@ -74,6 +74,8 @@ typedef enum SsdpSearchType {
 } SType;
 
 #define BUFSIZE   (size_t)2500
+/*! Maximum number of prefixes of the receive filter. */
+#define SSDP_MAX_FILTERS 8
 #define SSDP_IP   "239.255.255.250"
 #define SSDP_IPV6_LINKLOCAL "FF02::C"
 #define SSDP_IPV6_SITELOCAL "FF05::C"
@@ -143,8 +145,50 @@ typedef struct ssdpsearcharg
 	char * searchTarget;
 	void *cookie;
 	enum SsdpSearchType requestType;
+	/*! Next search in the same SsdpSearchIndex bucket or trie node. */
+	struct ssdpsearcharg *next;
 } SsdpSearchArg;
 
+/*! Buckets of the device presence table. */
+#define SSDP_PRESENCE_HASH_SIZE 64
+
+/*! Buckets of the exact match (UDN and root device) search table. */
+#define SSDP_SEARCH_HASH_SIZE 64
+
+/*! Slots, a power of two, of the table of the last LOCATION of each
+ * device, used to drop what was cached for a former LOCATION. */
+#define SSDP_LOCATION_TABLE_SIZE 256
+
+/*! Node of the search target trie, one per byte of a device or service
+ * type. */
+typedef struct ssdp_search_node
+{
+	/*! Byte matched by this node. */
+	char c;
+	/*! First child, i.e. first node for the next byte. */
+	struct ssdp_search_node *child;
+	/*! Next node for the same byte position. */
+	struct ssdp_search_node *sibling;
+	/*! Searches whose target ends at this node. */
+	SsdpSearchArg *searches;
+} ssdp_search_node;
+
+/*! Active searches of a control point, indexed by search target. It is
+ * modified with the handle write lock held and can be looked up under the
+ * read lock. */
+typedef struct SsdpSearchIndex
+{
+	/*! ssdp:all searches, matching any reply. */
+	SsdpSearchArg *all;
+	/*! UDN and root device searches, hashed on the full target. */
+	SsdpSearchArg *exact[SSDP_SEARCH_HASH_SIZE];
+	/*! Device and service type searches. */
+	ssdp_search_node *types;
+} SsdpSearchIndex;
+
+/*! Called by ssdp_search_index_match() for every matching search. */
+typedef void (*ssdp_search_visit)(SsdpSearchArg *search, void *arg);
+
 
 typedef struct 
 {
@@ -152,6 +196,35 @@ typedef struct
 	struct sockaddr_storage dest_addr;
 } ssdp_thread_data;
 
+/*! Headers of an SSDP message used by the control point, as slices of the
+ * message buffer. A slice with a NULL buf means the header is absent. */
+typedef struct
+{
+	/*! TRUE for a NOTIFY request, FALSE for a search reply. */
+	int is_request;
+	/*! Status code of a search reply. */
+	int status_code;
+	memptr host;
+	memptr nt;
+	memptr nts;
+	memptr st;
+	memptr usn;
+	memptr uid;
+	memptr dt;
+	memptr location;
+	memptr cache_control;
+} ssdp_hdrs;
+
+/*! Result of ssdp_scan_msg(). */
+enum ssdp_scan_result {
+	/*! The headers have been extracted. */
+	SSDP_SCAN_OK,
+	/*! Well formed message the control point does not handle. */
+	SSDP_SCAN_IGNORE,
+	/*! The message must go through the HTTP parser. */
+	SSDP_SCAN_FALLBACK
+};
+
 /* globals */
 
 #ifdef INCLUDE_CLIENT_APIS
@@ -227,13 +300,99 @@ int ssdp_request_type(
 	/* [out] The event structure partially filled by this function. */
 	SsdpEvent *Evt);
 
+/*!
+ * \brief Initializes the SSDP receive buffers and counters.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int ssdp_server_init(void);
+
+/*!
+ * \brief Releases the resources allocated by ssdp_server_init(). Must be
+ * called after the receive thread pool has been shut down.
+ */
+void ssdp_server_destroy(void);
+
+/*!
+ * \brief Copies the SSDP receive counters.
+ */
+void ssdp_get_stats(
+	/* [out] Snapshot of the counters. */
+	struct Upnp_Discovery_Stats *stats);
+
+/*!
+ * \brief Adds an NT/ST prefix to the receive filter.
+ *
+ * \return UPNP_E_SUCCESS, UPNP_E_INVALID_PARAM if the prefix is too long or
+ * UPNP_E_OUTOF_BOUNDS if SSDP_MAX_FILTERS prefixes are already registered.
+ */
+int ssdp_add_filter(
+	/* [in] Prefix to accept. */
+	const char *prefix);
+
+/*!
+ * \brief Empties the receive filter, all datagrams are accepted.
+ */
+void ssdp_remove_all_filters(void);
+
+/*!
+ * \brief Sets the window of the duplicate announcement cache and empties
+ * the cache.
+ */
+void ssdp_set_dedup_window(
+	/* [in] Window in milliseconds, 0 disables the cache. */
+	int window);
+
+/*!
+ * \brief Looks up an advertisement or search reply in the duplicate cache
+ * and records it.
+ *
+ * A search reply is checked once per matching search, so that a device
+ * answering two outstanding searches is reported to both.
+ *
+ * \return TRUE if the same message was seen within the window, else FALSE.
+ */
+int ssdp_dedup_check(
+	/* [in] Headers of the message. */
+	ssdp_hdrs *hdrs,
+	/* [in] Kind of message, the event type delivered for it. */
+	Upnp_EventType event_type,
+	/* [in] timeoutEventId of the search a reply is delivered to, 0 for
+	 * advertisements. */
+	int scope);
+
 /*!
  * \brief This function reads the data from the ssdp socket.
+ *
+ * When batched receive is available, up to SSDP_RECV_BATCH datagrams are
+ * read at once and handed to a single receive job.
+ *
+ * \return The number of bytes or datagrams received, or -1 if nothing could
+ * be read, in which case errno is set by the receive call (EAGAIN on a
+ * drained non-blocking socket).
  */
-void readFromSSDPSocket(
+int readFromSSDPSocket(
 	/* [in] SSDP socket. */
 	SOCKET socket);
 
+/*!
+ * \brief Scans a NOTIFY request or a search reply in a single pass, without
+ * allocating memory or modifying the buffer.
+ *
+ * \return SSDP_SCAN_OK with the headers filled in, SSDP_SCAN_IGNORE for an
+ * M-SEARCH request, or SSDP_SCAN_FALLBACK if the message must be handled by
+ * the HTTP parser.
+ */
+enum ssdp_scan_result ssdp_scan_msg(
+	/* [in] Received datagram. */
+	char *buf,
+	/* [in] Length of the datagram. */
+	size_t length,
+	/* [in] TRUE if the datagram was read from a search request socket. */
+	int is_reply,
+	/* [out] Slices of the headers used by the control point. */
+	ssdp_hdrs *hdrs);
+
 /*!
  * \brief Creates the IPv4 and IPv6 ssdp sockets required by the
  *  control point and device operation.
@@ -252,6 +411,19 @@ int get_ssdp_sockets(
  * @{
  */
 
+/*!
+ * \brief Initializes the table of device locations. Called by
+ * ssdp_server_init().
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_INIT_FAILED.
+ */
+int ssdp_ctrlpt_init(void);
+
+/*!
+ * \brief Releases the resources allocated by ssdp_ctrlpt_init().
+ */
+void ssdp_ctrlpt_destroy(void);
+
 /*!
  * \brief This function handles the ssdp messages from the devices. These
  * messages includes the search replies, advertisement of device coming alive
@@ -270,6 +442,84 @@ void ssdp_handle_ctrlpt_msg(
 	 * Only in search reply. */
 	void *cookie);
 
+/*!
+ * \brief Same as ssdp_handle_ctrlpt_msg() for a message already reduced to
+ * its headers, either by ssdp_scan_msg() or by the HTTP parser.
+ */
+void ssdp_handle_ctrlpt_hdrs(
+	/* [in] Headers of the SSDP message from the device. */
+	ssdp_hdrs *hdrs,
+	/* [in] Address of the device. */
+	struct sockaddr_storage *dest_addr);
+
+/*!
+ * \brief Adds a search to the index. The search is not copied.
+ *
+ * \return UPNP_E_SUCCESS or UPNP_E_OUTOF_MEMORY.
+ */
+int ssdp_search_index_add(
+	/* [in] Index of the control point. */
+	SsdpSearchIndex *index,
+	/* [in] Search to add. */
+	SsdpSearchArg *search);
+
+/*!
+ * \brief Removes a search from the index. The search itself is not freed.
+ */
+void ssdp_search_index_remove(
+	/* [in] Index of the control point. */
+	SsdpSearchIndex *index,
+	/* [in] Search to remove. */
+	SsdpSearchArg *search);
+
+/*!
+ * \brief Calls \b visit for every search matching the ST header of a search
+ * reply.
+ *
+ * A device or service type search matches when the target and the ST header
+ * agree up to the length of the shorter one.
+ */
+void ssdp_search_index_match(
+	/* [in] Index of the control point. */
+	SsdpSearchIndex *index,
+	/* [in] ST header of the reply. */
+	memptr *st,
+	/* [in] Function called for each match. */
+	ssdp_search_visit visit,
+	/* [in] Argument passed to \b visit. */
+	void *arg);
+
+/*!
+ * \brief Frees the trie nodes of an index. The searches are not freed.
+ */
+void ssdp_search_index_destroy(
+	/* [in] Index of the control point. */
+	SsdpSearchIndex *index);
+
+/*!
+ * \brief Enables or disables the device presence table. Disabling it
+ * forgets all tracked devices.
+ */
+void ssdp_presence_enable(
+	/* [in] Non-zero to enable the table. */
+	int enable);
+
+/*!
+ * \brief Tracks a device announced alive or found by a search, or pushes
+ * back its deadline. An announcement without a max-age counts as
+ * SSDP_DEFAULT_MAX_AGE seconds. Does nothing if the table is disabled.
+ */
+void ssdp_presence_update(
+	/* [in] Announcement of the device, with Expires set. */
+	struct Upnp_Discovery *param);
+
+/*!
+ * \brief Stops tracking a device that said byebye.
+ */
+void ssdp_presence_remove(
+	/* [in] UID of the device. */
+	const char *uid);
+
 /*!
  * \brief Creates and send the search request for a specific URL.
  *
@@ -278,7 +528,7 @@ void ssdp_handle_ctrlpt_msg(
  * IPv6 addresses. The search target(ST) is required and must be one of
  * the following:
  *     \li "ssdp:all" : Search for all devices and services.
- *     \li "ssdp:rootdevice" : Search for root devices only.
+ *     \li "upnp:rootdevice" : Search for root devices only.
  *     \li "uuid:<device-uuid>" : Search for a particular device.
  *     \li "urn:schemas-upnp-org:device:<deviceType:v>"
  *     \li "urn:schemas-upnp-org:service:<serviceType:v>"
@@ -64,6 +64,13 @@ extern size_t g_maxContentLength;
 /* 30-second timeout */
 #define UPNP_TIMEOUT	30
 
+/*! Deadline of a SOAP action in milliseconds, see UpnpSetActionTimeoutMs. */
+extern int g_actionTimeoutMs;
+
+/*! TRUE if identical asynchronous actions in flight are sent once, see
+ * UpnpSetActionCoalescing. */
+extern int g_actionCoalescing;
+
 typedef enum {HND_INVALID=-1,HND_CLIENT,HND_DEVICE} Upnp_Handle_Type;
 
 /* Data to be stored in handle table for */
@@ -82,8 +89,12 @@ struct Handle_Info
 #ifdef INCLUDE_CLIENT_APIS
 	/*! Client subscription list. */
 	ClientSubscription *ClientSubList;
+	/*! The subscriptions of ClientSubList indexed by SID. */
+	struct ClientSubIndex *ClientSubIdx;
 	/*! Active SSDP searches. */
 	LinkedList SsdpSearchList;
+	/*! The searches of SsdpSearchList indexed by search target. */
+	struct SsdpSearchIndex *SsdpSearchIdx;
 #endif
 };
 
@@ -170,6 +181,9 @@ extern TimerThread gTimerThread;
 extern ThreadPool gRecvThreadPool;
 extern ThreadPool gSendThreadPool;
 extern ThreadPool gMiniServerThreadPool;
+#ifdef INCLUDE_CLIENT_APIS
+extern ThreadPool gSubscribeThreadPool;
+#endif
 
 
 typedef enum {
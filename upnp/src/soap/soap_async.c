@@ -0,0 +1,1282 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Asynchronous action engine of the control point.
+ *
+ * UpnpSendActionAsync() queues its action here instead of blocking a thread
+ * of the send thread pool for the whole exchange. A single loop, run as a
+ * persistent job of that pool, drives every action in flight with
+ * non-blocking sockets registered to one epoll instance. Each action is a
+ * small state machine:
+ *
+ *	WAIT_CONN -> CONNECT -> WRITE -> READ_HEADERS -> READ_BODY
+ *
+ * A POST answered by 405 goes through the states again as M-POST.
+ *
+ * Connections are taken from, and given back to, the HTTP connection pool,
+ * so the engine shares the keep-alive connections and the per device limit
+ * with the blocking requests. Actions to a device that has no connection
+ * left are parked and retried. All the actions are kept in a list sorted by
+ * deadline, from which the loop expires them with UPNP_E_TIMEDOUT.
+ *
+ * Actions to a device whose circuit breaker is open are refused before
+ * being queued. A connect in progress has a deadline of its own, adapted to
+ * the device by the health table, so that an unreachable device does not
+ * hold an action for its whole timeout.
+ *
+ * With coalescing enabled, the loop keeps the actions in flight in a table
+ * hashed on their control URL. A new action identical to one of them, same
+ * URL and same body, becomes a follower of it instead of being sent: it
+ * completes with the same result. A new action of the same command class
+ * as parked ones, which have not reached the device yet, takes them as its
+ * followers and goes in their place.
+ *
+ * The callback of a completed action runs as a job of the send thread pool,
+ * so a slow application callback does not stall the loop. Its event owns
+ * the buffer the response was read into.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+#if EXCLUDE_SOAP == 0
+
+#include "httpconnpool.h"
+#include "httphealth.h"
+#include "httpparser.h"
+#include "ithread.h"
+#include "membuffer.h"
+#include "sock.h"
+#include "statcodes.h"
+#include "ThreadPool.h"
+#include "upnp.h"
+#include "upnpapi.h"
+#include "uri.h"
+#include "soaplib.h"
+#include "UpnpInet.h"
+#include "UpnpStdInt.h"
+#include "UpnpUniStd.h" /* for close() */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if SOAP_ASYNC_USE_EPOLL
+	#include <sys/epoll.h>
+#endif /* SOAP_ASYNC_USE_EPOLL */
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#undef DBG_TAG
+#define DBG_TAG "SOAP"
+
+#if SOAP_ASYNC_USE_EPOLL
+
+/*! Deadline of the actions sent without a timeout. */
+#define SOAP_ASYNC_NO_DEADLINE INT64_MAX
+
+/*! States of an action. */
+typedef enum {
+	/*! Parked until the device has a connection available. */
+	SOAP_ASYNC_WAIT_CONN,
+	/*! Non-blocking connect in progress. */
+	SOAP_ASYNC_CONNECT,
+	/*! Sending the request. */
+	SOAP_ASYNC_WRITE,
+	/*! Reading the status line and the headers of the response. */
+	SOAP_ASYNC_READ_HEADERS,
+	/*! Reading the entity of the response. */
+	SOAP_ASYNC_READ_BODY
+} soap_async_state;
+
+/*! An action in flight. */
+typedef struct soap_async_req
+{
+	soap_async_state state;
+	/*! Address and port of the device. */
+	struct sockaddr_storage addr;
+	/*! Entry of the device in the connection pool, NULL while the action
+	 * holds no connection. */
+	http_pool_host *host;
+	SOCKET sock;
+	/*! TRUE if the connection was idle in the pool. */
+	int reused;
+	/*! TRUE once a reused connection failed: the next one is new. */
+	int fresh;
+	/*! Copy of the control URL. */
+	char *url;
+	/*! Key of the control URL in the M-POST cache, pointing to \b url. */
+	SoapMethodKey key;
+	/*! TRUE once a 405 answer turned the POST into M-POST. */
+	int probedMPost;
+	/*! TRUE once a 405 answer made the action go again with the other
+	 * method. */
+	int retried;
+	/*! POST or M-POST request. */
+	membuffer request;
+	/*! Bytes of the request sent so far. */
+	size_t sent;
+	http_method_t method;
+	http_parser_t response;
+	/*! TRUE once the response parser holds memory. */
+	int parserInit;
+	/*! TRUE if the response ends when the device closes the connection. */
+	int okOnClose;
+	/*! Monotonic time, in milliseconds, the action times out, or the
+	 * connect does while in SOAP_ASYNC_CONNECT. */
+	int64_t deadline;
+	/*! Deadline of the action while the connect deadline is in force. */
+	int64_t actionDeadline;
+	/*! Monotonic time, in milliseconds, the last connect started. */
+	int64_t connectStart;
+	/*! Result passed to the callback. */
+	int ret;
+	Upnp_FunPtr Fun;
+	const void *Cookie;
+	/*! Links of the deadline list. */
+	struct soap_async_req *prev;
+	struct soap_async_req *next;
+	/*! TRUE while in the parked list. */
+	int parked;
+	/*! Links of the parked list, or next action of the submission
+	 * queue. */
+	struct soap_async_req *parkPrev;
+	struct soap_async_req *parkNext;
+	/*! TRUE if the action may be coalesced, set on submission. */
+	int coalesce;
+	/*! Length of the body, which ends the request. */
+	size_t bodyLen;
+	/*! Offset in the body and length of the command class, see
+	 * SOAP_COALESCE_CLASS_KEY; 0 long if the body has none. */
+	size_t classOff;
+	size_t classLen;
+	/*! TRUE while in the coalescing table. */
+	int hashed;
+	/*! Next action of the bucket of the coalescing table. */
+	struct soap_async_req *hashNext;
+	/*! Actions completing with the result of this one. */
+	struct soap_async_req *followers;
+	struct soap_async_req *followNext;
+} soap_async_req;
+
+/*! A doubly linked list of actions. */
+typedef struct soap_async_list
+{
+	soap_async_req *head;
+	soap_async_req *tail;
+} soap_async_list;
+
+/*! Life cycle of the engine. */
+typedef enum {
+	SOAP_ASYNC_STOPPED,
+	SOAP_ASYNC_RUNNING,
+	SOAP_ASYNC_STOPPING
+} soap_async_run_state;
+
+/*! Protects asyncState and the submission queue. */
+static ithread_mutex_t asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+/*! Signalled when the loop has stopped. */
+static ithread_cond_t asyncCond = PTHREAD_COND_INITIALIZER;
+static soap_async_run_state asyncState = SOAP_ASYNC_STOPPED;
+/*! Actions submitted but not seen by the loop yet. */
+static soap_async_req *asyncQueue = NULL;
+static soap_async_req **asyncQueueTail = &asyncQueue;
+/*! Pipe waking the loop up on submission and shutdown. */
+static int asyncWake[2] = { -1, -1 };
+static int asyncEpoll = -1;
+
+/* Owned by the loop. */
+/*! Actions in flight, by increasing deadline. */
+static soap_async_list asyncDeadlines;
+/*! Actions waiting for a connection, oldest first. */
+static soap_async_list asyncParked;
+/*! TRUE if the loop gave a connection back since the parked actions were
+ * last retried. */
+static int asyncReleased = FALSE;
+/*! Actions in flight that others may join, by hash of their control URL. */
+static soap_async_req *asyncCoalesce[SOAP_COALESCE_TABLE_SIZE];
+/*! Counters of UpnpGetActionStats, protected by asyncMutex. */
+static struct Upnp_Action_Stats asyncStats;
+
+/*!
+ * \brief Frees an action.
+ */
+static void soap_async_free(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	soap_async_req *follower;
+
+	while ((follower = req->followers) != NULL) {
+		req->followers = follower->followNext;
+		soap_async_free(follower);
+	}
+	if (req->parserInit) {
+		httpmsg_destroy(&req->response.msg);
+	}
+	membuffer_destroy(&req->request);
+	free(req->url);
+	free(req);
+}
+
+/*!
+ * \brief Runs the callback of an action that followed another one, with a
+ * copy of the result of the other one.
+ */
+static void soap_async_complete_follower(
+	/*! [in] Follower. */
+	soap_async_req *follower,
+	/*! [in] Event of the action it followed. */
+	const struct Upnp_Action_Complete *result)
+{
+	struct Upnp_Action_Complete event;
+
+	event = *result;
+	if (result->Entity != NULL) {
+		event.Entity = (char *)malloc(result->EntityLength + (size_t)1);
+		if (event.Entity == NULL) {
+			event.ErrCode = UPNP_E_OUTOF_MEMORY;
+			event.StatusCode = 0;
+			event.EntityLength = (size_t)0;
+		} else {
+			memcpy(event.Entity, result->Entity,
+				result->EntityLength + (size_t)1);
+		}
+	}
+	follower->Fun(UPNP_CONTROL_ACTION_COMPLETE, &event,
+		(void *)follower->Cookie);
+	UpnpReleaseActionEntity(event.Entity);
+}
+
+/*!
+ * \brief Runs the callback of a completed action and frees it. Job of the
+ * send thread pool.
+ */
+static void soap_async_complete(
+	/*! [in] Completed action. */
+	soap_async_req *req)
+{
+	struct Upnp_Action_Complete event;
+	soap_async_req *follower;
+
+	if (req->ret == UPNP_E_SUCCESS) {
+		CDBG_INFO("Response:---------------\n%s\n",
+			req->response.msg.entity.buf);
+	} else {
+		CDBG_INFO("Action failed: %d\n", req->ret);
+	}
+	SoapFillActionComplete(&event, req->ret,
+		req->parserInit ? &req->response : NULL);
+	for (follower = req->followers; follower != NULL;
+	     follower = follower->followNext) {
+		soap_async_complete_follower(follower, &event);
+	}
+	req->Fun(UPNP_CONTROL_ACTION_COMPLETE, &event, (void *)req->Cookie);
+	UpnpReleaseActionEntity(event.Entity);
+	soap_async_free(req);
+}
+
+/*!
+ * \brief Inserts an action in the deadline list, searching from the tail as
+ * actions mostly come in deadline order.
+ */
+static void soap_async_deadline_insert(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	soap_async_req *after = asyncDeadlines.tail;
+
+	while (after != NULL && after->deadline > req->deadline) {
+		after = after->prev;
+	}
+	req->prev = after;
+	if (after == NULL) {
+		req->next = asyncDeadlines.head;
+		asyncDeadlines.head = req;
+	} else {
+		req->next = after->next;
+		after->next = req;
+	}
+	if (req->next == NULL) {
+		asyncDeadlines.tail = req;
+	} else {
+		req->next->prev = req;
+	}
+}
+
+/*!
+ * \brief Removes an action from the deadline list.
+ */
+static void soap_async_deadline_remove(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	if (req->prev == NULL) {
+		asyncDeadlines.head = req->next;
+	} else {
+		req->prev->next = req->next;
+	}
+	if (req->next == NULL) {
+		asyncDeadlines.tail = req->prev;
+	} else {
+		req->next->prev = req->prev;
+	}
+	req->prev = req->next = NULL;
+}
+
+/*!
+ * \brief Parks an action until a connection to its device is released.
+ */
+static void soap_async_park(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	req->state = SOAP_ASYNC_WAIT_CONN;
+	req->parked = TRUE;
+	req->parkNext = NULL;
+	req->parkPrev = asyncParked.tail;
+	if (asyncParked.tail == NULL) {
+		asyncParked.head = req;
+	} else {
+		asyncParked.tail->parkNext = req;
+	}
+	asyncParked.tail = req;
+}
+
+/*!
+ * \brief Removes an action from the parked list.
+ */
+static void soap_async_unpark(
+	/*! [in] Parked action. */
+	soap_async_req *req)
+{
+	if (req->parkPrev == NULL) {
+		asyncParked.head = req->parkNext;
+	} else {
+		req->parkPrev->parkNext = req->parkNext;
+	}
+	if (req->parkNext == NULL) {
+		asyncParked.tail = req->parkPrev;
+	} else {
+		req->parkNext->parkPrev = req->parkPrev;
+	}
+	req->parkPrev = req->parkNext = NULL;
+	req->parked = FALSE;
+}
+
+/*!
+ * \brief Finds the command class of the body of an action, the string value
+ * of its SOAP_COALESCE_CLASS_KEY member.
+ */
+static void soap_async_find_class(
+	/*! [in,out] Action. */
+	soap_async_req *req,
+	/*! [in] Body of the action. */
+	const char *body)
+{
+	const char *start = strstr(body, SOAP_COALESCE_CLASS_KEY);
+	const char *end;
+
+	req->classLen = (size_t)0;
+	if (start == NULL) {
+		return;
+	}
+	start += sizeof(SOAP_COALESCE_CLASS_KEY) - 1;
+	start += strspn(start, " \t\r\n:");
+	if (*start != '"') {
+		return;
+	}
+	start++;
+	end = strchr(start, '"');
+	if (end != NULL) {
+		req->classOff = (size_t)(start - body);
+		req->classLen = (size_t)(end - start);
+	}
+}
+
+/*!
+ * \brief Returns the body of an action, at the end of its request.
+ */
+static const char *soap_async_body(
+	/*! [in] Action. */
+	const soap_async_req *req)
+{
+	return req->request.buf + req->request.length - req->bodyLen;
+}
+
+/*!
+ * \brief Removes an action from the coalescing table.
+ */
+static void soap_async_unhash(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	soap_async_req **link =
+		&asyncCoalesce[req->key.hash & (SOAP_COALESCE_TABLE_SIZE - 1)];
+
+	while (*link != req) {
+		link = &(*link)->hashNext;
+	}
+	*link = req->hashNext;
+	req->hashNext = NULL;
+	req->hashed = FALSE;
+}
+
+/*!
+ * \brief Makes an action, and its own followers, follow another one.
+ */
+static void soap_async_follow(
+	/*! [in] Action sent. */
+	soap_async_req *leader,
+	/*! [in] Action completing with the result of \b leader. */
+	soap_async_req *follower)
+{
+	soap_async_req **tail = &leader->followers;
+
+	/* the result of the leader counts once in the health table. */
+	http_HealthReport(&follower->addr, UPNP_E_FINISH);
+	membuffer_destroy(&follower->request);
+	while (*tail != NULL) {
+		tail = &(*tail)->followNext;
+	}
+	*tail = follower;
+	tail = &follower->followNext;
+	*tail = follower->followers;
+	follower->followers = NULL;
+}
+
+/*!
+ * \brief Lets a new action join an identical action in flight, or take the
+ * place of the parked actions of its command class. Otherwise the action
+ * goes in the table, for the next ones to join it.
+ *
+ * \return TRUE if the action joined another one and must not be sent.
+ */
+static int soap_async_coalesce(
+	/*! [in] New action. */
+	soap_async_req *req)
+{
+	soap_async_req **bucket =
+		&asyncCoalesce[req->key.hash & (SOAP_COALESCE_TABLE_SIZE - 1)];
+	soap_async_req **link;
+	soap_async_req *other;
+	const char *body = soap_async_body(req);
+	unsigned long replaced = 0ul;
+
+	for (other = *bucket; other != NULL; other = other->hashNext) {
+		if (SoapMethodKeyEqual(&other->key, &req->key) &&
+		    other->bodyLen == req->bodyLen &&
+		    memcmp(soap_async_body(other), body, req->bodyLen) == 0) {
+			CDBG_INFO("Action joins an identical one in flight\n");
+			soap_async_follow(other, req);
+			ithread_mutex_lock(&asyncMutex);
+			asyncStats.Coalesced++;
+			ithread_mutex_unlock(&asyncMutex);
+			return TRUE;
+		}
+	}
+	if (req->classLen > (size_t)0) {
+		link = bucket;
+		while ((other = *link) != NULL) {
+			if (other->parked &&
+			    SoapMethodKeyEqual(&other->key, &req->key) &&
+			    other->classLen == req->classLen &&
+			    memcmp(soap_async_body(other) + other->classOff,
+				body + req->classOff, req->classLen) == 0) {
+				*link = other->hashNext;
+				other->hashNext = NULL;
+				other->hashed = FALSE;
+				soap_async_unpark(other);
+				soap_async_deadline_remove(other);
+				soap_async_follow(req, other);
+				replaced++;
+			} else {
+				link = &other->hashNext;
+			}
+		}
+	}
+	if (replaced > 0ul) {
+		CDBG_INFO("Action replaces %lu waiting ones\n", replaced);
+		ithread_mutex_lock(&asyncMutex);
+		asyncStats.Replaced += replaced;
+		ithread_mutex_unlock(&asyncMutex);
+	}
+	req->hashNext = *bucket;
+	*bucket = req;
+	req->hashed = TRUE;
+
+	return FALSE;
+}
+
+/*!
+ * \brief Registers, or changes, the events the loop waits for on the socket
+ * of an action.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int soap_async_watch(
+	/*! [in] Action. */
+	soap_async_req *req,
+	/*! [in] EPOLL_CTL_ADD or EPOLL_CTL_MOD. */
+	int op,
+	/*! [in] EPOLLIN or EPOLLOUT. */
+	uint32_t events)
+{
+	struct epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.ptr = req;
+
+	return epoll_ctl(asyncEpoll, op, req->sock, &ev);
+}
+
+/*!
+ * \brief Gives the connection of an action back to the pool, or closes it.
+ */
+static void soap_async_drop_conn(
+	/*! [in] Action. */
+	soap_async_req *req,
+	/*! [in] TRUE if the connection can carry another request. */
+	int keep)
+{
+	if (req->sock != INVALID_SOCKET) {
+		epoll_ctl(asyncEpoll, EPOLL_CTL_DEL, req->sock, NULL);
+		/* pooled connections are in blocking mode. */
+		if (keep && sock_make_blocking(req->sock) == -1) {
+			keep = FALSE;
+		}
+	}
+	if (req->host != NULL) {
+		http_ConnPoolRelease(req->host, req->sock, keep);
+		asyncReleased = TRUE;
+	} else if (req->sock != INVALID_SOCKET) {
+		UpnpCloseSocket(req->sock);
+	}
+	req->host = NULL;
+	req->sock = INVALID_SOCKET;
+}
+
+/*!
+ * \brief Ends an action and hands its callback over to the send thread
+ * pool.
+ */
+static void soap_async_finish(
+	/*! [in] Action. */
+	soap_async_req *req,
+	/*! [in] Result of the action. */
+	int ret)
+{
+	ThreadPoolJob job;
+
+	soap_async_drop_conn(req, FALSE);
+	if (req->parked) {
+		soap_async_unpark(req);
+	}
+	if (req->hashed) {
+		soap_async_unhash(req);
+	}
+	soap_async_deadline_remove(req);
+	req->ret = ret;
+	membuffer_destroy(&req->request);
+	http_HealthReport(&req->addr, ret);
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)soap_async_complete, req);
+	TPJobSetFreeFunction(&job, (free_routine)soap_async_free);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gSendThreadPool, &job, NULL) != 0) {
+		/* job queue full: better late on this thread than never. */
+		soap_async_complete(req);
+	}
+}
+
+static void soap_async_acquire(soap_async_req *req);
+
+/*!
+ * \brief Handles an I/O error on the connection of an action. A reused
+ * connection the request could not be written to was closed by the device
+ * while idle: the action goes again on a new connection. Once the whole
+ * request is out the device may have run it, so the error is returned.
+ */
+static void soap_async_fail(
+	/*! [in] Action. */
+	soap_async_req *req,
+	/*! [in] Error code. */
+	int ret)
+{
+	if (!req->reused || req->fresh ||
+	    req->sent >= req->request.length) {
+		soap_async_finish(req, ret);
+		return;
+	}
+	CDBG_INFO("Pooled connection closed by the device, "
+		"retrying on a new one\n");
+	soap_async_drop_conn(req, FALSE);
+	req->fresh = TRUE;
+	soap_async_acquire(req);
+}
+
+/*!
+ * \brief Moves an action to a new deadline in the deadline list.
+ */
+static void soap_async_set_deadline(
+	/*! [in] Action. */
+	soap_async_req *req,
+	/*! [in] Monotonic time in milliseconds. */
+	int64_t deadline)
+{
+	if (req->deadline != deadline) {
+		soap_async_deadline_remove(req);
+		req->deadline = deadline;
+		soap_async_deadline_insert(req);
+	}
+}
+
+/*!
+ * \brief Ends the connect of an action: the time it took goes to the health
+ * table and the action gets its own deadline back.
+ */
+static void soap_async_connected(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	http_HealthRtt(&req->addr,
+		(int)(sock_monotonic_ms() - req->connectStart));
+	soap_async_set_deadline(req, req->actionDeadline);
+	req->state = SOAP_ASYNC_WRITE;
+}
+
+/*!
+ * \brief Opens a new connection for an action, in a slot reserved in the
+ * pool.
+ */
+static void soap_async_connect(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	socklen_t addrlen;
+	int64_t connect_deadline;
+
+	req->reused = FALSE;
+	req->sock = socket((int)req->addr.ss_family, SOCK_STREAM, 0);
+	if (req->sock == INVALID_SOCKET) {
+		soap_async_finish(req, UPNP_E_OUTOF_SOCKET);
+		return;
+	}
+	if (sock_make_no_blocking(req->sock) == -1) {
+		soap_async_finish(req, UPNP_E_SOCKET_CONNECT);
+		return;
+	}
+	addrlen = (socklen_t)(req->addr.ss_family == AF_INET6 ?
+		sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in));
+	req->connectStart = sock_monotonic_ms();
+	req->actionDeadline = req->deadline;
+	if (connect(req->sock, (struct sockaddr *)&req->addr, addrlen) == 0) {
+		soap_async_connected(req);
+	} else if (errno == EINPROGRESS) {
+		req->state = SOAP_ASYNC_CONNECT;
+		connect_deadline = req->connectStart +
+			http_HealthConnectTimeout(&req->addr);
+		if (connect_deadline < req->deadline) {
+			soap_async_set_deadline(req, connect_deadline);
+		}
+	} else {
+		soap_async_finish(req, UPNP_E_SOCKET_CONNECT);
+		return;
+	}
+	if (soap_async_watch(req, EPOLL_CTL_ADD, EPOLLOUT) == -1) {
+		soap_async_finish(req, UPNP_E_SOCKET_ERROR);
+	}
+}
+
+/*!
+ * \brief Gets a connection for an action: an idle pooled one, a new one,
+ * or none yet, in which case the action is parked.
+ */
+static void soap_async_acquire(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	int ret_code;
+
+	req->sent = (size_t)0;
+	if (req->parserInit) {
+		/* a failed attempt, or the 405 answer to the POST. */
+		httpmsg_destroy(&req->response.msg);
+		req->parserInit = FALSE;
+	}
+	ret_code = http_ConnPoolTryAcquire(&req->addr, req->fresh, &req->host,
+		&req->sock);
+	switch (ret_code) {
+	case HTTP_POOL_IDLE:
+		req->reused = TRUE;
+		req->state = SOAP_ASYNC_WRITE;
+		if (sock_make_no_blocking(req->sock) == -1 ||
+		    soap_async_watch(req, EPOLL_CTL_ADD, EPOLLOUT) == -1) {
+			soap_async_fail(req, UPNP_E_SOCKET_ERROR);
+		}
+		break;
+	case HTTP_POOL_NEW:
+		soap_async_connect(req);
+		break;
+	case HTTP_POOL_FULL:
+		req->host = NULL;
+		soap_async_park(req);
+		break;
+	default:
+		req->host = NULL;
+		soap_async_finish(req, ret_code);
+		break;
+	}
+}
+
+/*!
+ * \brief Retries the parked actions.
+ */
+static void soap_async_retry_parked(void)
+{
+	soap_async_list parked = asyncParked;
+	soap_async_req *req;
+
+	asyncParked.head = asyncParked.tail = NULL;
+	asyncReleased = FALSE;
+	while ((req = parked.head) != NULL) {
+		parked.head = req->parkNext;
+		req->parkPrev = req->parkNext = NULL;
+		req->parked = FALSE;
+		soap_async_acquire(req);
+	}
+}
+
+/*!
+ * \brief Handles a complete response: retries once with the other method
+ * on 405, else ends the action.
+ */
+static void soap_async_response(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	http_parser_t *response = &req->response;
+	int keep = http_ConnPoolReusable(response);
+
+	CDBG_INFO("<<< (RECVD) <<<\n%s\n-----------------\n",
+		response->msg.msg.buf);
+	if (response->msg.status_code == HTTP_METHOD_NOT_ALLOWED &&
+	    !req->retried) {
+		soap_async_drop_conn(req, keep);
+		if (req->method == SOAPMETHOD_POST) {
+			if (SoapAddManHeader(&req->request) != 0) {
+				soap_async_finish(req, UPNP_E_OUTOF_MEMORY);
+				return;
+			}
+			req->method = HTTPMETHOD_MPOST;
+			req->probedMPost = TRUE;
+		} else {
+			/* the device no longer wants M-POST. */
+			SoapMethodLearn(&req->key, SOAPMETHOD_POST);
+			SoapRemoveManHeader(&req->request);
+			req->method = SOAPMETHOD_POST;
+		}
+		req->retried = TRUE;
+		req->fresh = FALSE;
+		soap_async_acquire(req);
+		return;
+	}
+	if (req->method == HTTPMETHOD_MPOST) {
+		if (response->msg.status_code == HTTP_METHOD_NOT_ALLOWED) {
+			/* the next action tries POST again. */
+			SoapMethodLearn(&req->key, SOAPMETHOD_POST);
+		} else if (req->probedMPost) {
+			SoapMethodLearn(&req->key, HTTPMETHOD_MPOST);
+		}
+	}
+	soap_async_drop_conn(req, keep);
+	soap_async_finish(req, UPNP_E_SUCCESS);
+}
+
+/*!
+ * \brief Sends what the socket accepts of the request, then waits for the
+ * response.
+ */
+static void soap_async_write(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	ssize_t n;
+
+	while (req->sent < req->request.length) {
+		n = send(req->sock, req->request.buf + req->sent,
+			req->request.length - req->sent, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				soap_async_fail(req, UPNP_E_SOCKET_WRITE);
+			}
+			return;
+		}
+		req->sent += (size_t)n;
+	}
+	CDBG_INFO(">>> (SENT) >>>\n%.*s\nbuf_length=%" PRIzd
+		", reused=%d\n------------\n",
+		(int)req->request.length, req->request.buf,
+		req->request.length, req->reused);
+	parser_response_init(&req->response, req->method);
+	req->parserInit = TRUE;
+	req->okOnClose = FALSE;
+	req->state = SOAP_ASYNC_READ_HEADERS;
+	if (soap_async_watch(req, EPOLL_CTL_MOD, EPOLLIN) == -1) {
+		soap_async_finish(req, UPNP_E_SOCKET_ERROR);
+	}
+}
+
+/*!
+ * \brief Feeds what can be read of the response to the parser.
+ */
+static void soap_async_read(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	char buf[2 * 1024];
+	ssize_t n;
+
+	n = recv(req->sock, buf, sizeof(buf), 0);
+	if (n < 0) {
+		if (errno != EINTR && errno != EAGAIN &&
+		    errno != EWOULDBLOCK) {
+			soap_async_fail(req, UPNP_E_SOCKET_READ);
+		}
+		return;
+	}
+	if (n == 0) {
+		if (req->okOnClose) {
+			soap_async_response(req);
+		} else {
+			/* partial msg */
+			soap_async_fail(req, UPNP_E_BAD_HTTPMSG);
+		}
+		return;
+	}
+	switch (parser_append(&req->response, buf, (size_t)n)) {
+	case PARSE_SUCCESS:
+		soap_async_response(req);
+		return;
+	case PARSE_FAILURE:
+	case PARSE_NO_MATCH:
+		soap_async_finish(req, UPNP_E_BAD_HTTPMSG);
+		return;
+	case PARSE_INCOMPLETE_ENTITY:
+		/* read until close */
+		req->okOnClose = TRUE;
+		break;
+	default:
+		break;
+	}
+	if (req->state == SOAP_ASYNC_READ_HEADERS &&
+	    req->response.position == POS_ENTITY) {
+		req->state = SOAP_ASYNC_READ_BODY;
+		if (g_maxContentLength > (size_t)0 &&
+		    req->response.content_length >
+		    (unsigned int)g_maxContentLength) {
+			soap_async_finish(req, UPNP_E_OUTOF_BOUNDS);
+		}
+	}
+}
+
+/*!
+ * \brief Advances an action whose socket is ready.
+ */
+static void soap_async_io(
+	/*! [in] Action. */
+	soap_async_req *req)
+{
+	int error = 0;
+	socklen_t len = (socklen_t)sizeof(error);
+
+	switch (req->state) {
+	case SOAP_ASYNC_CONNECT:
+		if (getsockopt(req->sock, SOL_SOCKET, SO_ERROR, (void *)&error,
+			&len) == -1 || error != 0) {
+			soap_async_finish(req, UPNP_E_SOCKET_CONNECT);
+			return;
+		}
+		soap_async_connected(req);
+		/* fall through */
+	case SOAP_ASYNC_WRITE:
+		soap_async_write(req);
+		break;
+	case SOAP_ASYNC_READ_HEADERS:
+	case SOAP_ASYNC_READ_BODY:
+		soap_async_read(req);
+		break;
+	default:
+		break;
+	}
+}
+
+/*!
+ * \brief Times out the actions past their deadline.
+ */
+static void soap_async_expire(
+	/*! [in] Monotonic time in milliseconds. */
+	int64_t now)
+{
+	soap_async_req *req;
+
+	while (asyncDeadlines.head != NULL &&
+	       asyncDeadlines.head->deadline <= now) {
+		req = asyncDeadlines.head;
+		if (req->state == SOAP_ASYNC_CONNECT &&
+		    req->deadline < req->actionDeadline) {
+			/* the device did not answer the connect in time. */
+			soap_async_finish(req, UPNP_E_SOCKET_CONNECT);
+		} else {
+			soap_async_finish(req, UPNP_E_TIMEDOUT);
+		}
+	}
+}
+
+/*!
+ * \brief Computes how long the loop may sleep.
+ *
+ * \return Milliseconds, or -1 to wait for an event.
+ */
+static int soap_async_next_wait(
+	/*! [in] Monotonic time in milliseconds. */
+	int64_t now)
+{
+	int64_t wait = -1;
+
+	if (asyncDeadlines.head != NULL &&
+	    asyncDeadlines.head->deadline != SOAP_ASYNC_NO_DEADLINE) {
+		wait = asyncDeadlines.head->deadline - now;
+		if (wait < 0) {
+			wait = 0;
+		} else if (wait > INT_MAX) {
+			wait = INT_MAX;
+		}
+	}
+	if (asyncParked.head != NULL &&
+	    (wait < 0 || wait > SOAP_ASYNC_RETRY_INTERVAL)) {
+		wait = SOAP_ASYNC_RETRY_INTERVAL;
+	}
+
+	return (int)wait;
+}
+
+/*!
+ * \brief Empties the wake up pipe.
+ */
+static void soap_async_drain(void)
+{
+	char buf[64];
+
+	while (read(asyncWake[0], buf, sizeof(buf)) > 0) {
+	}
+}
+
+/*!
+ * \brief Loop of the engine. Persistent job of the send thread pool.
+ */
+static void soap_async_loop(
+	/*! [in] Unused. */
+	void *arg)
+{
+	struct epoll_event events[SOAP_ASYNC_MAX_EVENTS];
+	char errorBuffer[ERROR_BUFFER_LEN];
+	soap_async_req *queue;
+	soap_async_req *req;
+	int64_t now;
+	int64_t nextRetry = 0;
+	int nfds;
+	int i;
+
+	(void)arg;
+	while (TRUE) {
+		now = sock_monotonic_ms();
+		nfds = epoll_wait(asyncEpoll, events, SOAP_ASYNC_MAX_EVENTS,
+			soap_async_next_wait(now));
+		if (nfds == -1 && errno != EINTR) {
+			strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+			CDBG_ERROR("Error in epoll_wait(): %s\n", errorBuffer);
+			break;
+		}
+		for (i = 0; i < nfds; i++) {
+			if (events[i].data.ptr == NULL) {
+				soap_async_drain();
+			} else {
+				soap_async_io(
+					(soap_async_req *)events[i].data.ptr);
+			}
+		}
+		ithread_mutex_lock(&asyncMutex);
+		if (asyncState == SOAP_ASYNC_STOPPING) {
+			ithread_mutex_unlock(&asyncMutex);
+			break;
+		}
+		queue = asyncQueue;
+		asyncQueue = NULL;
+		asyncQueueTail = &asyncQueue;
+		ithread_mutex_unlock(&asyncMutex);
+		while ((req = queue) != NULL) {
+			queue = req->parkNext;
+			req->parkNext = NULL;
+			if (req->coalesce && soap_async_coalesce(req)) {
+				continue;
+			}
+			soap_async_deadline_insert(req);
+			soap_async_acquire(req);
+		}
+		now = sock_monotonic_ms();
+		if (asyncParked.head != NULL &&
+		    (asyncReleased || now >= nextRetry)) {
+			soap_async_retry_parked();
+			nextRetry = now + SOAP_ASYNC_RETRY_INTERVAL;
+		}
+		soap_async_expire(now);
+	}
+
+	/* the actions still in flight are dropped, as the jobs of a thread
+	 * pool being shut down. */
+	while ((req = asyncDeadlines.head) != NULL) {
+		soap_async_drop_conn(req, FALSE);
+		soap_async_deadline_remove(req);
+		soap_async_free(req);
+	}
+	asyncParked.head = asyncParked.tail = NULL;
+	ithread_mutex_lock(&asyncMutex);
+	while ((req = asyncQueue) != NULL) {
+		asyncQueue = req->parkNext;
+		soap_async_free(req);
+	}
+	asyncQueueTail = &asyncQueue;
+	close(asyncEpoll);
+	close(asyncWake[0]);
+	close(asyncWake[1]);
+	asyncEpoll = asyncWake[0] = asyncWake[1] = -1;
+	asyncState = SOAP_ASYNC_STOPPED;
+	ithread_cond_broadcast(&asyncCond);
+	ithread_mutex_unlock(&asyncMutex);
+}
+
+/*!
+ * \brief Starts the loop. Called with asyncMutex held.
+ *
+ * \return UPNP_E_SUCCESS, or UPNP_E_FINISH if the loop cannot run.
+ */
+static int soap_async_start(void)
+{
+	ThreadPoolJob job;
+	struct epoll_event ev;
+	char errorBuffer[ERROR_BUFFER_LEN];
+
+	asyncEpoll = epoll_create(SOAP_ASYNC_MAX_EVENTS);
+	if (asyncEpoll == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR("Error in epoll_create(): %s\n", errorBuffer);
+		return UPNP_E_FINISH;
+	}
+	if (pipe(asyncWake) == -1) {
+		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
+		CDBG_ERROR("Error in pipe(): %s\n", errorBuffer);
+		asyncWake[0] = asyncWake[1] = -1;
+		goto error_handler;
+	}
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if (sock_make_no_blocking(asyncWake[0]) == -1 ||
+	    sock_make_no_blocking(asyncWake[1]) == -1 ||
+	    epoll_ctl(asyncEpoll, EPOLL_CTL_ADD, asyncWake[0], &ev) == -1) {
+		goto error_handler;
+	}
+	asyncDeadlines.head = asyncDeadlines.tail = NULL;
+	asyncParked.head = asyncParked.tail = NULL;
+	asyncReleased = FALSE;
+	memset(asyncCoalesce, 0, sizeof(asyncCoalesce));
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)soap_async_loop, NULL);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAddPersistent(&gSendThreadPool, &job, NULL) != 0) {
+		goto error_handler;
+	}
+	asyncState = SOAP_ASYNC_RUNNING;
+	CDBG_INFO("Asynchronous action engine started\n");
+
+	return UPNP_E_SUCCESS;
+
+error_handler:
+	close(asyncEpoll);
+	if (asyncWake[0] != -1) {
+		close(asyncWake[0]);
+		close(asyncWake[1]);
+	}
+	asyncEpoll = asyncWake[0] = asyncWake[1] = -1;
+
+	return UPNP_E_FINISH;
+}
+
+/*!
+ * \brief Wakes the loop up. Called with asyncMutex held.
+ */
+static void soap_async_wake(void)
+{
+	char c = 0;
+
+	/* a full pipe already wakes the loop up. */
+	if (write(asyncWake[1], &c, (size_t)1) == -1 && errno != EAGAIN) {
+		CDBG_ERROR("Cannot wake the action engine up\n");
+	}
+}
+
+int SoapSendActionAsync(
+	const char *action_url,
+	const char *body,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	soap_async_req *req;
+	int ret_code;
+
+	req = (soap_async_req *)calloc((size_t)1, sizeof(soap_async_req));
+	if (req == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	membuffer_init(&req->request);
+	req->url = strdup(action_url);
+	if (req->url == NULL) {
+		soap_async_free(req);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	ret_code = SoapMakeActionRequest(req->url, body, &req->addr,
+		&req->request, &req->key, &req->method);
+	if (ret_code != UPNP_E_SUCCESS) {
+		soap_async_free(req);
+		return ret_code;
+	}
+	ret_code = http_HealthAdmit(&req->addr);
+	if (ret_code != UPNP_E_SUCCESS) {
+		soap_async_free(req);
+		return ret_code;
+	}
+	req->state = SOAP_ASYNC_WAIT_CONN;
+	req->sock = INVALID_SOCKET;
+	req->coalesce = g_actionCoalescing;
+	if (req->coalesce) {
+		req->bodyLen = strlen(body);
+		soap_async_find_class(req, body);
+	}
+	req->Fun = Fun;
+	req->Cookie = Cookie;
+	req->deadline = g_actionTimeoutMs > 0 ?
+		sock_monotonic_ms() + g_actionTimeoutMs :
+		SOAP_ASYNC_NO_DEADLINE;
+
+	ithread_mutex_lock(&asyncMutex);
+	if (asyncState == SOAP_ASYNC_STOPPED) {
+		soap_async_start();
+	}
+	if (asyncState != SOAP_ASYNC_RUNNING) {
+		ithread_mutex_unlock(&asyncMutex);
+		http_HealthReport(&req->addr, UPNP_E_FINISH);
+		soap_async_free(req);
+		return UPNP_E_FINISH;
+	}
+	if (asyncQueue == NULL) {
+		soap_async_wake();
+	}
+	*asyncQueueTail = req;
+	asyncQueueTail = &req->parkNext;
+	asyncStats.Submitted++;
+	ithread_mutex_unlock(&asyncMutex);
+
+	return UPNP_E_SUCCESS;
+}
+
+void SoapAsyncShutdown(void)
+{
+	ithread_mutex_lock(&asyncMutex);
+	if (asyncState == SOAP_ASYNC_RUNNING) {
+		asyncState = SOAP_ASYNC_STOPPING;
+		soap_async_wake();
+	}
+	while (asyncState != SOAP_ASYNC_STOPPED) {
+		ithread_cond_wait(&asyncCond, &asyncMutex);
+	}
+	memset(&asyncStats, 0, sizeof(asyncStats));
+	ithread_mutex_unlock(&asyncMutex);
+}
+
+void SoapAsyncGetStats(struct Upnp_Action_Stats *stats)
+{
+	ithread_mutex_lock(&asyncMutex);
+	*stats = asyncStats;
+	ithread_mutex_unlock(&asyncMutex);
+}
+
+#else /* SOAP_ASYNC_USE_EPOLL */
+
+int SoapSendActionAsync(
+	const char *action_url,
+	const char *body,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	(void)action_url;
+	(void)body;
+	(void)Fun;
+	(void)Cookie;
+
+	return UPNP_E_FINISH;
+}
+
+void SoapAsyncShutdown(void)
+{
+}
+
+void SoapAsyncGetStats(struct Upnp_Action_Stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* SOAP_ASYNC_USE_EPOLL */
+
+#endif /* EXCLUDE_SOAP == 0 */
+#endif /* INCLUDE_CLIENT_APIS */
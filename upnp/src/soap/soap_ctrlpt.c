@@ -39,16 +39,22 @@
 #include <stdio.h>
 #include <stdarg.h>
 
+#include "ithread.h"
 #include "miniserver.h"
 #include "membuffer.h"
+#include "httpconnpool.h"
 #include "httpparser.h"
 #include "httpreadwrite.h"
+#include "httptemplate.h"
 #include "statcodes.h"
 #include "parsetools.h"
+#include "sock.h"
 #include "upnpapi.h"
 #include "soaplib.h"
 #include "uri.h"
 #include "upnp.h"
+#include "UpnpInet.h"
+#include "UpnpIntTypes.h"
 
 #include "unixutil.h"
 
@@ -61,19 +67,123 @@
 #undef DBG_TAG
 #define DBG_TAG "SOAP"
 
+/*! MAN header of an M-POST action, and the prefix of its SOAPACTION
+ * header. */
+#define SOAP_MAN_HEADER \
+	"MAN: \"http://schemas.xmlsoap.org/soap/envelope/\"; ns=01\r\n01-"
+
+/*! A control URL known to accept M-POST only. */
+typedef struct soap_mpost_entry
+{
+	/*! Key of the URL, pointing to \b url. */
+	SoapMethodKey key;
+	/*! Copy of the control URL, NULL if the slot was never used. */
+	char *url;
+	/*! Monotonic time, in milliseconds, the entry expires; 0 if the slot
+	 * is empty. */
+	int64_t expires;
+} soap_mpost_entry;
+
+/*! M-POST capability cache, direct mapped: a new entry replaces the one
+ * in its slot. Protected by mpostMutex. */
+static soap_mpost_entry mpostCache[SOAP_MPOST_CACHE_SIZE];
+static ithread_mutex_t mpostMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Builds the cache key of a control URL.
+ */
+static void soap_method_key(
+	/*! [out] Key. */
+	SoapMethodKey *key,
+	/*! [in] Control URL. */
+	const char *action_url,
+	/*! [in] Length of the control URL. */
+	size_t url_len)
+{
+	size_t i;
+
+	key->url = action_url;
+	key->length = url_len;
+	key->hash = 2166136261u;
+	for (i = (size_t)0; i < url_len; i++) {
+		key->hash ^= (unsigned char)action_url[i];
+		key->hash *= 16777619u;
+	}
+}
+
+int SoapMethodKeyEqual(const SoapMethodKey *a, const SoapMethodKey *b)
+{
+	return a->hash == b->hash && a->length == b->length &&
+		memcmp(a->url, b->url, a->length) == 0;
+}
+
 /*!
- * \brief Adds "MAN" field in the HTTP header.
+ * \brief Looks a control URL up in the M-POST capability cache.
  *
- * \return 0 on success, UPNP_E_OUTOFMEMORY on error.
+ * \return HTTPMETHOD_MPOST if the device is known to reject POST, else
+ * SOAPMETHOD_POST.
  */
-static UPNP_INLINE int add_man_header(
-	/* [in,out] HTTP header. */
-	membuffer *headers)
+static http_method_t soap_method_lookup(
+	/*! [in] Key of the control URL. */
+	const SoapMethodKey *key)
+{
+	soap_mpost_entry *entry =
+		&mpostCache[key->hash & (SOAP_MPOST_CACHE_SIZE - 1)];
+	http_method_t method = SOAPMETHOD_POST;
+
+	ithread_mutex_lock(&mpostMutex);
+	if (entry->expires != 0 && SoapMethodKeyEqual(&entry->key, key)) {
+		if (sock_monotonic_ms() < entry->expires) {
+			method = HTTPMETHOD_MPOST;
+		} else {
+			/* aged out: try POST again, in case the firmware
+			 * changed. */
+			entry->expires = 0;
+		}
+	}
+	ithread_mutex_unlock(&mpostMutex);
+
+	return method;
+}
+
+void SoapMethodLearn(const SoapMethodKey *key, http_method_t method)
+{
+	soap_mpost_entry *entry =
+		&mpostCache[key->hash & (SOAP_MPOST_CACHE_SIZE - 1)];
+	char *url;
+
+	ithread_mutex_lock(&mpostMutex);
+	if (method == HTTPMETHOD_MPOST) {
+		if (entry->url == NULL ||
+		    !SoapMethodKeyEqual(&entry->key, key)) {
+			url = (char *)malloc(key->length + (size_t)1);
+			if (url == NULL) {
+				/* not remembered: the next action probes
+				 * again. */
+				ithread_mutex_unlock(&mpostMutex);
+				return;
+			}
+			memcpy(url, key->url, key->length);
+			url[key->length] = '\0';
+			free(entry->url);
+			entry->url = url;
+			entry->key = *key;
+			entry->key.url = url;
+		}
+		entry->expires = sock_monotonic_ms() +
+			(int64_t)SOAP_MPOST_CACHE_TTL * 1000;
+	} else if (entry->url != NULL &&
+		   SoapMethodKeyEqual(&entry->key, key)) {
+		entry->expires = 0;
+	}
+	ithread_mutex_unlock(&mpostMutex);
+}
+
+int SoapAddManHeader(membuffer *headers)
 {
 	size_t n;
 	char *soap_action_hdr;
-	const char *man_hdr =
-		"MAN: \"http://schemas.xmlsoap.org/soap/envelope/\"; ns=01\r\n01-";
+	const char *man_hdr = SOAP_MAN_HEADER;
 
 	/* change POST to M-POST */
 	if (membuffer_insert(headers, "M-", 2, 0) != 0)
@@ -89,16 +199,161 @@ static UPNP_INLINE int add_man_header(
 	return 0;
 }
 
+void SoapRemoveManHeader(membuffer *headers)
+{
+	const char *man_hdr = SOAP_MAN_HEADER;
+	char *soap_action_hdr;
+	size_t n;
+
+	/* remove the MAN header and the prefix of SOAPACTION */
+	soap_action_hdr = strstr(headers->buf, "SOAPACTION:");
+	/* can't fail */
+	assert(soap_action_hdr != NULL);
+	n = (size_t)(soap_action_hdr - headers->buf);
+	assert(n >= strlen(man_hdr));
+	membuffer_delete(headers, n - strlen(man_hdr), strlen(man_hdr));
+	/* change M-POST to POST */
+	membuffer_delete(headers, (size_t)0, (size_t)2);
+}
+
+/*!
+ * \brief Renders the template of a POST action.
+ */
+static int soap_build_post(
+	/*! [in] Fixed control URL. */
+	const uri_type *url,
+	/*! [in,out] Head of the template. */
+	membuffer *head,
+	/*! [in,out] Tail of the template. */
+	membuffer *tail)
+{
+    if( http_MakeMessage( head, 1, 1, "q", SOAPMETHOD_POST, url ) != 0 ||
+        http_MakeMessage( tail, 1, 1, "s" "sc" "s" "sc" "Uc",
+            ContentTypeHeader, "SOAPACTION:", "UID: ",
+            "yyccbb12345" ) != 0 ) {
+        return UPNP_E_OUTOF_MEMORY;
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Renders the template of an M-POST action.
+ */
+static int soap_build_mpost(
+	/*! [in] Fixed control URL. */
+	const uri_type *url,
+	/*! [in,out] Head of the template. */
+	membuffer *head,
+	/*! [in,out] Tail of the template. */
+	membuffer *tail)
+{
+    if( http_MakeMessage( head, 1, 1, "q", HTTPMETHOD_MPOST, url ) != 0 ||
+        http_MakeMessage( tail, 1, 1, "s" "s" "sc" "s" "sc" "Uc",
+            ContentTypeHeader, SOAP_MAN_HEADER, "SOAPACTION:", "UID: ",
+            "yyccbb12345" ) != 0 ) {
+        return UPNP_E_OUTOF_MEMORY;
+    }
+
+    return 0;
+}
+
+int SoapMakeActionRequest(
+	const char *action_url,
+	const char *body,
+	struct sockaddr_storage *dest,
+	membuffer *request,
+	SoapMethodKey *key,
+	http_method_t *method)
+{
+    size_t url_len = strlen( action_url );
+    size_t body_len = strlen( body );
+    char content_length[64];
+    memptr var;
+    int rc;
+    int ret_code;
+
+    rc = snprintf( content_length, sizeof( content_length ),
+                   "CONTENT-LENGTH: %" PRId64 "\r\n", ( int64_t ) body_len );
+    if( rc < 0 || ( unsigned int )rc >= sizeof( content_length ) ) {
+        return UPNP_E_OUTOF_MEMORY;
+    }
+    var.buf = content_length;
+    var.length = ( size_t ) rc;
+
+    soap_method_key( key, action_url, url_len );
+    *method = soap_method_lookup( key );
+    /* the URL is parsed and resolved only when its template is built */
+    if( *method == HTTPMETHOD_MPOST ) {
+        /* the device is known to reject POST */
+        ret_code = http_TemplateRender( HTTP_TEMPLATE_SOAP_MPOST,
+                                        action_url, url_len,
+                                        soap_build_mpost, &var,
+                                        ( size_t ) 1, body, body_len,
+                                        request, dest );
+    } else {
+        ret_code = http_TemplateRender( HTTP_TEMPLATE_SOAP_POST,
+                                        action_url, url_len,
+                                        soap_build_post, &var,
+                                        ( size_t ) 1, body, body_len,
+                                        request, dest );
+    }
+    if( ret_code != UPNP_E_SUCCESS ) {
+        return ret_code;
+    }
+    CDBG_INFO("%s %s\n", *method == HTTPMETHOD_MPOST ? "M-POST" : "POST",
+        action_url );
+
+    return ret_code;
+}
+
+void SoapFillActionComplete(
+	struct Upnp_Action_Complete *Event,
+	int ErrCode,
+	http_parser_t *response)
+{
+    size_t offset;
+    size_t length;
+    char *entity;
+
+    memset( Event, 0, sizeof( *Event ) );
+    Event->ErrCode = ErrCode;
+    if( ErrCode != UPNP_E_SUCCESS || response == NULL ) {
+        return;
+    }
+    Event->StatusCode = response->msg.status_code;
+    length = response->msg.entity.length;
+    if( length == ( size_t ) 0 || response->msg.entity.buf == NULL ) {
+        return;
+    }
+    /* take the message buffer and move the entity to its start, so the
+     * application can free it as is. */
+    offset = ( size_t ) ( response->msg.entity.buf - response->msg.msg.buf );
+    entity = membuffer_detach( &response->msg.msg );
+    memmove( entity, entity + offset, length );
+    entity[length] = 0;
+    response->msg.entity.buf = NULL;
+    response->msg.entity.length = ( size_t ) 0;
+    Event->Entity = entity;
+    Event->EntityLength = length;
+}
+
 /****************************************************************************
 *	Function :	soap_request_and_response
 *
 *	Parameters :
 *		IN membuffer* request :	request that will be sent to the device
-*		IN uri_type* destination_url :	destination address string
+*		IN struct sockaddr_storage* destination :	address and port
+*			of the device
+*		IN SoapMethodKey *key :	key of the URL in the M-POST cache
+*		IN http_method_t method : method the request was built with
 *		OUT http_parser_t *response :	response from the device
 *
 *	Description :	This function sends the control point's request to the 
-*		device and receives a response from it.
+*		device and receives a response from it. A POST answered by
+*		405 goes again as M-POST, and the device is remembered as
+*		accepting M-POST only. An M-POST answered by 405 goes again
+*		as POST, and the device is forgotten.
 *
 *	Return : int
 *
@@ -106,22 +361,44 @@ static UPNP_INLINE int add_man_header(
 ****************************************************************************/
 static int
 soap_request_and_response( IN membuffer * request,
-                           IN uri_type * destination_url,
+                           IN const struct sockaddr_storage * destination,
+                           IN const SoapMethodKey * key,
+                           IN http_method_t method,
                            OUT http_parser_t * response )
 {
     int ret_code;
+    /* one deadline covers the POST and the M-POST retry. */
+    int timeout_ms = g_actionTimeoutMs;
 
-    ret_code = http_RequestAndResponse( destination_url, request->buf,
-                                        request->length,
-                                        SOAPMETHOD_POST,
-                                        UPNP_TIMEOUT, response );
+    ret_code = http_PooledRequestAndResponse( destination, request->buf,
+                                              request->length,
+                                              method,
+                                              &timeout_ms, response );
     if( ret_code != 0 ) {
         httpmsg_destroy( &response->msg );
         return ret_code;
     }
     /* method-not-allowed error */
-    if( response->msg.status_code == HTTP_METHOD_NOT_ALLOWED ) {
-        ret_code = add_man_header( request );   /* change to M-POST msg */
+    if( response->msg.status_code == HTTP_METHOD_NOT_ALLOWED &&
+        method == HTTPMETHOD_MPOST ) {
+        /* the device no longer wants M-POST: try POST */
+        SoapMethodLearn( key, SOAPMETHOD_POST );
+        SoapRemoveManHeader( request );
+
+        httpmsg_destroy( &response->msg );  /* about to reuse response */
+
+        /* try again */
+        ret_code = http_PooledRequestAndResponse( destination,
+                                                  request->buf,
+                                                  request->length,
+                                                  SOAPMETHOD_POST,
+                                                  &timeout_ms,
+                                                  response );
+        if( ret_code != 0 ) {
+            httpmsg_destroy( &response->msg );
+        }
+    } else if( response->msg.status_code == HTTP_METHOD_NOT_ALLOWED ) {
+        ret_code = SoapAddManHeader( request );   /* change to M-POST msg */
         if( ret_code != 0 ) {
             return ret_code;
         }
@@ -129,13 +406,16 @@ soap_request_and_response( IN membuffer * request,
         httpmsg_destroy( &response->msg );  /* about to reuse response */
 
         /* try again */
-        ret_code = http_RequestAndResponse( destination_url, request->buf,
-                                            request->length,
-                                            HTTPMETHOD_MPOST,
-                                            UPNP_TIMEOUT,
-                                            response );
+        ret_code = http_PooledRequestAndResponse( destination,
+                                                  request->buf,
+                                                  request->length,
+                                                  HTTPMETHOD_MPOST,
+                                                  &timeout_ms,
+                                                  response );
         if( ret_code != 0 ) {
             httpmsg_destroy( &response->msg );
+        } else if( response->msg.status_code != HTTP_METHOD_NOT_ALLOWED ) {
+            SoapMethodLearn( key, HTTPMETHOD_MPOST );
         }
 
     }
@@ -149,8 +429,8 @@ soap_request_and_response( IN membuffer * request,
 *	Parameters :
 *		IN char* action_url :	device contrl URL 
 *		IN char *service_type :	device service type
-*		IN IXML_Document *action_node : SOAP action node	
-*		OUT IXML_Document **response_node :	SOAP response node
+*		OUT struct Upnp_Action_Complete *event : result of the action,
+*			owning the response entity
 *
 *	Description :	This function is called by UPnP API to send the SOAP 
 *		action request and waits till it gets the response from the device
@@ -162,68 +442,42 @@ soap_request_and_response( IN membuffer * request,
 ****************************************************************************/
 int
 SoapSendAction( IN char *action_url,
-                IN char *service_type)
+                IN char *service_type,
+                OUT struct Upnp_Action_Complete *event )
 {
     membuffer request;
     int err_code;
     int ret_code;
     http_parser_t response;
-    uri_type url;
+    struct sockaddr_storage destination;
+    SoapMethodKey key;
+    http_method_t method;
     int got_response = FALSE;
 
-    off_t content_length;
-    char *request_body;
-    size_t request_body_len;
-
-    /*const char *request_body=
-	"{\r\n\"command\":\r\n{\"commandName\":\"setName\",\"commandValue\":5,\"commandType\":\"proprietary\"},\r\n\"parameters\":\r\n{\"name\":\"Bed Room\"}\r\n}";*/
-    request_body = service_type;
-    request_body_len = strlen(request_body);
-
-    err_code = UPNP_E_OUTOF_MEMORY; /* default error */
-
     CDBG_INFO(
         "Inside SoapSendAction():" );
     /* init */
     membuffer_init( &request );
 
-    /* parse url */
-    if( http_FixStrUrl( action_url, strlen( action_url ), &url ) != 0 ) {
-        err_code = UPNP_E_INVALID_URL;
-        goto error_handler;
-    }
-
-    CDBG_INFO("path=%.*s, hostport=%.*s\n",
-        (int)url.pathquery.size,
-        url.pathquery.buff,
-        (int)url.hostport.text.size,
-        url.hostport.text.buff );
-
-    /* make request msg */
-    request.size_inc = 50;
-    content_length = (off_t)(request_body_len);
-    if (http_MakeMessage(
-	&request, 1, 1,
-	"q" "N" "s" "sc" "s" "sc" "Uc" "b",
-	SOAPMETHOD_POST, &url,
-        content_length,
-        ContentTypeHeader,
-	"SOAPACTION:",
-	"UID: ", "yyccbb12345",
-        request_body, request_body_len ) != 0 ) {
+    err_code = SoapMakeActionRequest( action_url, service_type, &destination,
+                                      &request, &key, &method );
+    if( err_code != UPNP_E_SUCCESS ) {
         goto error_handler;
     }
 
-    ret_code = soap_request_and_response( &request, &url, &response );
+    ret_code = soap_request_and_response( &request, &destination, &key, method,
+                                          &response );
     got_response = TRUE;
     if( ret_code != UPNP_E_SUCCESS ) {
         err_code = ret_code;
         goto error_handler;
     }
-    CDBG_ERROR("Response:---------------\n%s\n",response.msg.entity.buf);
+    CDBG_INFO("Response:---------------\n%s\n",response.msg.entity.buf);
 
     err_code = UPNP_E_SUCCESS;
 error_handler:
+    SoapFillActionComplete( event, err_code,
+                            got_response ? &response : NULL );
     membuffer_destroy( &request );
     if( got_response ) {
         httpmsg_destroy( &response.msg );
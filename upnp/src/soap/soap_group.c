@@ -0,0 +1,414 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Groups of actions sent by UpnpSendGroupActionAsync().
+ *
+ * A group sends the same body to many control URLs through the
+ * asynchronous action engine. The first actions, up to the in-flight limit,
+ * are sent by the caller; from then on the completion of an action sends
+ * the next one, so at most that many actions of the group are ever in the
+ * engine. An action the engine refuses completes at once with its error and
+ * makes room for the next one in the same way.
+ *
+ * The results are kept in the order of the control URLs. Once the last
+ * action completes, a job of the send thread pool hands them all to the
+ * application in a single UPNP_CONTROL_GROUP_ACTION_COMPLETE callback.
+ */
+
+#include "config.h"
+
+#ifdef INCLUDE_CLIENT_APIS
+#if EXCLUDE_SOAP == 0
+
+#include "httpparser.h"
+#include "ithread.h"
+#include "sock.h"
+#include "ThreadPool.h"
+#include "upnp.h"
+#include "upnpapi.h"
+#include "upnputil.h"
+#include "soaplib.h"
+#include "UpnpStdInt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#undef DBG_TAG
+#define DBG_TAG "SOAP"
+
+#if SOAP_ASYNC_USE_EPOLL
+
+struct soap_group;
+
+/*! An action of a group, the cookie of its callback. */
+typedef struct soap_group_slot
+{
+	struct soap_group *group;
+	int index;
+	/*! Monotonic time, in milliseconds, the action was sent. */
+	int64_t start;
+} soap_group_slot;
+
+/*! A group of actions. */
+typedef struct soap_group
+{
+	/*! Protects next, done and succeeded. */
+	ithread_mutex_t mutex;
+	/*! Copy of the body. */
+	char *body;
+	/*! Copies of the control URLs, one after the other. */
+	char *urls;
+	int num;
+	/*! Next action to send. */
+	int next;
+	/*! Actions completed. */
+	int done;
+	int succeeded;
+	/*! Monotonic time, in milliseconds, the group was sent. */
+	int64_t start;
+	/*! Milliseconds the group took, set by its last action. */
+	int elapsed;
+	Upnp_FunPtr Fun;
+	const void *Cookie;
+	soap_group_slot *slots;
+	struct Upnp_Group_Action_Result *results;
+	/*! Links of the list of the groups not freed yet. */
+	struct soap_group *listPrev;
+	struct soap_group *listNext;
+} soap_group;
+
+/*! Groups not freed yet, protected by groupsMutex. */
+static soap_group *groups = NULL;
+/*! TRUE from SoapGroupShutdown() to SoapGroupFlush(). */
+static int groupsStopping = FALSE;
+static ithread_mutex_t groupsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Frees a group, the entities its application did not take
+ * included.
+ */
+static void soap_group_free(
+	/*! [in] Group. */
+	soap_group *group)
+{
+	int i;
+
+	ithread_mutex_lock(&groupsMutex);
+	if (group->listPrev == NULL) {
+		groups = group->listNext;
+	} else {
+		group->listPrev->listNext = group->listNext;
+	}
+	if (group->listNext != NULL) {
+		group->listNext->listPrev = group->listPrev;
+	}
+	ithread_mutex_unlock(&groupsMutex);
+	for (i = 0; i < group->num; i++) {
+		UpnpReleaseActionEntity(group->results[i].Entity);
+	}
+	ithread_mutex_destroy(&group->mutex);
+	free(group->results);
+	free(group->slots);
+	free(group->urls);
+	free(group->body);
+	free(group);
+}
+
+/*!
+ * \brief Runs the callback of a completed group and frees it. Job of the
+ * send thread pool.
+ */
+static void soap_group_complete(
+	/*! [in] Completed group. */
+	soap_group *group)
+{
+	struct Upnp_Group_Action_Complete event;
+
+	CDBG_INFO("Group of %d actions completed in %d ms, %d succeeded\n",
+		group->num, group->elapsed, group->succeeded);
+	event.NumActions = group->num;
+	event.NumSucceeded = group->succeeded;
+	event.ElapsedMs = group->elapsed;
+	event.Results = group->results;
+	group->Fun(UPNP_CONTROL_GROUP_ACTION_COMPLETE, &event,
+		(void *)group->Cookie);
+	soap_group_free(group);
+}
+
+/*!
+ * \brief Hands a completed group over to the send thread pool.
+ */
+static void soap_group_finish(
+	/*! [in] Group. */
+	soap_group *group)
+{
+	ThreadPoolJob job;
+
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)soap_group_complete, group);
+	TPJobSetFreeFunction(&job, (free_routine)soap_group_free);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gSendThreadPool, &job, NULL) != 0) {
+		/* job queue full: better late on this thread than never. */
+		soap_group_complete(group);
+	}
+}
+
+static int soap_group_action_done(Upnp_EventType EventType, void *Event,
+	void *Cookie);
+
+/*!
+ * \brief Sends an action of a group.
+ *
+ * \return The result of SoapSendActionAsync(), or UPNP_E_FINISH once
+ * UpnpFinish has started.
+ */
+static int soap_group_send(
+	/*! [in] Action. */
+	soap_group_slot *slot)
+{
+	soap_group *group = slot->group;
+	int stopping;
+
+	slot->start = sock_monotonic_ms();
+	ithread_mutex_lock(&groupsMutex);
+	stopping = groupsStopping;
+	ithread_mutex_unlock(&groupsMutex);
+	if (stopping) {
+		return UPNP_E_FINISH;
+	}
+
+	return SoapSendActionAsync(group->results[slot->index].ActionURL,
+		group->body, soap_group_action_done, slot);
+}
+
+/*!
+ * \brief Records the result of an action of a group and sends the next
+ * action in its place. The group must not be used once this returns: its
+ * last action may have completed meanwhile.
+ */
+static void soap_group_end(
+	/*! [in] Completed action. */
+	soap_group_slot *slot,
+	/*! [in] Result of the action. */
+	int ret,
+	/*! [in,out] Event of the action, NULL if it was not sent. */
+	struct Upnp_Action_Complete *event)
+{
+	soap_group *group = slot->group;
+	struct Upnp_Group_Action_Result *result;
+	int64_t now;
+	int next;
+	int last;
+
+	for (;;) {
+		result = &group->results[slot->index];
+		now = sock_monotonic_ms();
+		result->ErrCode = ret;
+		result->ElapsedMs = (int)(now - slot->start);
+		if (event != NULL) {
+			result->StatusCode = event->StatusCode;
+			result->EntityLength = event->EntityLength;
+			result->Entity = UpnpDetachActionEntity(event);
+		}
+
+		ithread_mutex_lock(&group->mutex);
+		group->done++;
+		if (ret == UPNP_E_SUCCESS) {
+			group->succeeded++;
+		}
+		last = group->done == group->num;
+		next = group->next < group->num ? group->next++ : -1;
+		ithread_mutex_unlock(&group->mutex);
+
+		if (last) {
+			group->elapsed = (int)(now - group->start);
+			soap_group_finish(group);
+			return;
+		}
+		if (next < 0) {
+			return;
+		}
+		slot = &group->slots[next];
+		ret = soap_group_send(slot);
+		if (ret == UPNP_E_SUCCESS) {
+			return;
+		}
+		event = NULL;
+	}
+}
+
+/*!
+ * \brief Callback of the actions of a group.
+ */
+static int soap_group_action_done(
+	/*! [in] UPNP_CONTROL_ACTION_COMPLETE. */
+	Upnp_EventType EventType,
+	/*! [in,out] Event of the action. */
+	void *Event,
+	/*! [in] Action. */
+	void *Cookie)
+{
+	struct Upnp_Action_Complete *event =
+		(struct Upnp_Action_Complete *)Event;
+
+	if (EventType == UPNP_CONTROL_ACTION_COMPLETE) {
+		soap_group_end((soap_group_slot *)Cookie, event->ErrCode, event);
+	}
+
+	return 0;
+}
+
+int SoapSendGroupActionAsync(
+	const char **action_urls,
+	int num_actions,
+	const char *body,
+	int max_in_flight,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	soap_group *group;
+	size_t len = (size_t)0;
+	char *url;
+	int first;
+	int ret_code;
+	int i;
+
+	group = (soap_group *)calloc((size_t)1, sizeof(soap_group));
+	if (group == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	for (i = 0; i < num_actions; i++) {
+		len += strlen(action_urls[i]) + (size_t)1;
+	}
+	group->body = strdup(body);
+	group->urls = (char *)malloc(len);
+	group->slots = (soap_group_slot *)calloc((size_t)num_actions,
+		sizeof(soap_group_slot));
+	group->results = (struct Upnp_Group_Action_Result *)calloc(
+		(size_t)num_actions, sizeof(struct Upnp_Group_Action_Result));
+	if (group->body == NULL || group->urls == NULL ||
+	    group->slots == NULL || group->results == NULL) {
+		free(group->results);
+		free(group->slots);
+		free(group->urls);
+		free(group->body);
+		free(group);
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	ithread_mutex_init(&group->mutex, NULL);
+	url = group->urls;
+	for (i = 0; i < num_actions; i++) {
+		len = strlen(action_urls[i]) + (size_t)1;
+		memcpy(url, action_urls[i], len);
+		group->results[i].ActionURL = url;
+		group->slots[i].group = group;
+		group->slots[i].index = i;
+		url += len;
+	}
+	group->num = num_actions;
+	group->Fun = Fun;
+	group->Cookie = Cookie;
+	group->start = sock_monotonic_ms();
+	first = num_actions < max_in_flight ? num_actions : max_in_flight;
+	group->next = first;
+
+	ithread_mutex_lock(&groupsMutex);
+	group->listNext = groups;
+	if (groups != NULL) {
+		groups->listPrev = group;
+	}
+	groups = group;
+	ithread_mutex_unlock(&groupsMutex);
+
+	/* the group lives at least until its first actions are all sent. */
+	for (i = 0; i < first; i++) {
+		ret_code = soap_group_send(&group->slots[i]);
+		if (ret_code != UPNP_E_SUCCESS) {
+			soap_group_end(&group->slots[i], ret_code, NULL);
+		}
+	}
+
+	return UPNP_E_SUCCESS;
+}
+
+void SoapGroupShutdown(void)
+{
+	ithread_mutex_lock(&groupsMutex);
+	groupsStopping = TRUE;
+	ithread_mutex_unlock(&groupsMutex);
+}
+
+void SoapGroupFlush(void)
+{
+	while (groups != NULL) {
+		soap_group_free(groups);
+	}
+	ithread_mutex_lock(&groupsMutex);
+	groupsStopping = FALSE;
+	ithread_mutex_unlock(&groupsMutex);
+}
+
+#else /* SOAP_ASYNC_USE_EPOLL */
+
+int SoapSendGroupActionAsync(
+	const char **action_urls,
+	int num_actions,
+	const char *body,
+	int max_in_flight,
+	Upnp_FunPtr Fun,
+	const void *Cookie)
+{
+	(void)action_urls;
+	(void)num_actions;
+	(void)body;
+	(void)max_in_flight;
+	(void)Fun;
+	(void)Cookie;
+
+	return UPNP_E_FINISH;
+}
+
+void SoapGroupShutdown(void)
+{
+}
+
+void SoapGroupFlush(void)
+{
+}
+
+#endif /* SOAP_ASYNC_USE_EPOLL */
+
+#endif /* EXCLUDE_SOAP == 0 */
+#endif /* INCLUDE_CLIENT_APIS */
@@ -38,6 +38,8 @@
  * \file
  */
 
+#define _GNU_SOURCE	/* For sendmmsg() in sys/socket.h */
+
 #include "config.h"
 
 #include "upnputil.h"
@@ -47,6 +49,7 @@
 
 #include "httpparser.h"
 #include "httpreadwrite.h"
+#include "httpurlcache.h"
 #include "ssdp_ResultData.h"
 #include "ssdplib.h"
 #include "statcodes.h"
@@ -55,7 +58,9 @@
 #include "UpnpInet.h"
 #include "ThreadPool.h"
 
+#include <limits.h>
 #include <stdio.h>
+#include <strings.h>
 
 #ifdef WIN32
 #include <string.h>
@@ -66,6 +71,92 @@
 #define DBG_TAG "SSDP"
 
 extern const char OhmSearchType[];
+
+/*! Last LOCATION announced by a device. */
+typedef struct {
+	/*! Hash of the UID, 0 for an empty slot. */
+	uint32_t uid;
+	char location[LINE_SIZE];
+} ssdp_location_entry;
+
+/*! Table of the last LOCATION of each device, direct mapped on the hash of
+ * the UID: a new device replaces the one in its slot. Protected by
+ * ssdpLocationMutex. */
+static ssdp_location_entry ssdpLocations[SSDP_LOCATION_TABLE_SIZE];
+static ithread_mutex_t ssdpLocationMutex;
+
+int ssdp_ctrlpt_init(void)
+{
+	if (ithread_mutex_init(&ssdpLocationMutex, NULL) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+	memset(ssdpLocations, 0, sizeof(ssdpLocations));
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_ctrlpt_destroy(void)
+{
+	ithread_mutex_destroy(&ssdpLocationMutex);
+}
+
+/*!
+ * \brief Drops the URLs and request templates cached for the former
+ * LOCATION of a device, when it announces a new one or says byebye, and
+ * records its current LOCATION.
+ *
+ * Two UIDs with the same hash share a slot; the only cost is a spurious
+ * invalidation, after which the URLs are parsed again.
+ */
+static void ssdp_location_seen(
+	/* [in] Announcement or search reply. */
+	const struct Upnp_Discovery *param,
+	/* [in] TRUE for a byebye. */
+	int is_byebye)
+{
+	ssdp_location_entry *entry;
+	char former[LINE_SIZE];
+	const char *p;
+	uint32_t uid = 2166136261u;
+
+	if (param->UID[0] == '\0') {
+		return;
+	}
+	for (p = param->UID; *p != '\0'; p++) {
+		uid ^= (unsigned char)*p;
+		uid *= 16777619u;
+	}
+	if (uid == 0u) {
+		uid = 1u;
+	}
+	former[0] = '\0';
+	entry = &ssdpLocations[uid & (SSDP_LOCATION_TABLE_SIZE - 1)];
+	ithread_mutex_lock(&ssdpLocationMutex);
+	if (entry->uid == uid &&
+	    (is_byebye || strcmp(entry->location, param->Location) != 0)) {
+		memcpy(former, entry->location, sizeof(former));
+	}
+	if (is_byebye) {
+		if (entry->uid == uid) {
+			entry->uid = 0u;
+		}
+	} else {
+		entry->uid = uid;
+		memcpy(entry->location, param->Location,
+			sizeof(entry->location));
+	}
+	ithread_mutex_unlock(&ssdpLocationMutex);
+	if (former[0] != '\0') {
+		CDBG_INFO("SSDP: device %s left %s\n", param->UID, former);
+		http_InvalidateLocation(former);
+	}
+	if (is_byebye && param->Location[0] != '\0' &&
+	    strcmp(former, param->Location) != 0) {
+		/* a byebye with a LOCATION the table did not have. */
+		http_InvalidateLocation(param->Location);
+	}
+}
+
 /*!
  * \brief Sends a callback to the control point application with a SEARCH
  * result.
@@ -81,28 +172,198 @@ static void send_search_result(
 	free(temp);
 }
 
+/*!
+ * \brief Parses the max-age directive of a CACHE-CONTROL header.
+ *
+ * \return The max-age in seconds, or -1 if the header or the directive is
+ * missing or invalid.
+ */
+static int ssdp_max_age(
+	/* [in] CACHE-CONTROL header value. */
+	memptr *hdr_value)
+{
+	const char *p = hdr_value->buf;
+	const char *end = p + hdr_value->length;
+	size_t len = strlen("max-age");
+	int max_age = -1;
+
+	if (p == NULL) {
+		return -1;
+	}
+	for (; (size_t)(end - p) > len; p++) {
+		if (strncasecmp(p, "max-age", len) == 0) {
+			break;
+		}
+	}
+	if ((size_t)(end - p) <= len) {
+		return -1;
+	}
+	p += len;
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	if (p == end || *p++ != '=') {
+		return -1;
+	}
+	while (p < end && (*p == ' ' || *p == '\t')) {
+		p++;
+	}
+	for (; p < end && *p >= '0' && *p <= '9'; p++) {
+		if (max_age < 0) {
+			max_age = 0;
+		}
+		if (max_age > (INT_MAX - 9) / 10) {
+			return -1;
+		}
+		max_age = max_age * 10 + (*p - '0');
+	}
+
+	return max_age;
+}
+
+/*! Search reply handed to schedule_search_result(). */
+typedef struct {
+	/*! Headers of the reply, for the duplicate check. */
+	ssdp_hdrs *hdrs;
+	/*! ResultData of the reply, without the cookie. */
+	ResultData result;
+} ssdp_search_reply;
+
+/*!
+ * \brief Schedules send_search_result() for a search matching a reply,
+ * unless the search already got the same reply within the duplicate window.
+ */
+static void schedule_search_result(
+	/* [in] Matching search. */
+	SsdpSearchArg *search,
+	/* [in] ssdp_search_reply of the reply. */
+	void *arg)
+{
+	ssdp_search_reply *reply = (ssdp_search_reply *)arg;
+	ResultData *threadData;
+	ThreadPoolJob job;
+
+	if (ssdp_dedup_check(reply->hdrs, UPNP_DISCOVERY_SEARCH_RESULT,
+		search->timeoutEventId)) {
+		return;	/* copy of a recent reply to this search */
+	}
+	memset(&job, 0, sizeof(job));
+	threadData = (ResultData *)malloc(sizeof(ResultData));
+	if (threadData == NULL) {
+		return;
+	}
+	*threadData = reply->result;
+	threadData->cookie = search->cookie;
+	TPJobInit(&job, (start_routine)send_search_result, threadData);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	TPJobSetFreeFunction(&job, (free_routine)free);
+	if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0) {
+		free(threadData);
+	}
+}
+
+/*!
+ * \brief Checks whether an NT or ST header names the device type handled by
+ * the control point.
+ */
+static int ssdp_target_found(
+	/* [in] NT or ST header value. */
+	memptr *hdr_value)
+{
+	size_t len = strlen(OhmSearchType);
+
+	return hdr_value->buf != NULL && hdr_value->length >= len &&
+		!strncmp(hdr_value->buf, OhmSearchType, len);
+}
+
+/*!
+ * \brief Copies a header slice into a LINE_SIZE field of the discovery
+ * structure. An absent header gives an empty string.
+ */
+static void ssdp_copy_hdr(
+	/* [out] Destination field. */
+	char dest[LINE_SIZE],
+	/* [in] Header value. */
+	memptr *hdr_value)
+{
+	if (hdr_value->buf != NULL) {
+		linecopylen(dest, hdr_value->buf, hdr_value->length);
+	} else {
+		dest[0] = '\0';
+	}
+}
+
+/*!
+ * \brief Fills a header slice from a parsed message.
+ */
+static void ssdp_find_hdr(
+	/* [in] Parsed message. */
+	http_message_t *hmsg,
+	/* [in] Header id. */
+	int header_name_id,
+	/* [out] Header value, NULL buf if not found. */
+	memptr *hdr_value)
+{
+	if (httpmsg_find_hdr(hmsg, header_name_id, hdr_value) == NULL) {
+		hdr_value->buf = NULL;
+		hdr_value->length = (size_t)0;
+	}
+}
+
 void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_addr,
 			    int timeout, void *cookie)
 {
 	int handle;
 	struct Handle_Info *ctrlpt_info = NULL;
-	memptr hdr_value;
+	Upnp_FunPtr ctrlpt_callback;
+	http_header_t *usn;
+	ssdp_hdrs hdrs;
+
+	/* search timeout */
+	if (timeout) {
+		HandleReadLock();
+		if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
+			HandleUnlock();
+			return;
+		}
+		ctrlpt_callback = ctrlpt_info->Callback;
+		HandleUnlock();
+		ctrlpt_callback(UPNP_DISCOVERY_SEARCH_TIMEOUT, NULL, cookie);
+		return;
+	}
+	memset(&hdrs, 0, sizeof(hdrs));
+	hdrs.is_request = hmsg->is_request;
+	hdrs.status_code = hmsg->status_code;
+	ssdp_find_hdr(hmsg, HDR_HOST, &hdrs.host);
+	ssdp_find_hdr(hmsg, HDR_NT, &hdrs.nt);
+	ssdp_find_hdr(hmsg, HDR_NTS, &hdrs.nts);
+	ssdp_find_hdr(hmsg, HDR_ST, &hdrs.st);
+	ssdp_find_hdr(hmsg, HDR_UID, &hdrs.uid);
+	ssdp_find_hdr(hmsg, HDR_DT, &hdrs.dt);
+	ssdp_find_hdr(hmsg, HDR_LOCATION, &hdrs.location);
+	ssdp_find_hdr(hmsg, HDR_CACHE_CONTROL, &hdrs.cache_control);
+	usn = httpmsg_find_hdr_str(hmsg, "USN");
+	if (usn != NULL) {
+		hdrs.usn.buf = usn->value.buf;
+		hdrs.usn.length = usn->value.length;
+	}
+	ssdp_handle_ctrlpt_hdrs(&hdrs, dest_addr);
+}
+
+void ssdp_handle_ctrlpt_hdrs(ssdp_hdrs *hdrs, struct sockaddr_storage *dest_addr)
+{
+	int handle;
+	struct Handle_Info *ctrlpt_info = NULL;
+	memptr *hdr_value;
 	/* byebye or alive */
 	int is_byebye;
 	struct Upnp_Discovery param;
 	int nt_found;
 	int st_found;
-	char save_char;
 	Upnp_EventType event_type;
 	Upnp_FunPtr ctrlpt_callback;
 	void *ctrlpt_cookie;
-	ListNode *node = NULL;
-	SsdpSearchArg *searchArg = NULL;
-	int matched = 0;
-	ResultData *threadData = NULL;
-	ThreadPoolJob job;
-
-	memset(&job, 0, sizeof(job));
+	ssdp_search_reply reply;
 
 	/* we are assuming that there can be only one client supported at a time */
 	HandleReadLock();
@@ -115,52 +376,24 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 	ctrlpt_callback = ctrlpt_info->Callback;
 	ctrlpt_cookie = ctrlpt_info->Cookie;
 	HandleUnlock();
-	/* search timeout */
-	if (timeout) {
-		ctrlpt_callback(UPNP_DISCOVERY_SEARCH_TIMEOUT, NULL, cookie);
-		return;
-	}
 	param.ErrCode = UPNP_E_SUCCESS;
+	param.Expires = ssdp_max_age(&hdrs->cache_control);
 	/* dest addr */
 	memcpy(&param.DestAddr, dest_addr, sizeof(struct sockaddr_storage));
-	/* LOCATION */
-	param.Location[0] = '\0';
-	if (httpmsg_find_hdr(hmsg, HDR_LOCATION, &hdr_value) != NULL) {
-		linecopylen(param.Location, hdr_value.buf, hdr_value.length);
-	}
-	/* clear everything */
-	memset(param.DeviceType, 0, sizeof(param.DeviceType));
-	memset(param.UID, 0, sizeof(param.UID));
-	nt_found = FALSE;
-	if (httpmsg_find_hdr(hmsg, HDR_NT, &hdr_value) != NULL) {
-		save_char = hdr_value.buf[hdr_value.length];
-		hdr_value.buf[hdr_value.length] = '\0';
-		//nt_found = (ssdp_request_type(hdr_value.buf, &event) == 0);
-		if(!strncmp(hdr_value.buf,OhmSearchType,strlen(OhmSearchType)))
-		    nt_found = TRUE;
-		hdr_value.buf[hdr_value.length] = save_char;
-	}
-	if (httpmsg_find_hdr(hmsg, HDR_DT, &hdr_value) != NULL) {
-		save_char = hdr_value.buf[hdr_value.length];
-		hdr_value.buf[hdr_value.length] = '\0';
-		strncpy(param.DeviceType,hdr_value.buf,hdr_value.length);
-		hdr_value.buf[hdr_value.length] = save_char;
-	}
-	if (httpmsg_find_hdr(hmsg, HDR_UID, &hdr_value) != NULL) {
-		save_char = hdr_value.buf[hdr_value.length];
-		hdr_value.buf[hdr_value.length] = '\0';
-		strncpy(param.UID,hdr_value.buf,hdr_value.length);
-		hdr_value.buf[hdr_value.length] = save_char;
-	}
+	/* LOCATION, DT, UID */
+	ssdp_copy_hdr(param.Location, &hdrs->location);
+	ssdp_copy_hdr(param.DeviceType, &hdrs->dt);
+	ssdp_copy_hdr(param.UID, &hdrs->uid);
+	nt_found = ssdp_target_found(&hdrs->nt);
 	/* ADVERT. OR BYEBYE */
-	if (hmsg->is_request) {
+	if (hdrs->is_request) {
 		/* use NTS hdr to determine advert., or byebye */
-		if (httpmsg_find_hdr(hmsg, HDR_NTS, &hdr_value) == NULL) {
+		if (hdrs->nts.buf == NULL) {
 			return;	/* error; NTS header not found */
 		}
-		if (memptr_cmp(&hdr_value, "ssdp:alive") == 0) {
+		if (memptr_cmp(&hdrs->nts, "ssdp:alive") == 0) {
 			is_byebye = FALSE;
-		} else if (memptr_cmp(&hdr_value, "ssdp:byebye") == 0) {
+		} else if (memptr_cmp(&hdrs->nts, "ssdp:byebye") == 0) {
 			is_byebye = TRUE;
 		} else {
 			return;	/* bad value */
@@ -181,92 +414,39 @@ void ssdp_handle_ctrlpt_msg(http_message_t *hmsg, struct sockaddr_storage *dest_
 			}
 			event_type = UPNP_DISCOVERY_ADVERTISEMENT_ALIVE;
 		}
+		if (ssdp_dedup_check(hdrs, event_type, 0)) {
+			return;	/* copy of a recent message */
+		}
+		ssdp_location_seen(&param, is_byebye);
+		if (is_byebye) {
+			ssdp_presence_remove(param.UID);
+		} else {
+			ssdp_presence_update(&param);
+		}
 		/* call callback */
 		ctrlpt_callback(event_type, &param, ctrlpt_cookie);
 	} else {
 		/* reply (to a SEARCH) */
 		/* only checking to see if there is a valid ST header */
-		st_found = FALSE;
-		if ( httpmsg_find_hdr(hmsg, HDR_ST, &hdr_value) != NULL) {
-		    save_char = hdr_value.buf[hdr_value.length];
-		    hdr_value.buf[hdr_value.length] = '\0';
-		    //st_found = ssdp_request_type(hdr_value.buf, &event) == 0;
-		    if(!strncmp(hdr_value.buf,OhmSearchType,strlen(OhmSearchType)))
-			st_found = TRUE;
-		    hdr_value.buf[hdr_value.length] = save_char;
-		}
-		if (hmsg->status_code != HTTP_OK ||
+		hdr_value = &hdrs->st;
+		st_found = ssdp_target_found(hdr_value);
+		if (hdrs->status_code != HTTP_OK ||
 		    strlen(param.Location) == 0 || !st_found) {
 			return;	/* bad reply */
 		}
-		/* check each current search */
-		HandleLock();
+		ssdp_location_seen(&param, FALSE);
+		ssdp_presence_update(&param);
+		/* check each current search; duplicates are dropped per search */
+		reply.hdrs = hdrs;
+		reply.result.param = param;
+		reply.result.ctrlpt_callback = ctrlpt_callback;
+		HandleReadLock();
 		if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
 			HandleUnlock();
 			return;
 		}
-		node = ListHead(&ctrlpt_info->SsdpSearchList);
-		/* temporary add null termination */
-		/*save_char = hdr_value.buf[ hdr_value.length ]; */
-		/*hdr_value.buf[ hdr_value.length ] = '\0'; */
-		while (node != NULL) {
-			searchArg = node->item;
-			/* check for match of ST header and search target */
-			switch (searchArg->requestType) {
-			case SSDP_ALL:
-				matched = 1;
-				break;
-			case SSDP_DEVICEUDN:
-				matched = !strncmp(searchArg->searchTarget,
-						   hdr_value.buf,
-						   hdr_value.length);
-				break;
-			case SSDP_DEVICETYPE:{
-					size_t m = min(hdr_value.length,
-						       strlen
-						       (searchArg->searchTarget));
-					matched =
-					    !strncmp(searchArg->searchTarget,
-						     hdr_value.buf, m);
-					break;
-				}
-			case SSDP_SERVICE:{
-					size_t m = min(hdr_value.length,
-						       strlen
-						       (searchArg->searchTarget));
-					matched =
-					    !strncmp(searchArg->searchTarget,
-						     hdr_value.buf, m);
-					break;
-				}
-			default:
-				matched = 0;
-				break;
-			}
-			if (matched) {
-				/* schedule call back */
-				threadData =
-				    (ResultData *) malloc(sizeof(ResultData));
-				if (threadData != NULL) {
-					threadData->param = param;
-					threadData->cookie = searchArg->cookie;
-					threadData->ctrlpt_callback =
-					    ctrlpt_callback;
-					TPJobInit(&job, (start_routine)
-						  send_search_result,
-						  threadData);
-					TPJobSetPriority(&job, MED_PRIORITY);
-					TPJobSetFreeFunction(&job,
-							     (free_routine)
-							     free);
-					if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0) {
-						free(threadData);
-					}
-				}
-			}
-			node = ListNext(&ctrlpt_info->SsdpSearchList, node);
-		}
-
+		ssdp_search_index_match(ctrlpt_info->SsdpSearchIdx, hdr_value,
+			schedule_search_result, &reply);
 		HandleUnlock();
 		/*ctrlpt_callback( UPNP_DISCOVERY_SEARCH_RESULT, &param, cookie ); */
 	}
@@ -449,6 +629,8 @@ static void searchExpired(
 	while (node != NULL) {
 		item = (SsdpSearchArg *) node->item;
 		if (item->timeoutEventId == (*id)) {
+			ssdp_search_index_remove(ctrlpt_info->SsdpSearchIdx,
+				item);
 			free(item->searchTarget);
 			cookie = item->cookie;
 			found = 1;
@@ -467,32 +649,127 @@ static void searchExpired(
 	free(id);
 }
 
-int SearchByTarget(int Mx, char *St, void *Cookie)
-{
-	char errorBuffer[ERROR_BUFFER_LEN];
-	int *id = NULL;
-	int ret = 0;
-	char ReqBufv4[BUFSIZE];
+/*! M-SEARCH packets of a search, built once and sent NUM_SSDP_COPY times. */
+typedef struct {
+	/*! Copies still to be sent. */
+	int copies;
+	char v4[BUFSIZE];
 #ifdef UPNP_ENABLE_IPV6
-	char ReqBufv6[BUFSIZE];
-	char ReqBufv6UlaGua[BUFSIZE];
+	char v6[BUFSIZE];
+	char v6UlaGua[BUFSIZE];
 #endif
+} ssdp_search_packets;
+
+/*!
+ * \brief Sends one copy of the M-SEARCH packets of a search, without
+ * blocking.
+ *
+ * On IPv6 the site-local and link-local requests go out with a single
+ * sendmmsg() call where available.
+ */
+static void send_search_packets(
+	/* [in] Packets to send. */
+	ssdp_search_packets *packets)
+{
 	struct sockaddr_storage __ss_v4;
+	struct sockaddr_in *destAddr4 = (struct sockaddr_in *)&__ss_v4;
+	unsigned long addrv4 = inet_addr(gIF_IPV4);
 #ifdef UPNP_ENABLE_IPV6
-	struct sockaddr_storage __ss_v6;
+	struct sockaddr_storage __ss_v6[2];
+	struct sockaddr_in6 *destAddr6;
+	char *bufv6[2];
+	int i;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[2];
+	struct iovec iov[2];
 #endif
-	struct sockaddr_in *destAddr4 = (struct sockaddr_in *)&__ss_v4;
+#endif
+
 #ifdef UPNP_ENABLE_IPV6
-	struct sockaddr_in6 *destAddr6 = (struct sockaddr_in6 *)&__ss_v6;
+	if (gSsdpReqSocket6 != INVALID_SOCKET) {
+		setsockopt(gSsdpReqSocket6, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+			   (char *)&gIF_INDEX, sizeof(gIF_INDEX));
+		bufv6[0] = packets->v6UlaGua;
+		bufv6[1] = packets->v6;
+		for (i = 0; i < 2; i++) {
+			memset(&__ss_v6[i], 0, sizeof(__ss_v6[i]));
+			destAddr6 = (struct sockaddr_in6 *)&__ss_v6[i];
+			destAddr6->sin6_family = (sa_family_t)AF_INET6;
+			inet_pton(AF_INET6, i == 0 ? SSDP_IPV6_SITELOCAL :
+				  SSDP_IPV6_LINKLOCAL, &destAddr6->sin6_addr);
+			destAddr6->sin6_port = htons(SSDP_PORT);
+			destAddr6->sin6_scope_id = gIF_INDEX;
+			CDBG_INFO(">>> SSDP SEND M-SEARCH >>>\n%s\n", bufv6[i]);
+#ifdef HAVE_SENDMMSG
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			iov[i].iov_base = bufv6[i];
+			iov[i].iov_len = strlen(bufv6[i]);
+			msgs[i].msg_hdr.msg_name = &__ss_v6[i];
+			msgs[i].msg_hdr.msg_namelen =
+				sizeof(struct sockaddr_in6);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+#else
+			sendto(gSsdpReqSocket6, bufv6[i], strlen(bufv6[i]),
+			       MSG_DONTWAIT, (struct sockaddr *)&__ss_v6[i],
+			       sizeof(struct sockaddr_in6));
+#endif
+		}
+#ifdef HAVE_SENDMMSG
+		sendmmsg(gSsdpReqSocket6, msgs, 2u, MSG_DONTWAIT);
 #endif
-	fd_set wrSet;
+	}
+#endif /* IPv6 */
+	if (gSsdpReqSocket4 != INVALID_SOCKET) {
+		setsockopt(gSsdpReqSocket4, IPPROTO_IP, IP_MULTICAST_IF,
+			   (char *)&addrv4, sizeof(addrv4));
+		memset(&__ss_v4, 0, sizeof(__ss_v4));
+		destAddr4->sin_family = (sa_family_t)AF_INET;
+		inet_pton(AF_INET, SSDP_IP, &destAddr4->sin_addr);
+		destAddr4->sin_port = htons(SSDP_PORT);
+		CDBG_INFO(">>> SSDP SEND M-SEARCH >>>\n%s\n", packets->v4);
+		sendto(gSsdpReqSocket4, packets->v4, strlen(packets->v4),
+		       MSG_DONTWAIT, (struct sockaddr *)&__ss_v4,
+		       sizeof(struct sockaddr_in));
+	}
+}
+
+/*!
+ * \brief Sends the next copy of a search and schedules the one after it.
+ *
+ * Runs from the timer thread; frees the packets after the last copy.
+ */
+static void send_search_copy(
+	/* [in] ssdp_search_packets of the search. */
+	void *arg)
+{
+	ssdp_search_packets *packets = (ssdp_search_packets *)arg;
+	ThreadPoolJob job;
+
+	send_search_packets(packets);
+	packets->copies--;
+	if (packets->copies > 0) {
+		memset(&job, 0, sizeof(job));
+		TPJobInit(&job, (start_routine)send_search_copy, packets);
+		TPJobSetPriority(&job, MED_PRIORITY);
+		TPJobSetFreeFunction(&job, (free_routine)free);
+		if (TimerThreadSchedule(&gTimerThread, (time_t)SSDP_PAUSE,
+			REL_MSEC, &job, SHORT_TERM, NULL) == 0) {
+			return;
+		}
+	}
+	free(packets);
+}
+
+int SearchByTarget(int Mx, char *St, void *Cookie)
+{
+	int *id = NULL;
+	ssdp_search_packets *packets = NULL;
 	SsdpSearchArg *newArg = NULL;
 	int timeTillRead = 0;
 	int handle;
 	struct Handle_Info *ctrlpt_info = NULL;
 	enum SsdpSearchType requestType;
-	unsigned long addrv4 = inet_addr(gIF_IPV4);
-	SOCKET max_fd = 0;
 	int retVal;
 
 	/*ThreadData *ThData; */
@@ -510,41 +787,48 @@ int SearchByTarget(int Mx, char *St, void *Cookie)
 		timeTillRead = MIN_SEARCH_TIME;
 	else if (timeTillRead > MAX_SEARCH_TIME)
 		timeTillRead = MAX_SEARCH_TIME;
-	retVal = CreateClientRequestPacket(ReqBufv4, sizeof(ReqBufv4), timeTillRead, St, AF_INET);
+	packets = (ssdp_search_packets *)malloc(sizeof(ssdp_search_packets));
+	if (packets == NULL)
+		return UPNP_E_OUTOF_MEMORY;
+	packets->copies = NUM_SSDP_COPY;
+	retVal = CreateClientRequestPacket(packets->v4, sizeof(packets->v4), timeTillRead, St, AF_INET);
 	if (retVal != UPNP_E_SUCCESS)
-		return retVal;
+		goto error_handler;
 #ifdef UPNP_ENABLE_IPV6
-	retVal = CreateClientRequestPacket(ReqBufv6, sizeof(ReqBufv6), timeTillRead, St, AF_INET6);
+	retVal = CreateClientRequestPacket(packets->v6, sizeof(packets->v6), timeTillRead, St, AF_INET6);
 	if (retVal != UPNP_E_SUCCESS)
-		return retVal;
-	retVal = CreateClientRequestPacketUlaGua(ReqBufv6UlaGua, sizeof(ReqBufv6UlaGua), timeTillRead, St, AF_INET6);
+		goto error_handler;
+	retVal = CreateClientRequestPacketUlaGua(packets->v6UlaGua, sizeof(packets->v6UlaGua), timeTillRead, St, AF_INET6);
 	if (retVal != UPNP_E_SUCCESS)
-		return retVal;
-#endif
-
-	memset(&__ss_v4, 0, sizeof(__ss_v4));
-	destAddr4->sin_family = (sa_family_t)AF_INET;
-	inet_pton(AF_INET, SSDP_IP, &destAddr4->sin_addr);
-	destAddr4->sin_port = htons(SSDP_PORT);
-
-#ifdef UPNP_ENABLE_IPV6
-	memset(&__ss_v6, 0, sizeof(__ss_v6));
-	destAddr6->sin6_family = (sa_family_t)AF_INET6;
-	inet_pton(AF_INET6, SSDP_IPV6_SITELOCAL, &destAddr6->sin6_addr);
-	destAddr6->sin6_port = htons(SSDP_PORT);
-	destAddr6->sin6_scope_id = gIF_INDEX;
+		goto error_handler;
 #endif
 
 	/* add search criteria to list */
 	HandleLock();
 	if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
 		HandleUnlock();
-		return UPNP_E_INTERNAL_ERROR;
+		retVal = UPNP_E_INTERNAL_ERROR;
+		goto error_handler;
 	}
 	newArg = (SsdpSearchArg *) malloc(sizeof(SsdpSearchArg));
+	if (newArg == NULL) {
+		HandleUnlock();
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto error_handler;
+	}
 	newArg->searchTarget = strdup(St);
 	newArg->cookie = Cookie;
 	newArg->requestType = requestType;
+	newArg->next = NULL;
+	if (newArg->searchTarget == NULL ||
+	    ssdp_search_index_add(ctrlpt_info->SsdpSearchIdx, newArg) !=
+	    UPNP_E_SUCCESS) {
+		free(newArg->searchTarget);
+		free(newArg);
+		HandleUnlock();
+		retVal = UPNP_E_OUTOF_MEMORY;
+		goto error_handler;
+	}
 	id = (int *)malloc(sizeof(int));
 	TPJobInit(&job, (start_routine) searchExpired, id);
 	TPJobSetPriority(&job, MED_PRIORITY);
@@ -557,82 +841,15 @@ int SearchByTarget(int Mx, char *St, void *Cookie)
 	HandleUnlock();
 	/* End of lock */
 
-	FD_ZERO(&wrSet);
-	if (gSsdpReqSocket4 != INVALID_SOCKET) {
-		setsockopt(gSsdpReqSocket4, IPPROTO_IP, IP_MULTICAST_IF,
-			   (char *)&addrv4, sizeof(addrv4));
-		FD_SET(gSsdpReqSocket4, &wrSet);
-		max_fd = max(max_fd, gSsdpReqSocket4);
-	}
-#ifdef UPNP_ENABLE_IPV6
-	if (gSsdpReqSocket6 != INVALID_SOCKET) {
-		setsockopt(gSsdpReqSocket6, IPPROTO_IPV6, IPV6_MULTICAST_IF,
-			   (char *)&gIF_INDEX, sizeof(gIF_INDEX));
-		FD_SET(gSsdpReqSocket6, &wrSet);
-		max_fd = max(max_fd, gSsdpReqSocket6);
-	}
-#endif
-	ret = select(max_fd + 1, NULL, &wrSet, NULL, NULL);
-	if (ret == -1) {
-		strerror_r(errno, errorBuffer, ERROR_BUFFER_LEN);
-		CDBG_INFO(
-			   "SSDP_LIB: Error in select(): %s\n", errorBuffer);
-		shutdown(gSsdpReqSocket4, SD_BOTH);
-		UpnpCloseSocket(gSsdpReqSocket4);
-#ifdef UPNP_ENABLE_IPV6
-		shutdown(gSsdpReqSocket6, SD_BOTH);
-		UpnpCloseSocket(gSsdpReqSocket6);
-#endif
-		return UPNP_E_INTERNAL_ERROR;
-	}
-#ifdef UPNP_ENABLE_IPV6
-	if (gSsdpReqSocket6 != INVALID_SOCKET &&
-	    FD_ISSET(gSsdpReqSocket6, &wrSet)) {
-		int NumCopy = 0;
-
-		while (NumCopy < NUM_SSDP_COPY) {
-			CDBG_INFO(
-				   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				   ReqBufv6UlaGua);
-			sendto(gSsdpReqSocket6,
-			       ReqBufv6UlaGua, strlen(ReqBufv6UlaGua), 0,
-			       (struct sockaddr *)&__ss_v6,
-			       sizeof(struct sockaddr_in6));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
-		NumCopy = 0;
-		inet_pton(AF_INET6, SSDP_IPV6_LINKLOCAL, &destAddr6->sin6_addr);
-		while (NumCopy < NUM_SSDP_COPY) {
-			CDBG_INFO(
-				   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				   ReqBufv6);
-			sendto(gSsdpReqSocket6,
-			       ReqBufv6, strlen(ReqBufv6), 0,
-			       (struct sockaddr *)&__ss_v6,
-			       sizeof(struct sockaddr_in6));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
-	}
-#endif /* IPv6 */
-	if (gSsdpReqSocket4 != INVALID_SOCKET &&
-	    FD_ISSET(gSsdpReqSocket4, &wrSet)) {
-		int NumCopy = 0;
-		while (NumCopy < NUM_SSDP_COPY) {
-			CDBG_INFO(
-				   ">>> SSDP SEND M-SEARCH >>>\n%s\n",
-				   ReqBufv4);
-			sendto(gSsdpReqSocket4,
-			       ReqBufv4, strlen(ReqBufv4), 0,
-			       (struct sockaddr *)&__ss_v4,
-			       sizeof(struct sockaddr_in));
-			NumCopy++;
-			imillisleep(SSDP_PAUSE);
-		}
-	}
+	/* first copy now, the others from the timer thread. */
+	send_search_copy(packets);
 
 	return 1;
+
+error_handler:
+	free(packets);
+
+	return retVal;
 }
 #endif /* EXCLUDE_SSDP */
 #endif /* INCLUDE_CLIENT_APIS */
@@ -0,0 +1,298 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \addtogroup SSDPlib
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Device presence table of the control point.
+ *
+ * Announced devices are tracked by UID with the deadline of their last
+ * announcement, SSDP_DEFAULT_MAX_AGE seconds out when it has no usable
+ * CACHE-CONTROL max-age. Deadlines are on the monotonic clock. Each device
+ * has at most one event on the timer thread: a refresh only moves the
+ * deadline, and the event reschedules itself when it fires early. A device
+ * whose deadline passes is reported with
+ * UPNP_DISCOVERY_ADVERTISEMENT_EXPIRED.
+ */
+
+#include "config.h"
+
+#if EXCLUDE_SSDP == 0 && defined(INCLUDE_CLIENT_APIS)
+
+#include "sock.h"
+#include "ssdplib.h"
+#include "upnpapi.h"
+#include "TimerThread.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#undef DBG_TAG
+#define DBG_TAG "SSDP"
+
+/*! A tracked device. */
+typedef struct ssdp_presence_entry
+{
+	/*! Last announcement of the device. */
+	struct Upnp_Discovery param;
+	/*! Time the announcement expires, in monotonic ms. */
+	int64_t deadline;
+	/*! Identifies the entry in its timer event. */
+	unsigned long generation;
+	struct ssdp_presence_entry *next;
+} ssdp_presence_entry;
+
+/*! Argument of the expiry event of an entry. */
+typedef struct
+{
+	char UID[LINE_SIZE];
+	unsigned long generation;
+} ssdp_presence_timer;
+
+/*! Table of tracked devices, protected by presenceMutex. */
+static ssdp_presence_entry *presenceTable[SSDP_PRESENCE_HASH_SIZE];
+static int presenceEnabled = FALSE;
+static unsigned long presenceGeneration = 0lu;
+static ithread_mutex_t presenceMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*!
+ * \brief Returns the bucket of a UID.
+ */
+static ssdp_presence_entry **presence_bucket(
+	/*! [in] UID of the device. */
+	const char *uid)
+{
+	unsigned hash = 2166136261u;
+
+	while (*uid != '\0') {
+		hash ^= (unsigned char)*uid++;
+		hash *= 16777619u;
+	}
+
+	return &presenceTable[hash & (SSDP_PRESENCE_HASH_SIZE - 1)];
+}
+
+/*!
+ * \brief Returns the link pointing to the entry of a UID, or to the NULL at
+ * the end of its bucket if the UID is not tracked.
+ */
+static ssdp_presence_entry **presence_find(
+	/*! [in] UID of the device. */
+	const char *uid)
+{
+	ssdp_presence_entry **link = presence_bucket(uid);
+
+	while (*link != NULL && strcmp((*link)->param.UID, uid) != 0) {
+		link = &(*link)->next;
+	}
+
+	return link;
+}
+
+static void presence_expired(void *arg);
+
+/*!
+ * \brief Schedules the expiry event of an entry.
+ *
+ * \return 0 on success, nonzero if the event could not be scheduled.
+ */
+static int presence_schedule(
+	/*! [in] Entry to watch. */
+	ssdp_presence_entry *entry,
+	/*! [in] Milliseconds until the event. */
+	int64_t delay)
+{
+	ssdp_presence_timer *timer;
+	ThreadPoolJob job;
+	int rc;
+
+	timer = (ssdp_presence_timer *)malloc(sizeof(ssdp_presence_timer));
+	if (timer == NULL) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+	memcpy(timer->UID, entry->param.UID, sizeof(timer->UID));
+	timer->generation = entry->generation;
+	memset(&job, 0, sizeof(job));
+	TPJobInit(&job, (start_routine)presence_expired, timer);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	TPJobSetFreeFunction(&job, (free_routine)free);
+	rc = TimerThreadSchedule(&gTimerThread, (time_t)delay, REL_MSEC, &job,
+		SHORT_TERM, NULL);
+	if (rc != 0) {
+		free(timer);
+	}
+
+	return rc;
+}
+
+/*!
+ * \brief Expiry event of an entry: reports the device if its deadline has
+ * passed, else waits for the new deadline.
+ */
+static void presence_expired(
+	/*! [in] ssdp_presence_timer of the entry. */
+	void *arg)
+{
+	ssdp_presence_timer *timer = (ssdp_presence_timer *)arg;
+	ssdp_presence_entry **link;
+	ssdp_presence_entry *entry;
+	struct Upnp_Discovery param;
+	struct Handle_Info *ctrlpt_info = NULL;
+	Upnp_FunPtr ctrlpt_callback;
+	void *ctrlpt_cookie;
+	int handle;
+	int64_t now = sock_monotonic_ms();
+
+	ithread_mutex_lock(&presenceMutex);
+	link = presence_find(timer->UID);
+	entry = *link;
+	if (entry == NULL || entry->generation != timer->generation) {
+		/* removed, or replaced by an entry with its own event. */
+		ithread_mutex_unlock(&presenceMutex);
+		free(timer);
+		return;
+	}
+	if (entry->deadline > now &&
+	    presence_schedule(entry, entry->deadline - now) == 0) {
+		ithread_mutex_unlock(&presenceMutex);
+		free(timer);
+		return;
+	}
+	*link = entry->next;
+	param = entry->param;
+	free(entry);
+	ithread_mutex_unlock(&presenceMutex);
+	free(timer);
+
+	HandleReadLock();
+	if (GetClientHandleInfo(&handle, &ctrlpt_info) != HND_CLIENT) {
+		HandleUnlock();
+		return;
+	}
+	ctrlpt_callback = ctrlpt_info->Callback;
+	ctrlpt_cookie = ctrlpt_info->Cookie;
+	HandleUnlock();
+	CDBG_INFO("SSDP: device %s expired\n", param.UID);
+	ctrlpt_callback(UPNP_DISCOVERY_ADVERTISEMENT_EXPIRED, &param,
+		ctrlpt_cookie);
+}
+
+/*!
+ * \brief Frees all the entries. Their pending events find nothing and exit.
+ */
+static void presence_clear(void)
+{
+	ssdp_presence_entry *entry;
+	int i;
+
+	for (i = 0; i < SSDP_PRESENCE_HASH_SIZE; i++) {
+		while ((entry = presenceTable[i]) != NULL) {
+			presenceTable[i] = entry->next;
+			free(entry);
+		}
+	}
+}
+
+void ssdp_presence_enable(int enable)
+{
+	ithread_mutex_lock(&presenceMutex);
+	presenceEnabled = enable != 0;
+	if (!presenceEnabled) {
+		presence_clear();
+	}
+	ithread_mutex_unlock(&presenceMutex);
+}
+
+void ssdp_presence_update(struct Upnp_Discovery *param)
+{
+	ssdp_presence_entry **link;
+	ssdp_presence_entry *entry;
+	int64_t lifetime;
+
+	if (param->UID[0] == '\0') {
+		return;
+	}
+	lifetime = (int64_t)(param->Expires > 0 ?
+		param->Expires : SSDP_DEFAULT_MAX_AGE) * 1000;
+	ithread_mutex_lock(&presenceMutex);
+	if (!presenceEnabled) {
+		ithread_mutex_unlock(&presenceMutex);
+		return;
+	}
+	link = presence_find(param->UID);
+	entry = *link;
+	if (entry != NULL) {
+		/* the pending event picks up the new deadline. */
+		entry->param = *param;
+		entry->deadline = sock_monotonic_ms() + lifetime;
+		ithread_mutex_unlock(&presenceMutex);
+		return;
+	}
+	entry = (ssdp_presence_entry *)malloc(sizeof(ssdp_presence_entry));
+	if (entry == NULL) {
+		ithread_mutex_unlock(&presenceMutex);
+		return;
+	}
+	entry->param = *param;
+	entry->deadline = sock_monotonic_ms() + lifetime;
+	entry->generation = ++presenceGeneration;
+	if (presence_schedule(entry, lifetime) != 0) {
+		CDBG_ERROR("SSDP: cannot watch device %s\n", param->UID);
+		free(entry);
+	} else {
+		entry->next = NULL;
+		*link = entry;
+	}
+	ithread_mutex_unlock(&presenceMutex);
+}
+
+void ssdp_presence_remove(const char *uid)
+{
+	ssdp_presence_entry **link;
+	ssdp_presence_entry *entry;
+
+	ithread_mutex_lock(&presenceMutex);
+	link = presence_find(uid);
+	entry = *link;
+	if (entry != NULL) {
+		*link = entry->next;
+	}
+	ithread_mutex_unlock(&presenceMutex);
+	free(entry);
+}
+
+#endif /* EXCLUDE_SSDP == 0 && INCLUDE_CLIENT_APIS */
+
+/* @} SSDPlib */
@@ -0,0 +1,219 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \addtogroup SSDPlib
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Single pass scanner for the SSDP messages handled by the control
+ * point.
+ *
+ * NOTIFY requests and search replies are scanned in place: the headers the
+ * control point needs are returned as slices of the receive buffer, nothing
+ * is allocated and the buffer is not modified. Anything unusual (folded
+ * headers, unknown start line, missing end of headers) is left to the
+ * general HTTP parser.
+ */
+
+#include "config.h"
+
+#if EXCLUDE_SSDP == 0
+
+#include "ssdplib.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+
+/*! Headers extracted by the scanner and their place in ssdp_hdrs. */
+static const struct {
+	const char *name;
+	size_t length;
+	size_t offset;
+} ssdp_scan_names[] = {
+	{"NT", (size_t)2, offsetof(ssdp_hdrs, nt)},
+	{"NTS", (size_t)3, offsetof(ssdp_hdrs, nts)},
+	{"ST", (size_t)2, offsetof(ssdp_hdrs, st)},
+	{"USN", (size_t)3, offsetof(ssdp_hdrs, usn)},
+	{"UID", (size_t)3, offsetof(ssdp_hdrs, uid)},
+	{"DT", (size_t)2, offsetof(ssdp_hdrs, dt)},
+	{"HOST", (size_t)4, offsetof(ssdp_hdrs, host)},
+	{"LOCATION", (size_t)8, offsetof(ssdp_hdrs, location)},
+	{"CACHE-CONTROL", (size_t)13, offsetof(ssdp_hdrs, cache_control)},
+};
+
+#define NUM_SCAN_NAMES (sizeof(ssdp_scan_names) / sizeof(ssdp_scan_names[0]))
+
+/*!
+ * \brief Returns the slice for a header name, or NULL if the header is not
+ * used by the control point.
+ */
+static memptr *ssdp_scan_slot(
+	/*! [in] Structure receiving the slices. */
+	ssdp_hdrs *hdrs,
+	/*! [in] Header name. */
+	const char *name,
+	/*! [in] Length of the header name. */
+	size_t length)
+{
+	size_t i;
+
+	for (i = (size_t)0; i < NUM_SCAN_NAMES; i++) {
+		if (ssdp_scan_names[i].length == length &&
+		    strncasecmp(ssdp_scan_names[i].name, name, length) == 0) {
+			return (memptr *)((char *)hdrs +
+				ssdp_scan_names[i].offset);
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Checks a start line against a constant string.
+ */
+static int ssdp_scan_line_is(
+	/*! [in] Start of the line. */
+	const char *line,
+	/*! [in] Length of the line, without CRLF. */
+	size_t length,
+	/*! [in] Expected content. */
+	const char *s)
+{
+	return length == strlen(s) && memcmp(line, s, length) == 0;
+}
+
+/*!
+ * \brief Parses the status line of a search reply.
+ *
+ * \return The status code, or -1 if the line is not an HTTP/1.x status line.
+ */
+static int ssdp_scan_status(
+	/*! [in] Start of the line. */
+	const char *line,
+	/*! [in] Length of the line, without CRLF. */
+	size_t length)
+{
+	/* "HTTP/1.x NNN" */
+	if (length < (size_t)12 || memcmp(line, "HTTP/1.", (size_t)7) != 0 ||
+	    line[7] < '0' || line[7] > '9' || line[8] != ' ' ||
+	    line[9] < '0' || line[9] > '9' ||
+	    line[10] < '0' || line[10] > '9' ||
+	    line[11] < '0' || line[11] > '9' ||
+	    (length > (size_t)12 && line[12] != ' ')) {
+		return -1;
+	}
+
+	return (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+}
+
+enum ssdp_scan_result ssdp_scan_msg(char *buf, size_t length, int is_reply,
+	ssdp_hdrs *hdrs)
+{
+	char *p = buf;
+	char *end = buf + length;
+	char *eol;
+	char *line_end;
+	char *colon;
+	char *value;
+	memptr *slot;
+
+	memset(hdrs, 0, sizeof(*hdrs));
+	/* start line */
+	eol = memchr(p, '\n', (size_t)(end - p));
+	if (eol == NULL) {
+		return SSDP_SCAN_FALLBACK;
+	}
+	line_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+	if (is_reply) {
+		hdrs->status_code = ssdp_scan_status(p, (size_t)(line_end - p));
+		if (hdrs->status_code < 0) {
+			return SSDP_SCAN_FALLBACK;
+		}
+		hdrs->is_request = FALSE;
+	} else if (ssdp_scan_line_is(p, (size_t)(line_end - p),
+			"NOTIFY * HTTP/1.1") ||
+		   ssdp_scan_line_is(p, (size_t)(line_end - p),
+			"NOTIFY * HTTP/1.0")) {
+		hdrs->is_request = TRUE;
+	} else if ((size_t)(line_end - p) > (size_t)9 &&
+		   memcmp(p, "M-SEARCH ", (size_t)9) == 0) {
+		/* searches are only answered by devices. */
+		return SSDP_SCAN_IGNORE;
+	} else {
+		return SSDP_SCAN_FALLBACK;
+	}
+	/* headers */
+	while (TRUE) {
+		p = eol + 1;
+		eol = memchr(p, '\n', (size_t)(end - p));
+		if (eol == NULL) {
+			/* no empty line after the headers. */
+			return SSDP_SCAN_FALLBACK;
+		}
+		line_end = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+		if (line_end == p) {
+			break;
+		}
+		if (*p == ' ' || *p == '\t') {
+			/* folded header. */
+			return SSDP_SCAN_FALLBACK;
+		}
+		colon = memchr(p, ':', (size_t)(line_end - p));
+		if (colon == NULL || colon == p) {
+			return SSDP_SCAN_FALLBACK;
+		}
+		slot = ssdp_scan_slot(hdrs, p, (size_t)(colon - p));
+		if (slot == NULL || slot->buf != NULL) {
+			/* not needed, or repeated: keep the first one. */
+			continue;
+		}
+		value = colon + 1;
+		while (value < line_end && (*value == ' ' || *value == '\t')) {
+			value++;
+		}
+		while (line_end > value &&
+		       (line_end[-1] == ' ' || line_end[-1] == '\t')) {
+			line_end--;
+		}
+		slot->buf = value;
+		slot->length = (size_t)(line_end - value);
+	}
+
+	return SSDP_SCAN_OK;
+}
+
+#endif /* EXCLUDE_SSDP */
+
+/* @} SSDPlib */
@@ -0,0 +1,324 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \addtogroup SSDPlib
+ *
+ * @{
+ *
+ * \file
+ *
+ * \brief Index of the active searches of a control point.
+ *
+ * Search replies are matched against the outstanding searches without
+ * walking all of them: ssdp:all searches are kept in a single bucket, UDN
+ * and root device searches in a hash table keyed on the full target, and
+ * device and service type searches in a byte trie, so that a reply costs
+ * one pass over its ST header.
+ */
+
+#include "config.h"
+
+#if EXCLUDE_SSDP == 0 && defined(INCLUDE_CLIENT_APIS)
+
+#include "ssdplib.h"
+#include "upnp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*!
+ * \brief FNV-1a hash of a search target.
+ */
+static unsigned ssdp_search_hash(
+	/*! [in] Search target. */
+	const char *target,
+	/*! [in] Length of the target. */
+	size_t length)
+{
+	unsigned hash = 2166136261u;
+	size_t i;
+
+	for (i = (size_t)0; i < length; i++) {
+		hash ^= (unsigned char)target[i];
+		hash *= 16777619u;
+	}
+
+	return hash & (SSDP_SEARCH_HASH_SIZE - 1);
+}
+
+/*!
+ * \brief Removes a search from a singly linked chain.
+ */
+static void ssdp_search_unlink(
+	/*! [in,out] Head of the chain. */
+	SsdpSearchArg **head,
+	/*! [in] Search to remove. */
+	SsdpSearchArg *search)
+{
+	while (*head != NULL) {
+		if (*head == search) {
+			*head = search->next;
+			search->next = NULL;
+			return;
+		}
+		head = &(*head)->next;
+	}
+}
+
+/*!
+ * \brief Returns the child of a node for a byte, creating it if asked to.
+ *
+ * \return The child, or NULL if it does not exist or cannot be allocated.
+ */
+static ssdp_search_node *ssdp_search_child(
+	/*! [in,out] First child of the parent node. */
+	ssdp_search_node **first,
+	/*! [in] Byte of the child. */
+	char c,
+	/*! [in] Create the child if it does not exist. */
+	int create)
+{
+	ssdp_search_node *node;
+
+	for (node = *first; node != NULL; node = node->sibling) {
+		if (node->c == c) {
+			return node;
+		}
+	}
+	if (!create) {
+		return NULL;
+	}
+	node = (ssdp_search_node *)malloc(sizeof(ssdp_search_node));
+	if (node == NULL) {
+		return NULL;
+	}
+	node->c = c;
+	node->child = NULL;
+	node->searches = NULL;
+	node->sibling = *first;
+	*first = node;
+
+	return node;
+}
+
+/*!
+ * \brief Removes a search from the trie and frees the nodes it leaves empty.
+ *
+ * \return TRUE if \b *first no longer points to the node for \b target[0]
+ * because that node was freed.
+ */
+static int ssdp_search_trie_remove(
+	/*! [in,out] First child of the parent node. */
+	ssdp_search_node **first,
+	/*! [in] Remaining bytes of the target. */
+	const char *target,
+	/*! [in] Search to remove. */
+	SsdpSearchArg *search)
+{
+	ssdp_search_node **link;
+	ssdp_search_node *node;
+
+	for (link = first; *link != NULL; link = &(*link)->sibling) {
+		if ((*link)->c == *target) {
+			break;
+		}
+	}
+	node = *link;
+	if (node == NULL) {
+		return FALSE;
+	}
+	if (target[1] == '\0') {
+		ssdp_search_unlink(&node->searches, search);
+	} else {
+		ssdp_search_trie_remove(&node->child, target + 1, search);
+	}
+	if (node->searches == NULL && node->child == NULL) {
+		*link = node->sibling;
+		free(node);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*!
+ * \brief Visits all the searches of a subtree.
+ */
+static void ssdp_search_visit_subtree(
+	/*! [in] Root of the subtree. */
+	ssdp_search_node *node,
+	/*! [in] Function called for each search. */
+	ssdp_search_visit visit,
+	/*! [in] Argument passed to \b visit. */
+	void *arg)
+{
+	SsdpSearchArg *search;
+
+	for (search = node->searches; search != NULL; search = search->next) {
+		visit(search, arg);
+	}
+	for (node = node->child; node != NULL; node = node->sibling) {
+		ssdp_search_visit_subtree(node, visit, arg);
+	}
+}
+
+/*!
+ * \brief Frees a list of sibling nodes and their subtrees.
+ */
+static void ssdp_search_free_nodes(
+	/*! [in] First node of the list. */
+	ssdp_search_node *node)
+{
+	ssdp_search_node *next;
+
+	while (node != NULL) {
+		next = node->sibling;
+		ssdp_search_free_nodes(node->child);
+		free(node);
+		node = next;
+	}
+}
+
+int ssdp_search_index_add(SsdpSearchIndex *index, SsdpSearchArg *search)
+{
+	SsdpSearchArg **head;
+	ssdp_search_node **first;
+	ssdp_search_node *node = NULL;
+	const char *p;
+
+	switch (search->requestType) {
+	case SSDP_ALL:
+		head = &index->all;
+		break;
+	case SSDP_ROOTDEVICE:
+	case SSDP_DEVICEUDN:
+		head = &index->exact[ssdp_search_hash(search->searchTarget,
+			strlen(search->searchTarget))];
+		break;
+	case SSDP_DEVICETYPE:
+	case SSDP_SERVICE:
+		if (search->searchTarget[0] == '\0') {
+			return UPNP_E_INVALID_PARAM;
+		}
+		first = &index->types;
+		for (p = search->searchTarget; *p != '\0'; p++) {
+			node = ssdp_search_child(first, *p, TRUE);
+			if (node == NULL) {
+				/* drop the nodes created so far. */
+				ssdp_search_trie_remove(&index->types,
+					search->searchTarget, search);
+				return UPNP_E_OUTOF_MEMORY;
+			}
+			first = &node->child;
+		}
+		head = &node->searches;
+		break;
+	default:
+		return UPNP_E_INVALID_PARAM;
+	}
+	search->next = *head;
+	*head = search;
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_search_index_remove(SsdpSearchIndex *index, SsdpSearchArg *search)
+{
+	switch (search->requestType) {
+	case SSDP_ALL:
+		ssdp_search_unlink(&index->all, search);
+		break;
+	case SSDP_ROOTDEVICE:
+	case SSDP_DEVICEUDN:
+		ssdp_search_unlink(&index->exact[ssdp_search_hash(
+			search->searchTarget, strlen(search->searchTarget))],
+			search);
+		break;
+	case SSDP_DEVICETYPE:
+	case SSDP_SERVICE:
+		ssdp_search_trie_remove(&index->types, search->searchTarget,
+			search);
+		break;
+	default:
+		break;
+	}
+}
+
+void ssdp_search_index_match(SsdpSearchIndex *index, memptr *st,
+	ssdp_search_visit visit, void *arg)
+{
+	SsdpSearchArg *search;
+	ssdp_search_node *node = NULL;
+	ssdp_search_node *first;
+	size_t i;
+
+	for (search = index->all; search != NULL; search = search->next) {
+		visit(search, arg);
+	}
+	for (search = index->exact[ssdp_search_hash(st->buf, st->length)];
+	     search != NULL; search = search->next) {
+		if (strlen(search->searchTarget) == st->length &&
+		    memcmp(search->searchTarget, st->buf, st->length) == 0) {
+			visit(search, arg);
+		}
+	}
+	/* type searches: every target that is a prefix of ST matches on the
+	 * way down, and every target ST is a prefix of matches at the end. */
+	first = index->types;
+	for (i = (size_t)0; i < st->length; i++) {
+		node = ssdp_search_child(&first, st->buf[i], FALSE);
+		if (node == NULL) {
+			return;
+		}
+		if (i + 1 == st->length) {
+			break;
+		}
+		for (search = node->searches; search != NULL;
+		     search = search->next) {
+			visit(search, arg);
+		}
+		first = node->child;
+	}
+	if (node != NULL) {
+		ssdp_search_visit_subtree(node, visit, arg);
+	}
+}
+
+void ssdp_search_index_destroy(SsdpSearchIndex *index)
+{
+	ssdp_search_free_nodes(index->types);
+	memset(index, 0, sizeof(*index));
+}
+
+#endif /* EXCLUDE_SSDP == 0 && INCLUDE_CLIENT_APIS */
+
+/* @} SSDPlib */
@@ -38,6 +38,8 @@
  * \file
  */
 
+#define _GNU_SOURCE	/* For recvmmsg() in sys/socket.h */
+
 #ifndef WIN32
 	#include <sys/param.h>
 #else
@@ -62,6 +64,24 @@
 
 #define MAX_TIME_TOREAD  45
 
+#if defined(HAVE_RECVMMSG) && SSDP_RECV_BATCH > 1
+	#define SSDP_USE_RECVMMSG 1
+#else
+	#define SSDP_USE_RECVMMSG 0
+#endif
+
+#if SSDP_USE_RECVMMSG
+	#ifdef SO_RXQ_OVFL
+		#define SSDP_CMSG_SIZE CMSG_SPACE(sizeof(uint32_t))
+	#else
+		#define SSDP_CMSG_SIZE 1
+	#endif
+	/*! Number of receive batches kept for reuse. */
+	#define SSDP_BATCH_POOL 4
+	/*! Number of SSDP sockets tracked for kernel drop accounting. */
+	#define SSDP_MAX_OVFL_SOCKS 8
+#endif /* SSDP_USE_RECVMMSG */
+
 #undef DBG_TAG
 #define DBG_TAG "SSDP"
 
@@ -89,6 +109,332 @@ struct SSDPSockArray {
 #endif /* INCLUDE_CLIENT_APIS */
 };
 
+#if SSDP_USE_RECVMMSG
+/*! Datagrams read by a single recvmmsg() call. */
+typedef struct {
+	/*! Socket the datagrams were read from. */
+	SOCKET sock;
+	/*! Number of datagrams accepted by the receive filter. */
+	unsigned int count;
+	/*! Indexes of the accepted datagrams. */
+	unsigned int idx[SSDP_RECV_BATCH];
+	struct mmsghdr msgs[SSDP_RECV_BATCH];
+	struct iovec iov[SSDP_RECV_BATCH];
+	struct sockaddr_storage addr[SSDP_RECV_BATCH];
+	char cmsg[SSDP_RECV_BATCH][SSDP_CMSG_SIZE];
+	char buf[SSDP_RECV_BATCH][BUFSIZE];
+} ssdp_recv_batch;
+
+/*! Cache of receive batches, protected by ssdpRecvMutex. */
+static FreeList ssdpBatchList;
+/*! Last SO_RXQ_OVFL counter seen on each SSDP socket. */
+static struct {
+	SOCKET sock;
+	uint32_t count;
+} ssdpOvfl[SSDP_MAX_OVFL_SOCKS];
+#endif /* SSDP_USE_RECVMMSG */
+
+/*! Receive counters, protected by ssdpRecvMutex. */
+static struct Upnp_Discovery_Stats ssdpStats;
+static ithread_mutex_t ssdpRecvMutex;
+/*! NT/ST prefixes of the receive filter, protected by ssdpRecvMutex. */
+static struct {
+	char prefix[LINE_SIZE];
+	size_t length;
+} ssdpFilters[SSDP_MAX_FILTERS];
+static int ssdpFilterCount = 0;
+
+/*! Entry of the duplicate announcement cache. */
+typedef struct {
+	/*! Hash of UID, event type, LOCATION and scope. */
+	uint32_t key;
+	/*! Time the message was last seen, in ms; 0 for an empty entry. */
+	uint64_t time;
+} ssdp_dedup_entry;
+
+/*! Duplicate announcement cache, protected by ssdpDedupMutex. */
+static ssdp_dedup_entry ssdpDedup[SSDP_DEDUP_SIZE];
+static int ssdpDedupWindow = SSDP_DEDUP_WINDOW;
+static unsigned long ssdpDedupHits;
+static unsigned long ssdpDedupMisses;
+static ithread_mutex_t ssdpDedupMutex;
+
+int ssdp_server_init(void)
+{
+#if SSDP_USE_RECVMMSG
+	int i;
+#endif /* SSDP_USE_RECVMMSG */
+
+	if (ithread_mutex_init(&ssdpRecvMutex, NULL) != 0) {
+		return UPNP_E_INIT_FAILED;
+	}
+	if (ithread_mutex_init(&ssdpDedupMutex, NULL) != 0) {
+		ithread_mutex_destroy(&ssdpRecvMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+#ifdef INCLUDE_CLIENT_APIS
+	if (ssdp_ctrlpt_init() != UPNP_E_SUCCESS) {
+		ithread_mutex_destroy(&ssdpDedupMutex);
+		ithread_mutex_destroy(&ssdpRecvMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+#endif /* INCLUDE_CLIENT_APIS */
+	memset(&ssdpStats, 0, sizeof(ssdpStats));
+	ssdpFilterCount = 0;
+	memset(ssdpDedup, 0, sizeof(ssdpDedup));
+	ssdpDedupWindow = SSDP_DEDUP_WINDOW;
+	ssdpDedupHits = 0lu;
+	ssdpDedupMisses = 0lu;
+#if SSDP_USE_RECVMMSG
+	for (i = 0; i < SSDP_MAX_OVFL_SOCKS; i++) {
+		ssdpOvfl[i].sock = INVALID_SOCKET;
+		ssdpOvfl[i].count = 0u;
+	}
+	if (FreeListInit(&ssdpBatchList, sizeof(ssdp_recv_batch),
+		SSDP_BATCH_POOL) != 0) {
+#ifdef INCLUDE_CLIENT_APIS
+		ssdp_ctrlpt_destroy();
+#endif /* INCLUDE_CLIENT_APIS */
+		ithread_mutex_destroy(&ssdpDedupMutex);
+		ithread_mutex_destroy(&ssdpRecvMutex);
+		return UPNP_E_INIT_FAILED;
+	}
+#endif /* SSDP_USE_RECVMMSG */
+
+	return UPNP_E_SUCCESS;
+}
+
+void ssdp_server_destroy(void)
+{
+#if SSDP_USE_RECVMMSG
+	FreeListDestroy(&ssdpBatchList);
+#endif /* SSDP_USE_RECVMMSG */
+#ifdef INCLUDE_CLIENT_APIS
+	ssdp_ctrlpt_destroy();
+#endif /* INCLUDE_CLIENT_APIS */
+	ithread_mutex_destroy(&ssdpDedupMutex);
+	ithread_mutex_destroy(&ssdpRecvMutex);
+}
+
+void ssdp_get_stats(struct Upnp_Discovery_Stats *stats)
+{
+	ithread_mutex_lock(&ssdpRecvMutex);
+	*stats = ssdpStats;
+	ithread_mutex_unlock(&ssdpRecvMutex);
+	ithread_mutex_lock(&ssdpDedupMutex);
+	stats->DedupHits = ssdpDedupHits;
+	stats->DedupMisses = ssdpDedupMisses;
+	ithread_mutex_unlock(&ssdpDedupMutex);
+}
+
+/*!
+ * \brief Accounts for a batch of datagrams. Must be called with
+ * ssdpRecvMutex held.
+ */
+static void ssdp_count_batch(
+	/*! [in] Number of datagrams read. */
+	unsigned int count)
+{
+	ssdpStats.Batches++;
+	ssdpStats.Datagrams += count;
+	if (count > ssdpStats.MaxBatch) {
+		ssdpStats.MaxBatch = count;
+	}
+}
+
+/*!
+ * \brief Checks a datagram against the receive filter and updates the
+ * filter counters. Must be called with ssdpRecvMutex held.
+ *
+ * The NT and ST header lines are located with a plain byte scan; no
+ * parsing is done at this point.
+ *
+ * \return TRUE if the datagram must be handled, FALSE if it must be dropped.
+ */
+static int ssdp_filter_accept(
+	/*! [in] Received datagram. */
+	const char *buf,
+	/*! [in] Length of the datagram. */
+	size_t length)
+{
+	const char *p = buf;
+	const char *end = buf + length;
+	const char *eol;
+	const char *value;
+	int i;
+
+	if (ssdpFilterCount == 0) {
+		ssdpStats.FilterAccepted++;
+		return TRUE;
+	}
+	/* skip the start line, then look at each header line. */
+	while ((eol = memchr(p, '\n', (size_t)(end - p))) != NULL) {
+		p = eol + 1;
+		if (end - p < 3 || *p == '\r' || *p == '\n') {
+			/* end of headers. */
+			break;
+		}
+		if ((p[0] != 'N' && p[0] != 'n' && p[0] != 'S' && p[0] != 's') ||
+		    (p[1] != 'T' && p[1] != 't') || p[2] != ':') {
+			continue;
+		}
+		value = p + 3;
+		while (value < end && (*value == ' ' || *value == '\t')) {
+			value++;
+		}
+		for (i = 0; i < ssdpFilterCount; i++) {
+			if ((size_t)(end - value) >= ssdpFilters[i].length &&
+			    memcmp(value, ssdpFilters[i].prefix,
+				   ssdpFilters[i].length) == 0) {
+				ssdpStats.FilterAccepted++;
+				return TRUE;
+			}
+		}
+	}
+	ssdpStats.FilterDropped++;
+
+	return FALSE;
+}
+
+int ssdp_add_filter(const char *prefix)
+{
+	size_t length = strlen(prefix);
+	int ret = UPNP_E_SUCCESS;
+
+	if (length >= sizeof(ssdpFilters[0].prefix)) {
+		return UPNP_E_INVALID_PARAM;
+	}
+	ithread_mutex_lock(&ssdpRecvMutex);
+	if (ssdpFilterCount >= SSDP_MAX_FILTERS) {
+		ret = UPNP_E_OUTOF_BOUNDS;
+	} else {
+		memcpy(ssdpFilters[ssdpFilterCount].prefix, prefix, length + 1);
+		ssdpFilters[ssdpFilterCount].length = length;
+		ssdpFilterCount++;
+	}
+	ithread_mutex_unlock(&ssdpRecvMutex);
+
+	return ret;
+}
+
+void ssdp_remove_all_filters(void)
+{
+	ithread_mutex_lock(&ssdpRecvMutex);
+	ssdpFilterCount = 0;
+	ithread_mutex_unlock(&ssdpRecvMutex);
+}
+
+/*!
+ * \brief Returns a monotonic time in milliseconds, never 0.
+ */
+static uint64_t ssdp_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u + 1u;
+}
+
+/*!
+ * \brief FNV-1a hash of a header slice, chained from \b hash.
+ */
+static uint32_t ssdp_hash_hdr(
+	/*! [in] Hash of the previous fields. */
+	uint32_t hash,
+	/*! [in] Header value, NULL buf if absent. */
+	memptr *hdr_value)
+{
+	size_t i;
+
+	for (i = (size_t)0; hdr_value->buf != NULL && i < hdr_value->length; i++) {
+		hash ^= (unsigned char)hdr_value->buf[i];
+		hash *= 16777619u;
+	}
+	/* field separator. */
+	hash ^= 0xffu;
+	hash *= 16777619u;
+
+	return hash;
+}
+
+/*!
+ * \brief Computes the cache key of a message for a given event type.
+ */
+static uint32_t ssdp_dedup_key(
+	/*! [in] Headers of the message. */
+	ssdp_hdrs *hdrs,
+	/*! [in] Event type delivered for the message. */
+	Upnp_EventType event_type,
+	/*! [in] Search the reply is delivered to, 0 for advertisements. */
+	int scope)
+{
+	uint32_t hash = 2166136261u;
+
+	hash = ssdp_hash_hdr(hash, &hdrs->uid);
+	hash ^= (uint32_t)event_type;
+	hash *= 16777619u;
+	hash = ssdp_hash_hdr(hash, &hdrs->location);
+	hash ^= (uint32_t)scope;
+	hash *= 16777619u;
+
+	return hash;
+}
+
+void ssdp_set_dedup_window(int window)
+{
+	ithread_mutex_lock(&ssdpDedupMutex);
+	ssdpDedupWindow = window;
+	memset(ssdpDedup, 0, sizeof(ssdpDedup));
+	ithread_mutex_unlock(&ssdpDedupMutex);
+}
+
+int ssdp_dedup_check(ssdp_hdrs *hdrs, Upnp_EventType event_type, int scope)
+{
+	ssdp_dedup_entry *entry;
+	ssdp_dedup_entry *other = NULL;
+	uint32_t key;
+	uint32_t other_key = 0u;
+	uint64_t now;
+	int duplicate;
+
+	key = ssdp_dedup_key(hdrs, event_type, scope);
+	/* an alive after a byebye, or the reverse, is never a duplicate of
+	 * an older copy. */
+	if (event_type == UPNP_DISCOVERY_ADVERTISEMENT_ALIVE) {
+		other_key = ssdp_dedup_key(hdrs,
+			UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE, scope);
+	} else if (event_type == UPNP_DISCOVERY_ADVERTISEMENT_BYEBYE) {
+		other_key = ssdp_dedup_key(hdrs,
+			UPNP_DISCOVERY_ADVERTISEMENT_ALIVE, scope);
+	}
+	now = ssdp_now_ms();
+	ithread_mutex_lock(&ssdpDedupMutex);
+	if (ssdpDedupWindow == 0) {
+		ithread_mutex_unlock(&ssdpDedupMutex);
+		return FALSE;
+	}
+	entry = &ssdpDedup[key & (SSDP_DEDUP_SIZE - 1)];
+	duplicate = entry->time != 0u && entry->key == key &&
+		now - entry->time < (uint64_t)ssdpDedupWindow;
+	if (duplicate) {
+		ssdpDedupHits++;
+	} else {
+		ssdpDedupMisses++;
+		entry->key = key;
+		entry->time = now;
+		if (other_key != 0u) {
+			other = &ssdpDedup[other_key & (SSDP_DEDUP_SIZE - 1)];
+			if (other->key == other_key) {
+				other->time = 0u;
+			}
+		}
+	}
+	ithread_mutex_unlock(&ssdpDedupMutex);
+
+	return duplicate;
+}
+
 int unique_service_name(char *cmd, SsdpEvent *Evt)
 {
 	char *TempPtr = NULL;
@@ -112,8 +458,14 @@ enum SsdpSearchType ssdp_request_type1(char *cmd)
 {
 	if (strstr(cmd, ":all"))
 		return SSDP_ALL;
+	if (strncmp(cmd, "uuid:", strlen("uuid:")) == 0)
+		return SSDP_DEVICEUDN;
+	if (strcmp(cmd, "upnp:rootdevice") == 0)
+		return SSDP_ROOTDEVICE;
 	if (strstr(cmd, "urn:") && strstr(cmd, ":device:"))
 		return SSDP_DEVICETYPE;
+	if (strstr(cmd, "urn:") && strstr(cmd, ":service:"))
+		return SSDP_SERVICE;
 	return SSDP_SERROR;
 }
 
@@ -148,6 +500,30 @@ static void free_ssdp_event_handler_data(
 	}
 }
 
+/*!
+ * \brief Checks the HOST header of a multicast SSDP request.
+ *
+ * \return TRUE if the header names the SSDP multicast group, else FALSE.
+ */
+static int valid_ssdp_host(
+	/*! [in] HOST header value, NULL buf if absent. */
+	memptr *hdr_value)
+{
+	if (hdr_value->buf == NULL ||
+	    (memptr_cmp(hdr_value, "239.255.255.250:1900") != 0 &&
+	     memptr_cmp(hdr_value, "[FF02::C]:1900") != 0 &&
+	     memptr_cmp(hdr_value, "[ff02::c]:1900") != 0 &&
+	     memptr_cmp(hdr_value, "[FF05::C]:1900") != 0 &&
+	     memptr_cmp(hdr_value, "[ff05::c]:1900") != 0)) {
+		CDBG_INFO(
+			   "Invalid HOST header from SSDP message\n");
+
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 /*!
  * \brief Does some quick checking of the ssdp msg.
  *
@@ -174,15 +550,10 @@ static UPNP_INLINE int valid_ssdp_msg(
 			return FALSE;
 		}
 		/* check HOST header */
-		if (httpmsg_find_hdr(hmsg, HDR_HOST, &hdr_value) == NULL ||
-		    (memptr_cmp(&hdr_value, "239.255.255.250:1900") != 0 &&
-		     memptr_cmp(&hdr_value, "[FF02::C]:1900") != 0 &&
-		     memptr_cmp(&hdr_value, "[ff02::c]:1900") != 0 &&
-		     memptr_cmp(&hdr_value, "[FF05::C]:1900") != 0 &&
-		     memptr_cmp(&hdr_value, "[ff05::c]:1900") != 0)) {
-			CDBG_INFO(
-				   "Invalid HOST header from SSDP message\n");
-
+		if (httpmsg_find_hdr(hmsg, HDR_HOST, &hdr_value) == NULL) {
+			hdr_value.buf = NULL;
+		}
+		if (!valid_ssdp_host(&hdr_value)) {
 			return FALSE;
 		}
 	}
@@ -192,21 +563,16 @@ static UPNP_INLINE int valid_ssdp_msg(
 }
 
 /*!
- * \brief Parses the message and dispatches it to a handler which handles the
- * ssdp request msg.
+ * \brief Parses the received message and does the quick checks.
  *
- * \return 0 if successful, -1 if error.
+ * \return 0 if the message is a valid SSDP message, -1 otherwise.
  */
-static UPNP_INLINE int start_event_handler(
-	/*! [in] ssdp_thread_data structure. This structure contains SSDP
-	 * request message. */
-	void *Data)
+static int parse_ssdp_msg(
+	/*! [in] Parser holding the received datagram. */
+	http_parser_t *parser)
 {
-	http_parser_t *parser = NULL;
 	parse_status_t status;
-	ssdp_thread_data *data = (ssdp_thread_data *) Data;
 
-	parser = &data->parser;
 	status = parser_parse(parser);
 	if (status == (parse_status_t)PARSE_FAILURE) {
 		if (parser->msg.method != (http_method_t)HTTPMETHOD_NOTIFY ||
@@ -227,14 +593,101 @@ static UPNP_INLINE int start_event_handler(
 	if (valid_ssdp_msg(&parser->msg) != TRUE) {
 		goto error_handler;
 	}
-	/* done; thread will free 'data' */
 	return 0;
 
  error_handler:
-	free_ssdp_event_handler_data(data);
 	return -1;
 }
 
+/*!
+ * \brief Parses the message and dispatches it to a handler which handles the
+ * ssdp request msg.
+ *
+ * \return 0 if successful, -1 if error.
+ */
+static UPNP_INLINE int start_event_handler(
+	/*! [in] ssdp_thread_data structure. This structure contains SSDP
+	 * request message. */
+	void *Data)
+{
+	ssdp_thread_data *data = (ssdp_thread_data *) Data;
+
+	if (parse_ssdp_msg(&data->parser) != 0) {
+		free_ssdp_event_handler_data(data);
+		return -1;
+	}
+	/* done; thread will free 'data' */
+	return 0;
+}
+
+/*!
+ * \brief Tells whether a socket is one of the search request sockets, on
+ * which search replies are received.
+ */
+static int ssdp_is_req_sock(
+	/*! [in] SSDP socket. */
+	SOCKET socket)
+{
+#ifdef INCLUDE_CLIENT_APIS
+	return socket == gSsdpReqSocket4
+	#ifdef UPNP_ENABLE_IPV6
+	    || socket == gSsdpReqSocket6
+	#endif /* UPNP_ENABLE_IPV6 */
+	    ;
+#else /* INCLUDE_CLIENT_APIS */
+	return FALSE;
+#endif /* INCLUDE_CLIENT_APIS */
+}
+
+/*!
+ * \brief Initializes the parser for a datagram read from the given socket:
+ * search replies on the request sockets, NOTIFY/M-SEARCH otherwise.
+ */
+static void ssdp_parser_init(
+	/*! [out] Parser to initialize. */
+	http_parser_t *parser,
+	/*! [in] Socket the datagram was read from. */
+	SOCKET socket)
+{
+	if (ssdp_is_req_sock(socket))
+		parser_response_init(parser, HTTPMETHOD_MSEARCH);
+	else
+		parser_request_init(parser);
+}
+
+/*!
+ * \brief Handles a datagram with the SSDP scanner, without going through
+ * the HTTP parser.
+ *
+ * \return 0 if the datagram has been handled or dropped, -1 if it must be
+ * handled by the HTTP parser.
+ */
+static int ssdp_fast_path(
+	/*! [in] Received datagram. */
+	char *buf,
+	/*! [in] Length of the datagram. */
+	size_t length,
+	/*! [in] TRUE if read from a search request socket. */
+	int is_reply,
+	/*! [in] Address of the sender. */
+	struct sockaddr_storage *dest_addr)
+{
+	ssdp_hdrs hdrs;
+
+	switch (ssdp_scan_msg(buf, length, is_reply, &hdrs)) {
+	case SSDP_SCAN_OK:
+		if (hdrs.is_request && !valid_ssdp_host(&hdrs.host)) {
+			return 0;
+		}
+		ssdp_handle_ctrlpt_hdrs(&hdrs, dest_addr);
+		return 0;
+	case SSDP_SCAN_IGNORE:
+		return 0;
+	default:
+		return -1;
+	}
+}
+
 /*!
  * \brief This function is a thread that handles SSDP requests.
  */
@@ -246,6 +699,11 @@ static void ssdp_event_handler_thread(
 	ssdp_thread_data *data = (ssdp_thread_data *) the_data;
 	http_message_t *hmsg = &data->parser.msg;
 
+	if (ssdp_fast_path(hmsg->msg.buf, hmsg->msg.length, !hmsg->is_request,
+		&data->dest_addr) == 0) {
+		free_ssdp_event_handler_data(data);
+		return;
+	}
 	if (start_event_handler(the_data) != 0)
 		return;
 	/* send msg to device or ctrlpt */
@@ -260,89 +718,287 @@ static void ssdp_event_handler_thread(
 	free_ssdp_event_handler_data(data);
 }
 
-void readFromSSDPSocket(SOCKET socket)
+/*!
+ * \brief Reads a single datagram and queues a job to handle it.
+ *
+ * \return The number of bytes received or -1.
+ */
+static int read_ssdp_datagram(
+	/*! [in] SSDP socket. */
+	SOCKET socket)
 {
-	char *requestBuf = NULL;
 	char staticBuf[BUFSIZE];
 	struct sockaddr_storage __ss;
 	ThreadPoolJob job;
 	ssdp_thread_data *data = NULL;
 	socklen_t socklen = sizeof(__ss);
 	ssize_t byteReceived = 0;
+	int accepted;
 	char ntop_buf[INET6_ADDRSTRLEN];
 
 	memset(&job, 0, sizeof(job));
 
-	requestBuf = staticBuf;
-	/* in case memory can't be allocated, still drain the socket using a
-	 * static buffer. */
-	data = malloc(sizeof(ssdp_thread_data));
-	if (data) {
-		/* initialize parser */
-#ifdef INCLUDE_CLIENT_APIS
-		if (socket == gSsdpReqSocket4
-	#ifdef UPNP_ENABLE_IPV6
-		    || socket == gSsdpReqSocket6
-	#endif /* UPNP_ENABLE_IPV6 */
-		    )
-			parser_response_init(&data->parser, HTTPMETHOD_MSEARCH);
-		else
-			parser_request_init(&data->parser);
-#else /* INCLUDE_CLIENT_APIS */
-		parser_request_init(&data->parser);
-#endif /* INCLUDE_CLIENT_APIS */
-		/* set size of parser buffer */
-		if (membuffer_set_size(&data->parser.msg.msg, BUFSIZE) == 0)
-			/* use this as the buffer for recv */
-			requestBuf = data->parser.msg.msg.buf;
-		else {
-			free(data);
-			data = NULL;
-		}
-	}
-	byteReceived = recvfrom(socket, requestBuf, BUFSIZE - (size_t)1, 0,
+	/* read into a static buffer first, so that filtered datagrams, or
+	 * datagrams for which memory can't be allocated, are simply
+	 * drained. */
+	byteReceived = recvfrom(socket, staticBuf, BUFSIZE - (size_t)1, 0,
 				(struct sockaddr *)&__ss, &socklen);
-	if (byteReceived > 0) {
-		requestBuf[byteReceived] = '\0';
-		switch (__ss.ss_family) {
-		case AF_INET:
-			inet_ntop(AF_INET,
-				  &((struct sockaddr_in *)&__ss)->sin_addr,
-				  ntop_buf, sizeof(ntop_buf));
-			break;
+	if (byteReceived <= 0) {
+		return byteReceived < 0 ? -1 : 0;
+	}
+	staticBuf[byteReceived] = '\0';
+	ithread_mutex_lock(&ssdpRecvMutex);
+	ssdp_count_batch(1u);
+	accepted = ssdp_filter_accept(staticBuf, (size_t)byteReceived);
+	ithread_mutex_unlock(&ssdpRecvMutex);
+	if (!accepted) {
+		return (int)byteReceived;
+	}
+	switch (__ss.ss_family) {
+	case AF_INET:
+		inet_ntop(AF_INET,
+			  &((struct sockaddr_in *)&__ss)->sin_addr,
+			  ntop_buf, sizeof(ntop_buf));
+		break;
 #ifdef UPNP_ENABLE_IPV6
-		case AF_INET6:
-			inet_ntop(AF_INET6,
-				  &((struct sockaddr_in6 *)&__ss)->sin6_addr,
-				  ntop_buf, sizeof(ntop_buf));
-			break;
+	case AF_INET6:
+		inet_ntop(AF_INET6,
+			  &((struct sockaddr_in6 *)&__ss)->sin6_addr,
+			  ntop_buf, sizeof(ntop_buf));
+		break;
 #endif /* UPNP_ENABLE_IPV6 */
-		default:
-			memset(ntop_buf, 0, sizeof(ntop_buf));
-			strncpy(ntop_buf, "<Invalid address family>",
-				sizeof(ntop_buf) - 1);
+	default:
+		memset(ntop_buf, 0, sizeof(ntop_buf));
+		strncpy(ntop_buf, "<Invalid address family>",
+			sizeof(ntop_buf) - 1);
+	}
+	CDBG_INFO(
+		   "Start of received response ----------------------------------------------------\n"
+		   "%s\n"
+		   "End of received response ------------------------------------------------------\n"
+		   "From host %s\n", staticBuf, ntop_buf);
+	data = malloc(sizeof(ssdp_thread_data));
+	if (data == NULL) {
+		return (int)byteReceived;
+	}
+	/* initialize parser */
+	ssdp_parser_init(&data->parser, socket);
+	/* copy the datagram into the parser buffer */
+	if (membuffer_assign(&data->parser.msg.msg, staticBuf,
+		(size_t)byteReceived) != 0) {
+		free_ssdp_event_handler_data(data);
+		return (int)byteReceived;
+	}
+	memcpy(&data->dest_addr, &__ss, sizeof(__ss));
+	/* add thread pool job to handle request */
+	TPJobInit(&job, (start_routine)ssdp_event_handler_thread, data);
+	TPJobSetFreeFunction(&job, free_ssdp_event_handler_data);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
+		free_ssdp_event_handler_data(data);
+
+	return (int)byteReceived;
+}
+
+#if SSDP_USE_RECVMMSG
+/*!
+ * \brief Returns a batch to the cache.
+ */
+static void free_ssdp_batch(
+	/*! [in] ssdp_recv_batch structure. */
+	void *the_data)
+{
+	ithread_mutex_lock(&ssdpRecvMutex);
+	FreeListFree(&ssdpBatchList, the_data);
+	ithread_mutex_unlock(&ssdpRecvMutex);
+}
+
+#ifdef SO_RXQ_OVFL
+/*!
+ * \brief Adds the drops reported by the SO_RXQ_OVFL control message of a
+ * socket to the counters. Must be called with ssdpRecvMutex held.
+ */
+static void ssdp_count_drops(
+	/*! [in] SSDP socket. */
+	SOCKET sock,
+	/*! [in] Cumulative drop counter reported by the kernel. */
+	uint32_t count)
+{
+	int i;
+	int slot = -1;
+
+	for (i = 0; i < SSDP_MAX_OVFL_SOCKS; i++) {
+		if (ssdpOvfl[i].sock == sock) {
+			slot = i;
+			break;
 		}
-		CDBG_INFO(
-			   "Start of received response ----------------------------------------------------\n"
-			   "%s\n"
-			   "End of received response ------------------------------------------------------\n"
-			   "From host %s\n", requestBuf, ntop_buf);
-		/* add thread pool job to handle request */
-		if (data != NULL) {
-			data->parser.msg.msg.length += (size_t) byteReceived;
-			/* null-terminate */
-			data->parser.msg.msg.buf[byteReceived] = 0;
-			memcpy(&data->dest_addr, &__ss, sizeof(__ss));
-			TPJobInit(&job, (start_routine)
-				  ssdp_event_handler_thread, data);
-			TPJobSetFreeFunction(&job,
-					     free_ssdp_event_handler_data);
-			TPJobSetPriority(&job, MED_PRIORITY);
-			if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
-				free_ssdp_event_handler_data(data);
+		if (slot == -1 && ssdpOvfl[i].sock == INVALID_SOCKET) {
+			slot = i;
 		}
-	} else
-		free_ssdp_event_handler_data(data);
+	}
+	if (slot == -1) {
+		return;
+	}
+	if (ssdpOvfl[slot].sock != sock || count < ssdpOvfl[slot].count) {
+		/* new socket, or the descriptor has been reused. */
+		ssdpOvfl[slot].sock = sock;
+		ssdpOvfl[slot].count = 0u;
+	}
+	ssdpStats.KernelDrops += count - ssdpOvfl[slot].count;
+	ssdpOvfl[slot].count = count;
+}
+#endif /* SO_RXQ_OVFL */
+
+/*!
+ * \brief This function is a thread that handles a batch of SSDP datagrams.
+ */
+static void ssdp_batch_handler_thread(
+	/*! [in] ssdp_recv_batch structure. */
+	void *the_data)
+{
+	ssdp_recv_batch *batch = (ssdp_recv_batch *)the_data;
+	ssdp_thread_data data;
+	http_message_t *hmsg = &data.parser.msg;
+	unsigned int j;
+	unsigned int i;
+
+	for (j = 0u; j < batch->count; j++) {
+		i = batch->idx[j];
+		if (ssdp_fast_path(batch->buf[i], (size_t)batch->msgs[i].msg_len,
+			ssdp_is_req_sock(batch->sock), &batch->addr[i]) == 0) {
+			continue;
+		}
+		ssdp_parser_init(&data.parser, batch->sock);
+		if (membuffer_assign(&hmsg->msg, batch->buf[i],
+			(size_t)batch->msgs[i].msg_len) != 0) {
+			httpmsg_destroy(hmsg);
+			continue;
+		}
+		memcpy(&data.dest_addr, &batch->addr[i], sizeof(data.dest_addr));
+		if (parse_ssdp_msg(&data.parser) == 0 &&
+		    (hmsg->method == (http_method_t)HTTPMETHOD_NOTIFY ||
+		     hmsg->request_method == (http_method_t)HTTPMETHOD_MSEARCH)) {
+			ssdp_handle_ctrlpt_msg(hmsg, &data.dest_addr, FALSE, NULL);
+		}
+		httpmsg_destroy(hmsg);
+	}
+	free_ssdp_batch(batch);
+}
+
+/*!
+ * \brief Reads up to SSDP_RECV_BATCH datagrams with one recvmmsg() call and
+ * queues a single job to handle them.
+ *
+ * \return The number of datagrams received or -1.
+ */
+static int read_ssdp_batch(
+	/*! [in] SSDP socket. */
+	SOCKET socket)
+{
+	ssdp_recv_batch *batch;
+	ThreadPoolJob job;
+	struct msghdr *hdr;
+#ifdef SO_RXQ_OVFL
+	struct cmsghdr *cmsg;
+	uint32_t drops;
+#endif /* SO_RXQ_OVFL */
+	unsigned int i;
+	int saved_errno;
+	int n;
+
+	memset(&job, 0, sizeof(job));
+	ithread_mutex_lock(&ssdpRecvMutex);
+	batch = (ssdp_recv_batch *)FreeListAlloc(&ssdpBatchList);
+	ithread_mutex_unlock(&ssdpRecvMutex);
+	if (batch == NULL) {
+		/* still drain the socket. */
+		return read_ssdp_datagram(socket);
+	}
+	batch->sock = socket;
+	for (i = 0u; i < (unsigned int)SSDP_RECV_BATCH; i++) {
+		hdr = &batch->msgs[i].msg_hdr;
+		memset(hdr, 0, sizeof(*hdr));
+		batch->iov[i].iov_base = batch->buf[i];
+		batch->iov[i].iov_len = BUFSIZE - (size_t)1;
+		hdr->msg_name = &batch->addr[i];
+		hdr->msg_namelen = sizeof(batch->addr[i]);
+		hdr->msg_iov = &batch->iov[i];
+		hdr->msg_iovlen = 1;
+		hdr->msg_control = batch->cmsg[i];
+		hdr->msg_controllen = sizeof(batch->cmsg[i]);
+	}
+	/* block for the first datagram only. */
+	n = recvmmsg(socket, batch->msgs, SSDP_RECV_BATCH, MSG_WAITFORONE,
+		NULL);
+	if (n <= 0) {
+		saved_errno = errno;
+		free_ssdp_batch(batch);
+		errno = saved_errno;
+		return -1;
+	}
+	batch->count = 0u;
+	ithread_mutex_lock(&ssdpRecvMutex);
+	ssdp_count_batch((unsigned int)n);
+	for (i = 0u; i < (unsigned int)n; i++) {
+		batch->buf[i][batch->msgs[i].msg_len] = '\0';
+		if (batch->msgs[i].msg_len > 0u &&
+		    ssdp_filter_accept(batch->buf[i],
+			(size_t)batch->msgs[i].msg_len)) {
+			batch->idx[batch->count++] = i;
+		}
+#ifdef SO_RXQ_OVFL
+		hdr = &batch->msgs[i].msg_hdr;
+		for (cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL;
+		     cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET &&
+			    cmsg->cmsg_type == SO_RXQ_OVFL) {
+				memcpy(&drops, CMSG_DATA(cmsg), sizeof(drops));
+				ssdp_count_drops(socket, drops);
+			}
+		}
+#endif /* SO_RXQ_OVFL */
+	}
+	ithread_mutex_unlock(&ssdpRecvMutex);
+	CDBG_INFO("Received a batch of %d SSDP datagrams, %u accepted\n",
+		n, batch->count);
+	if (batch->count == 0u) {
+		free_ssdp_batch(batch);
+		return n;
+	}
+	/* add thread pool job to handle the batch */
+	TPJobInit(&job, (start_routine)ssdp_batch_handler_thread, batch);
+	TPJobSetFreeFunction(&job, free_ssdp_batch);
+	TPJobSetPriority(&job, MED_PRIORITY);
+	if (ThreadPoolAdd(&gRecvThreadPool, &job, NULL) != 0)
+		free_ssdp_batch(batch);
+
+	return n;
+}
+#endif /* SSDP_USE_RECVMMSG */
+
+int readFromSSDPSocket(SOCKET socket)
+{
+#if SSDP_USE_RECVMMSG
+	return read_ssdp_batch(socket);
+#else /* SSDP_USE_RECVMMSG */
+	return read_ssdp_datagram(socket);
+#endif /* SSDP_USE_RECVMMSG */
+}
+
+/*!
+ * \brief Asks the kernel to report receive queue drops on an SSDP socket.
+ * Failure is not fatal, drops are simply not counted.
+ */
+static void ssdp_enable_drop_count(
+	/*! [in] SSDP socket. */
+	SOCKET sock)
+{
+#if SSDP_USE_RECVMMSG && defined(SO_RXQ_OVFL)
+	int onOff = 1;
+
+	setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL, (char *)&onOff,
+		sizeof(onOff));
+#endif /* SSDP_USE_RECVMMSG && SO_RXQ_OVFL */
 }
 
 /*!
@@ -445,6 +1101,7 @@ static int create_ssdp_sock_v4(
 		ret = UPNP_E_NETWORK_ERROR;
 		goto error_handler;
 	}
+	ssdp_enable_drop_count(*ssdpSock);
 	ret = UPNP_E_SUCCESS;
 
 error_handler:
@@ -484,6 +1141,7 @@ static int create_ssdp_sock_reqv4(
 		   &ttl, sizeof(ttl));
 	/* just do it, regardless if fails or not. */
 	sock_make_no_blocking(*ssdpReqSock);
+	ssdp_enable_drop_count(*ssdpReqSock);
 
 	return UPNP_E_SUCCESS;
 }
@@ -585,6 +1243,7 @@ static int create_ssdp_sock_v6(
 		ret = UPNP_E_NETWORK_ERROR;
 		goto error_handler;
 	}
+	ssdp_enable_drop_count(*ssdpSock);
 	ret = UPNP_E_SUCCESS;
 
 error_handler:
@@ -699,6 +1358,7 @@ static int create_ssdp_sock_v6_ula_gua(
 		ret = UPNP_E_NETWORK_ERROR;
 		goto error_handler;
 	}
+	ssdp_enable_drop_count(*ssdpSock);
 	ret = UPNP_E_SUCCESS;
 
 error_handler:
@@ -740,6 +1400,7 @@ static int create_ssdp_sock_reqv6(
 		   &hops, sizeof(hops));
 	/* just do it, regardless if fails or not. */
 	sock_make_no_blocking(*ssdpReqSock);
+	ssdp_enable_drop_count(*ssdpReqSock);
 
 	return UPNP_E_SUCCESS;
 }
@@ -0,0 +1,98 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ */
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*! Search target the control point filters on, which the library expects
+ * from the application (see sample/ctrlpt.c). */
+const char OhmSearchType[] = "urn:device:ohm:1";
+
+int64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * 1000000000 + (int64_t)ts.tv_nsec;
+}
+
+/*!
+ * \brief Compares two durations, for qsort().
+ */
+static int bench_cmp(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a;
+	int64_t y = *(const int64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+void bench_print_latency(const char *name, int64_t *samples, size_t num)
+{
+	int64_t total = 0;
+	size_t i;
+
+	if (num == (size_t)0) {
+		printf("%-32s no sample\n", name);
+		return;
+	}
+	qsort(samples, num, sizeof(samples[0]), bench_cmp);
+	for (i = (size_t)0; i < num; i++) {
+		total += samples[i];
+	}
+	printf("%-32s min %7.1f  median %7.1f  p99 %7.1f  max %8.1f  "
+		"mean %7.1f us\n", name,
+		(double)samples[0] / 1000.0,
+		(double)samples[num / 2] / 1000.0,
+		(double)samples[num * 99 / 100] / 1000.0,
+		(double)samples[num - 1] / 1000.0,
+		(double)total / (double)num / 1000.0);
+	fflush(stdout);
+}
+
+void bench_print_rate(const char *name, size_t num, int64_t elapsed)
+{
+	if (elapsed <= 0) {
+		elapsed = 1;
+	}
+	printf("%-32s %10.1f ns/op  %12.0f op/s\n", name,
+		(double)elapsed / (double)num,
+		(double)num * 1e9 / (double)elapsed);
+	fflush(stdout);
+}
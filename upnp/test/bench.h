@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+#ifndef UPNP_TEST_BENCH_H
+#define UPNP_TEST_BENCH_H
+
+/*!
+ * \file
+ *
+ * \brief Helpers shared by the benchmarks and load tools of the test
+ * directory.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Returns the monotonic time in nanoseconds.
+ */
+int64_t bench_now_ns(void);
+
+/*!
+ * \brief Prints the minimum, median, 99th percentile, maximum and mean of a
+ * set of durations, in microseconds. The samples are sorted in place.
+ */
+void bench_print_latency(
+	/*! [in] Name of the measure. */
+	const char *name,
+	/*! [in,out] Durations in nanoseconds. */
+	int64_t *samples,
+	/*! [in] Number of samples. */
+	size_t num);
+
+/*!
+ * \brief Prints the cost of an operation measured over a number of runs, in
+ * nanoseconds per operation and operations per second.
+ */
+void bench_print_rate(
+	/*! [in] Name of the operation. */
+	const char *name,
+	/*! [in] Number of operations. */
+	size_t num,
+	/*! [in] Time they took, in nanoseconds. */
+	int64_t elapsed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* UPNP_TEST_BENCH_H */
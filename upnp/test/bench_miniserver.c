@@ -0,0 +1,289 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Measures the wakeup-to-dispatch latency of the miniserver loop.
+ *
+ * A NOTIFY request is written in one piece on a new connection to the HTTP
+ * listener of the miniserver. The time from the write to the GENA callback
+ * being called for it covers the loop waking up for the listener and for
+ * the connection, and the hand over to the miniserver thread pool. It is
+ * measured with no other connection open, then, with the epoll loop, with
+ * idle connections that each sent part of a request. The select() loop is
+ * not measured with idle connections: the job reading each one holds a
+ * thread of the miniserver pool until the request timeout, and the pool
+ * soon has none left for the measured requests.
+ *
+ * The loop is chosen at build time: the default build measures the epoll
+ * loop, a build configured with CPPFLAGS=-DMINISERVER_USE_SELECT measures
+ * the select() loop.
+ *
+ * Usage: bench_miniserver [rounds [idle connections]]
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "httpreadwrite.h"
+#include "miniserver.h"
+#include "statcodes.h"
+#include "upnp.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/*! Rounds not measured, to warm up the thread pool. */
+#define BENCH_WARMUP 100
+
+/*! Default number of idle connections, below MINISERVER_MAX_CONNECTIONS. */
+#define BENCH_IDLE 64
+
+static const char benchRequest[] =
+	"NOTIFY /bench HTTP/1.1\r\n"
+	"HOST: 127.0.0.1\r\n"
+	"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+	"CONTENT-LENGTH: 0\r\n"
+	"NT: upnp:event\r\n"
+	"NTS: upnp:propchange\r\n"
+	"SID: uuid:bench\r\n"
+	"SEQ: 0\r\n"
+	"\r\n";
+
+static ithread_mutex_t benchMutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t benchCond = PTHREAD_COND_INITIALIZER;
+/*! Time the last request was dispatched at, 0 if not yet. */
+static int64_t benchDispatched = 0;
+
+/*!
+ * \brief GENA callback of the benchmark: records the time and answers the
+ * request.
+ */
+static void bench_callback(
+	/*! [in] Parser of the request. */
+	http_parser_t *parser,
+	/*! [in] Request. */
+	http_message_t *request,
+	/*! [in] Connection. */
+	SOCKINFO *info)
+{
+	int64_t now = bench_now_ns();
+
+	(void)parser;
+	http_SendStatusResponse(info, HTTP_OK, request->major_version,
+		request->minor_version);
+	ithread_mutex_lock(&benchMutex);
+	benchDispatched = now;
+	ithread_cond_signal(&benchCond);
+	ithread_mutex_unlock(&benchMutex);
+}
+
+/*!
+ * \brief Opens a connection to the listener of the miniserver.
+ *
+ * \return The socket, or -1 on error.
+ */
+static int bench_connect(
+	/*! [in] Port of the listener. */
+	unsigned short port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int sock;
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock == -1) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(sock);
+		return -1;
+	}
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return sock;
+}
+
+/*!
+ * \brief Sends a request on a new connection and waits for its dispatch.
+ *
+ * \return The latency in nanoseconds, or -1 on error.
+ */
+static int64_t bench_round(
+	/*! [in] Port of the listener. */
+	unsigned short port)
+{
+	char buf[512];
+	int64_t start;
+	int64_t latency;
+	int sock;
+
+	sock = bench_connect(port);
+	if (sock == -1) {
+		return -1;
+	}
+	ithread_mutex_lock(&benchMutex);
+	benchDispatched = 0;
+	ithread_mutex_unlock(&benchMutex);
+	start = bench_now_ns();
+	if (send(sock, benchRequest, sizeof(benchRequest) - 1, 0) !=
+	    (ssize_t)(sizeof(benchRequest) - 1)) {
+		close(sock);
+		return -1;
+	}
+	ithread_mutex_lock(&benchMutex);
+	while (benchDispatched == 0) {
+		ithread_cond_wait(&benchCond, &benchMutex);
+	}
+	latency = benchDispatched - start;
+	ithread_mutex_unlock(&benchMutex);
+	/* wait for the response and the end of the connection. */
+	while (recv(sock, buf, sizeof(buf), 0) > 0) {
+	}
+	close(sock);
+
+	return latency;
+}
+
+/*!
+ * \brief Measures a number of rounds with idle connections open.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int bench_run(
+	/*! [in] Port of the listener. */
+	unsigned short port,
+	/*! [in] Number of measured rounds. */
+	int rounds,
+	/*! [in] Number of idle connections. */
+	int idle)
+{
+	static const char partial[] = "NOTIFY /idle HTTP/1.1\r\nHOST: ";
+	int64_t *samples;
+	int *idleSocks;
+	char name[64];
+	int opened;
+	int ret = 0;
+	int i;
+
+	samples = (int64_t *)malloc(sizeof(int64_t) * (size_t)rounds);
+	idleSocks = (int *)malloc(sizeof(int) * (size_t)(idle + 1));
+	if (samples == NULL || idleSocks == NULL) {
+		free(samples);
+		free(idleSocks);
+		return -1;
+	}
+	for (opened = 0; opened < idle; opened++) {
+		idleSocks[opened] = bench_connect(port);
+		if (idleSocks[opened] == -1) {
+			break;
+		}
+		if (send(idleSocks[opened], partial, sizeof(partial) - 1,
+			0) <= 0) {
+			close(idleSocks[opened]);
+			break;
+		}
+	}
+	if (opened < idle) {
+		fprintf(stderr, "cannot open idle connection %d\n", opened);
+		ret = -1;
+		goto exit_function;
+	}
+	for (i = -BENCH_WARMUP; i < rounds; i++) {
+		int64_t latency = bench_round(port);
+
+		if (latency < 0) {
+			fprintf(stderr, "round %d failed\n", i);
+			ret = -1;
+			goto exit_function;
+		}
+		if (i >= 0) {
+			samples[i] = latency;
+		}
+	}
+	snprintf(name, sizeof(name), "%s, %d idle",
+		MINISERVER_USE_EPOLL ? "epoll" : "select", idle);
+	bench_print_latency(name, samples, (size_t)rounds);
+
+exit_function:
+	for (i = 0; i < opened; i++) {
+		close(idleSocks[i]);
+	}
+	free(idleSocks);
+	free(samples);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned short port;
+	int rounds = 2000;
+	int idle = BENCH_IDLE;
+	int ret;
+
+	if (argc > 1) {
+		rounds = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		idle = atoi(argv[2]);
+	}
+	if (rounds <= 0 || idle < 0) {
+		fprintf(stderr, "usage: %s [rounds [idle connections]]\n",
+			argv[0]);
+		return 2;
+	}
+	ret = UpnpInit("127.0.0.1", 0);
+	if (ret != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpInit: %d\n", ret);
+		return 1;
+	}
+	SetGenaCallback(bench_callback);
+	port = UpnpGetServerPort();
+	ret = bench_run(port, rounds, 0);
+	if (ret == 0 && idle > 0 && MINISERVER_USE_EPOLL) {
+		ret = bench_run(port, rounds, idle);
+	}
+	UpnpFinish();
+
+	return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,278 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+/*!
+ * \file
+ *
+ * \brief Compares the SSDP scanner with the HTTP parser on the messages
+ * handled by the control point.
+ *
+ * A corpus of NOTIFY requests and search replies is run through
+ * ssdp_scan_msg(), then through the path used before the scanner: the
+ * datagram is copied into the parser, parsed, and the headers read by
+ * ssdp_handle_ctrlpt_msg() are looked up before the message is destroyed.
+ * Both paths must return the same headers; the rate of each is printed.
+ *
+ * Usage: bench_ssdp_scan [passes over the corpus]
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "ssdplib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! A datagram of the corpus. */
+typedef struct
+{
+	/*! TRUE if received on a search request socket. */
+	int is_reply;
+	const char *msg;
+} bench_packet;
+
+static const bench_packet benchCorpus[] = {
+	{0,
+	 "NOTIFY * HTTP/1.1\r\n"
+	 "HOST: 239.255.255.250:1900\r\n"
+	 "CACHE-CONTROL: max-age=1800\r\n"
+	 "LOCATION: http://192.168.1.20:55178/Ds/device.xml\r\n"
+	 "NT: urn:device:ohm:1\r\n"
+	 "NTS: ssdp:alive\r\n"
+	 "SERVER: Linux/3.x UPnP/1.0 Ohm/1.0\r\n"
+	 "UID: 4c494e4e-0026-0f21-a9b6-01373197013f\r\n"
+	 "USN: uuid:4c494e4e-0026-0f21-a9b6-01373197013f::urn:device:ohm:1\r\n"
+	 "\r\n"},
+	{0,
+	 "NOTIFY * HTTP/1.1\r\n"
+	 "HOST: 239.255.255.250:1900\r\n"
+	 "CACHE-CONTROL: max-age=120\r\n"
+	 "LOCATION: http://192.168.1.1:1900/gatedesc.xml\r\n"
+	 "OPT: \"http://schemas.upnp.org/upnp/1/0/\"; ns=01\r\n"
+	 "01-NLS: 8c2a0ea4-1dd2-11b2-8000-e0b5c92e3a04\r\n"
+	 "NT: urn:schemas-upnp-org:service:WANIPConnection:1\r\n"
+	 "NTS: ssdp:alive\r\n"
+	 "SERVER: Linux/2.6.36, UPnP/1.0, Portable SDK for UPnP devices/1.6.6\r\n"
+	 "X-User-Agent: redsonic\r\n"
+	 "USN: uuid:75802409-bccb-40e7-8e6c-fa095ecce13e::urn:schemas-upnp-org:service:WANIPConnection:1\r\n"
+	 "\r\n"},
+	{0,
+	 "NOTIFY * HTTP/1.1\r\n"
+	 "HOST: 239.255.255.250:1900\r\n"
+	 "NT: urn:device:ohm:1\r\n"
+	 "NTS: ssdp:byebye\r\n"
+	 "UID: 4c494e4e-0026-0f21-a9b6-01373197013f\r\n"
+	 "USN: uuid:4c494e4e-0026-0f21-a9b6-01373197013f::urn:device:ohm:1\r\n"
+	 "\r\n"},
+	{1,
+	 "HTTP/1.1 200 OK\r\n"
+	 "CACHE-CONTROL: max-age=1800\r\n"
+	 "DATE: Sat, 17 Oct 2026 10:12:31 GMT\r\n"
+	 "EXT:\r\n"
+	 "LOCATION: http://192.168.1.20:55178/Ds/device.xml\r\n"
+	 "SERVER: Linux/3.x UPnP/1.0 Ohm/1.0\r\n"
+	 "ST: urn:device:ohm:1\r\n"
+	 "UID: 4c494e4e-0026-0f21-a9b6-01373197013f\r\n"
+	 "DT: urn:linn-co-uk:device:Source:1\r\n"
+	 "USN: uuid:4c494e4e-0026-0f21-a9b6-01373197013f::urn:device:ohm:1\r\n"
+	 "\r\n"},
+	{1,
+	 "HTTP/1.1 200 OK\r\n"
+	 "CACHE-CONTROL: max-age=100\r\n"
+	 "EXT:\r\n"
+	 "LOCATION: http://192.168.1.37:80/description.xml\r\n"
+	 "SERVER: Linux/3.14.0 UPnP/1.0 IpBridge/1.26.0\r\n"
+	 "hue-bridgeid: 001788FFFE23BFC2\r\n"
+	 "ST: upnp:rootdevice\r\n"
+	 "USN: uuid:2f402f80-da50-11e1-9b23-001788255acc::upnp:rootdevice\r\n"
+	 "\r\n"},
+	{1,
+	 "HTTP/1.1 200 OK\r\n"
+	 "Cache-Control: max-age=1800\r\n"
+	 "Ext: \r\n"
+	 "Location: http://192.168.1.52:49152/description.xml\r\n"
+	 "Server: Linux/4.4 UPnP/1.0 MediaServer/2.0\r\n"
+	 "St: urn:schemas-upnp-org:service:ContentDirectory:1\r\n"
+	 "Usn: uuid:5f9ec1b3-ed59-1900-4530-00a0dea4f6e2::urn:schemas-upnp-org:service:ContentDirectory:1\r\n"
+	 "Content-Length: 0\r\n"
+	 "\r\n"},
+};
+
+#define BENCH_CORPUS_SIZE (sizeof(benchCorpus) / sizeof(benchCorpus[0]))
+
+/*!
+ * \brief Gets the headers of a datagram with the HTTP parser, as done
+ * before the scanner.
+ *
+ * \return 0 on success, -1 if the datagram was rejected.
+ */
+static int bench_parse(
+	/*! [in] Datagram. */
+	const bench_packet *packet,
+	/*! [out] Headers; valid only if \b check is set. */
+	ssdp_hdrs *hdrs,
+	/*! [in] TRUE to copy the headers out before destroying the message. */
+	int check)
+{
+	http_parser_t parser;
+	http_message_t *hmsg = &parser.msg;
+	http_header_t *usn;
+	parse_status_t status;
+	int ret = 0;
+
+	if (packet->is_reply) {
+		parser_response_init(&parser, HTTPMETHOD_MSEARCH);
+	} else {
+		parser_request_init(&parser);
+	}
+	if (membuffer_assign(&hmsg->msg, packet->msg,
+		strlen(packet->msg)) != 0) {
+		httpmsg_destroy(hmsg);
+		return -1;
+	}
+	status = parser_parse(&parser);
+	if (status != (parse_status_t)PARSE_SUCCESS &&
+	    !(status == (parse_status_t)PARSE_FAILURE &&
+	      hmsg->method == (http_method_t)HTTPMETHOD_NOTIFY &&
+	      parser.valid_ssdp_notify_hack)) {
+		httpmsg_destroy(hmsg);
+		return -1;
+	}
+	memset(hdrs, 0, sizeof(*hdrs));
+	hdrs->is_request = hmsg->is_request;
+	hdrs->status_code = hmsg->status_code;
+	httpmsg_find_hdr(hmsg, HDR_HOST, &hdrs->host);
+	httpmsg_find_hdr(hmsg, HDR_NT, &hdrs->nt);
+	httpmsg_find_hdr(hmsg, HDR_NTS, &hdrs->nts);
+	httpmsg_find_hdr(hmsg, HDR_ST, &hdrs->st);
+	httpmsg_find_hdr(hmsg, HDR_UID, &hdrs->uid);
+	httpmsg_find_hdr(hmsg, HDR_DT, &hdrs->dt);
+	httpmsg_find_hdr(hmsg, HDR_LOCATION, &hdrs->location);
+	httpmsg_find_hdr(hmsg, HDR_CACHE_CONTROL, &hdrs->cache_control);
+	usn = httpmsg_find_hdr_str(hmsg, "USN");
+	if (usn != NULL) {
+		hdrs->usn.buf = usn->value.buf;
+		hdrs->usn.length = usn->value.length;
+	}
+	if (check) {
+		ssdp_hdrs scanned;
+		char *buf = strdup(packet->msg);
+
+		if (buf == NULL ||
+		    ssdp_scan_msg(buf, strlen(buf), packet->is_reply,
+			&scanned) != SSDP_SCAN_OK) {
+			ret = -1;
+		} else {
+			memptr *a = &hdrs->host;
+			memptr *b = &scanned.host;
+			int i;
+
+			/* compare the nine slices, host to cache_control. */
+			for (i = 0; i < 9; i++) {
+				if ((a[i].buf == NULL) != (b[i].buf == NULL) ||
+				    (a[i].buf != NULL &&
+				     (a[i].length != b[i].length ||
+				      memcmp(a[i].buf, b[i].buf,
+					a[i].length) != 0))) {
+					ret = -1;
+				}
+			}
+		}
+		free(buf);
+	}
+	httpmsg_destroy(hmsg);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	char *bufs[BENCH_CORPUS_SIZE];
+	size_t lengths[BENCH_CORPUS_SIZE];
+	ssdp_hdrs hdrs;
+	int64_t start;
+	size_t num;
+	size_t i;
+	int passes = 200000;
+	int pass;
+	int ret = 0;
+
+	if (argc > 1) {
+		passes = atoi(argv[1]);
+	}
+	if (passes <= 0) {
+		fprintf(stderr, "usage: %s [passes]\n", argv[0]);
+		return 2;
+	}
+	for (i = 0; i < BENCH_CORPUS_SIZE; i++) {
+		if (bench_parse(&benchCorpus[i], &hdrs, 1) != 0) {
+			fprintf(stderr, "packet %u: scanner and parser differ\n",
+				(unsigned)i);
+			ret = 1;
+		}
+		bufs[i] = strdup(benchCorpus[i].msg);
+		lengths[i] = strlen(benchCorpus[i].msg);
+		if (bufs[i] == NULL) {
+			return 1;
+		}
+	}
+	num = (size_t)passes * BENCH_CORPUS_SIZE;
+
+	start = bench_now_ns();
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < BENCH_CORPUS_SIZE; i++) {
+			if (ssdp_scan_msg(bufs[i], lengths[i],
+				benchCorpus[i].is_reply,
+				&hdrs) != SSDP_SCAN_OK) {
+				ret = 1;
+			}
+		}
+	}
+	bench_print_rate("ssdp_scan_msg", num, bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (pass = 0; pass < passes; pass++) {
+		for (i = 0; i < BENCH_CORPUS_SIZE; i++) {
+			if (bench_parse(&benchCorpus[i], &hdrs, 0) != 0) {
+				ret = 1;
+			}
+		}
+	}
+	bench_print_rate("parser_parse", num, bench_now_ns() - start);
+
+	for (i = 0; i < BENCH_CORPUS_SIZE; i++) {
+		free(bufs[i]);
+	}
+
+	return ret;
+}
@@ -0,0 +1,257 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Compares the search index with a scan of the list of searches for
+ * matching search replies.
+ *
+ * A control point with many searches in flight is modelled by a mix of UDN,
+ * device type, service type and ssdp:all searches. The ST headers of the
+ * replies are drawn from the targets of the searches, plus some that match
+ * no search. Each reply is matched through ssdp_search_index_match(), then
+ * by walking the list of searches and comparing each target as was done
+ * before the index. Both must find the same number of matches.
+ *
+ * Usage: bench_ssdp_search [searches [replies]]
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "LinkedList.h"
+#include "ssdplib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! Distinct device and service types the searches are spread over. */
+#define BENCH_TYPES 50
+
+/*! Number of ST headers the replies cycle through. */
+#define BENCH_ST_COUNT 4096
+
+/*!
+ * \brief Visit function of the index: counts the matches.
+ */
+static void bench_visit(
+	/*! [in] Matching search. */
+	SsdpSearchArg *search,
+	/*! [in,out] Match counter. */
+	void *arg)
+{
+	(void)search;
+	(*(size_t *)arg)++;
+}
+
+/*!
+ * \brief Matches a reply against the list of searches, as done before the
+ * index.
+ *
+ * \return The number of matching searches.
+ */
+static size_t bench_list_match(
+	/*! [in] List of the searches. */
+	LinkedList *list,
+	/*! [in] ST header of the reply. */
+	memptr *st)
+{
+	ListNode *node;
+	SsdpSearchArg *search;
+	size_t matches = (size_t)0;
+	size_t m;
+	int matched;
+
+	for (node = ListHead(list); node != NULL; node = ListNext(list, node)) {
+		search = (SsdpSearchArg *)node->item;
+		switch (search->requestType) {
+		case SSDP_ALL:
+			matched = 1;
+			break;
+		case SSDP_DEVICEUDN:
+			matched = !strncmp(search->searchTarget, st->buf,
+				st->length);
+			break;
+		case SSDP_DEVICETYPE:
+		case SSDP_SERVICE:
+			m = strlen(search->searchTarget);
+			if (st->length < m) {
+				m = st->length;
+			}
+			matched = !strncmp(search->searchTarget, st->buf, m);
+			break;
+		default:
+			matched = 0;
+			break;
+		}
+		if (matched) {
+			matches++;
+		}
+	}
+
+	return matches;
+}
+
+/*!
+ * \brief Writes the target of the i-th search: 1% ssdp:all, 40% UDN, 30%
+ * device type and the rest service type.
+ */
+static void bench_target(
+	/*! [out] Target. */
+	char *buf,
+	/*! [in] Size of \b buf. */
+	size_t size,
+	/*! [in] Index of the search. */
+	int i)
+{
+	int kind = i % 100;
+
+	if (kind == 0) {
+		snprintf(buf, size, "ssdp:all");
+	} else if (kind <= 40) {
+		snprintf(buf, size,
+			"uuid:4c494e4e-0026-0f21-a9b6-%012d", i);
+	} else if (kind <= 70) {
+		snprintf(buf, size,
+			"urn:schemas-upnp-org:device:Bench%d:1",
+			i % BENCH_TYPES);
+	} else {
+		snprintf(buf, size,
+			"urn:schemas-upnp-org:service:Bench%d:1",
+			i % BENCH_TYPES);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	SsdpSearchIndex index;
+	LinkedList list;
+	SsdpSearchArg *searches;
+	memptr *sts;
+	char target[128];
+	int numSearches = 1000;
+	int numReplies = 100000;
+	size_t indexMatches = (size_t)0;
+	size_t listMatches = (size_t)0;
+	int64_t start;
+	int i;
+	int ret = 0;
+
+	if (argc > 1) {
+		numSearches = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		numReplies = atoi(argv[2]);
+	}
+	if (numSearches <= 0 || numReplies <= 0) {
+		fprintf(stderr, "usage: %s [searches [replies]]\n", argv[0]);
+		return 2;
+	}
+	searches = (SsdpSearchArg *)calloc((size_t)numSearches,
+		sizeof(SsdpSearchArg));
+	sts = (memptr *)calloc((size_t)BENCH_ST_COUNT, sizeof(memptr));
+	if (searches == NULL || sts == NULL) {
+		return 1;
+	}
+	memset(&index, 0, sizeof(index));
+	ListInit(&list, NULL, NULL);
+	for (i = 0; i < numSearches; i++) {
+		bench_target(target, sizeof(target), i);
+		searches[i].searchTarget = strdup(target);
+		searches[i].requestType = ssdp_request_type1(target);
+		if (searches[i].searchTarget == NULL ||
+		    ssdp_search_index_add(&index, &searches[i]) !=
+		    UPNP_E_SUCCESS ||
+		    ListAddTail(&list, &searches[i]) == NULL) {
+			return 1;
+		}
+	}
+	/* replies: 4 out of 5 answer one of the searches, the others answer
+	 * a search of another control point. */
+	srand(1);
+	for (i = 0; i < BENCH_ST_COUNT; i++) {
+		if (i % 5 == 4) {
+			snprintf(target, sizeof(target),
+				"uuid:5f9ec1b3-ed59-1900-4530-%012d", i);
+		} else {
+			do {
+				bench_target(target, sizeof(target),
+					rand() % numSearches);
+			} while (strcmp(target, "ssdp:all") == 0);
+		}
+		sts[i].buf = strdup(target);
+		sts[i].length = strlen(target);
+		if (sts[i].buf == NULL) {
+			return 1;
+		}
+	}
+
+	start = bench_now_ns();
+	for (i = 0; i < numReplies; i++) {
+		ssdp_search_index_match(&index, &sts[i % BENCH_ST_COUNT],
+			bench_visit, &indexMatches);
+	}
+	bench_print_rate("ssdp_search_index_match", (size_t)numReplies,
+		bench_now_ns() - start);
+
+	start = bench_now_ns();
+	for (i = 0; i < numReplies; i++) {
+		listMatches += bench_list_match(&list,
+			&sts[i % BENCH_ST_COUNT]);
+	}
+	bench_print_rate("list scan", (size_t)numReplies,
+		bench_now_ns() - start);
+
+	printf("%d searches, %.1f matches per reply\n", numSearches,
+		(double)indexMatches / (double)numReplies);
+	if (indexMatches != listMatches) {
+		fprintf(stderr, "index found %lu matches, list %lu\n",
+			(unsigned long)indexMatches,
+			(unsigned long)listMatches);
+		ret = 1;
+	}
+
+	ListDestroy(&list, 0);
+	ssdp_search_index_destroy(&index);
+	for (i = 0; i < numSearches; i++) {
+		free(searches[i].searchTarget);
+	}
+	free(searches);
+	for (i = 0; i < BENCH_ST_COUNT; i++) {
+		free(sts[i].buf);
+	}
+	free(sts);
+
+	return ret;
+}
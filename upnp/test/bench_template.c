@@ -0,0 +1,305 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Compares building the control point requests from their templates
+ * with building them in full.
+ *
+ * A SOAP action is built by SoapMakeActionRequest(), then as before the
+ * templates, by parsing its control URL and formatting every header with
+ * http_MakeMessage(), once with the URL parsed each time and once with the
+ * URL taken from the cache of http_FixStrUrl(). A subscription renewal is
+ * built by http_TemplateRender(), with the same template as the GENA
+ * client, and in full. Both ways must give the same bytes.
+ *
+ * Usage: bench_template [requests]
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "httpparser.h"
+#include "httpreadwrite.h"
+#include "httptemplate.h"
+#include "sock.h"
+#include "upnp.h"
+#include "upnputil.h"
+
+#include "soaplib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char benchActionUrl[] =
+	"http://192.168.1.20:55178/Ds/Product/control";
+
+static const char benchEventUrl[] =
+	"http://192.168.1.20:55178/Ds/Volume/event";
+
+static const char benchSid[] = "uuid:8c2a0ea4-1dd2-11b2-8000-e0b5c92e3a04";
+
+static const char benchTimeout[] = "1801";
+
+static const char benchBody[] =
+	"<?xml version=\"1.0\"?>\r\n"
+	"<s:Envelope xmlns:s=\"http://schemas.xmlsoap.org/soap/envelope/\" "
+	"s:encodingStyle=\"http://schemas.xmlsoap.org/soap/encoding/\">"
+	"<s:Body><u:SetSourceIndex xmlns:u=\"urn:av-openhome-org:service:"
+	"Product:1\"><Value>3</Value></u:SetSourceIndex></s:Body>"
+	"</s:Envelope>\r\n";
+
+/*!
+ * \brief Builds an action request in full, as done before the templates.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int bench_soap_full(
+	/*! [in] TRUE to take the URL from the cache of http_FixStrUrl(). */
+	int cached,
+	/*! [in,out] Initialized, empty buffer receiving the request. */
+	membuffer *request)
+{
+	uri_type parsed;
+	uri_type url;
+	size_t body_len = strlen(benchBody);
+
+	if (cached) {
+		if (http_FixStrUrl(benchActionUrl, strlen(benchActionUrl),
+			&url) != 0) {
+			return -1;
+		}
+	} else if (parse_uri(benchActionUrl, strlen(benchActionUrl),
+		&parsed) != HTTP_SUCCESS ||
+		http_FixUrl(&parsed, &url) != 0) {
+		return -1;
+	}
+	request->size_inc = (size_t)50;
+	if (http_MakeMessage(request, 1, 1,
+		"q" "N" "s" "sc" "s" "sc" "Uc" "b",
+		SOAPMETHOD_POST, &url, (off_t)body_len, ContentTypeHeader,
+		"SOAPACTION:", "UID: ", "yyccbb12345",
+		benchBody, body_len) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Builds an action request from its template.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int bench_soap_template(
+	/*! [in,out] Initialized, empty buffer receiving the request. */
+	membuffer *request)
+{
+	struct sockaddr_storage dest;
+	SoapMethodKey key;
+	http_method_t method;
+
+	return SoapMakeActionRequest(benchActionUrl, benchBody, &dest,
+		request, &key, &method) == UPNP_E_SUCCESS ? 0 : -1;
+}
+
+/*!
+ * \brief Renders the template of a renewal, as the GENA client does.
+ */
+static int bench_build_renew(
+	/*! [in] Event URL of the service. */
+	const uri_type *url,
+	/*! [in,out] Head of the template. */
+	membuffer *head,
+	/*! [in,out] Tail of the template. */
+	membuffer *tail)
+{
+	if (http_MakeMessage(head, 1, 1, "q",
+		HTTPMETHOD_SUBSCRIBE, url) != 0 ||
+	    http_MakeMessage(tail, 1, 1, "c") != 0) {
+		return UPNP_E_OUTOF_MEMORY;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Builds a renewal in full, as done before the templates.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int bench_renew_full(
+	/*! [in,out] Initialized, empty buffer receiving the request. */
+	membuffer *request)
+{
+	uri_type url;
+
+	if (http_FixStrUrl(benchEventUrl, strlen(benchEventUrl), &url) != 0 ||
+	    http_MakeMessage(request, 1, 1, "q" "ssc" "sscc",
+		HTTPMETHOD_SUBSCRIBE, &url, "SID: ", benchSid,
+		"TIMEOUT: Second-", benchTimeout) != 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief Builds a renewal from its template.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int bench_renew_template(
+	/*! [in,out] Initialized, empty buffer receiving the request. */
+	membuffer *request)
+{
+	struct sockaddr_storage dest;
+	memptr vars[6];
+
+	vars[0].buf = "SID: ";
+	vars[1].buf = (char *)benchSid;
+	vars[2].buf = "\r\n";
+	vars[3].buf = "TIMEOUT: Second-";
+	vars[4].buf = (char *)benchTimeout;
+	vars[5].buf = "\r\n";
+	vars[0].length = strlen(vars[0].buf);
+	vars[1].length = strlen(vars[1].buf);
+	vars[2].length = strlen(vars[2].buf);
+	vars[3].length = strlen(vars[3].buf);
+	vars[4].length = strlen(vars[4].buf);
+	vars[5].length = strlen(vars[5].buf);
+
+	return http_TemplateRender(HTTP_TEMPLATE_GENA_RENEW, benchEventUrl,
+		strlen(benchEventUrl), bench_build_renew, vars, (size_t)6,
+		NULL, (size_t)0, request, &dest) == UPNP_E_SUCCESS ? 0 : -1;
+}
+
+/*!
+ * \brief Checks that both builders give the same request.
+ *
+ * \return 0 if they do, -1 otherwise.
+ */
+static int bench_compare(
+	/*! [in] Name of the request. */
+	const char *name,
+	/*! [in] First request. */
+	membuffer *a,
+	/*! [in] Second request. */
+	membuffer *b)
+{
+	if (a->length != b->length || memcmp(a->buf, b->buf, a->length) != 0) {
+		fprintf(stderr, "%s: requests differ\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	membuffer a;
+	membuffer b;
+	int64_t start;
+	int num = 200000;
+	int ret;
+	int i;
+
+	if (argc > 1) {
+		num = atoi(argv[1]);
+	}
+	if (num <= 0) {
+		fprintf(stderr, "usage: %s [requests]\n", argv[0]);
+		return 2;
+	}
+	ret = UpnpInit("127.0.0.1", 0);
+	if (ret != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpInit: %d\n", ret);
+		return 1;
+	}
+	membuffer_init(&a);
+	membuffer_init(&b);
+	ret = bench_soap_full(FALSE, &a) || bench_soap_template(&b) ||
+		bench_compare("action", &a, &b);
+	membuffer_destroy(&a);
+	membuffer_destroy(&b);
+	if (ret == 0) {
+		ret = bench_renew_full(&a) || bench_renew_template(&b) ||
+			bench_compare("renewal", &a, &b);
+		membuffer_destroy(&a);
+		membuffer_destroy(&b);
+	}
+	if (ret != 0) {
+		UpnpFinish();
+		return 1;
+	}
+
+	start = bench_now_ns();
+	for (i = 0; i < num && ret == 0; i++) {
+		ret = bench_soap_full(FALSE, &a);
+		membuffer_destroy(&a);
+	}
+	bench_print_rate("action, full, URL parsed", (size_t)num,
+		bench_now_ns() - start);
+	start = bench_now_ns();
+	for (i = 0; i < num && ret == 0; i++) {
+		ret = bench_soap_full(TRUE, &a);
+		membuffer_destroy(&a);
+	}
+	bench_print_rate("action, full, URL cached", (size_t)num,
+		bench_now_ns() - start);
+	start = bench_now_ns();
+	for (i = 0; i < num && ret == 0; i++) {
+		ret = bench_soap_template(&a);
+		membuffer_destroy(&a);
+	}
+	bench_print_rate("action, template", (size_t)num,
+		bench_now_ns() - start);
+	start = bench_now_ns();
+	for (i = 0; i < num && ret == 0; i++) {
+		ret = bench_renew_full(&a);
+		membuffer_destroy(&a);
+	}
+	bench_print_rate("renewal, full", (size_t)num,
+		bench_now_ns() - start);
+	start = bench_now_ns();
+	for (i = 0; i < num && ret == 0; i++) {
+		ret = bench_renew_template(&a);
+		membuffer_destroy(&a);
+	}
+	bench_print_rate("renewal, template", (size_t)num,
+		bench_now_ns() - start);
+	UpnpFinish();
+
+	return ret == 0 ? 0 : 1;
+}
@@ -0,0 +1,258 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Measures the cost of the timer thread operations with many
+ * pending events.
+ *
+ * The timer is filled with events due between ten minutes and one hour
+ * from now, as left by subscriptions and advertisements. With them
+ * pending, the benchmark times scheduling more events, removing events
+ * picked at random, and running a burst of events due together, from the
+ * first of them to the last one reaching the thread pool. Only the public
+ * TimerThread API with REL_SEC times is used.
+ *
+ * Usage: bench_timer [pending events...]
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "ThreadPool.h"
+#include "TimerThread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*! Events scheduled, removed and run by each measure. */
+#define BENCH_OPS 1000
+
+static ithread_mutex_t benchMutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t benchCond = PTHREAD_COND_INITIALIZER;
+/*! Run times of the burst events. */
+static int64_t benchFired[BENCH_OPS];
+/*! Number of burst events run. */
+static int benchNumFired;
+
+/*!
+ * \brief Job of the burst events: records when it ran.
+ */
+static void *bench_fire(
+	/*! [in] Unused. */
+	void *arg)
+{
+	int64_t now = bench_now_ns();
+
+	(void)arg;
+	ithread_mutex_lock(&benchMutex);
+	if (benchNumFired < BENCH_OPS) {
+		benchFired[benchNumFired++] = now;
+	}
+	if (benchNumFired == BENCH_OPS) {
+		ithread_cond_signal(&benchCond);
+	}
+	ithread_mutex_unlock(&benchMutex);
+
+	return NULL;
+}
+
+/*!
+ * \brief Job of the pending events, never run.
+ */
+static void *bench_idle(
+	/*! [in] Unused. */
+	void *arg)
+{
+	(void)arg;
+
+	return NULL;
+}
+
+/*!
+ * \brief Schedules an event.
+ *
+ * \return The id of the event, or -1 on error.
+ */
+static int bench_schedule(
+	/*! [in] Timer. */
+	TimerThread *timer,
+	/*! [in] Seconds from now. */
+	time_t seconds,
+	/*! [in] Job to run. */
+	start_routine func)
+{
+	ThreadPoolJob job;
+	int id;
+
+	TPJobInit(&job, func, NULL);
+	if (TimerThreadSchedule(timer, seconds, REL_SEC, &job, SHORT_TERM,
+		&id) != 0) {
+		return -1;
+	}
+
+	return id;
+}
+
+/*!
+ * \brief Runs the measures with a number of pending events.
+ *
+ * \return 0 on success, -1 on error.
+ */
+static int bench_run(
+	/*! [in] Thread pool of the timer. */
+	ThreadPool *tp,
+	/*! [in] Number of pending events. */
+	int pending)
+{
+	TimerThread timer;
+	ThreadPoolJob job;
+	int *ids;
+	int numIds = pending + BENCH_OPS;
+	int64_t start;
+	char name[64];
+	int ret = 0;
+	int i;
+
+	ids = (int *)malloc(sizeof(int) * (size_t)numIds);
+	if (ids == NULL || TimerThreadInit(&timer, tp) != 0) {
+		free(ids);
+		return -1;
+	}
+	start = bench_now_ns();
+	for (i = 0; i < numIds; i++) {
+		/* the last BENCH_OPS are scheduled with all the others
+		 * pending and timed on their own. */
+		if (i == pending) {
+			snprintf(name, sizeof(name), "%d pending: fill",
+				pending);
+			bench_print_rate(name, (size_t)pending,
+				bench_now_ns() - start);
+			start = bench_now_ns();
+		}
+		ids[i] = bench_schedule(&timer, (time_t)(600 + rand() % 3000),
+			bench_idle);
+		if (ids[i] == -1) {
+			ret = -1;
+			goto exit_function;
+		}
+	}
+	snprintf(name, sizeof(name), "%d pending: schedule", pending);
+	bench_print_rate(name, (size_t)BENCH_OPS, bench_now_ns() - start);
+
+	/* pick the events to remove at random. */
+	for (i = 0; i < BENCH_OPS; i++) {
+		int j = i + rand() % (numIds - i);
+		int tmp = ids[i];
+
+		ids[i] = ids[j];
+		ids[j] = tmp;
+	}
+	start = bench_now_ns();
+	for (i = 0; i < BENCH_OPS; i++) {
+		if (TimerThreadRemove(&timer, ids[i], &job) != 0) {
+			ret = -1;
+			goto exit_function;
+		}
+	}
+	snprintf(name, sizeof(name), "%d pending: remove", pending);
+	bench_print_rate(name, (size_t)BENCH_OPS, bench_now_ns() - start);
+
+	ithread_mutex_lock(&benchMutex);
+	benchNumFired = 0;
+	ithread_mutex_unlock(&benchMutex);
+	for (i = 0; i < BENCH_OPS; i++) {
+		if (bench_schedule(&timer, (time_t)1, bench_fire) == -1) {
+			ret = -1;
+			goto exit_function;
+		}
+	}
+	ithread_mutex_lock(&benchMutex);
+	while (benchNumFired < BENCH_OPS) {
+		ithread_cond_wait(&benchCond, &benchMutex);
+	}
+	ithread_mutex_unlock(&benchMutex);
+	snprintf(name, sizeof(name), "%d pending: fire", pending);
+	bench_print_rate(name, (size_t)BENCH_OPS,
+		benchFired[BENCH_OPS - 1] - benchFired[0]);
+
+exit_function:
+	TimerThreadShutdown(&timer);
+	free(ids);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	static const int defaults[] = {1000, 10000, 100000};
+	ThreadPoolAttr attr;
+	ThreadPool tp;
+	int ret = 0;
+	int i;
+
+	TPAttrInit(&attr);
+	TPAttrSetMaxThreads(&attr, 4);
+	TPAttrSetMaxJobsTotal(&attr, 10 * BENCH_OPS);
+	if (ThreadPoolInit(&tp, &attr) != 0) {
+		fprintf(stderr, "cannot start the thread pool\n");
+		return 1;
+	}
+	srand(1);
+	if (argc > 1) {
+		for (i = 1; i < argc && ret == 0; i++) {
+			int pending = atoi(argv[i]);
+
+			if (pending <= 0) {
+				fprintf(stderr, "usage: %s [pending...]\n",
+					argv[0]);
+				ret = 2;
+			} else if (bench_run(&tp, pending) != 0) {
+				ret = 1;
+			}
+		}
+	} else {
+		for (i = 0; i < 3 && ret == 0; i++) {
+			if (bench_run(&tp, defaults[i]) != 0) {
+				ret = 1;
+			}
+		}
+	}
+	if (ret == 1) {
+		fprintf(stderr, "timer operation failed\n");
+	}
+	ThreadPoolShutdown(&tp);
+
+	return ret;
+}
@@ -0,0 +1,701 @@
+/*******************************************************************************
+ *
+ * Copyright (c) 2000-2003 Intel Corporation 
+ * All rights reserved. 
+ *
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met: 
+ *
+ * - Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer. 
+ * - Redistributions in binary form must reproduce the above copyright notice, 
+ * this list of conditions and the following disclaimer in the documentation 
+ * and/or other materials provided with the distribution. 
+ * - Neither name of Intel Corporation nor the names of its contributors 
+ * may be used to endorse or promote products derived from this software 
+ * without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS 
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT 
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR 
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL INTEL OR 
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, 
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR 
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY 
+ * OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS 
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ ******************************************************************************/
+
+
+/*!
+ * \file
+ *
+ * \brief Load test of the GENA NOTIFY listener of the miniserver.
+ *
+ * A stand-in publisher runs in the process: it answers the SUBSCRIBE of the
+ * control point with a SID, then sender threads push NOTIFY requests for
+ * that SID to the HTTP listener at a fixed rate, each on a new connection
+ * as devices do. Every NOTIFY must be answered 200 OK and reach the client
+ * callback as an UPNP_EVENT_RECEIVED event.
+ *
+ * The limits of the listener are checked afterwards: with
+ * MINISERVER_MAX_CONNECTIONS connections each holding a partial request,
+ * a new connection must be closed at once; a stalled connection must be
+ * closed after MINISERVER_REQUEST_TIMEOUT seconds.
+ *
+ * The client closes each connection with SO_LINGER set to 0 once it has
+ * the response, so that sustained load does not exhaust the local ports
+ * with connections in TIME_WAIT.
+ *
+ * Only the epoll loop is tested: the select() loop reads each connection
+ * from a thread of the miniserver pool.
+ *
+ * Usage: notify_load [events per second [seconds [sender threads]]]
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "httpreadwrite.h"
+#include "miniserver.h"
+#include "upnp.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*! SID given by the stand-in publisher. */
+#define LOAD_SID "uuid:4c494e4e-0026-0f21-a9b6-0137319701ff"
+
+/*! Most sender threads. */
+#define LOAD_MAX_SENDERS 64
+
+/*! Partial request keeping a connection open. */
+static const char loadPartial[] = "NOTIFY /event HTTP/1.1\r\nHOST: ";
+
+/*! Listening socket of the stand-in publisher. */
+static int loadPubSock = -1;
+/*! Set to stop the stand-in publisher. */
+static volatile int loadPubStop = 0;
+
+/*! Port of the HTTP listener of the miniserver. */
+static unsigned short loadPort;
+
+/*! SID of the subscription as seen by the client. */
+static Upnp_SID loadSid;
+
+static ithread_mutex_t loadMutex = PTHREAD_MUTEX_INITIALIZER;
+static ithread_cond_t loadCond = PTHREAD_COND_INITIALIZER;
+/*! Events received by the client callback. */
+static long loadReceived = 0;
+/*! Events received for another SID. */
+static long loadBadSid = 0;
+
+/*! A sender thread and its results. */
+typedef struct
+{
+	ithread_t thread;
+	/*! Index of the thread, giving the slots it sends in. */
+	int index;
+	/*! Number of events to send. */
+	int count;
+	/*! Start of the load. */
+	int64_t start;
+	/*! Time between two events of all the threads, in nanoseconds. */
+	int64_t interval;
+	/*! Number of sender threads. */
+	int numSenders;
+	/*! Send to response time of each event answered 200 OK. */
+	int64_t *latencies;
+	/*! Events answered 200 OK. */
+	int ok;
+	/*! Events answered with another status or not answered. */
+	int failed;
+	/*! Time the last response was read. */
+	int64_t end;
+} load_sender;
+
+/*!
+ * \brief Client callback: counts the events of the subscription.
+ */
+static int load_callback(
+	/*! [in] Kind of callback. */
+	Upnp_EventType type,
+	/*! [in] Event. */
+	void *event,
+	/*! [in] Unused. */
+	void *cookie)
+{
+	struct Upnp_Event *e = (struct Upnp_Event *)event;
+
+	(void)cookie;
+	if (type != UPNP_EVENT_RECEIVED) {
+		return 0;
+	}
+	ithread_mutex_lock(&loadMutex);
+	if (strcmp(e->Sid, loadSid) == 0) {
+		loadReceived++;
+	} else {
+		loadBadSid++;
+	}
+	ithread_cond_signal(&loadCond);
+	ithread_mutex_unlock(&loadMutex);
+
+	return 0;
+}
+
+/*!
+ * \brief Opens a connection to a local port.
+ *
+ * \return The socket, or -1 on error.
+ */
+static int load_connect(
+	/*! [in] Port. */
+	unsigned short port)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	int sock;
+
+	sock = socket(AF_INET, SOCK_STREAM, 0);
+	if (sock == -1) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		close(sock);
+		return -1;
+	}
+	setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return sock;
+}
+
+/*!
+ * \brief Closes a connection with a reset, leaving nothing in TIME_WAIT.
+ */
+static void load_abort(
+	/*! [in] Socket. */
+	int sock)
+{
+	struct linger lin;
+
+	lin.l_onoff = 1;
+	lin.l_linger = 0;
+	setsockopt(sock, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+	close(sock);
+}
+
+/*!
+ * \brief Reads the headers of an HTTP message.
+ *
+ * \return The status code of a response, 0 for a request, -1 if the
+ * connection ended before the end of the headers.
+ */
+static int load_read_headers(
+	/*! [in] Socket. */
+	int sock,
+	/*! [out] Buffer. */
+	char *buf,
+	/*! [in] Size of \b buf. */
+	size_t size)
+{
+	size_t length = (size_t)0;
+	ssize_t n;
+	int status;
+
+	while (length + 1 < size) {
+		n = recv(sock, buf + length, size - length - 1, 0);
+		if (n <= 0) {
+			return -1;
+		}
+		length += (size_t)n;
+		buf[length] = '\0';
+		if (strstr(buf, "\r\n\r\n") != NULL) {
+			if (sscanf(buf, "HTTP/1.%*d %d", &status) == 1) {
+				return status;
+			}
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+/*!
+ * \brief Stand-in publisher: answers SUBSCRIBE with the SID and TIMEOUT
+ * the client expects, and UNSUBSCRIBE with 200 OK.
+ */
+static void *load_publisher(
+	/*! [in] Unused. */
+	void *arg)
+{
+	static const char subscribed[] =
+		"HTTP/1.1 200 OK\r\n"
+		"SID: " LOAD_SID "\r\n"
+		"TIMEOUT: Second-1800\r\n"
+		"CONTENT-LENGTH: 0\r\n"
+		"CONNECTION: close\r\n"
+		"\r\n";
+	static const char unsubscribed[] =
+		"HTTP/1.1 200 OK\r\n"
+		"CONTENT-LENGTH: 0\r\n"
+		"CONNECTION: close\r\n"
+		"\r\n";
+	struct pollfd pfd;
+	char buf[2048];
+	int sock;
+
+	(void)arg;
+	while (!loadPubStop) {
+		pfd.fd = loadPubSock;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 100) <= 0) {
+			continue;
+		}
+		sock = accept(loadPubSock, NULL, NULL);
+		if (sock == -1) {
+			continue;
+		}
+		if (load_read_headers(sock, buf, sizeof(buf)) == 0) {
+			if (strncmp(buf, "SUBSCRIBE ", (size_t)10) == 0) {
+				send(sock, subscribed, sizeof(subscribed) - 1,
+					MSG_NOSIGNAL);
+			} else {
+				send(sock, unsubscribed,
+					sizeof(unsubscribed) - 1,
+					MSG_NOSIGNAL);
+			}
+		}
+		close(sock);
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Starts the stand-in publisher.
+ *
+ * \return Its port, or 0 on error.
+ */
+static unsigned short load_publisher_start(
+	/*! [out] Thread of the publisher. */
+	ithread_t *thread)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+
+	loadPubSock = socket(AF_INET, SOCK_STREAM, 0);
+	if (loadPubSock == -1) {
+		return 0;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(loadPubSock, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	    listen(loadPubSock, 16) == -1 ||
+	    getsockname(loadPubSock, (struct sockaddr *)&addr, &len) == -1 ||
+	    ithread_create(thread, NULL, load_publisher, NULL) != 0) {
+		close(loadPubSock);
+		return 0;
+	}
+
+	return ntohs(addr.sin_port);
+}
+
+/*!
+ * \brief Sends one NOTIFY on a new connection and reads the response.
+ *
+ * \return The status code, or -1 on error.
+ */
+static int load_notify(
+	/*! [in] Event key. */
+	int seq,
+	/*! [out] Send to response time, can be NULL. */
+	int64_t *latency)
+{
+	char body[256];
+	char request[768];
+	char buf[512];
+	int64_t start;
+	int bodyLen;
+	int len;
+	int status;
+	int sock;
+
+	bodyLen = snprintf(body, sizeof(body),
+		"<?xml version=\"1.0\"?>\r\n"
+		"<e:propertyset xmlns:e=\"urn:schemas-upnp-org:event-1-0\">"
+		"<e:property><Volume>%d</Volume></e:property>"
+		"</e:propertyset>\r\n", seq % 100);
+	len = snprintf(request, sizeof(request),
+		"NOTIFY /event HTTP/1.1\r\n"
+		"HOST: 127.0.0.1:%u\r\n"
+		"CONTENT-TYPE: text/xml; charset=\"utf-8\"\r\n"
+		"CONTENT-LENGTH: %d\r\n"
+		"NT: upnp:event\r\n"
+		"NTS: upnp:propchange\r\n"
+		"SID: " LOAD_SID "\r\n"
+		"SEQ: %d\r\n"
+		"\r\n"
+		"%s", (unsigned)loadPort, bodyLen, seq, body);
+	sock = load_connect(loadPort);
+	if (sock == -1) {
+		return -1;
+	}
+	start = bench_now_ns();
+	if (send(sock, request, (size_t)len, MSG_NOSIGNAL) != (ssize_t)len) {
+		load_abort(sock);
+		return -1;
+	}
+	status = load_read_headers(sock, buf, sizeof(buf));
+	if (latency != NULL) {
+		*latency = bench_now_ns() - start;
+	}
+	load_abort(sock);
+
+	return status;
+}
+
+/*!
+ * \brief Sender thread: sends its share of the events, each at its slot.
+ */
+static void *load_sender_run(
+	/*! [in,out] Sender. */
+	void *arg)
+{
+	load_sender *sender = (load_sender *)arg;
+	struct timespec ts;
+	int64_t due;
+	int64_t now;
+	int slot;
+	int i;
+
+	for (i = 0; i < sender->count; i++) {
+		slot = i * sender->numSenders + sender->index;
+		due = sender->start + (int64_t)slot * sender->interval;
+		now = bench_now_ns();
+		if (due > now) {
+			ts.tv_sec = (time_t)((due - now) / 1000000000);
+			ts.tv_nsec = (long)((due - now) % 1000000000);
+			nanosleep(&ts, NULL);
+		}
+		/* event keys start at 1: 0 is the initial event. */
+		if (load_notify(slot + 1,
+			&sender->latencies[sender->ok]) == 200) {
+			sender->ok++;
+		} else {
+			sender->failed++;
+		}
+	}
+	sender->end = bench_now_ns();
+
+	return NULL;
+}
+
+/*!
+ * \brief Pushes NOTIFY requests at a fixed rate and checks their delivery.
+ *
+ * \return 0 if every event was answered 200 OK and delivered, else -1.
+ */
+static int load_run(
+	/*! [in] Events per second. */
+	int rate,
+	/*! [in] Duration in seconds. */
+	int seconds,
+	/*! [in] Number of sender threads. */
+	int numSenders)
+{
+	load_sender senders[LOAD_MAX_SENDERS];
+	int64_t *latencies;
+	int64_t start;
+	int64_t end;
+	int total = rate * seconds;
+	int ok = 0;
+	int failed = 0;
+	int started;
+	long received;
+	struct timespec ts;
+	int i;
+
+	latencies = (int64_t *)malloc(sizeof(int64_t) * (size_t)total);
+	if (latencies == NULL) {
+		return -1;
+	}
+	ithread_mutex_lock(&loadMutex);
+	loadReceived = 0;
+	loadBadSid = 0;
+	ithread_mutex_unlock(&loadMutex);
+	start = bench_now_ns() + 10000000;
+	for (started = 0; started < numSenders; started++) {
+		load_sender *s = &senders[started];
+
+		memset(s, 0, sizeof(*s));
+		s->index = started;
+		s->numSenders = numSenders;
+		s->count = total / numSenders +
+			(started < total % numSenders ? 1 : 0);
+		s->start = start;
+		s->interval = (int64_t)1000000000 / rate;
+		s->latencies = latencies + ok;
+		ok += s->count;
+		if (ithread_create(&s->thread, NULL, load_sender_run, s) != 0) {
+			break;
+		}
+	}
+	end = start;
+	ok = 0;
+	for (i = 0; i < started; i++) {
+		ithread_join(senders[i].thread, NULL);
+		if (senders[i].end > end) {
+			end = senders[i].end;
+		}
+		/* gather the latencies at the start of the array. */
+		memmove(latencies + ok, senders[i].latencies,
+			sizeof(int64_t) * (size_t)senders[i].ok);
+		ok += senders[i].ok;
+		failed += senders[i].failed;
+	}
+	if (started < numSenders) {
+		fprintf(stderr, "cannot start sender thread %d\n", started);
+		free(latencies);
+		return -1;
+	}
+	/* the callback runs after the response is sent. */
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += 5;
+	ithread_mutex_lock(&loadMutex);
+	while (loadReceived < ok &&
+	       ithread_cond_timedwait(&loadCond, &loadMutex, &ts) == 0) {
+	}
+	received = loadReceived;
+	ithread_mutex_unlock(&loadMutex);
+
+	printf("%d NOTIFY in %.3f s: %.0f/s for %d/s asked, %d senders\n",
+		total, (double)(end - start) / 1e9,
+		(double)total * 1e9 / (double)(end - start), rate,
+		numSenders);
+	printf("%d answered 200 OK, %d failed, %ld events received, "
+		"%ld for another SID\n", ok, failed, received, loadBadSid);
+	if (ok > 0) {
+		bench_print_latency("NOTIFY to 200 OK", latencies, (size_t)ok);
+	}
+	free(latencies);
+
+	return failed == 0 && received == (long)ok && loadBadSid == 0 ?
+		0 : -1;
+}
+
+/*!
+ * \brief Waits for a connection to be closed by the miniserver.
+ *
+ * \return Time until it was, in nanoseconds, or -1 if it was not closed
+ * within \b timeout_ms.
+ */
+static int64_t load_wait_closed(
+	/*! [in] Socket. */
+	int sock,
+	/*! [in] Longest wait, in milliseconds. */
+	int timeout_ms)
+{
+	struct pollfd pfd;
+	char buf[64];
+	int64_t start = bench_now_ns();
+	int64_t left;
+
+	while (TRUE) {
+		left = (int64_t)timeout_ms -
+			(bench_now_ns() - start) / 1000000;
+		if (left <= 0) {
+			return -1;
+		}
+		pfd.fd = sock;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, (int)left) > 0 &&
+		    recv(sock, buf, sizeof(buf), 0) <= 0) {
+			return bench_now_ns() - start;
+		}
+	}
+}
+
+/*!
+ * \brief Checks that a connection beyond MINISERVER_MAX_CONNECTIONS
+ * connections being read is closed at once, and that requests are served
+ * again once they are gone.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+static int load_check_max_connections(void)
+{
+	int socks[MINISERVER_MAX_CONNECTIONS];
+	struct timespec ts;
+	int64_t closed = -1;
+	int opened;
+	int extra;
+	int ret = -1;
+	int i;
+
+	for (opened = 0; opened < MINISERVER_MAX_CONNECTIONS; opened++) {
+		socks[opened] = load_connect(loadPort);
+		if (socks[opened] == -1 ||
+		    send(socks[opened], loadPartial, sizeof(loadPartial) - 1,
+			MSG_NOSIGNAL) <= 0) {
+			fprintf(stderr, "cannot open connection %d\n", opened);
+			goto exit_function;
+		}
+	}
+	/* let the miniserver accept them all. */
+	ts.tv_sec = 0;
+	ts.tv_nsec = 200000000;
+	nanosleep(&ts, NULL);
+	extra = load_connect(loadPort);
+	if (extra != -1) {
+		send(extra, loadPartial, sizeof(loadPartial) - 1, MSG_NOSIGNAL);
+		closed = load_wait_closed(extra, 1000);
+		load_abort(extra);
+	}
+	if (closed < 0) {
+		printf("max connections: connection %d not closed\n",
+			MINISERVER_MAX_CONNECTIONS + 1);
+		goto exit_function;
+	}
+	printf("max connections: connection %d closed after %.3f ms\n",
+		MINISERVER_MAX_CONNECTIONS + 1, (double)closed / 1e6);
+	ret = 0;
+
+exit_function:
+	for (i = 0; i < opened; i++) {
+		load_abort(socks[i]);
+	}
+	if (ret == 0) {
+		nanosleep(&ts, NULL);
+		if (load_notify(1, NULL) != 200) {
+			printf("max connections: not served once the "
+				"connections are closed\n");
+			ret = -1;
+		}
+	}
+
+	return ret;
+}
+
+/*!
+ * \brief Checks that a connection stalled in its request is closed after
+ * MINISERVER_REQUEST_TIMEOUT seconds.
+ *
+ * \return 0 on success, -1 on failure.
+ */
+static int load_check_request_timeout(void)
+{
+	int64_t closed = -1;
+	int sock;
+
+	sock = load_connect(loadPort);
+	if (sock != -1 &&
+	    send(sock, loadPartial, sizeof(loadPartial) - 1,
+		MSG_NOSIGNAL) > 0) {
+		closed = load_wait_closed(sock,
+			(MINISERVER_REQUEST_TIMEOUT + 5) * 1000);
+	}
+	if (sock != -1) {
+		load_abort(sock);
+	}
+	if (closed < 0) {
+		printf("request timeout: stalled connection not closed\n");
+		return -1;
+	}
+	printf("request timeout: stalled connection closed after %.3f s "
+		"(MINISERVER_REQUEST_TIMEOUT %d)\n", (double)closed / 1e9,
+		MINISERVER_REQUEST_TIMEOUT);
+	if (closed < (int64_t)(MINISERVER_REQUEST_TIMEOUT - 1) * 1000000000 ||
+	    closed > (int64_t)(MINISERVER_REQUEST_TIMEOUT + 2) * 1000000000) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	UpnpClient_Handle handle;
+	ithread_t publisher;
+	unsigned short pubPort;
+	char url[64];
+	int timeout = 1800;
+	int rate = 10000;
+	int seconds = 10;
+	int numSenders = 4;
+	int ret;
+
+	if (argc > 1) {
+		rate = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		seconds = atoi(argv[2]);
+	}
+	if (argc > 3) {
+		numSenders = atoi(argv[3]);
+	}
+	if (rate <= 0 || seconds <= 0 || numSenders <= 0 ||
+	    numSenders > LOAD_MAX_SENDERS) {
+		fprintf(stderr, "usage: %s [events per second [seconds "
+			"[sender threads]]]\n", argv[0]);
+		return 2;
+	}
+	if (!MINISERVER_USE_EPOLL) {
+		printf("skipped: only the epoll loop is tested\n");
+		return 0;
+	}
+	ret = UpnpInit("127.0.0.1", 0);
+	if (ret != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpInit: %d\n", ret);
+		return 1;
+	}
+	loadPort = UpnpGetServerPort();
+	ret = UpnpRegisterClient(load_callback, NULL, &handle);
+	if (ret != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpRegisterClient: %d\n", ret);
+		UpnpFinish();
+		return 1;
+	}
+	pubPort = load_publisher_start(&publisher);
+	if (pubPort == 0) {
+		fprintf(stderr, "cannot start the publisher\n");
+		UpnpFinish();
+		return 1;
+	}
+	snprintf(url, sizeof(url), "http://127.0.0.1:%u/event",
+		(unsigned)pubPort);
+	ret = UpnpSubscribe(handle, url, &timeout, loadSid);
+	if (ret != UPNP_E_SUCCESS) {
+		fprintf(stderr, "UpnpSubscribe: %d\n", ret);
+	} else {
+		ret = load_run(rate, seconds, numSenders);
+		if (load_check_max_connections() != 0) {
+			ret = -1;
+		}
+		if (load_check_request_timeout() != 0) {
+			ret = -1;
+		}
+	}
+	UpnpFinish();
+	loadPubStop = 1;
+	ithread_join(publisher, NULL);
+	close(loadPubSock);
+
+	return ret == 0 ? 0 : 1;
+}